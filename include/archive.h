@@ -0,0 +1,77 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "codetable.h"
+
+// Archive of many small members coded with a few shared code tables:
+//
+//   header     "HUFA", u8 version
+//   members    the payload of each member, back to back
+//   tables     each shared table, serialized (see codetable.h)
+//   directory  per member: u16 name length, name, u64 offset of the payload, u64 raw size,
+//              u64 payload bits, u32 table number
+//   trailer    u64 histogram[256], u64 tables offset, u32 number of tables,
+//              u64 directory offset, u32 number of members, "HUFZ"
+//
+// Opening reads the trailer, the tables and the directory once; a member is then found
+// by name through a hash table and extracted with one seek, one read and one decode.
+// Adding members writes their payloads over the old tables and directory, which
+// archive_finish writes again after them.
+
+#define ARCHIVE_MAGIC "HUFA"
+#define ARCHIVE_TRAILER_MAGIC "HUFZ"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_HEADER_SIZE 5
+#define ARCHIVE_TRAILER_SIZE (8 * NB_SYMBOLS + 8 + 4 + 8 + 4 + 4)
+#define ARCHIVE_MAX_NAME_LENGTH 65535
+// A member reuses the cheapest of the last shared tables, or brings a new one when that
+// codes it in fewer bits, the table included
+#define ARCHIVE_TABLE_CANDIDATES 16
+
+typedef struct ArchiveMember
+{
+    char *name; //  NUL-terminated
+    unsigned long long offset;
+    unsigned long long raw_size;
+    unsigned long long payload_bits;
+    unsigned int table;
+} ArchiveMember;
+
+typedef struct Archive
+{
+    FILE *file;
+    ArchiveMember *members;
+    unsigned int nb_members;
+    unsigned int members_capacity;
+    CodeTable *tables;
+    unsigned int nb_tables;
+    unsigned int tables_capacity;
+    uint32_t *slots;                 //  Open addressing over the names: member number + 1, or 0 when free
+    size_t nb_slots;                 //  Power of 2, at least twice nb_members
+    long long histogram[NB_SYMBOLS]; //  Running histogram of all the members, for new tables
+    unsigned long long end;          //  Offset where the next payload goes
+} Archive;
+
+// Each function returns 0 on success, or -1 after printing an error.
+// archive_create writes an empty archive into a file opened in "w+b" mode;
+// archive_open reads one opened in "rb" mode, or "r+b" to add members
+int archive_create(Archive *archive, FILE *file);
+int archive_open(Archive *archive, FILE *file);
+// Codes and writes a member; its name must not be in the archive yet. The archive is
+// incomplete until archive_finish
+int archive_add(Archive *archive, const char *name, const unsigned char *data, size_t length);
+// Writes the tables, the directory and the trailer after the last member
+int archive_finish(Archive *archive);
+void archive_free(Archive *archive);
+
+// Number of the member of that name, or -1
+long archive_find(const Archive *archive, const char *name);
+// Decodes a member into out, which holds capacity bytes (at least its raw size);
+// returns its raw size, or -1. Only the members written before the last archive_finish
+// (or archive_open) can be extracted; several threads may extract at once
+long long archive_extract(const Archive *archive, unsigned int member, unsigned char *out, size_t capacity);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Positioned reads and writes that can be left in flight: io_uring on Linux kernels
+// that support it, otherwise pread/pwrite run at submission time (as for a request the
+// ring refuses). In both cases each operation is completed once through async_io_reap
+// with the user_data it was given.
+
+#define ASYNC_IO_DEPTH 8
+
+typedef struct AsyncIoCompletion
+{
+    unsigned long long user_data;
+    long long result; //  Number of bytes transferred, or -errno
+} AsyncIoCompletion;
+
+typedef struct AsyncIo
+{
+    int ring_fd; //  -1 when pread/pwrite are used
+    int in_flight;
+
+    // io_uring rings
+    void *sq_ring, *cq_ring, *sqes;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    void *cqes;
+
+    // Completions of the pread/pwrite fallback
+    AsyncIoCompletion done[ASYNC_IO_DEPTH];
+    int nb_done;
+} AsyncIo;
+
+// use_uring = 0 forces the pread/pwrite fallback
+void async_io_init(AsyncIo *io, int use_uring);
+void async_io_destroy(AsyncIo *io);
+int async_io_uses_uring(const AsyncIo *io);
+
+// Return 0, or -1 if ASYNC_IO_DEPTH operations are already in flight
+int async_io_read(AsyncIo *io, int fd, void *buffer, size_t length, off_t offset, unsigned long long user_data);
+int async_io_write(AsyncIo *io, int fd, const void *buffer, size_t length, off_t offset,
+                   unsigned long long user_data);
+
+// Takes one completed operation; waits for it if wait is set. Returns 1 if one was taken
+int async_io_reap(AsyncIo *io, int wait, AsyncIoCompletion *completion);
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef BITIO_H
+#define BITIO_H
+
+#include <stddef.h>
+#include <string.h>
+
+// Packed bit streams, most significant bit first (the bit order of the '0'/'1' text format)
+
+typedef struct BitWriter
+{
+    unsigned char *out;     //  Output buffer, large enough for everything written
+    size_t pos;             //  Number of complete bytes written
+    unsigned long long acc; //  Pending bits in the low nb_bits bits
+    int nb_bits;
+} BitWriter;
+
+typedef struct BitReader
+{
+    const unsigned char *in;
+    size_t size;            //  Size of the input in bytes; bits past the end read as 0
+    size_t pos;             //  Next byte to load
+    unsigned long long acc;
+    int nb_bits;
+} BitReader;
+
+static inline void bit_writer_init(BitWriter *writer, unsigned char *out)
+{
+    writer->out = out;
+    writer->pos = 0;
+    writer->acc = 0;
+    writer->nb_bits = 0;
+}
+
+// Appends the length low bits of code (length <= 32)
+static inline void bit_writer_put(BitWriter *writer, unsigned int code, int length)
+{
+    writer->acc = (writer->acc << length) | code;
+    writer->nb_bits += length;
+    while (writer->nb_bits >= 8)
+    {
+        writer->nb_bits -= 8;
+        writer->out[writer->pos++] = (unsigned char)(writer->acc >> writer->nb_bits);
+    }
+}
+
+// The 8 bytes of value at out, most significant first
+static inline void store_be64(unsigned char *out, unsigned long long value)
+{
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    value = __builtin_bswap64(value);
+    memcpy(out, &value, 8);
+#else
+    for (int i = 7; i >= 0; i--)
+    {
+        out[i] = (unsigned char)value;
+        value >>= 8;
+    }
+#endif
+}
+
+// Longest value bit_writer_put_wide takes
+#define BIT_WRITER_WIDE_BITS 56
+
+// Appends the length low bits of value (length <= BIT_WRITER_WIDE_BITS; the bits above
+// must be 0) without a branch: the pending bits are stored as a whole 64-bit word, padded
+// with 0 bits, so the 8 bytes from the current byte must be writable
+static inline void bit_writer_put_wide(BitWriter *writer, unsigned long long value, int length)
+{
+    writer->acc = (writer->acc << length) | value;
+    writer->nb_bits += length;
+    store_be64(writer->out + writer->pos, writer->acc << (63 - writer->nb_bits) << 1);
+    writer->pos += (size_t)(writer->nb_bits >> 3);
+    writer->nb_bits &= 7;
+}
+
+// Pads the last byte with 0 bits; returns the number of bytes written
+static inline size_t bit_writer_flush(BitWriter *writer)
+{
+    if (writer->nb_bits > 0)
+    {
+        writer->out[writer->pos++] = (unsigned char)(writer->acc << (8 - writer->nb_bits));
+        writer->nb_bits = 0;
+    }
+    return writer->pos;
+}
+
+static inline void bit_reader_init(BitReader *reader, const unsigned char *in, size_t size)
+{
+    reader->in = in;
+    reader->size = size;
+    reader->pos = 0;
+    reader->acc = 0;
+    reader->nb_bits = 0;
+}
+
+static inline int bit_reader_bit(BitReader *reader)
+{
+    if (reader->nb_bits == 0)
+    {
+        reader->acc = reader->pos < reader->size ? reader->in[reader->pos] : 0;
+        reader->pos++;
+        reader->nb_bits = 8;
+    }
+    reader->nb_bits--;
+    return (int)((reader->acc >> reader->nb_bits) & 1);
+}
+
+// The 8 bytes at in as a big-endian integer: the next 64 bits of a stream, for peeking
+static inline unsigned long long load_be64(const unsigned char *in)
+{
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    unsigned long long value;
+    memcpy(&value, in, 8);
+    return __builtin_bswap64(value);
+#else
+    unsigned long long value = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        value = (value << 8) | in[i];
+    }
+    return value;
+#endif
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef BITSTRING_H
+#define BITSTRING_H
+
+#include <stddef.h>
+
+// Conversions between packed bytes and the textual '0'/'1' bit-string format
+// (the format of output.txt and output_huffman.txt). Bits are written most
+// significant first, so each byte expands to the same 8 characters as "%08d"
+// applied to char_to_binary.
+
+// Expands n_bytes packed bytes into 8 * n_bytes ASCII '0'/'1' characters (no NUL added)
+void bits_to_ascii(const unsigned char *in, size_t n_bytes, char *out);
+
+// Packs n_chars ASCII '0'/'1' characters into (n_chars + 7) / 8 bytes; a last
+// incomplete byte is padded with 0 bits. Returns the index of the first character
+// that is neither '0' nor '1', or n_chars if the whole input is valid
+size_t ascii_to_bits(const char *in, size_t n_chars, unsigned char *out);
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef BYTEIO_H
+#define BYTEIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Little-endian integers in memory buffers, used by every binary format of the codec
+
+static inline void put_u16(unsigned char *out, uint16_t value)
+{
+    out[0] = (unsigned char)value;
+    out[1] = (unsigned char)(value >> 8);
+}
+
+static inline void put_u32(unsigned char *out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        out[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static inline void put_u64(unsigned char *out, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        out[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static inline uint16_t get_u16(const unsigned char *in)
+{
+    return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+static inline uint32_t get_u32(const unsigned char *in)
+{
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--)
+    {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+static inline uint64_t get_u64(const unsigned char *in)
+{
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--)
+    {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+// Unsigned LEB128: 7 bits per byte, low bits first, high bit set on all but the last byte
+#define VARINT_MAX_SIZE 10
+
+static inline size_t put_varint(unsigned char *out, uint64_t value)
+{
+    size_t pos = 0;
+    while (value >= 0x80)
+    {
+        out[pos++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[pos++] = (unsigned char)value;
+    return pos;
+}
+
+// Returns the number of bytes read, or 0 if the varint is truncated or too long
+static inline size_t get_varint(const unsigned char *in, size_t size, uint64_t *value)
+{
+    *value = 0;
+    for (size_t pos = 0; pos < size && pos < VARINT_MAX_SIZE; pos++)
+    {
+        *value |= (uint64_t)(in[pos] & 0x7F) << (7 * pos);
+        if (!(in[pos] & 0x80))
+        {
+            return pos + 1;
+        }
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef CODETABLE_H
+#define CODETABLE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "huffman.h"
+
+#define NB_SYMBOLS 256
+#define MAX_CODE_LENGTH 32
+#define DECODE_TABLE_BITS 11
+
+// Canonical Huffman code of every letter as integers, built from the lengths of the
+// codes of a HuffmanTree. Only the lengths need to be stored to rebuild it.
+typedef struct CodeTable
+{
+    unsigned int codes[NB_SYMBOLS];    //  Canonical code of each letter, in the low bits
+    unsigned char lengths[NB_SYMBOLS]; //  Code length in bits (0 if the letter has no code)
+    int max_length;
+    int nb_symbols;
+
+    // Canonical decoding: the codes of a given length are consecutive integers
+    unsigned int first_code[MAX_CODE_LENGTH + 1]; //  First code of each length
+    int first_index[MAX_CODE_LENGTH + 1];         //  Index in symbols of the letter of that code
+    int count[MAX_CODE_LENGTH + 1];               //  Number of codes of each length
+    unsigned char symbols[NB_SYMBOLS];            //  Letters sorted by (code length, letter)
+
+    // Letter | (code length << 8) of the code starting with each DECODE_TABLE_BITS-bit
+    // value, or 0 when that code is longer than DECODE_TABLE_BITS
+    unsigned short fast[1 << DECODE_TABLE_BITS];
+} CodeTable;
+
+// Histograms: histogram[c] is the number of occurrences of the byte c
+long long histogram_from_file(FILE *input, long long *histogram);
+void histogram_add_buffer(long long *histogram, const unsigned char *data, size_t length);
+Element *occurrences_from_histogram(const long long *histogram);
+// The reverse: the histogram of a list built by get_occurrences_by_dichotomy
+void histogram_from_occurrences(const Element *occurrences, long long *histogram);
+
+// Serialized histogram, for counting shards separately: "HUFH", u8 version, u16 number
+// of letters, then (letter, varint count) for each letter present, by increasing letter
+#define HISTOGRAM_MAGIC "HUFH"
+#define HISTOGRAM_VERSION 1
+#define HISTOGRAM_MAX_SERIALIZED_SIZE (4 + 1 + 2 + NB_SYMBOLS * (1 + 10))
+size_t histogram_serialized_size(const long long *histogram);
+size_t histogram_serialize(const long long *histogram, unsigned char *out);
+// Returns the number of bytes read, or 0 if the data is not a valid histogram
+size_t histogram_deserialize(const unsigned char *in, size_t size, long long *histogram);
+// Adds other into histogram; merging is associative and commutative, so shards can be
+// merged in any order and grouping. Returns -1 (histogram unchanged) if a count would overflow
+int histogram_merge(long long *histogram, const long long *other);
+
+// Returns 0, or -1 if the histogram is empty
+int code_table_from_histogram(const long long *histogram, CodeTable *table);
+// Assigns the canonical codes, or copies them from the table cache (see tablecache.h);
+// returns -1 if the lengths do not form a prefix code
+int code_table_from_lengths(const unsigned char *lengths, CodeTable *table);
+// Number of bits needed to code the histogram, or -1 if one of its letters has no code
+long long code_table_cost(const CodeTable *table, const long long *histogram);
+
+// Serialized table: u16 number of letters, then (letter, length) byte pairs
+size_t code_table_serialized_size(const CodeTable *table);
+size_t code_table_serialize(const CodeTable *table, unsigned char *out);
+// Returns the number of bytes read, or 0 if the data is not a valid table
+size_t code_table_deserialize(const unsigned char *in, size_t size, CodeTable *table);
+
+// Encodes length bytes into out (at least MAX_CODE_LENGTH * length / 8 + 8 bytes); returns the number of bits
+unsigned long long encode_buffer(const unsigned char *data, size_t length, const CodeTable *table, unsigned char *out);
+
+// Kernels of encode_buffer, all writing the same bits 64 at a time. When the codes are at
+// most 14 bits long, they merge 4 codes per store: the vector ones look up 8 (AVX2) or 64
+// (AVX-512 VBMI, with byte permutes) letters at once and merge their codes in the lanes.
+// Longer codes, and the last letters, go through the scalar kernel
+#define ENCODE_KERNEL_AUTO 0 //  The fastest one the processor runs
+#define ENCODE_KERNEL_SCALAR 1
+#define ENCODE_KERNEL_AVX2 2
+#define ENCODE_KERNEL_AVX512 3 //  Needs AVX-512 F, BW and VBMI
+// Kernel encode_buffer uses; one the processor does not run falls back to the next one down
+extern int ENCODE_KERNEL;
+// The kernel encode_buffer runs for a setting of ENCODE_KERNEL
+int encode_kernel_resolve(int kernel);
+const char *encode_kernel_name(int kernel);
+// Parses "auto", "scalar", "avx2" or "avx512"; returns -1 for anything else
+int encode_kernel_parse(const char *name);
+
+// Decodes raw_size letters from nb_bits bits straight into out; returns 0, or -1 if the bits
+// are not valid codes or do not hold exactly raw_size letters
+int decode_buffer(const unsigned char *in, unsigned long long nb_bits, const CodeTable *table, unsigned char *out,
+                  size_t raw_size);
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+#include <stdio.h>
+
+#include "codetable.h"
+#include "transform.h"
+#include "tableset.h"
+#include "tans.h"
+
+// Binary container of packed Huffman blocks:
+//
+//   header   "HUFC", u8 version
+//   blocks   u8 flags, u64 raw size, u64 payload bits, [transforms], [code table], payload
+//   index    one entry per block (see BlockInfo)
+//   trailer  u64 histogram[256], u64 raw size, u64 index offset, u32 number of blocks,
+//            u32 block size, "HUFT"
+//
+// A block either carries its own code table (BLOCK_NEW_TABLE), names a table of the
+// loaded table set (BLOCK_SET_TABLE: u32 set id, u8 table number, see tableset.h), or
+// reuses the table of the previous block. A block coded with tANS instead of Huffman
+// codes (BLOCK_TANS) carries its normalized frequencies (see tans.h), and the block after
+// it carries or names a table again. A block coded after transforms (BLOCK_TRANSFORMED, see transform.h)
+// lists them as u8 number of stages, u8 stage of each, u64 coded size: the payload then
+// codes that many transformed bytes, and the histograms count them instead of the raw
+// bytes. When the transforms end with a shuffle, each byte plane has its own table
+// (BLOCK_PLANES): per plane, u64 payload bits and its serialized table (no letter for an
+// empty plane), and the payload holds the codes of the planes in order, each padded to a
+// byte. The block after it carries or names a table again, as after a tANS block.
+// The trailer has a fixed size, so the index is found from the end
+// of the file, and appending only rewrites the index and the trailer.
+
+#define CONTAINER_MAGIC "HUFC"
+#define CONTAINER_TRAILER_MAGIC "HUFT"
+#define CONTAINER_VERSION 1
+#define CONTAINER_HEADER_SIZE 5
+#define CONTAINER_TRAILER_SIZE (8 * NB_SYMBOLS + 8 + 8 + 4 + 4 + 4)
+#define CONTAINER_INDEX_ENTRY_SIZE (8 + 8 + 8 + 4)
+#define CONTAINER_BLOCK_HEADER_SIZE (1 + 8 + 8)
+#define CONTAINER_PLANE_TABLES_SIZE (TRANSFORM_MAX_PLANES * (8 + 2 + 2 * NB_SYMBOLS))
+// The tables of the byte planes are the most a block carries
+#define CONTAINER_MAX_BLOCK_HEADER_SIZE                                                                            \
+    (CONTAINER_BLOCK_HEADER_SIZE + 1 + TRANSFORM_MAX_STAGES + 8 + CONTAINER_PLANE_TABLES_SIZE)
+#define CONTAINER_BLOCK_SIZE (1 << 20)
+// Smallest block size chosen to fit a memory limit
+#define CONTAINER_MIN_BLOCK_SIZE (1 << 12)
+// Largest number of bytes coded for a block of block_size bytes
+#define CONTAINER_MAX_CODED_SIZE(block_size) ((size_t)(block_size) + TRANSFORM_MAX_GROWTH)
+// Heap bytes needed to code one block: the raw data, and the largest block the
+// codes (at most MAX_CODE_LENGTH bits per byte) can produce
+#define CONTAINER_BLOCK_MEMORY(block_size)                                                                           \
+    ((long long)(block_size) + (long long)CONTAINER_MAX_CODED_SIZE(block_size) * (MAX_CODE_LENGTH / 8) +            \
+     CONTAINER_MAX_BLOCK_HEADER_SIZE + 64)
+
+#define BLOCK_NEW_TABLE 1
+#define BLOCK_TRANSFORMED 2
+#define BLOCK_SET_TABLE 4
+#define BLOCK_TANS 8
+#define BLOCK_PLANES 16
+// Flags of the blocks that switch to another table, at most one per block
+#define BLOCK_TABLE_FLAGS (BLOCK_NEW_TABLE | BLOCK_SET_TABLE | BLOCK_TANS | BLOCK_PLANES)
+#define CONTAINER_SET_TABLE_SIZE (4 + 1)
+
+typedef struct BlockHeader
+{
+    int flags;
+    unsigned long long raw_size;
+    unsigned long long payload_bits;
+    unsigned long long coded_size; //  Bytes coded in the payload: raw_size, unless the block is transformed
+    TransformChain transforms;     //  Stages applied before coding, when BLOCK_TRANSFORMED is set
+    int set_table;                 //  Table of CONTAINER_TABLE_SET, when BLOCK_SET_TABLE is set
+    int backend;                   //  CONTAINER_BACKEND_HUFFMAN, or CONTAINER_BACKEND_TANS with BLOCK_TANS
+    TansFrequencies frequencies;   //  Frequencies of the tANS blocks
+    unsigned int nb_planes;        //  Byte planes coded with their own tables (BLOCK_PLANES), or 1
+    unsigned long long plane_bits[TRANSFORM_MAX_PLANES];
+    unsigned char plane_lengths[TRANSFORM_MAX_PLANES][NB_SYMBOLS]; //  Code lengths of the table of each plane
+} BlockHeader;
+
+// Transforms applied by the encoders to every block they write (none by default); set
+// it before compressing, it is not meant to change while an encoder runs
+extern TransformChain CONTAINER_TRANSFORMS;
+// Trained tables the encoders may pick for a block, and the decoders look the tables of
+// BLOCK_SET_TABLE blocks up in (none by default); same rules as CONTAINER_TRANSFORMS
+extern const TableSet *CONTAINER_TABLE_SET;
+
+// Entropy coder of the blocks the encoders write: Huffman (the default), tANS, or for each
+// block the one that codes it in fewer bits, headers included; same rules as CONTAINER_TRANSFORMS
+#define CONTAINER_BACKEND_HUFFMAN 0
+#define CONTAINER_BACKEND_TANS 1
+#define CONTAINER_BACKEND_AUTO 2
+extern int CONTAINER_BACKEND;
+// CONTAINER_BACKEND_* of a name: huffman, tans or auto; -1 for another name
+int container_backend_parse(const char *name);
+typedef struct BlockInfo
+{
+    unsigned long long offset;     //  Offset of the block header in the container
+    unsigned long long raw_offset; //  Offset of the first byte of the block in the original data
+    unsigned long long raw_size;   //  Number of bytes of original data in the block
+    unsigned int table_block;      //  Block holding the code table used by this block
+} BlockInfo;
+
+typedef struct ContainerInfo
+{
+    long long histogram[NB_SYMBOLS]; //  Running histogram of all the bytes coded so far
+    unsigned long long raw_size;
+    unsigned long long index_offset;
+    unsigned int nb_blocks;
+    unsigned int block_size;
+    unsigned int capacity; //  Number of entries allocated in blocks
+    BlockInfo *blocks;
+} ContainerInfo;
+
+// Each function returns 0 on success, or -1 after printing an error. Under a memory
+// limit (see memstats.h), the encoder uses smaller blocks than asked when needed
+int container_compress(FILE *input, FILE *output, unsigned int block_size);
+// Adds the content of input at the end of a container opened in "r+b" mode
+int container_append(FILE *container, FILE *input);
+int container_decompress(FILE *container, FILE *output);
+
+// Compresses length bytes of memory into out, which must hold container_compress_bound
+// bytes; returns the size of the container, or -1
+size_t container_compress_bound(size_t length, unsigned int block_size);
+long long container_compress_buffer(const unsigned char *data, size_t length, unsigned int block_size,
+                                    unsigned char *out, size_t capacity);
+
+// Decode the whole content straight into a buffer of capacity bytes (at least the
+// raw size recorded in the trailer). Return the number of bytes decoded, or -1
+long long container_decompress_into(FILE *container, unsigned char *buffer, size_t capacity);
+long long container_decompress_buffer(const unsigned char *container, size_t size, unsigned char *buffer,
+                                      size_t capacity);
+
+int container_read_info(FILE *container, ContainerInfo *info);
+void container_free_info(ContainerInfo *info);
+// Reads the code table stored in the given block
+int container_read_table(FILE *container, const ContainerInfo *info, unsigned int block, CodeTable *table);
+
+// Building blocks of the container format, shared with the threaded pipeline
+int container_write_header(FILE *output);
+int container_write_index_and_trailer(FILE *container, const ContainerInfo *info);
+// Picks the table that codes the block in the fewest bits, the table itself included:
+// the last table, the best one of CONTAINER_TABLE_SET, or a fresh one. Returns 1 and
+// replaces last_table when it changes, with *set_table the number of the set table, or -1
+int container_choose_table(const ContainerInfo *info, const long long *block_histogram, CodeTable *last_table,
+                           int *set_table);
+// Then picks the backend of the block after CONTAINER_BACKEND, weighing the tANS
+// frequencies of the block (with their header) against the table container_choose_table
+// chose (with its header, when new_table is set). Sets header->backend and, for tANS,
+// header->frequencies, and returns 1: last_table is emptied, since the next block cannot
+// reuse it. Returns 0 for Huffman. The byte planes of a shuffled block always take the
+// Huffman tables container_transform_block made for them, and empty last_table too
+int container_choose_backend(const long long *block_histogram, CodeTable *last_table, int new_table,
+                             BlockHeader *header);
+// Codes the header->coded_size symbols of a block with its backend into out (at least
+// MAX_CODE_LENGTH * coded_size / 8 + 16 bytes); returns the number of bits
+unsigned long long container_encode_block(const unsigned char *symbols, const BlockHeader *header,
+                                          const CodeTable *table, unsigned char *out);
+// Writes a block header (with new_table, unless it is NULL) and returns its size; the
+// flags are set from new_table, the backend and the transforms of the header: a new
+// table that is header->set_table of CONTAINER_TABLE_SET is only named, and a tANS block
+// carries its frequencies instead
+size_t container_block_header(unsigned char *out, const BlockHeader *header, const CodeTable *new_table);
+// Parses a block header and, if the block carries or names one, its code table (table may
+// be NULL to skip it; a tANS block empties it). Returns the size of the header, or 0 if
+// it is damaged or names a table of another set than CONTAINER_TABLE_SET
+size_t container_parse_block_header(const unsigned char *in, size_t size, BlockHeader *header, CodeTable *table);
+// Applies CONTAINER_TRANSFORMS to a block into coded, which holds CONTAINER_MAX_CODED_SIZE
+// bytes, and fills the sizes and transforms of header, with the table and bits of each
+// byte plane when the transforms end with a shuffle. Returns the bytes to code: coded,
+// or data itself when there are no transforms, or when they grow the block by more than
+// TRANSFORM_MAX_GROWTH bytes or run out of memory (the block is then stored as is)
+const unsigned char *container_transform_block(const unsigned char *data, size_t length, unsigned char *coded,
+                                               BlockHeader *header);
+// Payload bits of a BLOCK_PLANES block, from the bits of its planes
+unsigned long long container_planes_bits(const BlockHeader *header);
+// Decodes the payload of a block into its header->raw_size bytes of original data.
+// Returns 0, or -1 if the block is damaged or the memory for its transforms is missing
+int container_decode_block(const unsigned char *payload, const BlockHeader *header, const CodeTable *table,
+                           unsigned char *out);
+// Largest block size, halving from max_block_size down to CONTAINER_MIN_BLOCK_SIZE, for
+// which nb_buffers block buffers (and, with CONTAINER_TRANSFORMS, as many coded buffers
+// and the memory of one transform), reserved other bytes and the index of input_size bytes
+// (unknown when negative: a quarter of the memory is kept for it) fit under the memory
+// limit. Returns max_block_size when there is no limit, and 0 when nothing fits
+unsigned int container_fit_block_size(unsigned int max_block_size, unsigned int nb_buffers, long long reserved,
+                                      long long input_size);
+// Size of a regular file, or -1 (pipes, terminals)
+long long container_input_size(FILE *input);
+// Records a block written at offset in the index and the running histogram
+int container_add_block(ContainerInfo *info, unsigned long long offset, unsigned long long raw_size,
+                        unsigned int table_block, const long long *block_histogram);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stddef.h>
+
+// Compression service on a Unix domain socket. A client connection carries any number
+// of requests, each answered before the next one is read:
+//
+//   request   u8 operation, u64 length, payload
+//   response  u8 status (0: success), u64 length, payload (the error message on failure)
+//
+// with the integers in little-endian order. Compress takes raw bytes and returns a
+// block container, decompress the reverse; stats returns the latency percentiles as text.
+// Each worker thread serves one connection at a time and keeps its buffers from one
+// request to the next; code tables come from the shared table cache. A connection on
+// which the client sends or reads nothing for DAEMON_CLIENT_TIMEOUT, between two
+// requests or within one, is closed, so that idle or stalled clients do not hold workers.
+
+#define DAEMON_COMPRESS 'C'
+#define DAEMON_DECOMPRESS 'D'
+#define DAEMON_STATS 'S'
+
+// Largest payload accepted, in either direction
+#define DAEMON_MAX_PAYLOAD (1ULL << 30)
+// Block size of the containers written by the daemon
+#define DAEMON_BLOCK_SIZE (1 << 16)
+// Milliseconds a client may leave its connection idle
+#define DAEMON_CLIENT_TIMEOUT 2000
+
+// Serves until daemon_stop is called or SIGINT/SIGTERM is received, then prints the
+// latency percentiles on stderr. Returns 0, or -1 if the socket cannot be set up
+int daemon_serve(const char *socket_path, int nb_workers);
+void daemon_stop(void);
+
+// Client side: sends one request and waits for its response. reply (allocated with
+// malloc) holds the payload of the response. Returns the status of the response, or -1
+// if the daemon cannot be reached
+int daemon_request(const char *socket_path, int operation, const unsigned char *data, size_t length,
+                   unsigned char **reply, size_t *reply_length);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef ESTIMATE_H
+#define ESTIMATE_H
+
+#include <stdio.h>
+
+// Compressed sizes computed from histograms only: the input is counted, the code
+// tables are built as the encoder would, and nothing is encoded. With CONTAINER_TRANSFORMS
+// (see container.h), the blocks are transformed first and their coded bytes are counted
+
+typedef struct SizeEstimate
+{
+    unsigned long long raw_size;        //  Bytes of input
+    unsigned long long payload_bits;    //  Σ occ × code length, with one code table for the whole input
+    unsigned long long table_bytes;     //  Size of that code table once serialized
+    double entropy_bits;                //  Shannon bound, below any prefix code of single bytes
+    unsigned long long container_bytes; //  Size of the container written by container_compress
+    double ratio;                       //  container_bytes / raw_size (0 for an empty input)
+    int sampled;                        //  1 when everything was projected from a sample of the input
+} SizeEstimate;
+
+// Exact: one counting pass, with the block by block table choices of container_compress
+// for the given block size. Only the payloads of tANS blocks (see CONTAINER_BACKEND) are
+// estimated, from their frequencies. Returns 0, or -1 on a read error
+int estimate_compressed_size(FILE *input, unsigned int block_size, SizeEstimate *estimate);
+
+// Approximate, for huge files: counts nb_samples chunks of ESTIMATE_SAMPLE_SIZE bytes
+// spread over the input and scales the counts up to its size. The container size assumes
+// a single code table. Falls back on the exact pass when the input is small or cannot
+// be sought in
+#define ESTIMATE_SAMPLE_SIZE (1 << 16)
+#define ESTIMATE_SAMPLES 64
+int estimate_compressed_size_sampled(FILE *input, unsigned int block_size, unsigned int nb_samples,
+                                     SizeEstimate *estimate);
+
+#endif
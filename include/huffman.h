@@ -0,0 +1,98 @@
+#ifndef HUFFMAN_H
+#define HUFFMAN_H
+
+#include <stdio.h>
+
+typedef struct Node
+{
+    int letter;                //  Contained letter in (= -1 if no letter is contained)
+    long long size;            //  Weight of the node
+    struct Node *left, *right; //  Pointers to the nodes below this Node
+    char *code;
+    struct Element *element_ref;
+} Node;
+
+typedef struct Element
+{
+    int letter;           //  Contained letter
+    struct Element *next; //  Pointer to the next element
+    long long occ;        //  Number of occurrences of the letter
+    Node *node;           //  Associated Node structure
+} Element;
+
+typedef struct HuffmanTree
+{
+    Node *root_node;
+    Element *root_dict;
+} HuffmanTree;
+
+// Characters and display names
+int fgetc_ascii(FILE *file);
+char *display_char(int c);
+int get_char_from_display_char(char *display_chr);
+
+// Linked lists of occurrences
+Element *get_element(Element *root, int index);
+int len(Element *root);
+Node *new_node(int letter, long long occ, Node *left, Node *right, Element *element_ref);
+Element *new_element(int letter);
+// Frees a list together with the nodes of its elements: occurrences that were not turned
+// into a tree, or a dictionary read by decode_dict
+void free_elements(Element *root);
+Element *get_occurrences(char *text);
+Element *get_occurrences_by_dichotomy(FILE *input_file);
+Element *insert_elem_desc(Element *root, Element *to_insert, int node_or_elem, int size_or_letter);
+Element *find_elem_in_dict(Element *dict, char *value, int letter_or_code);
+void print_occurrences(Element *root, int display_code, int elem_or_node);
+
+// Huffman tree, built from a list of occurrences that it takes over: huffman_tree_free
+// frees the tree, its dictionary and the elements of that list
+HuffmanTree *huffman_tree_from_occurrences(Element *root);
+void huffman_tree_free(HuffmanTree *huffman_tree);
+void print_tree_2D_wrapper(struct Node *root);
+
+// Files
+FILE *open_file(char *file, char *mode);
+char *load_full_file(FILE *file);
+long long nb_char_in_file(FILE *input_file);
+void file_to_binary_file(FILE *input_file, FILE *output_file);
+int binary_file_to_file(FILE *input_file, FILE *output_file);
+
+// Compression and decompression
+void write_huffman_dict(FILE *dict_file, Element *dict);
+// The codes of a dictionary written by write_huffman_dict, pointing into its text
+#define DICT_NB_LETTERS 256
+#define DICT_MAX_CODE_LENGTH 255
+typedef struct DictCodes
+{
+    const char *codes[DICT_NB_LETTERS];      //  '0'/'1' characters of the code of each letter, not NUL-terminated
+    unsigned char lengths[DICT_NB_LETTERS];  //  Length of each code (0 if the letter has no code)
+    int nb_letters;
+} DictCodes;
+// Parses the text of a dictionary in one pass, without allocating or modifying it, so that
+// any number of threads can parse dictionaries at once. Returns 0, or the number (from 1)
+// of the first line that is not "<letter>: <code>" with a new letter and a code of '0'/'1'
+int dict_parse(const char *text, size_t length, DictCodes *dict);
+// The same as a list of elements in letter order, or NULL if the dictionary is empty or invalid
+Element *decode_dict(FILE *input_dictionary);
+void compress_file(FILE *input, FILE *output, HuffmanTree *huffman_tree);
+void compress_file_wrapper(FILE *input, FILE *output);
+// One-read variant of compress_file_wrapper for very large inputs: the tree is built from
+// evenly spaced chunks covering about sample_percent % of the input, then the input is
+// coded in a single sequential pass. Letters the chunks miss get one occurrence, so they
+// still have a code. Returns the tree (for its dictionary), or NULL if the input is empty
+// or cannot be sought in
+#define SAMPLE_CHUNK_SIZE (1 << 16)
+#define SAMPLE_DEFAULT_PERCENT 2.0
+typedef struct SampledCompression
+{
+    long long raw_size;
+    long long sampled_bytes;       //  Bytes read to build the tree, on top of the coding pass
+    int nb_fallback_letters;       //  Letters of the input missing from the sample
+    unsigned long long bits;       //  Bits written
+    unsigned long long exact_bits; //  Bits the tree of the exact histogram would have written
+} SampledCompression;
+HuffmanTree *compress_file_sampled(FILE *input, FILE *output, double sample_percent, SampledCompression *report);
+void uncompress_file(FILE *input_compressed, FILE *input_dictionary, FILE *output_uncompressed);
+
+#endif
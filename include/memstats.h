@@ -0,0 +1,70 @@
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+
+#include <stddef.h>
+
+// Accounted allocations of the codec buffers (blocks, payloads, indexes, pipeline
+// jobs), with an optional hard limit: an allocation that would take the total above
+// the limit fails and returns NULL. The block coders size their buffers from
+// memory_available() so that they stay under the limit instead of failing.
+
+typedef struct MemoryStats
+{
+    long long current;  //  Bytes currently allocated
+    long long peak;     //  Highest value of current since the last memory_reset_peak
+    long long limit;    //  Hard limit, 0 when there is none
+    long long failures; //  Allocations refused because of the limit
+} MemoryStats;
+
+// Subsystems the allocations are accounted to, each with its own counters
+typedef enum MemorySubsystem
+{
+    MEM_BUFFERS, //  Codec buffers: everything allocated with mem_alloc
+    MEM_TREES,   //  Huffman trees, occurrence lists and dictionaries of the text format
+    MEM_TABLES,  //  Code tables kept by the table cache
+    MEM_TOKENS,  //  Token tables and dictionaries of the token mode
+    MEM_NB_SUBSYSTEMS
+} MemorySubsystem;
+
+typedef struct MemoryUsage
+{
+    long long allocations; //  Allocations since the start (a realloc counts as one)
+    long long live;        //  Allocations not freed yet
+    long long bytes;       //  Bytes currently allocated, headers included
+} MemoryUsage;
+
+void *mem_alloc(size_t size);
+void *mem_calloc(size_t count, size_t size);
+void *mem_alloc_in(MemorySubsystem subsystem, size_t size);
+void *mem_calloc_in(MemorySubsystem subsystem, size_t count, size_t size);
+// The block stays accounted to the subsystem it was allocated in
+void *mem_realloc(void *ptr, size_t size);
+void mem_free(void *ptr);
+
+// Where the blocks come from: malloc, realloc and free by default. A service can plug
+// in its own allocator; it must only be changed while no block is allocated
+typedef struct MemoryAllocator
+{
+    void *(*alloc)(void *context, size_t size);
+    void *(*realloc)(void *context, void *ptr, size_t size);
+    void (*free)(void *context, void *ptr);
+    void *context;
+} MemoryAllocator;
+
+// NULL restores the default allocator
+void memory_set_allocator(const MemoryAllocator *allocator);
+void memory_get_usage(MemorySubsystem subsystem, MemoryUsage *usage);
+const char *memory_subsystem_name(MemorySubsystem subsystem);
+
+// 0 removes the limit
+void memory_set_limit(long long limit);
+long long memory_limit(void);
+// Bytes that can still be allocated, or -1 when there is no limit
+long long memory_available(void);
+void memory_get_stats(MemoryStats *stats);
+void memory_reset_peak(void);
+
+// Parses a size such as "4096", "512K", "64M" or "2G" (powers of 1024); returns -1 if invalid
+long long memory_parse_size(const char *text);
+
+#endif
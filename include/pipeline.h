@@ -0,0 +1,27 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdio.h>
+
+// Threaded container compression and decompression: a reader thread, nb_coders coder
+// threads and a writer thread exchange large block buffers through bounded lock-free
+// queues, so that reading, coding and writing overlap; a thread with nothing to do
+// sleeps on its queue, or on its writes in flight. The reader keeps the next read
+// in flight while it prepares the current block, and the writer keeps several writes
+// in flight, through io_uring when the kernel allows it (pread/pwrite otherwise).
+// The output is byte for byte the one of container_compress / container_decompress.
+
+// Set to 0 to always use pread/pwrite
+extern int PIPELINE_URING;
+
+// Return 0 on success, -1 on error, or 1 when the pipeline cannot be used, in which case
+// nothing was done: the files do not allow positioned I/O (pipes, terminals), or the
+// buffers of a single coder do not fit under the memory limit (see memstats.h). Under
+// a limit, the compressor runs fewer coders than asked, then uses smaller blocks
+int pipeline_compress(FILE *input, FILE *output, unsigned int block_size, int nb_coders);
+int pipeline_decompress(FILE *container, FILE *output, int nb_coders);
+
+// Number of online processors, at least 1
+int pipeline_default_coders(void);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdio.h>
+
+#include "container.h"
+
+// Search of a byte string in a block container without writing its content out. In a
+// Huffman block, the pattern is coded with the table of the block, and the payload is
+// scanned for these bits at every bit position: a block whose table has no code for one
+// of the letters of the pattern is not even scanned. Bits that match are a match when a
+// code starts there, which a walk over the code lengths of the block, from its first bit
+// to the last candidate, tells, along with the offset of the letter. Blocks coded with
+// tANS or after transforms are decoded into memory and searched there. The blocks are
+// independent, since the index gives the block holding the table of each one, so they
+// are searched on several threads; the matches across the ends of the blocks are
+// stitched afterwards from the letters found at both sides.
+
+// Longest pattern: a match spans the end of at most this many blocks
+#define SEARCH_MAX_PATTERN 256
+
+typedef struct SearchReport
+{
+    unsigned int nb_blocks;
+    unsigned int nb_skipped;           //  Huffman blocks with no code for a letter of the pattern
+    unsigned int nb_walked;            //  Huffman blocks with candidates, whose codes were walked
+    unsigned int nb_decoded;           //  tANS or transformed blocks, decoded in memory
+    unsigned long long nb_candidates; //  Bit positions whose bits match the coded pattern
+    unsigned long long nb_matches;
+} SearchReport;
+
+// Offsets in the content of the container of every occurrence (overlapping ones too) of
+// the length bytes of pattern, in increasing order, in *offsets (allocated with mem_alloc,
+// for mem_free; NULL when there is none), searched on nb_threads threads. Returns the
+// number of matches, or -1 after printing an error
+long long container_search(FILE *container, const unsigned char *pattern, size_t length, int nb_threads,
+                           unsigned long long **offsets, SearchReport *report);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef SYNCDECODE_H
+#define SYNCDECODE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "huffman.h"
+
+// Parallel decoding of the '0'/'1' text of compress_file, which has no block index:
+// the text is cut into one chunk per thread, and each thread decodes its chunk from its
+// first bit as if a code started there. A wrong guess usually falls back in step with
+// the real codes after a few letters (Huffman codes synchronize by themselves), and from
+// then on it decodes the same letters. Once the threads are done, the real decoding
+// resumes where the previous chunk ended and runs until it reaches a code start of the
+// guessed decoding: only that short prefix is decoded twice. When it never does (codes
+// that all have the same length, for instance), the chunk is decoded again entirely, so
+// the output is always the one of uncompress_file.
+
+// Chunks are at least this many bits, so that small texts are decoded by one thread.
+// Exposed for the tests, which cut texts into tiny chunks to stitch as often as possible
+extern size_t SYNC_DECODE_MIN_CHUNK_BITS;
+// Code starts of a guessed decoding kept for finding where the real decoding meets it
+#define SYNC_DECODE_WINDOW 4096
+
+typedef struct SyncDecodeReport
+{
+    int nb_chunks;
+    int nb_synchronized;              //  Chunks whose guessed decoding was joined by the real one
+    unsigned long long redecoded_bits; //  Bits decoded again while stitching the chunks
+    unsigned long long nb_letters;
+} SyncDecodeReport;
+
+// Decodes the nb_bits '0'/'1' characters of bits with the codes of dict into output, on
+// nb_threads threads. Returns 0, or -1 after printing an error: the codes do not form a
+// prefix code, the text holds another character, a sequence that is no code, or ends
+// inside a code (uncompress_file drops such an incomplete last code)
+int sync_decode(const char *bits, size_t nb_bits, const DictCodes *dict, FILE *output, int nb_threads,
+                SyncDecodeReport *report);
+// The same from the files written by compress_file and write_huffman_dict
+int uncompress_file_parallel(FILE *input_compressed, FILE *input_dictionary, FILE *output_uncompressed,
+                             int nb_threads, SyncDecodeReport *report);
+
+#endif
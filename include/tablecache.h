@@ -0,0 +1,38 @@
+#ifndef TABLECACHE_H
+#define TABLECACHE_H
+
+#include <stdint.h>
+
+#include "codetable.h"
+
+// Bounded LRU cache of finished code tables (canonical codes, decoding tables), keyed
+// by a hash of their code lengths. code_table_from_lengths goes through it, so a table
+// seen recently (a stable distribution on the encoder side, a repeated table on the
+// decoder side) is copied instead of being expanded again. Lookups go straight to the
+// bucket of the hash, take a shared lock and can run from any number of threads at once.
+
+#define TABLE_CACHE_DEFAULT_CAPACITY 64
+#define TABLE_CACHE_MAX_CAPACITY 4096
+
+typedef struct TableCacheStats
+{
+    long long hits;
+    long long misses;
+    int nb_entries;
+    int capacity;
+} TableCacheStats;
+
+// Hash of the code lengths: the key of the cache, and an identifier of the code
+uint64_t code_lengths_hash(const unsigned char *lengths);
+
+// Copies the cached table of these lengths into table; returns 1, or 0 if it is not cached
+int table_cache_lookup(uint64_t hash, const unsigned char *lengths, CodeTable *table);
+// Stores a copy of table, evicting the least recently used table when the cache is full
+void table_cache_insert(uint64_t hash, const CodeTable *table);
+
+// 0 disables the cache; the cached tables are dropped
+void table_cache_set_capacity(int capacity);
+void table_cache_clear(void);
+void table_cache_get_stats(TableCacheStats *stats);
+
+#endif
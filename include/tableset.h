@@ -0,0 +1,51 @@
+#ifndef TABLESET_H
+#define TABLESET_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "codetable.h"
+#include "bitio.h"
+
+// Named code tables trained in advance on samples of each kind of data a service sees
+// (JSON, base64, telemetry...), so that a block of a known kind does not need to carry
+// its own table. File format:
+//
+//   "HUFS", u8 version, u8 number of tables, then per table: u8 name length, name,
+//   serialized table (see codetable.h)
+//
+// The set is identified by a hash of its tables in order: a container records it with
+// the number of each table it uses, and only decodes with the same set loaded.
+
+#define TABLE_SET_MAGIC "HUFS"
+#define TABLE_SET_VERSION 1
+#define TABLE_SET_MAX_TABLES 16
+#define TABLE_SET_MAX_NAME_LENGTH 255
+// Longest code of a trained table: four codes per put of the bit writer
+#define TABLE_SET_MAX_CODE_LENGTH (BIT_WRITER_WIDE_BITS / 4)
+
+typedef struct TableSet
+{
+    unsigned int nb_tables;
+    char names[TABLE_SET_MAX_TABLES][TABLE_SET_MAX_NAME_LENGTH + 1];
+    CodeTable tables[TABLE_SET_MAX_TABLES];
+    uint32_t id; //  FNV-1a of the serialized tables, kept up to date by the functions below
+} TableSet;
+
+void table_set_init(TableSet *set);
+// Adds a table trained on the histogram of samples, or replaces the one of that name.
+// Every letter gets a code, of at most TABLE_SET_MAX_CODE_LENGTH bits, so that the table
+// codes any block. Returns 0, or -1 after printing an error (full set, empty histogram,
+// bad name)
+int table_set_train(TableSet *set, const char *name, const long long *histogram);
+// Number of the table of that name, or -1
+int table_set_find(const TableSet *set, const char *name);
+// Number of the table that codes the histogram in the fewest bits, with that cost in
+// *cost, or -1 if the set is empty
+int table_set_best(const TableSet *set, const long long *histogram, long long *cost);
+
+// Return 0, or -1 after printing an error
+int table_set_write(const TableSet *set, FILE *file);
+int table_set_read(TableSet *set, FILE *file);
+
+#endif
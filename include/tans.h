@@ -0,0 +1,56 @@
+#ifndef TANS_H
+#define TANS_H
+
+#include <stddef.h>
+
+#include "codetable.h"
+
+// Table-based asymmetric numeral systems (tANS, as in FSE): an entropy coder that spends
+// fractional bits per letter, so it gets close to the entropy of skewed histograms where
+// Huffman spends at least one bit on the most frequent letter.
+//
+// The histogram of a block is normalized into frequencies that add up to 1 << table_log.
+// The state of the coder is a number in [0, 1 << table_log): the letters are spread over
+// the states in proportion to their frequencies, and coding a letter moves the state to
+// one of its slots, writing the low bits that the decoder reads back to return from there.
+// The encoder runs from the last letter to the first, so the payload is read backwards:
+// it ends with the final states on table_log bits each (the letters at even and odd
+// positions have their own state, so that two lookups run at once), and each letter pops
+// the bits written for it from the end.
+
+#define TANS_TABLE_LOG 11 //  Table size of the frequencies made by the encoders
+#define TANS_MIN_TABLE_LOG 8
+#define TANS_MAX_TABLE_LOG 12
+
+typedef struct TansFrequencies
+{
+    unsigned int table_log;
+    unsigned short counts[NB_SYMBOLS]; //  Normalized count of each letter (0 if it is absent)
+    int nb_symbols;
+} TansFrequencies;
+
+// Scales the histogram to counts adding up to 1 << table_log, every letter present
+// keeping at least 1. Returns 0, or -1 if the histogram is empty
+int tans_normalize(const long long *histogram, unsigned int table_log, TansFrequencies *frequencies);
+// Bits needed to code the histogram with the frequencies, the final states included: an
+// estimate, within a few bits per thousand letters of what tans_encode writes. -1 if one
+// of its letters has no frequency
+long long tans_cost(const TansFrequencies *frequencies, const long long *histogram);
+
+// Serialized frequencies: u8 table log, u16 number of letters, then (letter, u16 count)
+#define TANS_MAX_SERIALIZED_SIZE (1 + 2 + 3 * NB_SYMBOLS)
+size_t tans_serialized_size(const TansFrequencies *frequencies);
+size_t tans_serialize(const TansFrequencies *frequencies, unsigned char *out);
+// Returns the number of bytes read, or 0 if the data is not valid frequencies
+size_t tans_deserialize(const unsigned char *in, size_t size, TansFrequencies *frequencies);
+
+// Encodes length bytes, all with a frequency, into out (at least TANS_MAX_TABLE_LOG * length / 8 + 16
+// bytes); returns the number of bits
+unsigned long long tans_encode(const unsigned char *data, size_t length, const TansFrequencies *frequencies,
+                               unsigned char *out);
+// Decodes length bytes from the nb_bits of in; returns 0, or -1 if the bits do not decode
+// into exactly length bytes
+int tans_decode(const unsigned char *in, unsigned long long nb_bits, const TansFrequencies *frequencies,
+                unsigned char *out, size_t length);
+
+#endif
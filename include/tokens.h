@@ -0,0 +1,79 @@
+#ifndef TOKENS_H
+#define TOKENS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Token mode: the alphabet is the set of distinct tokens of the input (words, runs of
+// spaces, lines...) instead of the 256 bytes, so that natural language and logs are coded
+// one whole token per code, and decoded one whole token per table lookup. Alphabets of
+// millions of tokens are handled: tokens are numbered through an open-addressing hash
+// table and the code lengths are computed in place on the sorted counts.
+
+#define TOKEN_MAX_CODE_LENGTH 32
+#define TOKEN_DECODE_BITS 12
+#define TOKEN_MAX_LENGTH 4096
+
+// Splits the input into tokens: a token is a run of bytes of the same non-zero class, or
+// a single byte of class 0. A byte of class TOKEN_CLASS_END ends the run it follows and is
+// part of it. Runs longer than max_length are cut into several tokens
+#define TOKEN_CLASS_END 255
+typedef struct Tokenizer
+{
+    unsigned char classes[256];
+    size_t max_length;
+} Tokenizer;
+
+// Presets: "words" (runs of letters, digits, '_' and non-ASCII bytes, runs of spaces and
+// tabs, any other byte alone), "fields" (runs of whitespace and runs of anything else)
+// and "lines" (whole lines, each ending with its '\n'). Returns -1 for an unknown name
+int tokenizer_init(Tokenizer *tokenizer, const char *name);
+// Puts every byte of bytes in the given class, to customize a preset
+void tokenizer_set_class(Tokenizer *tokenizer, const char *bytes, unsigned char class);
+// Length of the token at the start of data (0 only if length is 0)
+size_t tokenizer_next(const Tokenizer *tokenizer, const unsigned char *data, size_t length);
+
+// Distinct tokens and their counts; the token bytes are not copied, they must stay valid
+// as long as the table is used. Tokens are numbered from 0 in order of first appearance
+typedef struct TokenTable
+{
+    const unsigned char **tokens;
+    uint32_t *lengths;
+    uint32_t *hashes;
+    uint64_t *counts;
+    size_t nb_tokens;
+    size_t capacity;  //  Size of the four arrays above
+    uint32_t *slots;  //  Open addressing with linear probing: token number + 1, or 0 when free
+    size_t nb_slots;  //  Power of 2, at least twice nb_tokens
+} TokenTable;
+
+// Returns 0, or -1 if the memory could not be allocated (the table is then empty)
+int token_table_init(TokenTable *table);
+void token_table_free(TokenTable *table);
+// Counts one more occurrence of the token; returns its number, or -1 if the table could not grow
+long token_table_add(TokenTable *table, const unsigned char *token, size_t length);
+// Returns the number of the token, or -1 if it is not in the table
+long token_table_find(const TokenTable *table, const unsigned char *token, size_t length);
+
+// Optimal code lengths of nb_symbols counts, limited to max_length bits (at most
+// TOKEN_MAX_CODE_LENGTH): O(n log n) for the sort, then O(n) without extra memory
+// (Moffat and Katajainen's in-place method). Symbols of count 0 get length 0.
+// Returns the number of coded symbols, or -1 if the memory could not be allocated
+// or max_length is too small for that many symbols
+long token_code_lengths(const uint64_t *counts, size_t nb_symbols, unsigned char *lengths, int max_length);
+
+// Token container: "HUFW", u8 version, u8 longest code length L, varint number of tokens,
+// varint count of codes of each length from 1 to L, then each token as varint length and
+// bytes, sorted by (code length, first appearance), which gives the canonical codes;
+// then varint number of coded tokens, varint number of bits and the payload
+#define TOKEN_MAGIC "HUFW"
+#define TOKEN_VERSION 1
+
+// Reads the whole input in memory. Returns 0, or -1 on error
+int token_compress(FILE *input, FILE *output, const Tokenizer *tokenizer);
+int token_decompress(FILE *input, FILE *output);
+// 1 if the file starts with TOKEN_MAGIC, 0 otherwise; the file is rewound
+int token_file_detect(FILE *input);
+
+#endif
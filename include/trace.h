@@ -0,0 +1,50 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Compile-time tracing. TRACE_LEVEL is fixed when building (make TRACE=2, or
+// -DTRACE_LEVEL=2): every TRACE call above that level is a constant-false branch
+// removed by the compiler, so the default build (level 0) pays nothing.
+// Enabled events are appended to a lock-free in-memory ring buffer holding a
+// format and up to four integer arguments; nothing is formatted or printed until
+// trace_dump is called (main calls it on exit, whatever the command).
+
+#define TRACE_OFF 0    // No tracing (default)
+#define TRACE_STEPS 1  // One event per function call / summary
+#define TRACE_DETAIL 2 // One event per tree or list operation
+#define TRACE_BYTES 3  // One event per byte read or written
+
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_OFF
+#endif
+
+// Number of events kept in the ring buffer (a power of two); older events are overwritten
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE (1 << 16)
+#endif
+
+#define TRACE_ENABLED(level) (TRACE_LEVEL >= (level))
+
+// TRACE(level, format, args...): the format may only use %lld conversions, at most four
+#define TRACE(level, ...)                                  \
+    do                                                     \
+    {                                                      \
+        if (TRACE_ENABLED(level))                          \
+        {                                                  \
+            TRACE_RECORD_(__VA_ARGS__, 0, 0, 0, 0, 0);     \
+        }                                                  \
+    } while (0)
+
+#define TRACE_RECORD_(format, a, b, c, d, ...) \
+    trace_record(format, (long long)(a), (long long)(b), (long long)(c), (long long)(d))
+
+#include <stdio.h>
+
+void trace_record(const char *format, long long a, long long b, long long c, long long d);
+
+// Prints the events still held in the ring buffer, oldest first, one per line
+void trace_dump(FILE *output);
+
+// Forgets every recorded event
+void trace_clear(void);
+
+#endif
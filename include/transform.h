@@ -0,0 +1,93 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Reversible transforms run on a block before it is counted and coded, so that the
+// Huffman codes see a skewed distribution where the raw bytes had long-range structure:
+//
+//   rle  after 4 equal bytes, one byte counts the further repeats (0 to 255)
+//   mtf  each byte becomes its rank in a list of recently seen bytes (move-to-front)
+//   bwt  Burrows-Wheeler transform: u32 primary index, then the last column of the
+//        sorted rotations (built from a suffix array, SA-IS)
+//   deltaN    for records of N bytes (N = 2, 4 or 8): each element, a little-endian
+//             integer, becomes its difference with the previous one, modulo 2^(8N)
+//   shuffleN  byte k of every element of N bytes goes to plane k: the N planes follow
+//             each other, then the length % N bytes left. Always the last stage, since
+//             the container codes each plane with its own table
+//
+// The classic chain is "bwt,mtf,rle": the BWT groups the bytes by context, the MTF turns
+// the groups into runs of small ranks, the RLE shortens the runs. Arrays of integers or
+// floats take "shuffle4" or "shuffle8" instead, after "delta4" for counters and
+// timestamps: the nearly constant high bytes then no longer share the codes of the
+// noisy low ones.
+
+#define TRANSFORM_RLE 1
+#define TRANSFORM_MTF 2
+#define TRANSFORM_BWT 3
+#define TRANSFORM_DELTA2 4
+#define TRANSFORM_DELTA4 5
+#define TRANSFORM_DELTA8 6
+#define TRANSFORM_SHUFFLE2 7
+#define TRANSFORM_SHUFFLE4 8
+#define TRANSFORM_SHUFFLE8 9
+#define TRANSFORM_MAX_PLANES 8
+// Each stage appears at most once in a chain
+#define TRANSFORM_MAX_STAGES 3
+// Encoders keep a transformed block at most this many bytes above its raw size (the
+// intermediate results of the inverse then fit in raw size + TRANSFORM_MAX_GROWTH too)
+#define TRANSFORM_MAX_GROWTH 64
+// Bytes of any chain's output for length bytes of input
+#define TRANSFORM_BOUND(length) ((size_t)(length) + (size_t)(length) / 4 + 16)
+// Heap bytes a chain may allocate to transform length bytes
+#define TRANSFORM_MEMORY(length) ((long long)(length) * 12 + 4096)
+
+typedef struct TransformChain
+{
+    unsigned char nb_stages;
+    unsigned char stages[TRANSFORM_MAX_STAGES]; //  In the order they are applied
+} TransformChain;
+
+// Parses a comma separated list of stage names ("bwt,mtf,rle"), or "none". Returns -1
+// for an unknown or repeated stage
+int transform_chain_parse(const char *text, TransformChain *chain);
+// 1 if the chain holds known stages, each at most once
+int transform_chain_valid(const TransformChain *chain);
+// Name of a stage, or "?"
+const char *transform_stage_name(int stage);
+// Number of byte planes the chain leaves: the width of its shuffle, or 1 without one
+unsigned int transform_planes(const TransformChain *chain);
+
+// Applies the stages in order into out. Returns the size of the result, or -1 if it does
+// not fit in capacity or the memory could not be allocated
+long long transform_forward(const TransformChain *chain, const unsigned char *data, size_t length, unsigned char *out,
+                            size_t capacity);
+// Undoes the stages into out, which receives exactly raw_size bytes. Returns 0, or -1 if
+// the data is damaged or the memory could not be allocated
+int transform_inverse(const TransformChain *chain, const unsigned char *data, size_t length, unsigned char *out,
+                      size_t raw_size);
+
+// The stages alone. rle_encode writes at most length + length / 4 + 1 bytes and returns
+// their number; rle_decode returns the number of bytes decoded, or -1 if the input is
+// damaged or they do not fit in capacity
+size_t rle_encode(const unsigned char *data, size_t length, unsigned char *out);
+long long rle_decode(const unsigned char *data, size_t length, unsigned char *out, size_t capacity);
+void mtf_encode(const unsigned char *data, size_t length, unsigned char *out);
+void mtf_decode(const unsigned char *data, size_t length, unsigned char *out);
+// bwt_encode writes length + 4 bytes; bwt_decode reads length bytes and writes
+// length - 4. Both return 0, or -1 (no memory, damaged input, blocks of 2 GiB or more)
+int bwt_encode(const unsigned char *data, size_t length, unsigned char *out);
+int bwt_decode(const unsigned char *data, size_t length, unsigned char *out);
+// width is 2, 4 or 8; out has length bytes, and is not data
+void delta_encode(const unsigned char *data, size_t length, unsigned int width, unsigned char *out);
+void delta_decode(const unsigned char *data, size_t length, unsigned int width, unsigned char *out);
+// Vector (SSE2) transposes of 16 elements at a time where available
+void shuffle_encode(const unsigned char *data, size_t length, unsigned int width, unsigned char *out);
+void shuffle_decode(const unsigned char *data, size_t length, unsigned int width, unsigned char *out);
+
+// Starting positions of the suffixes of data in lexicographic order (a suffix comes
+// before the longer ones it prefixes), in linear time. Returns 0, or -1 as bwt_encode
+int suffix_array(const unsigned char *data, size_t length, int32_t *sa);
+
+#endif
@@ -0,0 +1,434 @@
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "archive.h"
+#include "memstats.h"
+#include "byteio.h"
+#include "trace.h"
+
+#define ARCHIVE_ENTRY_FIXED_SIZE (2 + 8 + 8 + 8 + 4)
+
+// FNV-1a, folded to 32 bits
+static uint32_t name_hash(const char *name)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *c = (const unsigned char *)name; *c != '\0'; c++)
+    {
+        hash = (hash ^ *c) * 1099511628211ULL;
+    }
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+static void insert_slot(uint32_t *slots, size_t nb_slots, const char *name, uint32_t member)
+{
+    size_t slot = name_hash(name) & (nb_slots - 1);
+    while (slots[slot] != 0)
+    {
+        slot = (slot + 1) & (nb_slots - 1);
+    }
+    slots[slot] = member + 1;
+}
+
+// Makes room for one more member in the arrays and the hash table
+static int grow_members(Archive *archive)
+{
+    if (archive->nb_members == archive->members_capacity)
+    {
+        unsigned int capacity = archive->members_capacity < 16 ? 16 : 2 * archive->members_capacity;
+        ArchiveMember *members = mem_realloc(archive->members, capacity * sizeof(ArchiveMember));
+        if (members == NULL)
+        {
+            return -1;
+        }
+        archive->members = members;
+        archive->members_capacity = capacity;
+    }
+    if (2 * ((size_t)archive->nb_members + 1) > archive->nb_slots)
+    {
+        size_t nb_slots = archive->nb_slots < 64 ? 64 : 2 * archive->nb_slots;
+        uint32_t *slots = mem_calloc(nb_slots, sizeof(uint32_t));
+        if (slots == NULL)
+        {
+            return -1;
+        }
+        for (unsigned int i = 0; i < archive->nb_members; i++)
+        {
+            insert_slot(slots, nb_slots, archive->members[i].name, i);
+        }
+        mem_free(archive->slots);
+        archive->slots = slots;
+        archive->nb_slots = nb_slots;
+    }
+    return 0;
+}
+
+static int add_table(Archive *archive, const CodeTable *table)
+{
+    if (archive->nb_tables == archive->tables_capacity)
+    {
+        unsigned int capacity = archive->tables_capacity < 4 ? 4 : 2 * archive->tables_capacity;
+        CodeTable *tables = mem_realloc(archive->tables, capacity * sizeof(CodeTable));
+        if (tables == NULL)
+        {
+            return -1;
+        }
+        archive->tables = tables;
+        archive->tables_capacity = capacity;
+    }
+    archive->tables[archive->nb_tables++] = *table;
+    return 0;
+}
+
+// Records a member whose name is not in the archive yet; the name is copied
+static int add_member(Archive *archive, const char *name, const ArchiveMember *member)
+{
+    size_t name_length = strlen(name);
+    char *copy = mem_alloc(name_length + 1);
+    if (copy == NULL || grow_members(archive) != 0)
+    {
+        mem_free(copy);
+        return -1;
+    }
+    memcpy(copy, name, name_length + 1);
+    archive->members[archive->nb_members] = *member;
+    archive->members[archive->nb_members].name = copy;
+    insert_slot(archive->slots, archive->nb_slots, copy, archive->nb_members);
+    archive->nb_members++;
+    return 0;
+}
+
+long archive_find(const Archive *archive, const char *name)
+{
+    if (archive->nb_slots == 0)
+    {
+        return -1;
+    }
+    size_t slot = name_hash(name) & (archive->nb_slots - 1);
+    while (archive->slots[slot] != 0)
+    {
+        uint32_t member = archive->slots[slot] - 1;
+        if (strcmp(archive->members[member].name, name) == 0)
+        {
+            return (long)member;
+        }
+        slot = (slot + 1) & (archive->nb_slots - 1);
+    }
+    return -1;
+}
+
+int archive_create(Archive *archive, FILE *file)
+{
+    memset(archive, 0, sizeof(Archive));
+    archive->file = file;
+    archive->end = ARCHIVE_HEADER_SIZE;
+
+    unsigned char header[ARCHIVE_HEADER_SIZE];
+    memcpy(header, ARCHIVE_MAGIC, 4);
+    header[4] = ARCHIVE_VERSION;
+    if (fseeko(file, 0, SEEK_SET) != 0 || fwrite(header, 1, sizeof(header), file) != sizeof(header))
+    {
+        printf("Error: could not write the archive.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Parses the tables and the directory, read in memory from the tables offset to the trailer
+static int parse_tables_and_directory(Archive *archive, const unsigned char *in, size_t size, size_t directory_start,
+                                      unsigned int nb_tables, unsigned int nb_members)
+{
+    size_t pos = 0;
+    for (unsigned int i = 0; i < nb_tables; i++)
+    {
+        CodeTable table;
+        size_t table_size = code_table_deserialize(in + pos, directory_start - pos, &table);
+        if (table_size == 0 || add_table(archive, &table) != 0)
+        {
+            return -1;
+        }
+        pos += table_size;
+    }
+    if (pos != directory_start)
+    {
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < nb_members; i++)
+    {
+        ArchiveMember member;
+        char name[ARCHIVE_MAX_NAME_LENGTH + 1];
+        if (size - pos < ARCHIVE_ENTRY_FIXED_SIZE)
+        {
+            return -1;
+        }
+        size_t name_length = get_u16(in + pos);
+        if (size - pos < ARCHIVE_ENTRY_FIXED_SIZE + name_length)
+        {
+            return -1;
+        }
+        memcpy(name, in + pos + 2, name_length);
+        name[name_length] = '\0';
+        pos += 2 + name_length;
+        member.offset = get_u64(in + pos);
+        member.raw_size = get_u64(in + pos + 8);
+        member.payload_bits = get_u64(in + pos + 16);
+        member.table = get_u32(in + pos + 24);
+        pos += 28;
+
+        if (strlen(name) != name_length || archive_find(archive, name) >= 0 || member.offset < ARCHIVE_HEADER_SIZE ||
+            member.payload_bits > member.raw_size * MAX_CODE_LENGTH ||
+            member.offset + (member.payload_bits + 7) / 8 > archive->end ||
+            (member.table >= nb_tables && member.raw_size > 0) || add_member(archive, name, &member) != 0)
+        {
+            return -1;
+        }
+    }
+    return pos == size ? 0 : -1;
+}
+
+int archive_open(Archive *archive, FILE *file)
+{
+    unsigned char header[ARCHIVE_HEADER_SIZE];
+    unsigned char trailer[ARCHIVE_TRAILER_SIZE];
+
+    memset(archive, 0, sizeof(Archive));
+    archive->file = file;
+    if (fseeko(file, 0, SEEK_END) != 0)
+    {
+        return -1;
+    }
+    off_t size = ftello(file);
+    fseeko(file, 0, SEEK_SET);
+    if (size < ARCHIVE_HEADER_SIZE + ARCHIVE_TRAILER_SIZE ||
+        fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, ARCHIVE_MAGIC, 4) != 0 ||
+        header[4] != ARCHIVE_VERSION)
+    {
+        printf("Error: not an archive.\n");
+        return -1;
+    }
+    fseeko(file, size - ARCHIVE_TRAILER_SIZE, SEEK_SET);
+    if (fread(trailer, 1, sizeof(trailer), file) != sizeof(trailer) ||
+        memcmp(trailer + ARCHIVE_TRAILER_SIZE - 4, ARCHIVE_TRAILER_MAGIC, 4) != 0)
+    {
+        printf("Error: the archive trailer is missing or damaged.\n");
+        return -1;
+    }
+
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        archive->histogram[c] = (long long)get_u64(trailer + 8 * c);
+    }
+    unsigned long long tables_offset = get_u64(trailer + 8 * NB_SYMBOLS);
+    unsigned int nb_tables = get_u32(trailer + 8 * NB_SYMBOLS + 8);
+    unsigned long long directory_offset = get_u64(trailer + 8 * NB_SYMBOLS + 12);
+    unsigned int nb_members = get_u32(trailer + 8 * NB_SYMBOLS + 20);
+    unsigned long long tail_end = (unsigned long long)size - ARCHIVE_TRAILER_SIZE;
+    archive->end = tables_offset;
+
+    if (tables_offset < ARCHIVE_HEADER_SIZE || directory_offset < tables_offset || directory_offset > tail_end)
+    {
+        printf("Error: the archive directory is damaged.\n");
+        return -1;
+    }
+    size_t tail_size = (size_t)(tail_end - tables_offset);
+    unsigned char *tail = mem_alloc(tail_size + 1);
+    int status = tail != NULL ? 0 : -1;
+    if (status == 0)
+    {
+        fseeko(file, (off_t)tables_offset, SEEK_SET);
+        if (fread(tail, 1, tail_size, file) != tail_size ||
+            parse_tables_and_directory(archive, tail, tail_size, (size_t)(directory_offset - tables_offset),
+                                       nb_tables, nb_members) != 0)
+        {
+            status = -1;
+        }
+    }
+    mem_free(tail);
+    if (status != 0)
+    {
+        printf("Error: the archive directory is damaged.\n");
+        archive_free(archive);
+        return -1;
+    }
+    TRACE(TRACE_STEPS, "archive: %lld members, %lld tables", archive->nb_members, archive->nb_tables);
+    return 0;
+}
+
+// Table that codes the histogram in the fewest bits: one of the last shared tables, or
+// fresh (number nb_tables) built from the running histogram with the member, its
+// serialized size counted. Returns 1 when it is fresh
+static int choose_table(const Archive *archive, const long long *histogram, CodeTable *fresh, unsigned int *table)
+{
+    long long merged[NB_SYMBOLS];
+    long long best = -1;
+
+    *table = 0;
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        merged[c] = archive->histogram[c] + histogram[c];
+    }
+    if (code_table_from_histogram(merged, fresh) == 0)
+    {
+        best = code_table_cost(fresh, histogram) + 8 * (long long)code_table_serialized_size(fresh);
+        *table = archive->nb_tables;
+    }
+    unsigned int first = archive->nb_tables > ARCHIVE_TABLE_CANDIDATES ? archive->nb_tables - ARCHIVE_TABLE_CANDIDATES : 0;
+    for (unsigned int t = first; t < archive->nb_tables; t++)
+    {
+        long long cost = code_table_cost(&archive->tables[t], histogram);
+        if (cost >= 0 && (best < 0 || cost <= best))
+        {
+            best = cost;
+            *table = t;
+        }
+    }
+    return best >= 0 && *table == archive->nb_tables;
+}
+
+int archive_add(Archive *archive, const char *name, const unsigned char *data, size_t length)
+{
+    if (strlen(name) > ARCHIVE_MAX_NAME_LENGTH || archive_find(archive, name) >= 0)
+    {
+        printf("Error: the archive already holds %s, or the name is too long.\n", name);
+        return -1;
+    }
+
+    long long histogram[NB_SYMBOLS] = {0};
+    CodeTable fresh;
+    ArchiveMember member;
+
+    histogram_add_buffer(histogram, data, length);
+    if (choose_table(archive, histogram, &fresh, &member.table) && add_table(archive, &fresh) != 0)
+    {
+        printf("Error: the memory limit is too low for the archive tables.\n");
+        return -1;
+    }
+
+    unsigned char *payload = mem_alloc(length * (MAX_CODE_LENGTH / 8) + 8);
+    if (payload == NULL)
+    {
+        printf("Error: the memory limit is too low for a member of %zu bytes.\n", length);
+        return -1;
+    }
+    member.offset = archive->end;
+    member.raw_size = length;
+    member.payload_bits = length > 0 ? encode_buffer(data, length, &archive->tables[member.table], payload) : 0;
+    size_t payload_size = (size_t)((member.payload_bits + 7) / 8);
+    int status = fseeko(archive->file, (off_t)archive->end, SEEK_SET) == 0 &&
+                         fwrite(payload, 1, payload_size, archive->file) == payload_size &&
+                         add_member(archive, name, &member) == 0
+                     ? 0
+                     : -1;
+    mem_free(payload);
+    if (status != 0)
+    {
+        printf("Error: could not add %s to the archive.\n", name);
+        return -1;
+    }
+    archive->end += payload_size;
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        archive->histogram[c] += histogram[c];
+    }
+    return 0;
+}
+
+int archive_finish(Archive *archive)
+{
+    unsigned char buffer[ARCHIVE_ENTRY_FIXED_SIZE + ARCHIVE_MAX_NAME_LENGTH];
+    unsigned char trailer[ARCHIVE_TRAILER_SIZE];
+    FILE *file = archive->file;
+    int status = fseeko(file, (off_t)archive->end, SEEK_SET) == 0 ? 0 : -1;
+
+    for (unsigned int t = 0; t < archive->nb_tables && status == 0; t++)
+    {
+        size_t size = code_table_serialize(&archive->tables[t], buffer);
+        status = fwrite(buffer, 1, size, file) == size ? 0 : -1;
+    }
+    unsigned long long directory_offset = (unsigned long long)ftello(file);
+    for (unsigned int i = 0; i < archive->nb_members && status == 0; i++)
+    {
+        const ArchiveMember *member = &archive->members[i];
+        size_t name_length = strlen(member->name);
+        put_u16(buffer, (uint16_t)name_length);
+        memcpy(buffer + 2, member->name, name_length);
+        put_u64(buffer + 2 + name_length, member->offset);
+        put_u64(buffer + 10 + name_length, member->raw_size);
+        put_u64(buffer + 18 + name_length, member->payload_bits);
+        put_u32(buffer + 26 + name_length, member->table);
+        size_t size = ARCHIVE_ENTRY_FIXED_SIZE + name_length;
+        status = fwrite(buffer, 1, size, file) == size ? 0 : -1;
+    }
+
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        put_u64(trailer + 8 * c, (unsigned long long)archive->histogram[c]);
+    }
+    put_u64(trailer + 8 * NB_SYMBOLS, archive->end);
+    put_u32(trailer + 8 * NB_SYMBOLS + 8, archive->nb_tables);
+    put_u64(trailer + 8 * NB_SYMBOLS + 12, directory_offset);
+    put_u32(trailer + 8 * NB_SYMBOLS + 20, archive->nb_members);
+    memcpy(trailer + ARCHIVE_TRAILER_SIZE - 4, ARCHIVE_TRAILER_MAGIC, 4);
+    if (status != 0 || fwrite(trailer, 1, sizeof(trailer), file) != sizeof(trailer) || fflush(file) != 0)
+    {
+        printf("Error: could not write the archive directory.\n");
+        return -1;
+    }
+    return 0;
+}
+
+void archive_free(Archive *archive)
+{
+    for (unsigned int i = 0; i < archive->nb_members; i++)
+    {
+        mem_free(archive->members[i].name);
+    }
+    mem_free(archive->members);
+    mem_free(archive->tables);
+    mem_free(archive->slots);
+    memset(archive, 0, sizeof(Archive));
+}
+
+// Positioned read: several threads can extract members of the same archive at once
+long long archive_extract(const Archive *archive, unsigned int member, unsigned char *out, size_t capacity)
+{
+    if (member >= archive->nb_members)
+    {
+        printf("Error: the archive has no member %u.\n", member);
+        return -1;
+    }
+    const ArchiveMember *entry = &archive->members[member];
+    if (entry->raw_size > capacity)
+    {
+        printf("Error: %llu bytes do not fit in a buffer of %zu bytes.\n", entry->raw_size, capacity);
+        return -1;
+    }
+    if (entry->raw_size == 0)
+    {
+        return 0;
+    }
+
+    size_t payload_size = (size_t)((entry->payload_bits + 7) / 8);
+    unsigned char *payload = mem_alloc(payload_size + 1);
+    if (payload == NULL)
+    {
+        printf("Error: the memory limit is too low for a member of %llu bytes.\n", entry->raw_size);
+        return -1;
+    }
+    int status = pread(fileno(archive->file), payload, payload_size, (off_t)entry->offset) == (ssize_t)payload_size &&
+                         decode_buffer(payload, entry->payload_bits, &archive->tables[entry->table], out,
+                                       (size_t)entry->raw_size) == 0
+                     ? 0
+                     : -1;
+    mem_free(payload);
+    if (status != 0)
+    {
+        printf("Error: the member %s of the archive is damaged.\n", entry->name);
+        return -1;
+    }
+    return (long long)entry->raw_size;
+}
@@ -0,0 +1,257 @@
+#define _FILE_OFFSET_BITS 64
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "async_io.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define ASYNC_IO_URING 1
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#ifdef ASYNC_IO_URING
+
+static int uring_setup(AsyncIo *io)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    int fd = (int)syscall(__NR_io_uring_setup, ASYNC_IO_DEPTH, &params);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    io->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    io->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (io->cq_ring_size > io->sq_ring_size)
+        {
+            io->sq_ring_size = io->cq_ring_size;
+        }
+        io->cq_ring_size = io->sq_ring_size;
+    }
+    io->sq_ring = mmap(NULL, io->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                       IORING_OFF_SQ_RING);
+    if (io->sq_ring == MAP_FAILED)
+    {
+        close(fd);
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        io->cq_ring = io->sq_ring;
+    }
+    else
+    {
+        io->cq_ring = mmap(NULL, io->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                           IORING_OFF_CQ_RING);
+        if (io->cq_ring == MAP_FAILED)
+        {
+            munmap(io->sq_ring, io->sq_ring_size);
+            close(fd);
+            return -1;
+        }
+    }
+    io->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    io->sqes = mmap(NULL, io->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (io->sqes == MAP_FAILED)
+    {
+        if (io->cq_ring != io->sq_ring)
+        {
+            munmap(io->cq_ring, io->cq_ring_size);
+        }
+        munmap(io->sq_ring, io->sq_ring_size);
+        close(fd);
+        return -1;
+    }
+
+    char *sq = io->sq_ring, *cq = io->cq_ring;
+    io->sq_head = (unsigned *)(sq + params.sq_off.head);
+    io->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    io->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    io->sq_array = (unsigned *)(sq + params.sq_off.array);
+    io->cq_head = (unsigned *)(cq + params.cq_off.head);
+    io->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    io->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    io->cqes = cq + params.cq_off.cqes;
+    io->ring_fd = fd;
+    return 0;
+}
+
+static int uring_submit(AsyncIo *io, int opcode, int fd, const void *buffer, size_t length, off_t offset,
+                        unsigned long long user_data)
+{
+    unsigned tail = *io->sq_tail;
+    unsigned index = tail & *io->sq_mask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)io->sqes + index;
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (unsigned char)opcode;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long)(size_t)buffer;
+    sqe->len = (unsigned)length;
+    sqe->off = (unsigned long long)offset;
+    sqe->user_data = user_data;
+    io->sq_array[index] = index;
+    atomic_store_explicit((_Atomic unsigned *)io->sq_tail, tail + 1, memory_order_release);
+
+    if (syscall(__NR_io_uring_enter, io->ring_fd, 1, 0, 0, NULL, 0) != 1)
+    {
+        // The kernel did not take the entry: it leaves the ring, so that no completion
+        // comes for a request served another way
+        atomic_store_explicit((_Atomic unsigned *)io->sq_tail, tail, memory_order_release);
+        return -1;
+    }
+    return 0;
+}
+
+static int uring_reap(AsyncIo *io, int wait, AsyncIoCompletion *completion)
+{
+    for (;;)
+    {
+        unsigned head = *io->cq_head;
+        if (head != atomic_load_explicit((_Atomic unsigned *)io->cq_tail, memory_order_acquire))
+        {
+            struct io_uring_cqe *cqe = (struct io_uring_cqe *)io->cqes + (head & *io->cq_mask);
+            completion->user_data = cqe->user_data;
+            completion->result = cqe->res;
+            atomic_store_explicit((_Atomic unsigned *)io->cq_head, head + 1, memory_order_release);
+            return 1;
+        }
+        if (!wait)
+        {
+            return 0;
+        }
+        if (syscall(__NR_io_uring_enter, io->ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+        {
+            return 0;
+        }
+    }
+}
+
+#endif
+
+void async_io_init(AsyncIo *io, int use_uring)
+{
+    memset(io, 0, sizeof(AsyncIo));
+    io->ring_fd = -1;
+#ifdef ASYNC_IO_URING
+    if (use_uring && uring_setup(io) != 0)
+    {
+        io->ring_fd = -1;
+    }
+#else
+    (void)use_uring;
+#endif
+}
+
+void async_io_destroy(AsyncIo *io)
+{
+    AsyncIoCompletion completion;
+    while (io->in_flight > 0 && async_io_reap(io, 1, &completion))
+    {
+    }
+#ifdef ASYNC_IO_URING
+    if (io->ring_fd >= 0)
+    {
+        munmap(io->sqes, io->sqes_size);
+        if (io->cq_ring != io->sq_ring)
+        {
+            munmap(io->cq_ring, io->cq_ring_size);
+        }
+        munmap(io->sq_ring, io->sq_ring_size);
+        close(io->ring_fd);
+        io->ring_fd = -1;
+    }
+#endif
+}
+
+int async_io_uses_uring(const AsyncIo *io)
+{
+    return io->ring_fd >= 0;
+}
+
+static void push_done(AsyncIo *io, long long result, unsigned long long user_data)
+{
+    io->done[io->nb_done].user_data = user_data;
+    io->done[io->nb_done].result = result < 0 ? -errno : result;
+    io->nb_done++;
+}
+
+int async_io_read(AsyncIo *io, int fd, void *buffer, size_t length, off_t offset, unsigned long long user_data)
+{
+    if (io->in_flight >= ASYNC_IO_DEPTH)
+    {
+        return -1;
+    }
+#ifdef ASYNC_IO_URING
+    if (io->ring_fd >= 0)
+    {
+        if (uring_submit(io, IORING_OP_READ, fd, buffer, length, offset, user_data) == 0)
+        {
+            io->in_flight++;
+            return 0;
+        }
+        // Refused by the kernel: served at once, as without io_uring
+    }
+#endif
+    push_done(io, (long long)pread(fd, buffer, length, offset), user_data);
+    io->in_flight++;
+    return 0;
+}
+
+int async_io_write(AsyncIo *io, int fd, const void *buffer, size_t length, off_t offset,
+                   unsigned long long user_data)
+{
+    if (io->in_flight >= ASYNC_IO_DEPTH)
+    {
+        return -1;
+    }
+#ifdef ASYNC_IO_URING
+    if (io->ring_fd >= 0)
+    {
+        if (uring_submit(io, IORING_OP_WRITE, fd, buffer, length, offset, user_data) == 0)
+        {
+            io->in_flight++;
+            return 0;
+        }
+        // Refused by the kernel: served at once, as without io_uring
+    }
+#endif
+    push_done(io, (long long)pwrite(fd, buffer, length, offset), user_data);
+    io->in_flight++;
+    return 0;
+}
+
+int async_io_reap(AsyncIo *io, int wait, AsyncIoCompletion *completion)
+{
+    if (io->in_flight == 0)
+    {
+        return 0;
+    }
+#ifdef ASYNC_IO_URING
+    if (io->ring_fd >= 0 && io->nb_done == 0)
+    {
+        if (!uring_reap(io, wait, completion))
+        {
+            return 0;
+        }
+        io->in_flight--;
+        return 1;
+    }
+#else
+    (void)wait;
+#endif
+    *completion = io->done[0];
+    io->nb_done--;
+    memmove(io->done, io->done + 1, (size_t)io->nb_done * sizeof(AsyncIoCompletion));
+    io->in_flight--;
+    return 1;
+}
@@ -0,0 +1,149 @@
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "bitstring.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define BITSTRING_X86 1
+#include <immintrin.h>
+#endif
+
+// 8 ASCII characters for every byte value, stored in memory order
+static char byte_to_ascii[256][8];
+static pthread_once_t byte_to_ascii_once = PTHREAD_ONCE_INIT;
+
+static void init_byte_to_ascii(void)
+{
+    for (int b = 0; b < 256; b++)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            byte_to_ascii[b][i] = (b & (0x80 >> i)) ? '1' : '0';
+        }
+    }
+}
+
+static void bits_to_ascii_scalar(const unsigned char *in, size_t n_bytes, char *out)
+{
+    pthread_once(&byte_to_ascii_once, init_byte_to_ascii);
+    for (size_t i = 0; i < n_bytes; i++)
+    {
+        memcpy(out + 8 * i, byte_to_ascii[in[i]], 8);
+    }
+}
+
+// Returns the number of characters consumed before the first invalid one
+static size_t ascii_to_bits_scalar(const char *in, size_t n_chars, unsigned char *out)
+{
+    size_t i;
+    unsigned char byte = 0;
+    for (i = 0; i < n_chars; i++)
+    {
+        unsigned char bit = (unsigned char)(in[i] - '0');
+        if (bit > 1)
+        {
+            return i;
+        }
+        byte = (unsigned char)((byte << 1) | bit);
+        if ((i & 7) == 7)
+        {
+            out[i >> 3] = byte;
+            byte = 0;
+        }
+    }
+    if (n_chars & 7)
+    {
+        out[n_chars >> 3] = (unsigned char)(byte << (8 - (n_chars & 7)));
+    }
+    return n_chars;
+}
+
+#ifdef BITSTRING_X86
+
+// 4 input bytes -> 32 characters: each byte is broadcast to 8 lanes, the lane keeps
+// its own bit (MSB first) and turns it into '0' or '1'
+__attribute__((target("avx2"))) static void bits_to_ascii_avx2(const unsigned char *in, size_t n_bytes, char *out)
+{
+    const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                            2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i masks = _mm256_set1_epi64x((long long)0x0102040810204080ULL);
+    const __m256i zero_char = _mm256_set1_epi8('0');
+    size_t i = 0;
+
+    for (; i + 4 <= n_bytes; i += 4)
+    {
+        uint32_t word;
+        memcpy(&word, in + i, 4);
+        __m256i bytes = _mm256_set1_epi32((int)word);
+        // _mm256_shuffle_epi8 works per 128-bit lane, so bytes 2 and 3 are taken from
+        // the upper lane copy; the broadcast makes both lanes identical
+        __m256i spread_bytes = _mm256_shuffle_epi8(bytes, spread);
+        __m256i bits = _mm256_cmpeq_epi8(_mm256_and_si256(spread_bytes, masks), masks);
+        __m256i chars = _mm256_sub_epi8(zero_char, bits);
+        _mm256_storeu_si256((__m256i *)(out + 8 * i), chars);
+    }
+    bits_to_ascii_scalar(in + i, n_bytes - i, out + 8 * i);
+}
+
+// 32 characters -> 4 output bytes: the characters of every byte are reversed so that
+// movemask puts the first character in the most significant bit
+__attribute__((target("avx2"))) static size_t ascii_to_bits_avx2(const char *in, size_t n_chars, unsigned char *out)
+{
+    const __m256i reverse = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                             7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    const __m256i ignore_bit = _mm256_set1_epi8((char)0xFE);
+    const __m256i zero_char = _mm256_set1_epi8('0');
+    const __m256i one_char = _mm256_set1_epi8('1');
+    size_t i = 0;
+
+    for (; i + 32 <= n_chars; i += 32)
+    {
+        __m256i chars = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i valid = _mm256_cmpeq_epi8(_mm256_and_si256(chars, ignore_bit), zero_char);
+        if ((uint32_t)_mm256_movemask_epi8(valid) != 0xFFFFFFFFu)
+        {
+            break;
+        }
+        __m256i ones = _mm256_cmpeq_epi8(_mm256_shuffle_epi8(chars, reverse), one_char);
+        uint32_t word = (uint32_t)_mm256_movemask_epi8(ones);
+        memcpy(out + (i >> 3), &word, 4);
+    }
+    return i + ascii_to_bits_scalar(in + i, n_chars - i, out + (i >> 3));
+}
+
+static int has_avx2(void)
+{
+    static int cached = -1;
+    if (cached < 0)
+    {
+        __builtin_cpu_init();
+        cached = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return cached;
+}
+
+#endif
+
+void bits_to_ascii(const unsigned char *in, size_t n_bytes, char *out)
+{
+#ifdef BITSTRING_X86
+    if (has_avx2())
+    {
+        bits_to_ascii_avx2(in, n_bytes, out);
+        return;
+    }
+#endif
+    bits_to_ascii_scalar(in, n_bytes, out);
+}
+
+size_t ascii_to_bits(const char *in, size_t n_chars, unsigned char *out)
+{
+#ifdef BITSTRING_X86
+    if (has_avx2())
+    {
+        return ascii_to_bits_avx2(in, n_chars, out);
+    }
+#endif
+    return ascii_to_bits_scalar(in, n_chars, out);
+}
@@ -0,0 +1,759 @@
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "codetable.h"
+#include "tablecache.h"
+#include "bitio.h"
+#include "byteio.h"
+
+#include <pthread.h>
+
+// The vector kernels are compiled for their instruction sets function by function and
+// only called when the processor runs them, so the library needs no special flags
+#if defined(__GNUC__) && defined(__x86_64__)
+#define ENCODE_X86 1
+#include <immintrin.h>
+#endif
+// Below this many letters, filling the lookup tables of the kernels costs more than it saves
+#define ENCODE_KERNEL_MIN_LENGTH 256
+
+long long histogram_from_file(FILE *input, long long *histogram)
+{
+    unsigned char buffer[1 << 16];
+    size_t nb_bytes;
+    long long total = 0;
+
+    memset(histogram, 0, NB_SYMBOLS * sizeof(long long));
+    while ((nb_bytes = fread(buffer, 1, sizeof(buffer), input)) > 0)
+    {
+        histogram_add_buffer(histogram, buffer, nb_bytes);
+        total += (long long)nb_bytes;
+    }
+    return total;
+}
+
+void histogram_add_buffer(long long *histogram, const unsigned char *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        histogram[data[i]]++;
+    }
+}
+
+// Same list as get_occurrences_by_dichotomy would build, without reading the text
+Element *occurrences_from_histogram(const long long *histogram)
+{
+    Element *root = NULL, *last = NULL;
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        if (histogram[c] > 0)
+        {
+            Element *elem = new_element(c);
+            elem->occ = histogram[c];
+            if (last == NULL)
+            {
+                root = elem;
+            }
+            else
+            {
+                last->next = elem;
+            }
+            last = elem;
+        }
+    }
+    return root;
+}
+
+void histogram_from_occurrences(const Element *occurrences, long long *histogram)
+{
+    memset(histogram, 0, NB_SYMBOLS * sizeof(long long));
+    for (const Element *curr = occurrences; curr != NULL; curr = curr->next)
+    {
+        if (curr->letter >= 0 && curr->letter < NB_SYMBOLS)
+        {
+            histogram[curr->letter] += curr->occ;
+        }
+    }
+}
+
+size_t histogram_serialized_size(const long long *histogram)
+{
+    unsigned char varint[VARINT_MAX_SIZE];
+    size_t size = 4 + 1 + 2;
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        if (histogram[c] > 0)
+        {
+            size += 1 + put_varint(varint, (uint64_t)histogram[c]);
+        }
+    }
+    return size;
+}
+
+size_t histogram_serialize(const long long *histogram, unsigned char *out)
+{
+    size_t pos = 4 + 1 + 2;
+    int nb_letters = 0;
+
+    memcpy(out, HISTOGRAM_MAGIC, 4);
+    out[4] = HISTOGRAM_VERSION;
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        if (histogram[c] > 0)
+        {
+            out[pos++] = (unsigned char)c;
+            pos += put_varint(out + pos, (uint64_t)histogram[c]);
+            nb_letters++;
+        }
+    }
+    put_u16(out + 5, (uint16_t)nb_letters);
+    return pos;
+}
+
+size_t histogram_deserialize(const unsigned char *in, size_t size, long long *histogram)
+{
+    memset(histogram, 0, NB_SYMBOLS * sizeof(long long));
+    if (size < 4 + 1 + 2 || memcmp(in, HISTOGRAM_MAGIC, 4) != 0 || in[4] != HISTOGRAM_VERSION)
+    {
+        return 0;
+    }
+
+    size_t nb_letters = get_u16(in + 5);
+    size_t pos = 4 + 1 + 2;
+    int previous = -1;
+    for (size_t i = 0; i < nb_letters; i++)
+    {
+        uint64_t count;
+        size_t varint_size;
+        if (pos >= size || (int)in[pos] <= previous ||
+            (varint_size = get_varint(in + pos + 1, size - pos - 1, &count)) == 0 || count == 0 ||
+            count > (uint64_t)LLONG_MAX)
+        {
+            memset(histogram, 0, NB_SYMBOLS * sizeof(long long));
+            return 0;
+        }
+        previous = in[pos];
+        histogram[previous] = (long long)count;
+        pos += 1 + varint_size;
+    }
+    return pos;
+}
+
+int histogram_merge(long long *histogram, const long long *other)
+{
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        if (other[c] < 0 || histogram[c] > LLONG_MAX - other[c])
+        {
+            return -1;
+        }
+    }
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        histogram[c] += other[c];
+    }
+    return 0;
+}
+
+// Caps the code lengths at max_length: the over-long codes are shortened, then the
+// longest codes still under the cap are lengthened until the Kraft sum is back to 1
+static void limit_code_lengths(unsigned char *lengths, const long long *histogram, int max_length)
+{
+    unsigned long long kraft = 0, capacity = 1ULL << max_length;
+    int too_long = 0;
+
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        if (lengths[c] > max_length)
+        {
+            lengths[c] = (unsigned char)max_length;
+            too_long = 1;
+        }
+        if (lengths[c] > 0)
+        {
+            kraft += capacity >> lengths[c];
+        }
+    }
+    if (!too_long)
+    {
+        return;
+    }
+
+    while (kraft > capacity)
+    {
+        // The least frequent letter among the longest codes that can still grow
+        int best = -1;
+        for (int c = 0; c < NB_SYMBOLS; c++)
+        {
+            if (lengths[c] > 0 && lengths[c] < max_length &&
+                (best < 0 || lengths[c] > lengths[best] ||
+                 (lengths[c] == lengths[best] && histogram[c] < histogram[best])))
+            {
+                best = c;
+            }
+        }
+        kraft -= capacity >> (lengths[best] + 1);
+        lengths[best]++;
+    }
+}
+
+typedef struct WeightedLetter
+{
+    long long weight;
+    int letter;
+} WeightedLetter;
+
+static int compare_weighted_letters(const void *a, const void *b)
+{
+    const WeightedLetter *x = a, *y = b;
+    if (x->weight != y->weight)
+    {
+        return x->weight < y->weight ? -1 : 1;
+    }
+    return x->letter - y->letter;
+}
+
+// Optimal code lengths of the letters of the histogram, with the same merges as
+// huffman_tree_from_occurrences but on fixed arrays (two-queue method: the sorted
+// leaves and the merged nodes, created by increasing weight, are two sorted queues),
+// so that the block coders allocate nothing per table. Returns the number of letters
+static int huffman_code_lengths(const long long *histogram, unsigned char *lengths)
+{
+    WeightedLetter leaves[NB_SYMBOLS];
+    long long weight[2 * NB_SYMBOLS];
+    int parent[2 * NB_SYMBOLS];
+    int depth[2 * NB_SYMBOLS];
+    int nb_leaves = 0;
+
+    memset(lengths, 0, NB_SYMBOLS);
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        if (histogram[c] > 0)
+        {
+            leaves[nb_leaves].weight = histogram[c];
+            leaves[nb_leaves].letter = c;
+            nb_leaves++;
+        }
+    }
+    if (nb_leaves == 1)
+    {
+        // A single letter still needs a one-bit code
+        lengths[leaves[0].letter] = 1;
+    }
+    if (nb_leaves <= 1)
+    {
+        return nb_leaves;
+    }
+
+    qsort(leaves, (size_t)nb_leaves, sizeof(WeightedLetter), compare_weighted_letters);
+    for (int i = 0; i < nb_leaves; i++)
+    {
+        weight[i] = leaves[i].weight;
+    }
+
+    int next_leaf = 0, next_node = nb_leaves;
+    for (int node = nb_leaves; node < 2 * nb_leaves - 1; node++)
+    {
+        weight[node] = 0;
+        for (int k = 0; k < 2; k++)
+        {
+            int lightest;
+            if (next_leaf < nb_leaves && (next_node >= node || weight[next_leaf] <= weight[next_node]))
+            {
+                lightest = next_leaf++;
+            }
+            else
+            {
+                lightest = next_node++;
+            }
+            weight[node] += weight[lightest];
+            parent[lightest] = node;
+        }
+    }
+
+    // Parents come after their children, so the depths are filled from the root down
+    depth[2 * nb_leaves - 2] = 0;
+    for (int node = 2 * nb_leaves - 3; node >= 0; node--)
+    {
+        depth[node] = depth[parent[node]] + 1;
+    }
+    for (int i = 0; i < nb_leaves; i++)
+    {
+        lengths[leaves[i].letter] = (unsigned char)(depth[i] > 255 ? 255 : depth[i]);
+    }
+    return nb_leaves;
+}
+
+int code_table_from_histogram(const long long *histogram, CodeTable *table)
+{
+    unsigned char lengths[NB_SYMBOLS];
+
+    if (huffman_code_lengths(histogram, lengths) == 0)
+    {
+        return -1;
+    }
+
+    limit_code_lengths(lengths, histogram, MAX_CODE_LENGTH);
+    return code_table_from_lengths(lengths, table);
+}
+
+// Expands the lengths into the canonical codes and the decoding tables
+static int build_code_table(const unsigned char *lengths, CodeTable *table)
+{
+    unsigned long long kraft = 0;
+
+    memset(table, 0, sizeof(CodeTable));
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        if (lengths[c] > MAX_CODE_LENGTH)
+        {
+            return -1;
+        }
+        if (lengths[c] > 0)
+        {
+            table->lengths[c] = lengths[c];
+            table->count[lengths[c]]++;
+            table->nb_symbols++;
+            kraft += 1ULL << (MAX_CODE_LENGTH - lengths[c]);
+            if (lengths[c] > table->max_length)
+            {
+                table->max_length = lengths[c];
+            }
+        }
+    }
+    if (table->nb_symbols == 0 || kraft > (1ULL << MAX_CODE_LENGTH))
+    {
+        return -1;
+    }
+
+    unsigned int code = 0;
+    int index = 0;
+    for (int length = 1; length <= MAX_CODE_LENGTH; length++)
+    {
+        code = (code + (unsigned int)table->count[length - 1]) << 1;
+        table->first_code[length] = code;
+        table->first_index[length] = index;
+        index += table->count[length];
+    }
+
+    int next_index[MAX_CODE_LENGTH + 1];
+    memcpy(next_index, table->first_index, sizeof(next_index));
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        int length = table->lengths[c];
+        if (length > 0)
+        {
+            int rank = next_index[length]++;
+            table->symbols[rank] = (unsigned char)c;
+            table->codes[c] = table->first_code[length] + (unsigned int)(rank - table->first_index[length]);
+
+            if (length <= DECODE_TABLE_BITS)
+            {
+                unsigned int first = table->codes[c] << (DECODE_TABLE_BITS - length);
+                unsigned int last = first + (1u << (DECODE_TABLE_BITS - length));
+                for (unsigned int i = first; i < last; i++)
+                {
+                    table->fast[i] = (unsigned short)(c | (length << 8));
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int code_table_from_lengths(const unsigned char *lengths, CodeTable *table)
+{
+    uint64_t hash = code_lengths_hash(lengths);
+    if (table_cache_lookup(hash, lengths, table))
+    {
+        return 0;
+    }
+    if (build_code_table(lengths, table) != 0)
+    {
+        return -1;
+    }
+    table_cache_insert(hash, table);
+    return 0;
+}
+
+long long code_table_cost(const CodeTable *table, const long long *histogram)
+{
+    long long cost = 0;
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        if (histogram[c] > 0)
+        {
+            if (table->lengths[c] == 0)
+            {
+                return -1;
+            }
+            cost += histogram[c] * table->lengths[c];
+        }
+    }
+    return cost;
+}
+
+size_t code_table_serialized_size(const CodeTable *table)
+{
+    return 2 + 2 * (size_t)table->nb_symbols;
+}
+
+size_t code_table_serialize(const CodeTable *table, unsigned char *out)
+{
+    size_t pos = 2;
+    put_u16(out, (uint16_t)table->nb_symbols);
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        if (table->lengths[c] > 0)
+        {
+            out[pos++] = (unsigned char)c;
+            out[pos++] = table->lengths[c];
+        }
+    }
+    return pos;
+}
+
+size_t code_table_deserialize(const unsigned char *in, size_t size, CodeTable *table)
+{
+    unsigned char lengths[NB_SYMBOLS] = {0};
+    if (size < 2)
+    {
+        return 0;
+    }
+    size_t nb_symbols = get_u16(in);
+    if (nb_symbols == 0 || nb_symbols > NB_SYMBOLS || size < 2 + 2 * nb_symbols)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < nb_symbols; i++)
+    {
+        lengths[in[2 + 2 * i]] = in[3 + 2 * i];
+    }
+    if (code_table_from_lengths(lengths, table) != 0 || (size_t)table->nb_symbols != nb_symbols)
+    {
+        return 0;
+    }
+    return 2 + 2 * nb_symbols;
+}
+
+int ENCODE_KERNEL = ENCODE_KERNEL_AUTO;
+
+static int encode_best_kernel = ENCODE_KERNEL_SCALAR;
+static pthread_once_t encode_detect_once = PTHREAD_ONCE_INIT;
+
+static void encode_detect(void)
+{
+#ifdef ENCODE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512vbmi"))
+    {
+        encode_best_kernel = ENCODE_KERNEL_AVX512;
+    }
+    else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2"))
+    {
+        encode_best_kernel = ENCODE_KERNEL_AVX2;
+    }
+#endif
+}
+
+int encode_kernel_resolve(int kernel)
+{
+    pthread_once(&encode_detect_once, encode_detect);
+    if (kernel == ENCODE_KERNEL_AUTO || kernel > encode_best_kernel)
+    {
+        return encode_best_kernel;
+    }
+    return kernel < ENCODE_KERNEL_SCALAR ? ENCODE_KERNEL_SCALAR : kernel;
+}
+
+static const char *const encode_kernel_names[] = {"auto", "scalar", "avx2", "avx512"};
+
+const char *encode_kernel_name(int kernel)
+{
+    return kernel >= ENCODE_KERNEL_AUTO && kernel <= ENCODE_KERNEL_AVX512 ? encode_kernel_names[kernel] : "?";
+}
+
+int encode_kernel_parse(const char *name)
+{
+    for (int kernel = ENCODE_KERNEL_AUTO; kernel <= ENCODE_KERNEL_AVX512; kernel++)
+    {
+        if (strcmp(name, encode_kernel_names[kernel]) == 0)
+        {
+            return kernel;
+        }
+    }
+    return -1;
+}
+
+// Letters merged into one store: 4 codes of up to 14 bits, 2 of up to 28 bits, or 1
+static int encode_group_size(const CodeTable *table)
+{
+    return table->max_length <= BIT_WRITER_WIDE_BITS / 4 ? 4 : table->max_length <= BIT_WRITER_WIDE_BITS / 2 ? 2 : 1;
+}
+
+// The kernels work on a local copy of the writer: stores through the output bytes could
+// alias *writer, which would then be reloaded after each of them
+static void encode_scalar(const unsigned char *data, size_t length, const CodeTable *table, BitWriter *shared_writer)
+{
+    BitWriter local = *shared_writer, *writer = &local;
+    int group = encode_group_size(table);
+    size_t i = 0;
+    for (; i + (size_t)group <= length; i += (size_t)group)
+    {
+        unsigned long long value = 0;
+        int nb_bits = 0;
+        for (int k = 0; k < group; k++)
+        {
+            value = (value << table->lengths[data[i + k]]) | table->codes[data[i + k]];
+            nb_bits += table->lengths[data[i + k]];
+        }
+        bit_writer_put_wide(writer, value, nb_bits);
+    }
+    for (; i < length; i++)
+    {
+        bit_writer_put_wide(writer, table->codes[data[i]], table->lengths[data[i]]);
+    }
+    *shared_writer = local;
+}
+
+// The kernels below code 4 letters per store, for codes of at most BIT_WRITER_WIDE_BITS / 4
+// bits, and return how many letters they coded (encode_scalar does the rest). entries
+// holds code << 8 | length for each letter, one load per letter
+
+static size_t encode_fours(const unsigned char *data, size_t length, const unsigned int *entries,
+                           BitWriter *shared_writer)
+{
+    BitWriter local = *shared_writer, *writer = &local;
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4)
+    {
+        unsigned int e0 = entries[data[i]], e1 = entries[data[i + 1]];
+        unsigned int e2 = entries[data[i + 2]], e3 = entries[data[i + 3]];
+        unsigned long long value = (unsigned long long)(e0 >> 8) << (e1 & 0xFF) | (e1 >> 8);
+        value = (value << (e2 & 0xFF) | (e2 >> 8)) << (e3 & 0xFF) | (e3 >> 8);
+        bit_writer_put_wide(writer, value, (int)((e0 & 0xFF) + (e1 & 0xFF) + (e2 & 0xFF) + (e3 & 0xFF)));
+    }
+    *shared_writer = local;
+    return i;
+}
+
+#ifdef ENCODE_X86
+// 8 letters at a time. Each 64-bit lane holds two letters, the first in its low half: the
+// lane becomes the code of the first followed by the code of the second, then the lanes 0
+// and 2 take the codes of the lanes 1 and 3 after their own. The entries are loaded one by
+// one: a gather was slower than that on the processors we measured (microcode mitigations)
+__attribute__((target("avx2,bmi2"))) static size_t encode_avx2(const unsigned char *data, size_t length,
+                                                               const unsigned int *entries, BitWriter *shared_writer)
+{
+    BitWriter local = *shared_writer, *writer = &local;
+    const __m256i low_half = _mm256_set1_epi64x(0xFFFFFFFF);
+    const __m256i low_byte = _mm256_set1_epi32(0xFF);
+    unsigned long long values[4], sizes[4];
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8)
+    {
+        __m256i found = _mm256_setr_epi32((int)entries[data[i]], (int)entries[data[i + 1]], (int)entries[data[i + 2]],
+                                          (int)entries[data[i + 3]], (int)entries[data[i + 4]], (int)entries[data[i + 5]],
+                                          (int)entries[data[i + 6]], (int)entries[data[i + 7]]);
+        __m256i codes = _mm256_srli_epi32(found, 8);
+        __m256i code_lengths = _mm256_and_si256(found, low_byte);
+        __m256i pairs = _mm256_or_si256(
+            _mm256_sllv_epi64(_mm256_and_si256(codes, low_half), _mm256_srli_epi64(code_lengths, 32)),
+            _mm256_srli_epi64(codes, 32));
+        __m256i pair_sizes =
+            _mm256_add_epi64(_mm256_and_si256(code_lengths, low_half), _mm256_srli_epi64(code_lengths, 32));
+        __m256i next = _mm256_shuffle_epi32(pairs, _MM_SHUFFLE(1, 0, 3, 2));
+        __m256i next_sizes = _mm256_shuffle_epi32(pair_sizes, _MM_SHUFFLE(1, 0, 3, 2));
+        _mm256_storeu_si256((__m256i *)values, _mm256_or_si256(_mm256_sllv_epi64(pairs, next_sizes), next));
+        _mm256_storeu_si256((__m256i *)sizes, _mm256_add_epi64(pair_sizes, next_sizes));
+        bit_writer_put_wide(writer, values[0], (int)sizes[0]);
+        bit_writer_put_wide(writer, values[2], (int)sizes[2]);
+    }
+    *shared_writer = local;
+    return i;
+}
+
+// 64 letters at a time, without gathers either: the low and high bytes of the codes and the lengths come from 256-byte tables
+// held in registers, looked up with byte permutes (AVX-512 VBMI). The codes are widened
+// to 16 bits, merged in pairs in the 32-bit lanes, then in fours in the 64-bit lanes
+__attribute__((target("avx512f,avx512bw,avx512vbmi,bmi2"))) static size_t
+encode_avx512(const unsigned char *data, size_t length, const CodeTable *table, BitWriter *shared_writer)
+{
+    BitWriter local = *shared_writer, *writer = &local;
+    unsigned char bytes[3][NB_SYMBOLS];
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        bytes[0][c] = (unsigned char)table->codes[c];
+        bytes[1][c] = (unsigned char)(table->codes[c] >> 8);
+        bytes[2][c] = table->lengths[c];
+    }
+    __m512i lookup[3][4];
+    for (int t = 0; t < 3; t++)
+    {
+        for (int q = 0; q < 4; q++)
+        {
+            lookup[t][q] = _mm512_loadu_si512((const void *)(bytes[t] + 64 * q));
+        }
+    }
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i low_16 = _mm512_set1_epi32(0xFFFF);
+    const __m512i low_32 = _mm512_set1_epi64(0xFFFFFFFF);
+    // The unpacks interleave the 128-bit lanes: these put the fours back in the text order
+    const __m512i first_order = _mm512_setr_epi64(0, 1, 8, 9, 2, 3, 10, 11);
+    const __m512i second_order = _mm512_setr_epi64(4, 5, 12, 13, 6, 7, 14, 15);
+    unsigned long long values[16], sizes[16];
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64)
+    {
+        __m512i letters = _mm512_loadu_si512((const void *)(data + i));
+        __mmask64 upper = _mm512_movepi8_mask(letters);
+        __m512i found[3];
+        for (int t = 0; t < 3; t++)
+        {
+            found[t] = _mm512_mask_blend_epi8(upper, _mm512_permutex2var_epi8(lookup[t][0], letters, lookup[t][1]),
+                                              _mm512_permutex2var_epi8(lookup[t][2], letters, lookup[t][3]));
+        }
+        __m512i fours[2], four_sizes[2];
+        for (int half = 0; half < 2; half++)
+        {
+            __m512i codes = half == 0 ? _mm512_unpacklo_epi8(found[0], found[1]) : _mm512_unpackhi_epi8(found[0], found[1]);
+            __m512i code_lengths = half == 0 ? _mm512_unpacklo_epi8(found[2], zero) : _mm512_unpackhi_epi8(found[2], zero);
+            __m512i pairs = _mm512_or_si512(
+                _mm512_sllv_epi32(_mm512_and_si512(codes, low_16), _mm512_srli_epi32(code_lengths, 16)),
+                _mm512_srli_epi32(codes, 16));
+            __m512i pair_sizes =
+                _mm512_add_epi32(_mm512_and_si512(code_lengths, low_16), _mm512_srli_epi32(code_lengths, 16));
+            fours[half] = _mm512_or_si512(
+                _mm512_sllv_epi64(_mm512_and_si512(pairs, low_32), _mm512_srli_epi64(pair_sizes, 32)),
+                _mm512_srli_epi64(pairs, 32));
+            four_sizes[half] =
+                _mm512_add_epi64(_mm512_and_si512(pair_sizes, low_32), _mm512_srli_epi64(pair_sizes, 32));
+        }
+        _mm512_storeu_si512((void *)values, _mm512_permutex2var_epi64(fours[0], first_order, fours[1]));
+        _mm512_storeu_si512((void *)(values + 8), _mm512_permutex2var_epi64(fours[0], second_order, fours[1]));
+        _mm512_storeu_si512((void *)sizes, _mm512_permutex2var_epi64(four_sizes[0], first_order, four_sizes[1]));
+        _mm512_storeu_si512((void *)(sizes + 8), _mm512_permutex2var_epi64(four_sizes[0], second_order, four_sizes[1]));
+        for (int k = 0; k < 16; k++)
+        {
+            bit_writer_put_wide(writer, values[k], (int)sizes[k]);
+        }
+    }
+    *shared_writer = local;
+    return i;
+}
+#endif
+
+unsigned long long encode_buffer(const unsigned char *data, size_t length, const CodeTable *table, unsigned char *out)
+{
+    BitWriter writer;
+    bit_writer_init(&writer, out);
+    size_t done = 0;
+    if (encode_group_size(table) == 4 && length >= ENCODE_KERNEL_MIN_LENGTH)
+    {
+        unsigned int entries[NB_SYMBOLS];
+        for (int c = 0; c < NB_SYMBOLS; c++)
+        {
+            entries[c] = table->codes[c] << 8 | table->lengths[c];
+        }
+        switch (encode_kernel_resolve(ENCODE_KERNEL))
+        {
+#ifdef ENCODE_X86
+        case ENCODE_KERNEL_AVX512:
+            done = encode_avx512(data, length, table, &writer);
+            break;
+        case ENCODE_KERNEL_AVX2:
+            done = encode_avx2(data, length, entries, &writer);
+            break;
+#endif
+        default:
+            done = encode_fours(data, length, entries, &writer);
+        }
+    }
+    encode_scalar(data + done, length - done, table, &writer);
+    unsigned long long nb_bits = 8ULL * writer.pos + (unsigned long long)writer.nb_bits;
+    bit_writer_flush(&writer);
+    return nb_bits;
+}
+
+// Decodes the letter whose code starts at bit *bit_pos of in (the 8 bytes from
+// in + *bit_pos / 8 must be readable). An invalid code sets *invalid and skips
+// max_length bits, so that the caller only has to test the flag at the end
+static inline unsigned char decode_letter(const CodeTable *table, const unsigned char *in,
+                                          unsigned long long *bit_pos, int *invalid)
+{
+    unsigned long long peek = load_be64(in + (*bit_pos >> 3)) << (*bit_pos & 7);
+    unsigned int entry = table->fast[peek >> (64 - DECODE_TABLE_BITS)];
+    if (entry >> 8)
+    {
+        *bit_pos += entry >> 8;
+        return (unsigned char)entry;
+    }
+
+    for (int length = DECODE_TABLE_BITS + 1; length <= table->max_length; length++)
+    {
+        unsigned int code = (unsigned int)(peek >> (64 - length));
+        if (code - table->first_code[length] < (unsigned int)table->count[length])
+        {
+            *bit_pos += (unsigned long long)length;
+            return table->symbols[table->first_index[length] + (int)(code - table->first_code[length])];
+        }
+    }
+    *invalid = 1;
+    *bit_pos += (unsigned long long)table->max_length;
+    return 0;
+}
+
+int decode_buffer(const unsigned char *in, unsigned long long nb_bits, const CodeTable *table, unsigned char *out,
+                  size_t raw_size)
+{
+    size_t in_size = (size_t)((nb_bits + 7) / 8);
+    unsigned long long bit_pos = 0;
+    unsigned long long max_length = (unsigned long long)table->max_length;
+    int invalid = 0;
+    size_t i = 0;
+
+    // Bulk loop: as long as every code of the next run of letters, even at the maximal
+    // length, starts 8 bytes before the end of the input, nothing needs to be checked
+    if (in_size >= 8)
+    {
+        unsigned long long safe_bits = 8ULL * (in_size - 8);
+        while (i < raw_size && bit_pos <= safe_bits)
+        {
+            size_t run = (size_t)((safe_bits - bit_pos) / max_length + 1);
+            if (run > raw_size - i)
+            {
+                run = raw_size - i;
+            }
+            for (size_t end = i + run; i < end; i++)
+            {
+                out[i] = decode_letter(table, in, &bit_pos, &invalid);
+            }
+        }
+    }
+
+    // Tail loop: the last bytes are copied in a zero-padded buffer and every code is checked
+    if (i < raw_size)
+    {
+        unsigned char tail[32] = {0};
+        size_t tail_start = (size_t)(bit_pos >> 3);
+        memcpy(tail, in + tail_start, in_size - tail_start);
+        unsigned long long tail_pos = bit_pos & 7;
+        unsigned long long tail_bits = nb_bits - 8ULL * tail_start;
+
+        for (; i < raw_size; i++)
+        {
+            out[i] = decode_letter(table, tail, &tail_pos, &invalid);
+            if (tail_pos > tail_bits || invalid)
+            {
+                return -1;
+            }
+        }
+        bit_pos = 8ULL * tail_start + tail_pos;
+    }
+
+    return (invalid || bit_pos != nb_bits) ? -1 : 0;
+}
@@ -0,0 +1,1191 @@
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CONTAINER_MMAP 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "container.h"
+#include "memstats.h"
+#include "byteio.h"
+#include "trace.h"
+
+int container_write_header(FILE *output)
+{
+    unsigned char header[CONTAINER_HEADER_SIZE];
+    memcpy(header, CONTAINER_MAGIC, 4);
+    header[4] = CONTAINER_VERSION;
+    return fwrite(header, 1, CONTAINER_HEADER_SIZE, output) == CONTAINER_HEADER_SIZE ? 0 : -1;
+}
+
+static void put_index_entry(unsigned char *entry, const BlockInfo *block)
+{
+    put_u64(entry, block->offset);
+    put_u64(entry + 8, block->raw_offset);
+    put_u64(entry + 16, block->raw_size);
+    put_u32(entry + 24, block->table_block);
+}
+
+static void put_trailer(unsigned char *trailer, const ContainerInfo *info)
+{
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        put_u64(trailer + 8 * c, (unsigned long long)info->histogram[c]);
+    }
+    put_u64(trailer + 8 * NB_SYMBOLS, info->raw_size);
+    put_u64(trailer + 8 * NB_SYMBOLS + 8, info->index_offset);
+    put_u32(trailer + 8 * NB_SYMBOLS + 16, info->nb_blocks);
+    put_u32(trailer + 8 * NB_SYMBOLS + 20, info->block_size);
+    memcpy(trailer + 8 * NB_SYMBOLS + 24, CONTAINER_TRAILER_MAGIC, 4);
+}
+
+int container_write_index_and_trailer(FILE *container, const ContainerInfo *info)
+{
+    unsigned char entry[CONTAINER_INDEX_ENTRY_SIZE];
+    unsigned char trailer[CONTAINER_TRAILER_SIZE];
+
+    if (fseeko(container, (off_t)info->index_offset, SEEK_SET) != 0)
+    {
+        return -1;
+    }
+    for (unsigned int i = 0; i < info->nb_blocks; i++)
+    {
+        put_index_entry(entry, &info->blocks[i]);
+        if (fwrite(entry, 1, sizeof(entry), container) != sizeof(entry))
+        {
+            return -1;
+        }
+    }
+
+    put_trailer(trailer, info);
+    if (fwrite(trailer, 1, sizeof(trailer), container) != sizeof(trailer))
+    {
+        return -1;
+    }
+    return fflush(container) == 0 ? 0 : -1;
+}
+
+TransformChain CONTAINER_TRANSFORMS = {0, {0}};
+const TableSet *CONTAINER_TABLE_SET = NULL;
+int CONTAINER_BACKEND = CONTAINER_BACKEND_HUFFMAN;
+
+int container_backend_parse(const char *name)
+{
+    static const char *const names[] = {"huffman", "tans", "auto"};
+    for (int backend = 0; backend < 3; backend++)
+    {
+        if (strcmp(name, names[backend]) == 0)
+        {
+            return backend;
+        }
+    }
+    return -1;
+}
+
+// Plane k of the coded bytes of a BLOCK_PLANES block, starting at *start: the bytes left
+// after the last whole element go with the last plane
+static size_t plane_size(const BlockHeader *header, unsigned int k, size_t *start)
+{
+    size_t n = (size_t)header->coded_size / header->nb_planes;
+    *start = k * n;
+    return k + 1 < header->nb_planes ? n : (size_t)header->coded_size - k * n;
+}
+
+unsigned long long container_planes_bits(const BlockHeader *header)
+{
+    unsigned long long bits = 0;
+    for (unsigned int k = 0; k < header->nb_planes; k++)
+    {
+        bits += (header->plane_bits[k] + 7) / 8 * 8;
+    }
+    return bits;
+}
+
+size_t container_parse_block_header(const unsigned char *in, size_t size, BlockHeader *header, CodeTable *table)
+{
+    if (size < CONTAINER_BLOCK_HEADER_SIZE)
+    {
+        return 0;
+    }
+    int table_flags = in[0] & BLOCK_TABLE_FLAGS;
+    if ((in[0] & ~(BLOCK_TABLE_FLAGS | BLOCK_TRANSFORMED)) != 0 || (table_flags & (table_flags - 1)) != 0)
+    {
+        return 0;
+    }
+    header->flags = in[0];
+    header->raw_size = get_u64(in + 1);
+    header->payload_bits = get_u64(in + 9);
+    header->coded_size = header->raw_size;
+    header->transforms.nb_stages = 0;
+    header->set_table = -1;
+    header->backend = CONTAINER_BACKEND_HUFFMAN;
+    header->nb_planes = 1;
+
+    size_t header_size = CONTAINER_BLOCK_HEADER_SIZE;
+    if (header->flags & BLOCK_TRANSFORMED)
+    {
+        TransformChain *chain = &header->transforms;
+        if (size < header_size + 1 || in[header_size] == 0 || in[header_size] > TRANSFORM_MAX_STAGES ||
+            size < header_size + 1 + in[header_size] + 8)
+        {
+            return 0;
+        }
+        chain->nb_stages = in[header_size];
+        memcpy(chain->stages, in + header_size + 1, chain->nb_stages);
+        header_size += 1 + chain->nb_stages;
+        header->coded_size = get_u64(in + header_size);
+        header_size += 8;
+        if (!transform_chain_valid(chain) || header->coded_size > header->raw_size + TRANSFORM_MAX_GROWTH)
+        {
+            return 0;
+        }
+    }
+    if (header->payload_bits > header->coded_size * MAX_CODE_LENGTH)
+    {
+        return 0;
+    }
+
+    if (header->flags & BLOCK_SET_TABLE)
+    {
+        if (size < header_size + CONTAINER_SET_TABLE_SIZE)
+        {
+            return 0;
+        }
+        header->set_table = in[header_size + 4];
+        if (CONTAINER_TABLE_SET == NULL || get_u32(in + header_size) != CONTAINER_TABLE_SET->id ||
+            header->set_table >= (int)CONTAINER_TABLE_SET->nb_tables)
+        {
+            printf("Error: a block is coded with a table set that is not loaded (set %08x).\n",
+                   (unsigned int)get_u32(in + header_size));
+            return 0;
+        }
+        if (table != NULL)
+        {
+            *table = CONTAINER_TABLE_SET->tables[header->set_table];
+        }
+        header_size += CONTAINER_SET_TABLE_SIZE;
+    }
+    if (header->flags & BLOCK_TANS)
+    {
+        size_t frequencies_size = tans_deserialize(in + header_size, size - header_size, &header->frequencies);
+        if (frequencies_size == 0)
+        {
+            return 0;
+        }
+        header->backend = CONTAINER_BACKEND_TANS;
+        if (table != NULL)
+        {
+            memset(table, 0, sizeof(CodeTable));
+        }
+        header_size += frequencies_size;
+    }
+    if (header->flags & BLOCK_PLANES)
+    {
+        header->nb_planes = transform_planes(&header->transforms);
+        if (header->nb_planes == 1)
+        {
+            return 0;
+        }
+        for (unsigned int k = 0; k < header->nb_planes; k++)
+        {
+            size_t start;
+            size_t plane = plane_size(header, k, &start);
+            if (size < header_size + 8 + 2)
+            {
+                return 0;
+            }
+            header->plane_bits[k] = get_u64(in + header_size);
+            header_size += 8;
+            memset(header->plane_lengths[k], 0, NB_SYMBOLS);
+            if (get_u16(in + header_size) == 0)
+            {
+                if (plane > 0 || header->plane_bits[k] > 0)
+                {
+                    return 0;
+                }
+                header_size += 2;
+                continue;
+            }
+            CodeTable plane_table;
+            size_t table_size = code_table_deserialize(in + header_size, size - header_size, &plane_table);
+            if (table_size == 0 || plane == 0 || header->plane_bits[k] > (unsigned long long)plane * MAX_CODE_LENGTH)
+            {
+                return 0;
+            }
+            memcpy(header->plane_lengths[k], plane_table.lengths, NB_SYMBOLS);
+            header_size += table_size;
+        }
+        if (container_planes_bits(header) != header->payload_bits)
+        {
+            return 0;
+        }
+        if (table != NULL)
+        {
+            memset(table, 0, sizeof(CodeTable));
+        }
+    }
+    if (header->flags & BLOCK_NEW_TABLE)
+    {
+        CodeTable block_table;
+        size_t table_size = code_table_deserialize(in + header_size, size - header_size, &block_table);
+        if (table_size == 0)
+        {
+            return 0;
+        }
+        if (table != NULL)
+        {
+            *table = block_table;
+        }
+        header_size += table_size;
+    }
+    return header_size;
+}
+
+// Reads a block header and its code table, if any, from the file, which is left at
+// the start of the payload
+static int read_block_header(FILE *container, BlockHeader *block_header, CodeTable *table)
+{
+    unsigned char header[CONTAINER_MAX_BLOCK_HEADER_SIZE];
+    size_t size = CONTAINER_BLOCK_HEADER_SIZE;
+
+    if (fread(header, 1, size, container) != size)
+    {
+        return -1;
+    }
+    if (header[0] & BLOCK_TRANSFORMED)
+    {
+        if (fread(header + size, 1, 1, container) != 1)
+        {
+            return -1;
+        }
+        size_t nb_stages = header[size];
+        size += 1;
+        if (nb_stages > TRANSFORM_MAX_STAGES || fread(header + size, 1, nb_stages + 8, container) != nb_stages + 8)
+        {
+            return -1;
+        }
+        size += nb_stages + 8;
+    }
+    if (header[0] & BLOCK_SET_TABLE)
+    {
+        if (fread(header + size, 1, CONTAINER_SET_TABLE_SIZE, container) != CONTAINER_SET_TABLE_SIZE)
+        {
+            return -1;
+        }
+        size += CONTAINER_SET_TABLE_SIZE;
+    }
+    if (header[0] & BLOCK_TANS)
+    {
+        if (fread(header + size, 1, 3, container) != 3)
+        {
+            return -1;
+        }
+        size_t nb_symbols = get_u16(header + size + 1);
+        size += 3;
+        if (nb_symbols > NB_SYMBOLS || fread(header + size, 1, 3 * nb_symbols, container) != 3 * nb_symbols)
+        {
+            return -1;
+        }
+        size += 3 * nb_symbols;
+    }
+    if (header[0] & BLOCK_PLANES)
+    {
+        // As many tables as the shuffle ending the transforms makes planes
+        TransformChain chain = {0, {0}};
+        if (header[0] & BLOCK_TRANSFORMED)
+        {
+            chain.nb_stages = header[CONTAINER_BLOCK_HEADER_SIZE];
+            memcpy(chain.stages, header + CONTAINER_BLOCK_HEADER_SIZE + 1, chain.nb_stages);
+        }
+        for (unsigned int k = 0; k < transform_planes(&chain); k++)
+        {
+            if (fread(header + size, 1, 8 + 2, container) != 8 + 2)
+            {
+                return -1;
+            }
+            size_t nb_symbols = get_u16(header + size + 8);
+            size += 8 + 2;
+            if (nb_symbols > NB_SYMBOLS || fread(header + size, 1, 2 * nb_symbols, container) != 2 * nb_symbols)
+            {
+                return -1;
+            }
+            size += 2 * nb_symbols;
+        }
+    }
+    if (header[0] & BLOCK_NEW_TABLE)
+    {
+        if (fread(header + size, 1, 2, container) != 2)
+        {
+            return -1;
+        }
+        size_t nb_symbols = get_u16(header + size);
+        size += 2;
+        if (nb_symbols > NB_SYMBOLS || fread(header + size, 1, 2 * nb_symbols, container) != 2 * nb_symbols)
+        {
+            return -1;
+        }
+        size += 2 * nb_symbols;
+    }
+    return container_parse_block_header(header, size, block_header, table) == size ? 0 : -1;
+}
+
+const unsigned char *container_transform_block(const unsigned char *data, size_t length, unsigned char *coded,
+                                               BlockHeader *header)
+{
+    header->raw_size = length;
+    header->coded_size = length;
+    header->transforms.nb_stages = 0;
+    header->set_table = -1;
+    header->backend = CONTAINER_BACKEND_HUFFMAN;
+    header->nb_planes = 1;
+    if (CONTAINER_TRANSFORMS.nb_stages == 0)
+    {
+        return data;
+    }
+    long long size = transform_forward(&CONTAINER_TRANSFORMS, data, length, coded, CONTAINER_MAX_CODED_SIZE(length));
+    if (size < 0)
+    {
+        TRACE(TRACE_DETAIL, "block of %lld bytes stored without its transforms", length);
+        return data;
+    }
+    header->coded_size = (unsigned long long)size;
+    header->transforms = CONTAINER_TRANSFORMS;
+    header->nb_planes = transform_planes(&header->transforms);
+    for (unsigned int k = 0; k < header->nb_planes && header->nb_planes > 1; k++)
+    {
+        size_t start;
+        size_t plane = plane_size(header, k, &start);
+        long long histogram[NB_SYMBOLS] = {0};
+        CodeTable table;
+        histogram_add_buffer(histogram, coded + start, plane);
+        memset(header->plane_lengths[k], 0, NB_SYMBOLS);
+        header->plane_bits[k] = 0;
+        if (plane > 0 && code_table_from_histogram(histogram, &table) == 0)
+        {
+            memcpy(header->plane_lengths[k], table.lengths, NB_SYMBOLS);
+            header->plane_bits[k] = (unsigned long long)code_table_cost(&table, histogram);
+        }
+    }
+    return coded;
+}
+
+// Decodes the payload of a block into its header->coded_size symbols
+static int decode_symbols(const unsigned char *payload, const BlockHeader *header, const CodeTable *table,
+                          unsigned char *out)
+{
+    size_t pos = 0;
+    for (unsigned int k = 0; k < header->nb_planes && header->nb_planes > 1; k++)
+    {
+        size_t start;
+        size_t plane = plane_size(header, k, &start);
+        CodeTable plane_table;
+        if (plane > 0 && (code_table_from_lengths(header->plane_lengths[k], &plane_table) != 0 ||
+                          decode_buffer(payload + pos, header->plane_bits[k], &plane_table, out + start, plane) != 0))
+        {
+            return -1;
+        }
+        pos += (size_t)((header->plane_bits[k] + 7) / 8);
+    }
+    if (header->nb_planes > 1)
+    {
+        return 0;
+    }
+    if (header->backend == CONTAINER_BACKEND_TANS)
+    {
+        return tans_decode(payload, header->payload_bits, &header->frequencies, out, (size_t)header->coded_size);
+    }
+    if (table->nb_symbols == 0 && header->coded_size > 0)
+    {
+        // A block that reuses the table of a tANS block
+        return -1;
+    }
+    return decode_buffer(payload, header->payload_bits, table, out, (size_t)header->coded_size);
+}
+
+int container_decode_block(const unsigned char *payload, const BlockHeader *header, const CodeTable *table,
+                           unsigned char *out)
+{
+    if (!(header->flags & BLOCK_TRANSFORMED))
+    {
+        return decode_symbols(payload, header, table, out);
+    }
+    unsigned char *coded = mem_alloc((size_t)header->coded_size + 1);
+    int status = coded != NULL && decode_symbols(payload, header, table, coded) == 0 &&
+                         transform_inverse(&header->transforms, coded, (size_t)header->coded_size, out,
+                                           (size_t)header->raw_size) == 0
+                     ? 0
+                     : -1;
+    mem_free(coded);
+    return status;
+}
+
+int container_choose_table(const ContainerInfo *info, const long long *block_histogram, CodeTable *last_table,
+                           int *set_table)
+{
+    long long merged[NB_SYMBOLS];
+    CodeTable fresh;
+
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        merged[c] = info->histogram[c] + block_histogram[c];
+    }
+    code_table_from_histogram(merged, &fresh);
+
+    long long cost_last = info->nb_blocks > 0 ? code_table_cost(last_table, block_histogram) : -1;
+    long long cost_fresh = code_table_cost(&fresh, block_histogram) + 8 * (long long)code_table_serialized_size(&fresh);
+    long long cost_set = -1;
+    int best_set = CONTAINER_TABLE_SET != NULL ? table_set_best(CONTAINER_TABLE_SET, block_histogram, &cost_set) : -1;
+    if (best_set >= 0)
+    {
+        cost_set += 8 * CONTAINER_SET_TABLE_SIZE;
+    }
+    TRACE(TRACE_DETAIL, "block %lld: %lld bits with the last table, %lld with a new one", info->nb_blocks, cost_last,
+          cost_fresh);
+    TRACE(TRACE_DETAIL, "block %lld: %lld bits with set table %lld", info->nb_blocks, cost_set, best_set);
+    if (cost_last >= 0 && cost_last <= cost_fresh && (best_set < 0 || cost_last <= cost_set))
+    {
+        return 0;
+    }
+    if (best_set >= 0 && cost_set <= cost_fresh)
+    {
+        *last_table = CONTAINER_TABLE_SET->tables[best_set];
+        *set_table = best_set;
+        return 1;
+    }
+    *last_table = fresh;
+    *set_table = -1;
+    return 1;
+}
+
+int container_choose_backend(const long long *block_histogram, CodeTable *last_table, int new_table,
+                             BlockHeader *header)
+{
+    header->backend = CONTAINER_BACKEND_HUFFMAN;
+    if (header->nb_planes > 1)
+    {
+        memset(last_table, 0, sizeof(CodeTable));
+        return 1;
+    }
+    if (CONTAINER_BACKEND == CONTAINER_BACKEND_HUFFMAN ||
+        tans_normalize(block_histogram, TANS_TABLE_LOG, &header->frequencies) != 0)
+    {
+        return 0;
+    }
+    if (CONTAINER_BACKEND == CONTAINER_BACKEND_AUTO)
+    {
+        long long table_size = !new_table ? 0
+                               : header->set_table >= 0
+                                   ? CONTAINER_SET_TABLE_SIZE
+                                   : (long long)code_table_serialized_size(last_table);
+        long long cost_huffman = code_table_cost(last_table, block_histogram) + 8 * table_size;
+        long long cost_tans = tans_cost(&header->frequencies, block_histogram) +
+                              8 * (long long)tans_serialized_size(&header->frequencies);
+        TRACE(TRACE_DETAIL, "block of %lld bits with Huffman codes, %lld with tANS", cost_huffman, cost_tans);
+        if (cost_huffman <= cost_tans)
+        {
+            return 0;
+        }
+    }
+    header->backend = CONTAINER_BACKEND_TANS;
+    memset(last_table, 0, sizeof(CodeTable));
+    return 1;
+}
+
+unsigned long long container_encode_block(const unsigned char *symbols, const BlockHeader *header,
+                                          const CodeTable *table, unsigned char *out)
+{
+    if (header->backend == CONTAINER_BACKEND_TANS)
+    {
+        return tans_encode(symbols, (size_t)header->coded_size, &header->frequencies, out);
+    }
+    if (header->nb_planes == 1)
+    {
+        return encode_buffer(symbols, (size_t)header->coded_size, table, out);
+    }
+    // Each plane from the byte after the previous one: what encode_buffer writes past its
+    // bits is overwritten by the next plane
+    size_t pos = 0;
+    for (unsigned int k = 0; k < header->nb_planes; k++)
+    {
+        size_t start;
+        size_t plane = plane_size(header, k, &start);
+        CodeTable plane_table;
+        if (plane > 0 && code_table_from_lengths(header->plane_lengths[k], &plane_table) == 0)
+        {
+            pos += (size_t)((encode_buffer(symbols + start, plane, &plane_table, out + pos) + 7) / 8);
+        }
+    }
+    return 8 * (unsigned long long)pos;
+}
+
+size_t container_block_header(unsigned char *out, const BlockHeader *header, const CodeTable *new_table)
+{
+    size_t header_size = CONTAINER_BLOCK_HEADER_SIZE;
+    const TransformChain *chain = &header->transforms;
+    int planes = header->nb_planes > 1;
+    int tans = !planes && header->backend == CONTAINER_BACKEND_TANS;
+    int set_table = !planes && !tans && new_table != NULL && header->set_table >= 0;
+    out[0] = (planes ? BLOCK_PLANES
+              : tans ? BLOCK_TANS
+              : new_table != NULL ? (set_table ? BLOCK_SET_TABLE : BLOCK_NEW_TABLE)
+                                  : 0) |
+             (chain->nb_stages > 0 ? BLOCK_TRANSFORMED : 0);
+    put_u64(out + 1, header->raw_size);
+    put_u64(out + 9, header->payload_bits);
+    if (chain->nb_stages > 0)
+    {
+        out[header_size] = chain->nb_stages;
+        memcpy(out + header_size + 1, chain->stages, chain->nb_stages);
+        header_size += 1 + chain->nb_stages;
+        put_u64(out + header_size, header->coded_size);
+        header_size += 8;
+    }
+    if (planes)
+    {
+        for (unsigned int k = 0; k < header->nb_planes; k++)
+        {
+            size_t table_start = header_size + 8;
+            put_u64(out + header_size, header->plane_bits[k]);
+            header_size += 8 + 2;
+            for (int c = 0; c < NB_SYMBOLS; c++)
+            {
+                if (header->plane_lengths[k][c] > 0)
+                {
+                    out[header_size++] = (unsigned char)c;
+                    out[header_size++] = header->plane_lengths[k][c];
+                }
+            }
+            put_u16(out + table_start, (uint16_t)((header_size - table_start - 2) / 2));
+        }
+    }
+    else if (tans)
+    {
+        header_size += tans_serialize(&header->frequencies, out + header_size);
+    }
+    else if (set_table)
+    {
+        put_u32(out + header_size, CONTAINER_TABLE_SET->id);
+        out[header_size + 4] = (unsigned char)header->set_table;
+        header_size += CONTAINER_SET_TABLE_SIZE;
+    }
+    else if (new_table != NULL)
+    {
+        header_size += code_table_serialize(new_table, out + header_size);
+    }
+    return header_size;
+}
+
+int container_add_block(ContainerInfo *info, unsigned long long offset, unsigned long long raw_size,
+                        unsigned int table_block, const long long *block_histogram)
+{
+    if (info->nb_blocks == info->capacity)
+    {
+        unsigned int capacity = info->capacity < 16 ? 16 : 2 * info->capacity;
+        BlockInfo *blocks = mem_realloc(info->blocks, capacity * sizeof(BlockInfo));
+        if (blocks == NULL)
+        {
+            return -1;
+        }
+        info->blocks = blocks;
+        info->capacity = capacity;
+    }
+    BlockInfo *blocks = info->blocks;
+    blocks[info->nb_blocks].offset = offset;
+    blocks[info->nb_blocks].raw_offset = info->raw_size;
+    blocks[info->nb_blocks].raw_size = raw_size;
+    blocks[info->nb_blocks].table_block = table_block;
+
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        info->histogram[c] += block_histogram[c];
+    }
+    info->raw_size += raw_size;
+    info->nb_blocks++;
+    return 0;
+}
+
+unsigned int container_fit_block_size(unsigned int max_block_size, unsigned int nb_buffers, long long reserved,
+                                      long long input_size)
+{
+    long long available = memory_available();
+    if (available < 0)
+    {
+        return max_block_size;
+    }
+    available -= reserved;
+
+    unsigned int block_size = max_block_size;
+    for (;;)
+    {
+        // Growing the index by doubling needs up to three times its final size
+        long long index = input_size >= 0
+                              ? 3 * (input_size / block_size + 2) * (long long)sizeof(BlockInfo)
+                              : available / 4;
+        long long transforms = CONTAINER_TRANSFORMS.nb_stages > 0
+                                   ? nb_buffers * (long long)CONTAINER_MAX_CODED_SIZE(block_size) +
+                                         TRANSFORM_MEMORY(block_size)
+                                   : 0;
+        if (nb_buffers * CONTAINER_BLOCK_MEMORY(block_size) + transforms + index <= available)
+        {
+            return block_size;
+        }
+        if (block_size / 2 < CONTAINER_MIN_BLOCK_SIZE)
+        {
+            return 0;
+        }
+        block_size /= 2;
+    }
+}
+
+long long container_input_size(FILE *input)
+{
+    struct stat status;
+    if (fstat(fileno(input), &status) != 0 || !S_ISREG(status.st_mode))
+    {
+        return -1;
+    }
+    long long position = (long long)ftello(input);
+    return position >= 0 && position <= (long long)status.st_size ? (long long)status.st_size - position : -1;
+}
+
+// Codes the input as new blocks written from info->index_offset, each block reusing
+// last_table or carrying a fresh table built from the running histogram, whichever
+// gives the smaller block
+static int append_blocks(FILE *container, ContainerInfo *info, FILE *input, CodeTable *last_table,
+                         unsigned int *last_table_block)
+{
+    size_t block_size = container_fit_block_size(info->block_size, 1, 2 * (long long)info->capacity * sizeof(BlockInfo),
+                                                 container_input_size(input));
+    if (block_size == 0)
+    {
+        printf("Error: the memory limit is too low, even for blocks of %d bytes.\n", CONTAINER_MIN_BLOCK_SIZE);
+        return -1;
+    }
+    unsigned char *data = mem_alloc(block_size);
+    unsigned char *payload = mem_alloc(CONTAINER_MAX_CODED_SIZE(block_size) * (MAX_CODE_LENGTH / 8) + 8);
+    unsigned char *coded = CONTAINER_TRANSFORMS.nb_stages > 0 ? mem_alloc(CONTAINER_MAX_CODED_SIZE(block_size)) : NULL;
+    unsigned char header[CONTAINER_MAX_BLOCK_HEADER_SIZE];
+    int status = 0;
+    size_t nb_bytes;
+
+    if (data == NULL || payload == NULL || (CONTAINER_TRANSFORMS.nb_stages > 0 && coded == NULL) ||
+        fseeko(container, (off_t)info->index_offset, SEEK_SET) != 0)
+    {
+        mem_free(data);
+        mem_free(payload);
+        mem_free(coded);
+        return -1;
+    }
+
+    while ((nb_bytes = fread(data, 1, block_size, input)) > 0)
+    {
+        long long block_histogram[NB_SYMBOLS] = {0};
+        BlockHeader block;
+
+        const unsigned char *symbols = container_transform_block(data, nb_bytes, coded, &block);
+        histogram_add_buffer(block_histogram, symbols, (size_t)block.coded_size);
+        int new_table = container_choose_table(info, block_histogram, last_table, &block.set_table);
+        new_table |= container_choose_backend(block_histogram, last_table, new_table, &block);
+        if (new_table)
+        {
+            *last_table_block = info->nb_blocks;
+        }
+
+        block.payload_bits = container_encode_block(symbols, &block, last_table, payload);
+        size_t header_size = container_block_header(header, &block, new_table ? last_table : NULL);
+        size_t payload_size = (size_t)((block.payload_bits + 7) / 8);
+        unsigned long long offset = (unsigned long long)ftello(container);
+
+        if (fwrite(header, 1, header_size, container) != header_size ||
+            fwrite(payload, 1, payload_size, container) != payload_size ||
+            container_add_block(info, offset, nb_bytes, *last_table_block, block_histogram) != 0)
+        {
+            status = -1;
+            break;
+        }
+    }
+
+    info->index_offset = (unsigned long long)ftello(container);
+    mem_free(data);
+    mem_free(payload);
+    mem_free(coded);
+    return status;
+}
+
+// Fills everything but the blocks of info from the trailer of a container of the given size
+static int parse_trailer(const unsigned char *trailer, unsigned long long size, ContainerInfo *info)
+{
+    if (memcmp(trailer + 8 * NB_SYMBOLS + 24, CONTAINER_TRAILER_MAGIC, 4) != 0)
+    {
+        printf("Error: the container trailer is missing or damaged.\n");
+        return -1;
+    }
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        info->histogram[c] = (long long)get_u64(trailer + 8 * c);
+    }
+    info->raw_size = get_u64(trailer + 8 * NB_SYMBOLS);
+    info->index_offset = get_u64(trailer + 8 * NB_SYMBOLS + 8);
+    info->nb_blocks = get_u32(trailer + 8 * NB_SYMBOLS + 16);
+    info->block_size = get_u32(trailer + 8 * NB_SYMBOLS + 20);
+
+    // Compared without sums, which a damaged trailer could wrap
+    unsigned long long index_end = size - CONTAINER_TRAILER_SIZE;
+    if (info->index_offset < CONTAINER_HEADER_SIZE || info->index_offset > index_end ||
+        (unsigned long long)info->nb_blocks * CONTAINER_INDEX_ENTRY_SIZE != index_end - info->index_offset ||
+        info->block_size == 0)
+    {
+        printf("Error: the container index is damaged.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Blocks follow the header in increasing order: min_offset is the header size for the first one,
+// and one past the previous block for the others
+static int parse_index_entry(const unsigned char *entry, const ContainerInfo *info, unsigned int i,
+                             unsigned long long min_offset, BlockInfo *block)
+{
+    block->offset = get_u64(entry);
+    block->raw_offset = get_u64(entry + 8);
+    block->raw_size = get_u64(entry + 16);
+    block->table_block = get_u32(entry + 24);
+    if (block->table_block > i || block->raw_size > info->block_size || block->offset < min_offset ||
+        block->offset >= info->index_offset || block->raw_offset > info->raw_size ||
+        block->raw_size > info->raw_size - block->raw_offset)
+    {
+        printf("Error: the container index is damaged.\n");
+        return -1;
+    }
+    return 0;
+}
+
+int container_read_info(FILE *container, ContainerInfo *info)
+{
+    unsigned char header[CONTAINER_HEADER_SIZE];
+    unsigned char trailer[CONTAINER_TRAILER_SIZE];
+    unsigned char entry[CONTAINER_INDEX_ENTRY_SIZE];
+
+    memset(info, 0, sizeof(ContainerInfo));
+    if (fseeko(container, 0, SEEK_END) != 0)
+    {
+        return -1;
+    }
+    off_t size = ftello(container);
+    fseeko(container, 0, SEEK_SET);
+    if (size < CONTAINER_HEADER_SIZE + CONTAINER_TRAILER_SIZE ||
+        fread(header, 1, sizeof(header), container) != sizeof(header) || memcmp(header, CONTAINER_MAGIC, 4) != 0 ||
+        header[4] != CONTAINER_VERSION)
+    {
+        printf("Error: not a compressed container.\n");
+        return -1;
+    }
+
+    fseeko(container, size - CONTAINER_TRAILER_SIZE, SEEK_SET);
+    if (fread(trailer, 1, sizeof(trailer), container) != sizeof(trailer) ||
+        parse_trailer(trailer, (unsigned long long)size, info) != 0)
+    {
+        return -1;
+    }
+
+    info->capacity = info->nb_blocks + 1;
+    info->blocks = mem_alloc(info->capacity * sizeof(BlockInfo));
+    if (info->blocks == NULL)
+    {
+        printf("Error: the memory limit is too low for the index of %u blocks.\n", info->nb_blocks);
+        info->nb_blocks = 0;
+        info->capacity = 0;
+        return -1;
+    }
+    fseeko(container, (off_t)info->index_offset, SEEK_SET);
+    for (unsigned int i = 0; i < info->nb_blocks; i++)
+    {
+        if (fread(entry, 1, sizeof(entry), container) != sizeof(entry))
+        {
+            container_free_info(info);
+            return -1;
+        }
+        unsigned long long min_offset = i == 0 ? CONTAINER_HEADER_SIZE : info->blocks[i - 1].offset + 1;
+        if (parse_index_entry(entry, info, i, min_offset, &info->blocks[i]) != 0)
+        {
+            container_free_info(info);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void container_free_info(ContainerInfo *info)
+{
+    mem_free(info->blocks);
+    info->blocks = NULL;
+    info->nb_blocks = 0;
+    info->capacity = 0;
+}
+
+int container_read_table(FILE *container, const ContainerInfo *info, unsigned int block, CodeTable *table)
+{
+    BlockHeader header;
+
+    if (block >= info->nb_blocks || fseeko(container, (off_t)info->blocks[block].offset, SEEK_SET) != 0 ||
+        read_block_header(container, &header, table) != 0 || !(header.flags & BLOCK_TABLE_FLAGS))
+    {
+        printf("Error: block %u holds no code table.\n", block);
+        return -1;
+    }
+    return 0;
+}
+
+int container_compress(FILE *input, FILE *output, unsigned int block_size)
+{
+    ContainerInfo info;
+    CodeTable table;
+    unsigned int table_block = 0;
+
+    memset(&info, 0, sizeof(info));
+    // The trailer records the block size, which sets the buffers of the decoders too
+    info.block_size = container_fit_block_size(block_size > 0 ? block_size : CONTAINER_BLOCK_SIZE, 1, 0,
+                                               container_input_size(input));
+    info.index_offset = CONTAINER_HEADER_SIZE;
+    if (info.block_size == 0)
+    {
+        printf("Error: the memory limit is too low, even for blocks of %d bytes.\n", CONTAINER_MIN_BLOCK_SIZE);
+        return -1;
+    }
+
+    int status = container_write_header(output);
+    if (status == 0)
+    {
+        status = append_blocks(output, &info, input, &table, &table_block);
+    }
+    if (status == 0)
+    {
+        status = container_write_index_and_trailer(output, &info);
+    }
+    if (status != 0)
+    {
+        printf("Error: could not write the compressed container.\n");
+    }
+    container_free_info(&info);
+    return status;
+}
+
+int container_append(FILE *container, FILE *input)
+{
+    ContainerInfo info;
+    CodeTable table;
+    unsigned int table_block = 0;
+
+    if (container_read_info(container, &info) != 0)
+    {
+        return -1;
+    }
+    if (info.nb_blocks > 0)
+    {
+        table_block = info.blocks[info.nb_blocks - 1].table_block;
+        if (container_read_table(container, &info, table_block, &table) != 0)
+        {
+            container_free_info(&info);
+            return -1;
+        }
+    }
+
+    unsigned int old_nb_blocks = info.nb_blocks;
+    int status = append_blocks(container, &info, input, &table, &table_block);
+    if (status == 0)
+    {
+        status = container_write_index_and_trailer(container, &info);
+    }
+    if (status != 0)
+    {
+        printf("Error: could not append to the compressed container.\n");
+    }
+    TRACE(TRACE_STEPS, "appended %lld blocks", info.nb_blocks - old_nb_blocks);
+    container_free_info(&info);
+    return status;
+}
+
+long long container_decompress_into(FILE *container, unsigned char *buffer, size_t capacity)
+{
+    ContainerInfo info;
+    CodeTable table;
+    int status = 0;
+
+    if (container_read_info(container, &info) != 0)
+    {
+        return -1;
+    }
+    if (info.raw_size > capacity)
+    {
+        printf("Error: %llu bytes do not fit in a buffer of %zu bytes.\n", info.raw_size, capacity);
+        container_free_info(&info);
+        return -1;
+    }
+
+    unsigned char *payload = mem_alloc(CONTAINER_MAX_CODED_SIZE(info.block_size) * (MAX_CODE_LENGTH / 8) + 8);
+    if (payload == NULL)
+    {
+        printf("Error: the memory limit is too low for blocks of %u bytes.\n", info.block_size);
+        container_free_info(&info);
+        return -1;
+    }
+    for (unsigned int i = 0; i < info.nb_blocks && status == 0; i++)
+    {
+        BlockHeader header;
+
+        fseeko(container, (off_t)info.blocks[i].offset, SEEK_SET);
+        if (read_block_header(container, &header, &table) != 0 || header.raw_size != info.blocks[i].raw_size ||
+            (i == 0 && !(header.flags & BLOCK_TABLE_FLAGS)))
+        {
+            status = -1;
+            break;
+        }
+        size_t payload_size = (size_t)((header.payload_bits + 7) / 8);
+        if (fread(payload, 1, payload_size, container) != payload_size ||
+            container_decode_block(payload, &header, &table, buffer + info.blocks[i].raw_offset) != 0)
+        {
+            status = -1;
+        }
+    }
+    if (status != 0)
+    {
+        printf("Error: the compressed container is damaged.\n");
+    }
+
+    long long raw_size = (long long)info.raw_size;
+    mem_free(payload);
+    container_free_info(&info);
+    return status == 0 ? raw_size : -1;
+}
+
+size_t container_compress_bound(size_t length, unsigned int block_size)
+{
+    size_t nb_blocks = length / block_size + 1;
+    return CONTAINER_HEADER_SIZE + CONTAINER_TRAILER_SIZE +
+           nb_blocks * (CONTAINER_MAX_BLOCK_HEADER_SIZE + CONTAINER_INDEX_ENTRY_SIZE + 8 +
+                        TRANSFORM_MAX_GROWTH * (MAX_CODE_LENGTH / 8)) +
+           length * (MAX_CODE_LENGTH / 8);
+}
+
+long long container_compress_buffer(const unsigned char *data, size_t length, unsigned int block_size,
+                                    unsigned char *out, size_t capacity)
+{
+    ContainerInfo info;
+    CodeTable table;
+    unsigned int table_block = 0;
+
+    memset(&info, 0, sizeof(info));
+    info.block_size = block_size > 0 ? block_size : CONTAINER_BLOCK_SIZE;
+    if (capacity < container_compress_bound(length, info.block_size))
+    {
+        printf("Error: a buffer of %zu bytes may not hold the compressed container.\n", capacity);
+        return -1;
+    }
+
+    unsigned char *coded = NULL;
+    if (CONTAINER_TRANSFORMS.nb_stages > 0 && (coded = mem_alloc(CONTAINER_MAX_CODED_SIZE(info.block_size))) == NULL)
+    {
+        printf("Error: the memory limit is too low for blocks of %u bytes.\n", info.block_size);
+        return -1;
+    }
+
+    // Same blocks as append_blocks, coded straight into out
+    memcpy(out, CONTAINER_MAGIC, 4);
+    out[4] = CONTAINER_VERSION;
+    size_t pos = CONTAINER_HEADER_SIZE;
+    for (size_t raw_offset = 0; raw_offset < length; raw_offset += info.block_size)
+    {
+        size_t nb_bytes = length - raw_offset < info.block_size ? length - raw_offset : info.block_size;
+        long long block_histogram[NB_SYMBOLS] = {0};
+        BlockHeader block;
+
+        const unsigned char *symbols = container_transform_block(data + raw_offset, nb_bytes, coded, &block);
+        histogram_add_buffer(block_histogram, symbols, (size_t)block.coded_size);
+        int new_table = container_choose_table(&info, block_histogram, &table, &block.set_table);
+        new_table |= container_choose_backend(block_histogram, &table, new_table, &block);
+        if (new_table)
+        {
+            table_block = info.nb_blocks;
+        }
+        block.payload_bits = 0;
+        size_t header_size = container_block_header(out + pos, &block, new_table ? &table : NULL);
+        block.payload_bits = container_encode_block(symbols, &block, &table, out + pos + header_size);
+        container_block_header(out + pos, &block, new_table ? &table : NULL);
+        if (container_add_block(&info, pos, nb_bytes, table_block, block_histogram) != 0)
+        {
+            mem_free(coded);
+            container_free_info(&info);
+            return -1;
+        }
+        pos += header_size + (size_t)((block.payload_bits + 7) / 8);
+    }
+    mem_free(coded);
+
+    info.index_offset = pos;
+    for (unsigned int i = 0; i < info.nb_blocks; i++)
+    {
+        put_index_entry(out + pos, &info.blocks[i]);
+        pos += CONTAINER_INDEX_ENTRY_SIZE;
+    }
+    put_trailer(out + pos, &info);
+    pos += CONTAINER_TRAILER_SIZE;
+    container_free_info(&info);
+    return (long long)pos;
+}
+
+long long container_decompress_buffer(const unsigned char *container, size_t size, unsigned char *buffer,
+                                      size_t capacity)
+{
+    ContainerInfo info;
+    CodeTable table;
+
+    memset(&info, 0, sizeof(info));
+    if (size < CONTAINER_HEADER_SIZE + CONTAINER_TRAILER_SIZE || memcmp(container, CONTAINER_MAGIC, 4) != 0 ||
+        container[4] != CONTAINER_VERSION)
+    {
+        printf("Error: not a compressed container.\n");
+        return -1;
+    }
+    if (parse_trailer(container + size - CONTAINER_TRAILER_SIZE, size, &info) != 0)
+    {
+        return -1;
+    }
+    if (info.raw_size > capacity)
+    {
+        printf("Error: %llu bytes do not fit in a buffer of %zu bytes.\n", info.raw_size, capacity);
+        return -1;
+    }
+
+    // The payloads are decoded in place: nothing is copied but the decoded bytes
+    unsigned long long min_offset = CONTAINER_HEADER_SIZE;
+    for (unsigned int i = 0; i < info.nb_blocks; i++)
+    {
+        BlockInfo block;
+        BlockHeader header;
+
+        if (parse_index_entry(container + info.index_offset + (size_t)i * CONTAINER_INDEX_ENTRY_SIZE, &info, i,
+                              min_offset, &block) != 0)
+        {
+            return -1;
+        }
+        min_offset = block.offset + 1;
+        size_t available = (size_t)(info.index_offset - block.offset);
+        size_t header_size = container_parse_block_header(container + block.offset, available, &header, &table);
+        if (header_size == 0 || header.raw_size != block.raw_size || (i == 0 && !(header.flags & BLOCK_TABLE_FLAGS)) ||
+            (header.payload_bits + 7) / 8 > available - header_size ||
+            container_decode_block(container + block.offset + header_size, &header, &table,
+                                   buffer + block.raw_offset) != 0)
+        {
+            printf("Error: the compressed container is damaged.\n");
+            return -1;
+        }
+    }
+    return (long long)info.raw_size;
+}
+
+#ifdef CONTAINER_MMAP
+// Decodes straight into the output file mapped in memory; returns 1 if the output
+// cannot be mapped (a pipe for instance) so that the caller writes it instead
+static int decompress_mapped(FILE *container, FILE *output)
+{
+    ContainerInfo info;
+
+    if (container_read_info(container, &info) != 0)
+    {
+        return -1;
+    }
+    size_t raw_size = (size_t)info.raw_size;
+    container_free_info(&info);
+    if (raw_size == 0 || fflush(output) != 0)
+    {
+        return 1;
+    }
+
+    int fd = fileno(output);
+    if (ftruncate(fd, (off_t)raw_size) != 0)
+    {
+        return 1;
+    }
+    unsigned char *mapped = mmap(NULL, raw_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED)
+    {
+        return 1;
+    }
+
+    long long decoded = container_decompress_into(container, mapped, raw_size);
+    munmap(mapped, raw_size);
+    fseeko(output, (off_t)raw_size, SEEK_SET);
+    return decoded == (long long)raw_size ? 0 : -1;
+}
+#endif
+
+int container_decompress(FILE *container, FILE *output)
+{
+    ContainerInfo info;
+    CodeTable table;
+    int status = 0;
+
+#ifdef CONTAINER_MMAP
+    // The pages of a mapped output count in the resident size, so a memory limit
+    // keeps the output written block by block
+    if (memory_limit() == 0)
+    {
+        status = decompress_mapped(container, output);
+        if (status <= 0)
+        {
+            return status;
+        }
+        status = 0;
+    }
+#endif
+
+    if (container_read_info(container, &info) != 0)
+    {
+        return -1;
+    }
+
+    unsigned char *data = mem_alloc(info.block_size);
+    unsigned char *payload = mem_alloc(CONTAINER_MAX_CODED_SIZE(info.block_size) * (MAX_CODE_LENGTH / 8) + 8);
+    if (data == NULL || payload == NULL)
+    {
+        printf("Error: the memory limit is too low for blocks of %u bytes.\n", info.block_size);
+        mem_free(data);
+        mem_free(payload);
+        container_free_info(&info);
+        return -1;
+    }
+    for (unsigned int i = 0; i < info.nb_blocks && status == 0; i++)
+    {
+        BlockHeader header;
+
+        fseeko(container, (off_t)info.blocks[i].offset, SEEK_SET);
+        if (read_block_header(container, &header, &table) != 0 || header.raw_size != info.blocks[i].raw_size ||
+            (i == 0 && !(header.flags & BLOCK_TABLE_FLAGS)))
+        {
+            status = -1;
+            break;
+        }
+        size_t payload_size = (size_t)((header.payload_bits + 7) / 8);
+        if (fread(payload, 1, payload_size, container) != payload_size ||
+            container_decode_block(payload, &header, &table, data) != 0 ||
+            fwrite(data, 1, (size_t)header.raw_size, output) != header.raw_size)
+        {
+            status = -1;
+        }
+    }
+    if (status != 0)
+    {
+        printf("Error: the compressed container is damaged.\n");
+    }
+
+    mem_free(data);
+    mem_free(payload);
+    container_free_info(&info);
+    return status;
+}
@@ -0,0 +1,498 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "daemon.h"
+#include "container.h"
+#include "memstats.h"
+#include "byteio.h"
+#include "trace.h"
+
+#define DAEMON_FRAME_HEADER_SIZE (1 + 8)
+// Milliseconds between two checks of the stop flag while waiting
+#define DAEMON_POLL_INTERVAL 200
+
+// Latencies in nanoseconds, in buckets of 1/8th of a power of two (12.5% precision)
+#define LATENCY_SUB_BUCKETS 8
+#define LATENCY_BUCKETS (16 + 60 * LATENCY_SUB_BUCKETS)
+
+typedef struct LatencyHistogram
+{
+    atomic_llong buckets[LATENCY_BUCKETS];
+    atomic_llong count;
+    atomic_llong max;
+} LatencyHistogram;
+
+typedef struct Daemon
+{
+    int listen_fd;
+    LatencyHistogram latency[2]; //  Compress and decompress requests
+    atomic_llong nb_errors;
+} Daemon;
+
+// Buffers kept by a worker from one request to the next
+typedef struct DaemonWorker
+{
+    Daemon *daemon;
+    pthread_t thread;
+    unsigned char *in, *out;
+    size_t in_capacity, out_capacity;
+} DaemonWorker;
+
+static atomic_int daemon_stopping = 0;
+
+void daemon_stop(void)
+{
+    atomic_store(&daemon_stopping, 1);
+}
+
+static void on_stop_signal(int signal_number)
+{
+    (void)signal_number;
+    daemon_stop();
+}
+
+static long long now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static int latency_bucket(long long ns)
+{
+    if (ns < 16)
+    {
+        return ns < 0 ? 0 : (int)ns;
+    }
+    int exponent = 63 - __builtin_clzll((unsigned long long)ns);
+    int sub = (int)((ns >> (exponent - 3)) & (LATENCY_SUB_BUCKETS - 1));
+    return 16 + (exponent - 4) * LATENCY_SUB_BUCKETS + sub;
+}
+
+// Smallest latency of a bucket
+static long long latency_bucket_value(int bucket)
+{
+    if (bucket < 16)
+    {
+        return bucket;
+    }
+    int exponent = (bucket - 16) / LATENCY_SUB_BUCKETS + 4;
+    int sub = (bucket - 16) % LATENCY_SUB_BUCKETS;
+    return (long long)(LATENCY_SUB_BUCKETS + sub) << (exponent - 3);
+}
+
+static void latency_record(LatencyHistogram *histogram, long long ns)
+{
+    atomic_fetch_add_explicit(&histogram->buckets[latency_bucket(ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    long long max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    while (ns > max &&
+           !atomic_compare_exchange_weak_explicit(&histogram->max, &max, ns, memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+}
+
+static long long latency_percentile(LatencyHistogram *histogram, double percentile)
+{
+    long long count = atomic_load(&histogram->count);
+    long long rank = (long long)(percentile / 100 * (double)count + 0.999999);
+    long long seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS && count > 0; bucket++)
+    {
+        seen += atomic_load_explicit(&histogram->buckets[bucket], memory_order_relaxed);
+        if (seen >= rank)
+        {
+            return latency_bucket_value(bucket);
+        }
+    }
+    return 0;
+}
+
+static size_t format_stats(Daemon *daemon, char *text, size_t size)
+{
+    const char *names[2] = {"compress", "decompress"};
+    size_t length = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        LatencyHistogram *histogram = &daemon->latency[i];
+        length += (size_t)snprintf(text + length, size - length,
+                                   "%s: %lld requests, latency p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, "
+                                   "max %.1f us\n",
+                                   names[i], atomic_load(&histogram->count), latency_percentile(histogram, 50) / 1e3,
+                                   latency_percentile(histogram, 90) / 1e3, latency_percentile(histogram, 99) / 1e3,
+                                   latency_percentile(histogram, 99.9) / 1e3, atomic_load(&histogram->max) / 1e3);
+    }
+    length += (size_t)snprintf(text + length, size - length, "errors: %lld\n", atomic_load(&daemon->nb_errors));
+    return length;
+}
+
+static int read_full(int fd, unsigned char *buffer, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t nb_bytes = recv(fd, buffer, length, 0);
+        if (nb_bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (nb_bytes <= 0)
+        {
+            return -1;
+        }
+        buffer += nb_bytes;
+        length -= (size_t)nb_bytes;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const unsigned char *buffer, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t nb_bytes = send(fd, buffer, length, MSG_NOSIGNAL);
+        if (nb_bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (nb_bytes <= 0)
+        {
+            return -1;
+        }
+        buffer += nb_bytes;
+        length -= (size_t)nb_bytes;
+    }
+    return 0;
+}
+
+static int send_frame(int fd, int code, const unsigned char *payload, size_t length)
+{
+    unsigned char header[DAEMON_FRAME_HEADER_SIZE];
+    header[0] = (unsigned char)code;
+    put_u64(header + 1, length);
+    return write_full(fd, header, sizeof(header)) == 0 && write_full(fd, payload, length) == 0 ? 0 : -1;
+}
+
+// Waits until fd can be read from, the daemon stops, or timeout_ms milliseconds pass
+// (-1: no limit); returns 0 when fd is ready
+static int wait_readable(int fd, int timeout_ms)
+{
+    struct pollfd poll_fd = {.fd = fd, .events = POLLIN};
+    long long deadline = now_ns() + (long long)timeout_ms * 1000000;
+    while (!atomic_load(&daemon_stopping) && (timeout_ms < 0 || now_ns() < deadline))
+    {
+        int ready = poll(&poll_fd, 1, DAEMON_POLL_INTERVAL);
+        if (ready > 0)
+        {
+            return 0;
+        }
+        if (ready < 0 && errno != EINTR)
+        {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+// Reads from a client: gives up when the daemon stops, or when the client sends nothing
+// for DAEMON_CLIENT_TIMEOUT, be it between two requests or within one
+static int receive_full(int fd, unsigned char *buffer, size_t length)
+{
+    while (length > 0)
+    {
+        if (wait_readable(fd, DAEMON_CLIENT_TIMEOUT) != 0)
+        {
+            return -1;
+        }
+        ssize_t nb_bytes = recv(fd, buffer, length, MSG_DONTWAIT);
+        if (nb_bytes < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            continue;
+        }
+        if (nb_bytes <= 0)
+        {
+            return -1;
+        }
+        buffer += nb_bytes;
+        length -= (size_t)nb_bytes;
+    }
+    return 0;
+}
+
+// Grows a worker buffer, dropping its content
+static int reserve(unsigned char **buffer, size_t *capacity, size_t size)
+{
+    if (size <= *capacity && *buffer != NULL)
+    {
+        return 0;
+    }
+    mem_free(*buffer);
+    *capacity = size > 4096 ? size : 4096;
+    *buffer = mem_alloc(*capacity);
+    if (*buffer == NULL)
+    {
+        *capacity = 0;
+        return -1;
+    }
+    return 0;
+}
+
+// Runs one request read in worker->in; returns the size of the response written in
+// worker->out, which is an error message when *status is not 0
+static size_t handle_request(DaemonWorker *worker, int operation, size_t length, int *status)
+{
+    const char *error = NULL;
+    long long size = -1;
+
+    if (operation == DAEMON_COMPRESS)
+    {
+        size_t bound = container_compress_bound(length, DAEMON_BLOCK_SIZE);
+        if (reserve(&worker->out, &worker->out_capacity, bound) != 0)
+        {
+            error = "Error: not enough memory for the request.";
+        }
+        else
+        {
+            size = container_compress_buffer(worker->in, length, DAEMON_BLOCK_SIZE, worker->out, bound);
+        }
+    }
+    else if (operation == DAEMON_DECOMPRESS)
+    {
+        unsigned long long raw_size =
+            length >= CONTAINER_TRAILER_SIZE ? get_u64(worker->in + length - CONTAINER_TRAILER_SIZE + 8 * NB_SYMBOLS) : 0;
+        if (raw_size > DAEMON_MAX_PAYLOAD)
+        {
+            error = "Error: the decompressed data would be too large.";
+        }
+        else if (reserve(&worker->out, &worker->out_capacity, (size_t)raw_size) != 0)
+        {
+            error = "Error: not enough memory for the request.";
+        }
+        else
+        {
+            size = container_decompress_buffer(worker->in, length, worker->out, worker->out_capacity);
+        }
+    }
+    else if (operation == DAEMON_STATS)
+    {
+        if (reserve(&worker->out, &worker->out_capacity, 1024) == 0)
+        {
+            size = (long long)format_stats(worker->daemon, (char *)worker->out, worker->out_capacity);
+        }
+    }
+    else
+    {
+        error = "Error: unknown operation.";
+    }
+
+    *status = size < 0 ? 1 : 0;
+    if (size < 0)
+    {
+        if (error == NULL)
+        {
+            error = "Error: the request could not be processed.";
+        }
+        size = 0;
+        if (reserve(&worker->out, &worker->out_capacity, strlen(error)) == 0)
+        {
+            size = (long long)strlen(error);
+            memcpy(worker->out, error, strlen(error));
+        }
+    }
+    return (size_t)size;
+}
+
+static void serve_connection(DaemonWorker *worker, int fd)
+{
+    unsigned char header[DAEMON_FRAME_HEADER_SIZE];
+
+    while (receive_full(fd, header, sizeof(header)) == 0)
+    {
+        long long start = now_ns();
+        int operation = header[0];
+        unsigned long long length = get_u64(header + 1);
+
+        if (length > DAEMON_MAX_PAYLOAD || reserve(&worker->in, &worker->in_capacity, (size_t)length) != 0)
+        {
+            const char *error = "Error: the request is too large.";
+            send_frame(fd, 1, (const unsigned char *)error, strlen(error));
+            break;
+        }
+        if (receive_full(fd, worker->in, (size_t)length) != 0)
+        {
+            break;
+        }
+
+        int status;
+        size_t size = handle_request(worker, operation, (size_t)length, &status);
+        if (status != 0)
+        {
+            atomic_fetch_add(&worker->daemon->nb_errors, 1);
+        }
+        if (send_frame(fd, status, worker->out, size) != 0)
+        {
+            break;
+        }
+        if (status == 0 && (operation == DAEMON_COMPRESS || operation == DAEMON_DECOMPRESS))
+        {
+            latency_record(&worker->daemon->latency[operation == DAEMON_DECOMPRESS], now_ns() - start);
+        }
+    }
+    close(fd);
+}
+
+static void *worker_thread(void *arg)
+{
+    DaemonWorker *worker = arg;
+    while (wait_readable(worker->daemon->listen_fd, -1) == 0)
+    {
+        // Another worker may have taken the connection: the socket does not block
+        int fd = accept(worker->daemon->listen_fd, NULL, NULL);
+        if (fd >= 0)
+        {
+            // Nor does a client that stops reading its responses keep the worker
+            struct timeval timeout = {DAEMON_CLIENT_TIMEOUT / 1000, DAEMON_CLIENT_TIMEOUT % 1000 * 1000};
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            serve_connection(worker, fd);
+        }
+    }
+    mem_free(worker->in);
+    mem_free(worker->out);
+    return NULL;
+}
+
+static int socket_address(const char *socket_path, struct sockaddr_un *address)
+{
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address->sun_path))
+    {
+        printf("Error: the socket path %s is too long.\n", socket_path);
+        return -1;
+    }
+    strcpy(address->sun_path, socket_path);
+    return 0;
+}
+
+int daemon_serve(const char *socket_path, int nb_workers)
+{
+    struct sockaddr_un address;
+    struct stat status;
+    Daemon *daemon = calloc(1, sizeof(Daemon));
+
+    if (daemon == NULL || socket_address(socket_path, &address) != 0)
+    {
+        free(daemon);
+        return -1;
+    }
+    // A socket left by a previous daemon would make bind fail
+    if (stat(socket_path, &status) == 0 && S_ISSOCK(status.st_mode))
+    {
+        unlink(socket_path);
+    }
+    daemon->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (daemon->listen_fd < 0 || bind(daemon->listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(daemon->listen_fd, 64) != 0)
+    {
+        printf("Error: cannot listen on %s.\n", socket_path);
+        if (daemon->listen_fd >= 0)
+        {
+            close(daemon->listen_fd);
+        }
+        free(daemon);
+        return -1;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_stop_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    atomic_store(&daemon_stopping, 0);
+
+    nb_workers = nb_workers > 0 ? nb_workers : 1;
+    DaemonWorker *workers = calloc((size_t)nb_workers, sizeof(DaemonWorker));
+    int nb_started = 0;
+    for (int i = 0; workers != NULL && i < nb_workers; i++)
+    {
+        workers[i].daemon = daemon;
+        if (pthread_create(&workers[i].thread, NULL, worker_thread, &workers[i]) == 0)
+        {
+            nb_started++;
+        }
+    }
+    TRACE(TRACE_STEPS, "daemon: %lld workers", nb_started);
+    for (int i = 0; i < nb_started; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    char stats[1024];
+    format_stats(daemon, stats, sizeof(stats));
+    fprintf(stderr, "%s", stats);
+
+    close(daemon->listen_fd);
+    unlink(socket_path);
+    free(workers);
+    free(daemon);
+    return nb_started > 0 ? 0 : -1;
+}
+
+int daemon_request(const char *socket_path, int operation, const unsigned char *data, size_t length,
+                   unsigned char **reply, size_t *reply_length)
+{
+    struct sockaddr_un address;
+    unsigned char header[DAEMON_FRAME_HEADER_SIZE];
+
+    *reply = NULL;
+    *reply_length = 0;
+    if (socket_address(socket_path, &address) != 0)
+    {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        printf("Error: cannot connect to %s.\n", socket_path);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+
+    int status = -1;
+    if (send_frame(fd, operation, data, length) == 0 && read_full(fd, header, sizeof(header)) == 0 &&
+        get_u64(header + 1) <= DAEMON_MAX_PAYLOAD)
+    {
+        *reply_length = (size_t)get_u64(header + 1);
+        *reply = malloc(*reply_length + 1);
+        if (*reply != NULL && read_full(fd, *reply, *reply_length) == 0)
+        {
+            (*reply)[*reply_length] = '\0';
+            status = header[0];
+        }
+    }
+    if (status < 0)
+    {
+        printf("Error: no response from %s.\n", socket_path);
+        free(*reply);
+        *reply = NULL;
+        *reply_length = 0;
+    }
+    close(fd);
+    return status;
+}
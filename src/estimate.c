@@ -0,0 +1,175 @@
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "estimate.h"
+#include "container.h"
+#include "memstats.h"
+#include "trace.h"
+
+// Fills the fields that only depend on the histogram of the whole input
+static void estimate_from_histogram(const long long *histogram, SizeEstimate *estimate)
+{
+    CodeTable table;
+    long long total = 0;
+
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        total += histogram[c];
+    }
+    estimate->raw_size = (unsigned long long)total;
+    estimate->payload_bits = 0;
+    estimate->table_bytes = 0;
+    estimate->entropy_bits = 0;
+    if (code_table_from_histogram(histogram, &table) == 0)
+    {
+        estimate->payload_bits = (unsigned long long)code_table_cost(&table, histogram);
+        estimate->table_bytes = code_table_serialized_size(&table);
+    }
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        if (histogram[c] > 0)
+        {
+            estimate->entropy_bits += (double)histogram[c] * log2((double)total / (double)histogram[c]);
+        }
+    }
+}
+
+static void estimate_ratio(SizeEstimate *estimate)
+{
+    estimate->ratio = estimate->raw_size > 0 ? (double)estimate->container_bytes / (double)estimate->raw_size : 0;
+}
+
+int estimate_compressed_size(FILE *input, unsigned int block_size, SizeEstimate *estimate)
+{
+    ContainerInfo plan;
+    CodeTable table;
+    size_t nb_bytes;
+    unsigned long long raw_size = 0;
+
+    memset(estimate, 0, sizeof(SizeEstimate));
+    memset(&plan, 0, sizeof(plan));
+    block_size = container_fit_block_size(block_size > 0 ? block_size : CONTAINER_BLOCK_SIZE, 1, 0,
+                                          container_input_size(input));
+    unsigned char *data = block_size > 0 ? mem_alloc(block_size) : NULL;
+    unsigned char *coded = CONTAINER_TRANSFORMS.nb_stages > 0 && data != NULL
+                               ? mem_alloc(CONTAINER_MAX_CODED_SIZE(block_size))
+                               : NULL;
+    if (data == NULL || (CONTAINER_TRANSFORMS.nb_stages > 0 && coded == NULL))
+    {
+        printf("Error: the memory limit is too low, even for blocks of %d bytes.\n", CONTAINER_MIN_BLOCK_SIZE);
+        mem_free(data);
+        return -1;
+    }
+
+    // Same decisions as append_blocks, with the cost of each block instead of its bits
+    estimate->container_bytes = CONTAINER_HEADER_SIZE + CONTAINER_TRAILER_SIZE;
+    while ((nb_bytes = fread(data, 1, block_size, input)) > 0)
+    {
+        long long block_histogram[NB_SYMBOLS] = {0};
+        unsigned char header[CONTAINER_MAX_BLOCK_HEADER_SIZE];
+        BlockHeader block;
+
+        const unsigned char *symbols = container_transform_block(data, nb_bytes, coded, &block);
+        histogram_add_buffer(block_histogram, symbols, (size_t)block.coded_size);
+        int new_table = container_choose_table(&plan, block_histogram, &table, &block.set_table);
+        new_table |= container_choose_backend(block_histogram, &table, new_table, &block);
+        block.payload_bits = block.nb_planes > 1 ? container_planes_bits(&block)
+                             : (unsigned long long)(block.backend == CONTAINER_BACKEND_TANS
+                                                        ? tans_cost(&block.frequencies, block_histogram)
+                                                        : code_table_cost(&table, block_histogram));
+
+        estimate->container_bytes += container_block_header(header, &block, new_table ? &table : NULL) +
+                                     CONTAINER_INDEX_ENTRY_SIZE + (block.payload_bits + 7) / 8;
+        for (int c = 0; c < NB_SYMBOLS; c++)
+        {
+            plan.histogram[c] += block_histogram[c];
+        }
+        plan.nb_blocks++;
+        raw_size += nb_bytes;
+    }
+    int status = ferror(input) ? -1 : 0;
+    mem_free(data);
+    mem_free(coded);
+
+    estimate_from_histogram(plan.histogram, estimate);
+    estimate->raw_size = raw_size;
+    estimate_ratio(estimate);
+    TRACE(TRACE_STEPS, "estimate: %lld blocks, %lld bytes", plan.nb_blocks, estimate->container_bytes);
+    return status;
+}
+
+int estimate_compressed_size_sampled(FILE *input, unsigned int block_size, unsigned int nb_samples,
+                                     SizeEstimate *estimate)
+{
+    long long input_size = container_input_size(input);
+    off_t start = ftello(input);
+    nb_samples = nb_samples > 0 ? nb_samples : ESTIMATE_SAMPLES;
+    if (input_size < 0 || start < 0 || input_size <= 2 * (long long)nb_samples * ESTIMATE_SAMPLE_SIZE)
+    {
+        return estimate_compressed_size(input, block_size, estimate);
+    }
+
+    unsigned char *data = mem_alloc(ESTIMATE_SAMPLE_SIZE);
+    unsigned char *coded = CONTAINER_TRANSFORMS.nb_stages > 0 ? mem_alloc(CONTAINER_MAX_CODED_SIZE(ESTIMATE_SAMPLE_SIZE))
+                                                              : NULL;
+    if (data == NULL || (CONTAINER_TRANSFORMS.nb_stages > 0 && coded == NULL))
+    {
+        printf("Error: the memory limit is too low to sample the input.\n");
+        mem_free(data);
+        mem_free(coded);
+        return -1;
+    }
+
+    // Evenly spaced chunks, from the start to the end of the input, transformed as the
+    // blocks would be (the transforms of small chunks find less structure)
+    long long histogram[NB_SYMBOLS] = {0};
+    long long sampled = 0;
+    long long step = (input_size - ESTIMATE_SAMPLE_SIZE) / (nb_samples - (nb_samples > 1 ? 1 : 0));
+    for (unsigned int i = 0; i < nb_samples; i++)
+    {
+        if (fseeko(input, start + (off_t)(i * step), SEEK_SET) != 0)
+        {
+            break;
+        }
+        size_t nb_bytes = fread(data, 1, ESTIMATE_SAMPLE_SIZE, input);
+        BlockHeader block;
+        const unsigned char *symbols = container_transform_block(data, nb_bytes, coded, &block);
+        histogram_add_buffer(histogram, symbols, (size_t)block.coded_size);
+        sampled += (long long)nb_bytes;
+    }
+    mem_free(data);
+    mem_free(coded);
+    fseeko(input, 0, SEEK_END);
+    if (sampled == 0)
+    {
+        return -1;
+    }
+
+    // Scaled counts keep every sampled letter, the unsampled ones are the error of the estimate
+    double scale = (double)input_size / (double)sampled;
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        if (histogram[c] > 0)
+        {
+            long long scaled = (long long)((double)histogram[c] * scale);
+            histogram[c] = scaled > 0 ? scaled : 1;
+        }
+    }
+
+    memset(estimate, 0, sizeof(SizeEstimate));
+    estimate_from_histogram(histogram, estimate);
+    estimate->raw_size = (unsigned long long)input_size;
+    estimate->sampled = 1;
+
+    block_size = block_size > 0 ? block_size : CONTAINER_BLOCK_SIZE;
+    unsigned long long nb_blocks = ((unsigned long long)input_size + block_size - 1) / block_size;
+    size_t transforms_bytes = CONTAINER_TRANSFORMS.nb_stages > 0 ? 1 + CONTAINER_TRANSFORMS.nb_stages + 8 : 0;
+    estimate->container_bytes = CONTAINER_HEADER_SIZE + CONTAINER_TRAILER_SIZE + estimate->table_bytes +
+                                nb_blocks * (CONTAINER_BLOCK_HEADER_SIZE + transforms_bytes + CONTAINER_INDEX_ENTRY_SIZE) +
+                                (estimate->payload_bits + 7) / 8;
+    estimate_ratio(estimate);
+    return 0;
+}
@@ -0,0 +1,1344 @@
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+#include "huffman.h"
+#include "codetable.h"
+#include "bitstring.h"
+#include "memstats.h"
+#include "trace.h"
+
+char *NaN = "NaN";
+char *_NULL = "NULL";
+char *NEWLINE = "LF/NL";
+char *TAB = "TAB";
+char *SPACE = "SPACE";
+char *DEL = "DEL";
+char *ALT = "ALT";
+char *SPECIAL = "CHR";
+
+// Code of the nodes that have none yet, shared and never freed
+static char EMPTY_CODE[] = "";
+
+// Allocations of the trees, lists and dictionaries, accounted to MEM_TREES; as in
+// open_file, running out of memory stops the program
+static void *tree_alloc(size_t size)
+{
+    void *ptr = mem_alloc_in(MEM_TREES, size);
+    if (ptr == NULL)
+    {
+        printf("Error: not enough memory for the Huffman tree.");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+static char *copy_code(const char *code, size_t length)
+{
+    char *copy = tree_alloc(length + 1);
+    memcpy(copy, code, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+// Returns the next byte as an int in [0, 255], or EOF (-1) at the end of the file,
+// so that a real 0xFF byte is never mistaken for the end of the input
+int fgetc_ascii(FILE *file)
+{
+    return fgetc(file);
+}
+
+static char display_names[256][8];
+static pthread_once_t display_names_once = PTHREAD_ONCE_INIT;
+
+static void init_display_names(void)
+{
+    for (int c = 0; c < 256; c++)
+    {
+        if (c < 32)
+        {
+            sprintf(display_names[c], "%s%02d", SPECIAL, c);
+        }
+        else
+        {
+            display_names[c][0] = (char)c;
+            display_names[c][1] = '\0';
+        }
+    }
+}
+
+// The names are static strings, never to be freed
+char *display_char(int c)
+{
+    char *new_chr = NULL;
+
+    switch (c)
+    {
+    case 0:
+        new_chr = _NULL;
+        break;
+
+    case 10:
+        new_chr = NEWLINE;
+        break;
+
+    case 9:
+        new_chr = TAB;
+        break;
+
+    case 32:
+        new_chr = SPACE;
+        break;
+
+    case 127:
+        new_chr = DEL;
+        break;
+
+    case 255:
+        new_chr = ALT;
+        break;
+
+    default:
+        if (c < 0 || c > 255)
+        {
+            new_chr = NaN;
+        }
+        else
+        {
+            pthread_once(&display_names_once, init_display_names);
+            new_chr = display_names[c];
+        }
+    }
+
+    return new_chr;
+}
+
+
+Element *get_element(Element *root, int index)
+{
+    if (index >= 0)
+    {
+        Element *curr = root;
+        for (int i = 0; i < index; i++)
+        {
+            if (curr->next != NULL)
+            {
+                curr = curr->next;
+            }
+            else
+            {
+                exit(EXIT_FAILURE);
+            }
+        }
+        return curr;
+    }
+    else
+    {
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Letter of a name written by display_char, told apart by its length and first letter
+// instead of being compared with every special name; -1 if it is not such a name
+static int letter_from_display_name(const char *name, size_t length)
+{
+    size_t special_length = strlen(SPECIAL);
+
+    if (length == 1)
+    {
+        return (unsigned char)name[0];
+    }
+    if (length == special_length + 2 && memcmp(name, SPECIAL, special_length) == 0)
+    {
+        char tens = name[special_length], units = name[special_length + 1];
+        int c = (tens - '0') * 10 + (units - '0');
+        return tens >= '0' && tens <= '9' && units >= '0' && units <= '9' && c < 32 ? c : -1;
+    }
+
+    const char *special = NULL;
+    int letter = -1;
+    switch (name[0])
+    {
+    case 'N':
+        special = _NULL;
+        letter = 0;
+        break;
+    case 'L':
+        special = NEWLINE;
+        letter = 10;
+        break;
+    case 'T':
+        special = TAB;
+        letter = 9;
+        break;
+    case 'S':
+        special = SPACE;
+        letter = 32;
+        break;
+    case 'D':
+        special = DEL;
+        letter = 127;
+        break;
+    case 'A':
+        special = ALT;
+        letter = 255;
+        break;
+    }
+    return special != NULL && length == strlen(special) && memcmp(name, special, length) == 0 ? letter : -1;
+}
+
+int get_char_from_display_char(char *display_chr)
+{
+    return letter_from_display_name(display_chr, strlen(display_chr));
+}
+
+void print_node(Node *node)
+{
+    Node *left = node->left;
+    Node *right = node->right;
+
+    if (left != NULL)
+    {
+        if (left->letter == -1)
+        {
+            printf("(%lld) <- ", left->size);
+        }
+        else
+        {
+            printf("(%s, %lld) <- ", display_char(left->letter), left->size);
+        }
+    }
+    else
+    {
+        printf("  NULL  <- ");
+    }
+
+    if (node->letter == -1)
+    {
+        printf("(%lld)", node->size);
+    }
+    else
+    {
+        printf("(%s, %lld)", display_char(node->letter), node->size);
+    }
+
+    if (right != NULL)
+    {
+        if (right->letter == -1)
+        {
+            printf(" -> (%lld)", right->size);
+        }
+        else
+        {
+            printf(" -> (%s, %lld)", display_char(right->letter), right->size);
+        }
+    }
+    else
+    {
+        printf(" ->  EOF");
+    }
+}
+
+void print_element(Element *element, int display_code, int elem_or_node)
+{
+    if (elem_or_node)
+    {
+        if (display_code)
+        {
+            printf("-> %s: %lld (%s)\n", display_char(element->node->letter), element->node->size, element->node->code);
+        }
+        else
+        {
+            printf("-> %s: %lld\n", display_char(element->node->letter), element->node->size);
+        }
+    }
+    else
+    {
+        if (display_code)
+        {
+            printf("-> %s: %lld (%s)\n", display_char(element->letter), element->occ, element->node->code);
+        }
+        else
+        {
+            printf("-> %s: %lld\n", display_char(element->letter), element->occ);
+        }
+    }
+}
+
+void print_occurrences(Element *root, int display_code, int elem_or_node)
+{
+    if (root == NULL)
+    {
+        printf("Error: The linked list of occurrences is empty.");
+        return;
+    }
+    printf("\n");
+    Element *curr = root;
+    do
+    {
+        print_element(curr, display_code, elem_or_node);
+        curr = curr->next;
+    } while (curr != NULL);
+
+    printf("-> EOF\n");
+}
+
+// C : Fonction qui renvoie une liste contenant chaque caractere present dans le texte,
+//     ainsi que le nombre d’occurrences de ce caractere.
+
+int idx_letter(Element *root, int letter)
+{
+    if (root != NULL)
+    {
+        Element *curr = root;
+        for (int i = 0; curr != NULL; i++)
+        {
+            if (curr->letter == letter)
+            {
+                return i;
+            }
+            curr = curr->next;
+        }
+    }
+    return -1;
+}
+
+Node *new_node(int letter, long long occ, Node *left, Node *right, Element *element_ref)
+{
+    Node *node = tree_alloc(sizeof(Node));
+    node->letter = letter;
+    node->size = occ;
+    node->left = left;
+    node->right = right;
+    node->code = EMPTY_CODE;
+    node->element_ref = element_ref;
+
+    return node;
+}
+
+Element *new_element(int letter)
+{
+    Element *new = tree_alloc(sizeof(Element));
+    new->next = NULL;
+    new->letter = letter;
+    new->occ = 1;
+    new->node = new_node(-1, -1, NULL, NULL, new);
+
+    return new;
+}
+
+static void free_node(Node *node)
+{
+    if (node->code != EMPTY_CODE)
+    {
+        mem_free(node->code);
+    }
+    mem_free(node);
+}
+
+void free_elements(Element *root)
+{
+    while (root != NULL)
+    {
+        Element *next = root->next;
+        free_node(root->node);
+        mem_free(root);
+        root = next;
+    }
+}
+
+// To pass an entire array to a function, only the name of the array is passed as an argument
+Element *get_occurrences(char *text)
+{
+    size_t text_length = strlen(text);
+    int idx_occ;
+    if (text_length > 0)
+    {
+        Element *root = new_element((unsigned char)text[0]);
+        Element *curr = root;
+        for (size_t i = 1; i <= text_length - 1; i++)
+        {
+            idx_occ = idx_letter(root, (unsigned char)text[i]);
+            if (idx_occ == -1)
+            {
+                curr->next = new_element((unsigned char)text[i]);
+                curr = curr->next;
+            }
+            else
+            {
+                get_element(root, idx_occ)->occ++;
+            }
+        }
+        return root;
+    }
+    return NULL;
+}
+
+// D : Fonction qui renvoie un arbre de Huffman, à partir d’une liste d’occurrences
+
+char *insert_char_in_front(char c, char *curr_string)
+{
+    int new_len = strlen(curr_string) + 1;
+    char *new_string = tree_alloc((new_len + 1) * sizeof(char));
+    new_string[0] = c;
+
+    for (int i = 1; i <= new_len; i++)
+    {
+        if (i == new_len) {
+            new_string[i] = '\0';
+        } else {
+            new_string[i] = curr_string[i - 1];
+        }
+    }
+
+    return new_string;
+}
+
+void swap(Element *a, Element *b)
+{
+    Element temp = *a;
+
+    a->letter = b->letter;
+    a->occ = b->occ;
+    a->node = b->node;
+    a->node->element_ref = a;
+
+    b->letter = temp.letter;
+    b->occ = temp.occ;
+    b->node = temp.node;
+    b->node->element_ref = b;
+}
+
+void new_compare(long long *comparer_curr, long long *comparer_to_insert, Element *curr, Element *to_insert, int node_or_elem,
+                 int size_or_letter)
+{
+    if (size_or_letter)
+    {
+        if (node_or_elem)
+        {
+            *comparer_curr = curr->letter;
+            *comparer_to_insert = to_insert->letter;
+        }
+        else
+        {
+            *comparer_curr = curr->node->letter;
+            *comparer_to_insert = to_insert->node->letter;
+        }
+    }
+    else
+    {
+        if (node_or_elem)
+        {
+            *comparer_curr = curr->occ;
+            *comparer_to_insert = to_insert->occ;
+        }
+        else
+        {
+            *comparer_curr = curr->node->size;
+            *comparer_to_insert = to_insert->node->size;
+        }
+    }
+}
+
+void insert_elem(Element *to_insert, Element *after, int insert_before)
+{
+    Element *temp = after->next;
+    after->next = to_insert;
+    to_insert->next = temp;
+    if (insert_before)
+    {
+        swap(after, to_insert);
+    }
+}
+
+Element *insert_elem_desc(Element *root, Element *to_insert, int node_or_elem, int size_or_letter)
+{
+    TRACE(TRACE_DETAIL, "insert_elem_desc (elem: %lld, letter: %lld)", node_or_elem, size_or_letter);
+
+    Element *curr = root;
+    long long comparer_curr, comparer_to_insert;
+    new_compare(&comparer_curr, &comparer_to_insert, curr, to_insert, node_or_elem, size_or_letter);
+
+    if (comparer_to_insert > comparer_curr)
+    {
+        TRACE(TRACE_DETAIL, "to_insert (%lld) greater than root (%lld): inserting and swapping", comparer_to_insert,
+              comparer_curr);
+        insert_elem(to_insert, root, 1);
+        return root;
+    }
+    else
+    {
+        while (comparer_curr > comparer_to_insert)
+        {
+            if (curr->next == NULL)
+            {
+                TRACE(TRACE_DETAIL, "reached the end of the occurrences: inserting (%lld) at the end", comparer_to_insert);
+                curr->next = to_insert;
+                return to_insert;
+            }
+            else
+            {
+                TRACE(TRACE_DETAIL, "to_insert (%lld) smaller than curr (%lld): continuing", comparer_to_insert, comparer_curr);
+                curr = curr->next;
+                new_compare(&comparer_curr, &comparer_to_insert, curr, to_insert, node_or_elem, size_or_letter);
+            }
+        }
+        TRACE(TRACE_DETAIL, "to_insert (%lld) greater than or equal to curr (%lld): inserting", comparer_to_insert,
+              comparer_curr);
+        insert_elem(to_insert, curr, 1);
+        return to_insert;
+    }
+}
+
+int SPACING = 10;
+// Displays a tree with the leaves first, going back to the root
+void print_tree_2D(Node *root, int space)
+{
+    if (root == NULL)
+        return;
+
+    space += SPACING;
+
+    // Process right children first
+    print_tree_2D(root->right, space);
+
+    // Display the current node
+    printf("\n");
+    for (int i = SPACING; i < space; i++)
+        printf(" ");
+
+    if (root->letter == -1)
+    {
+        printf("(%lld)\n", root->size);
+    }
+    else
+    {
+        printf("(%s, %lld)\n", display_char(root->letter), root->size);
+    }
+
+    // Process left children afterwards
+    print_tree_2D(root->left, space);
+}
+
+void print_tree_2D_wrapper(struct Node *root)
+{
+    print_tree_2D(root, 0);
+}
+
+// G : fonction qui compresse un fichier texte
+//     Le fichier d’entree ne sera pas modifie, un autre fichier, contenant le texte compresse sera cree
+
+int len(Element *root)
+{
+    Element *curr = root;
+    int i;
+    for (i = 1; curr->next != NULL; i++)
+    {
+        curr = curr->next;
+    }
+    return i;
+}
+
+// Add occurrences to a new tab (kept in descending order) by dichotomy
+Element *get_occurrences_by_dichotomy(FILE *input_file)
+{
+    TRACE(TRACE_STEPS, "get_occurrences_by_dichotomy");
+
+    int curr_char = fgetc_ascii(input_file);
+
+    // Create and initialize the tab
+    Element *root;
+    if (curr_char == EOF)
+    {
+        printf("Error: file is empty.");
+        exit(EXIT_FAILURE);
+    }
+    else
+    {
+        root = new_element(curr_char);
+        TRACE(TRACE_BYTES, "starting with character %lld, adding with occurrence 1", curr_char);
+        curr_char = fgetc_ascii(input_file);
+    }
+
+    int lower_bnd, upper_bnd, middle;
+    Element *curr;
+
+    int curr_len = 1;
+    while (curr_char != EOF)
+    {
+        lower_bnd = 0;
+        upper_bnd = curr_len - 1;
+        middle = (upper_bnd + lower_bnd) / 2;
+        curr = get_element(root, middle);
+        TRACE(TRACE_BYTES, "searching for the next letter %lld (lower bound: %lld, upper bound: %lld)", curr_char,
+              lower_bnd, upper_bnd);
+        while (lower_bnd < upper_bnd)
+        {
+            if (curr_char > curr->letter)
+            {
+                upper_bnd = middle - 1;
+            }
+            else if (curr_char < curr->letter)
+            {
+                lower_bnd = middle + 1;
+            }
+            else
+            {
+                lower_bnd = middle;
+                upper_bnd = middle; //End the while loop
+            }
+            TRACE(TRACE_BYTES, "index %lld holds letter %lld, new boundaries: (%lld, %lld)", middle, curr->letter,
+                  lower_bnd, upper_bnd);
+            middle = (upper_bnd + lower_bnd) / 2;
+            curr = get_element(root, middle);
+        }
+
+        if (curr->letter == curr_char)
+        {
+            TRACE(TRACE_BYTES, "letter %lld already exists, new occurrence: %lld", curr_char, curr->occ + 1);
+            curr->occ++;
+        }
+        else
+        {
+            TRACE(TRACE_BYTES, "letter %lld isn't in the list, adding with occurrence 1", curr_char);
+
+            if (curr_char < curr->letter)
+            {
+                insert_elem(new_element(curr_char), curr, 0);
+            }
+            else
+            {
+                insert_elem(new_element(curr_char), curr, 1);
+            }
+            curr_len++;
+        }
+
+        curr_char = fgetc_ascii(input_file);
+    }
+    fseeko(input_file, 0, SEEK_SET);
+
+    if (TRACE_ENABLED(TRACE_DETAIL))
+    {
+        for (curr = root; curr != NULL; curr = curr->next)
+        {
+            TRACE(TRACE_DETAIL, "got occurrences: letter %lld, %lld times", curr->letter, curr->occ);
+        }
+    }
+
+    return root;
+}
+
+// J : Fonction qui trie un tableau de noeuds en fonction des occurrences
+
+// C Implementation of the Quick Sorting Algorithm for Linked List
+void quick_sorting(Element *root, int first, int last)
+{
+    int pivot;
+    if (first < last)
+    {
+        pivot = first; //On definit le pivot au debut
+        long long curr_pivot_occ = get_element(root, pivot)->occ;
+
+        int i = first, j = last;
+        while (i < j)
+        {
+            // On cherche un element plus grand que le pivot a gauche
+            while ((get_element(root, i)->occ >= curr_pivot_occ) && (i < last))
+            {
+                i++;
+            }
+
+            // On cherche un element plus petit que le pivot a droite
+            while (get_element(root, j)->occ < curr_pivot_occ)
+            {
+                j--;
+            }
+
+            // Si les deux éléments existent, on les échange
+            if (i < j)
+            {
+                swap(get_element(root, i), get_element(root, j));
+            }
+        }
+
+        swap(get_element(root, pivot), get_element(root, j));
+        quick_sorting(root, first, j - 1); // On repete l'operation jusqu'a obtenir les deux sub-tables
+        quick_sorting(root, j + 1, last);
+    }
+}
+
+void quick_sorting_wrapper(Element *root)
+{
+    quick_sorting(root, 0, len(root) - 1);
+}
+
+void new_code(char zero_or_one, Node *node)
+{
+    char *old_code = node->code;
+    node->code = insert_char_in_front(zero_or_one, old_code);
+    if (old_code != EMPTY_CODE)
+    {
+        mem_free(old_code);
+    }
+}
+
+void propagate_new_code(char zero_or_one, Node *node)
+{
+    new_code(zero_or_one, node);
+    if (node->left != NULL)
+    {
+        propagate_new_code(zero_or_one, node->left);
+    }
+
+    if (node->right != NULL)
+    {
+        propagate_new_code(zero_or_one, node->right);
+    }
+}
+
+Element *copy_elems_shallow_nodes(Element *root)
+{
+    if (root == NULL)
+    {
+        return NULL;
+    }
+    else
+    {
+        Element *new_root = new_element(root->letter);
+        new_root->occ = root->occ;
+        free_node(new_root->node);
+        new_root->node = root->node;
+        new_root->next = copy_elems_shallow_nodes(root->next);
+        return new_root;
+    }
+}
+
+// Upper bound on the sum of all the occurrences, so that the weights of the inner nodes
+// (sums of the weights below them) can never overflow a long long
+long long MAX_TOTAL_OCC = LLONG_MAX / 2;
+
+// Whether the occurrences shifted right by shift bits (at least 1) add up to at most
+// MAX_TOTAL_OCC; the sum stops before it could wrap around
+static int occurrences_fit(Element *root, int shift)
+{
+    unsigned long long total = 0;
+    for (Element *curr = root; curr != NULL; curr = curr->next)
+    {
+        unsigned long long occ = (curr->occ >> shift) > 0 ? (unsigned long long)(curr->occ >> shift) : 1;
+        if (occ > (unsigned long long)MAX_TOTAL_OCC - total)
+        {
+            return 0;
+        }
+        total += occ;
+    }
+    return 1;
+}
+
+// Scales the occurrences down by powers of two until their sum fits under MAX_TOTAL_OCC,
+// keeping every letter present in the list with an occurrence of at least 1
+void normalize_occurrences(Element *root)
+{
+    int shift = 0;
+    while (!occurrences_fit(root, shift))
+    {
+        shift++;
+    }
+
+    if (shift > 0)
+    {
+        for (Element *curr = root; curr != NULL; curr = curr->next)
+        {
+            curr->occ = (curr->occ >> shift) > 0 ? (curr->occ >> shift) : 1;
+        }
+    }
+}
+
+HuffmanTree *huffman_tree_from_occurrences(Element *root)
+{
+    normalize_occurrences(root);
+    quick_sorting_wrapper(root);
+    for (Element *curr = root; curr != NULL; curr = curr->next)
+    {
+        free_node(curr->node);
+        curr->node = new_node(curr->letter, curr->occ, NULL, NULL, curr);
+    }
+
+    Element *dict = copy_elems_shallow_nodes(root);
+
+    int curr_len = len(root);
+    while (curr_len > 1)
+    {
+        Element *first = get_element(root, curr_len - 1);
+        Element *second = get_element(root, curr_len - 2);
+
+        propagate_new_code('0', first->node);
+        propagate_new_code('1', second->node);
+
+        Element *sum_elem = tree_alloc(sizeof(Element));
+        sum_elem->letter = -1;
+        sum_elem->occ = -1;
+        sum_elem->node = new_node(-1, first->node->size + second->node->size, first->node, second->node, sum_elem);
+        insert_elem_desc(root, sum_elem, 0, 0);
+
+        get_element(root, curr_len - 2)->next = NULL;
+        first->next = NULL;
+        second->next = NULL;
+        curr_len = curr_len - 1;
+    }
+
+    // A text made of a single letter still needs a one-bit code for that letter
+    if (root->node->left == NULL && root->node->right == NULL)
+    {
+        propagate_new_code('0', root->node);
+    }
+
+    HuffmanTree *huffman_tree = tree_alloc(sizeof(HuffmanTree));
+    huffman_tree->root_dict = dict;
+    huffman_tree->root_node = root->node;
+
+    return huffman_tree;
+}
+
+// Each node of the tree is held by one element of the list it was built from, sums
+// included (node->element_ref, kept up to date by swap); the dictionary shares the leaves
+static void free_tree_nodes(Node *node)
+{
+    if (node != NULL)
+    {
+        free_tree_nodes(node->left);
+        free_tree_nodes(node->right);
+        mem_free(node->element_ref);
+        free_node(node);
+    }
+}
+
+void huffman_tree_free(HuffmanTree *huffman_tree)
+{
+    if (huffman_tree == NULL)
+    {
+        return;
+    }
+    free_tree_nodes(huffman_tree->root_node);
+    for (Element *curr = huffman_tree->root_dict; curr != NULL;)
+    {
+        Element *next = curr->next;
+        mem_free(curr);
+        curr = next;
+    }
+    mem_free(huffman_tree);
+}
+
+char *delim = ": ";
+char *separator = "\n";
+
+void write_huffman_dict(FILE *dict_file, Element *dict)
+{
+    Element *curr_elem = dict;
+
+    if (dict_file != NULL && curr_elem != NULL)
+    {
+        while (curr_elem != NULL)
+        {
+            fprintf(dict_file, "%s%s%s%s", display_char(curr_elem->letter), delim, curr_elem->node->code, separator);
+            curr_elem = curr_elem->next;
+        }
+        fseeko(dict_file, 0, SEEK_SET);
+    }
+}
+
+FILE *open_file(char *file, char *mode)
+{
+    FILE *input_file = fopen(file, mode);
+    if (input_file == NULL)
+    {                                                  // Si fopen n'arrive pas a ouvrir le fichier
+        printf("Error: input file cannot be opened."); // Message d'erreur
+        exit(EXIT_FAILURE);                            // Arrêt du programme
+    }
+    return input_file;
+}
+
+int char_to_binary(int word)
+{
+    int res = 0, i = 1;
+    while (word > 0)
+    {
+        //printf("%d %d %d\n", word % 2 , i, word);
+        res = res + (i * (word % 2));
+        word = word / 2;
+        i = i * 10;
+    }
+    return res;
+}
+
+long long nb_char_in_file(FILE *input_file)
+{
+    long long cpt = 0;
+    int curr_char;
+    TRACE(TRACE_STEPS, "nb_char_in_file");
+    if (input_file != NULL)
+    {
+        while ((curr_char = fgetc(input_file)) != EOF)
+        {
+            cpt++;
+            TRACE(TRACE_BYTES, "letter %lld (%lld)", curr_char, cpt);
+        }
+    }
+    fseeko(input_file, 0, SEEK_SET);
+    TRACE(TRACE_STEPS, "got %lld chars", cpt);
+    return cpt;
+}
+
+// Size of the blocks of packed bytes converted at once by the bit-string kernels
+size_t BITSTRING_BLOCK = 1 << 16;
+
+void file_to_binary_file(FILE *input_file, FILE *output_file)
+{
+    if (input_file != NULL && output_file != NULL)
+    {
+        TRACE(TRACE_STEPS, "file_to_binary_file");
+
+        unsigned char *bytes = malloc(BITSTRING_BLOCK);
+        char *chars = malloc(8 * BITSTRING_BLOCK);
+        size_t nb_bytes;
+        while ((nb_bytes = fread(bytes, 1, BITSTRING_BLOCK, input_file)) > 0)
+        {
+            bits_to_ascii(bytes, nb_bytes, chars);
+            for (size_t i = 0; TRACE_ENABLED(TRACE_BYTES) && i < nb_bytes; i++)
+            {
+                TRACE(TRACE_BYTES, "byte %lld in binary", bytes[i]);
+            }
+            fwrite(chars, 1, 8 * nb_bytes, output_file);
+        }
+        free(bytes);
+        free(chars);
+
+        fseeko(input_file, 0, SEEK_SET);
+        fseeko(output_file, 0, SEEK_SET);
+    }
+}
+
+// Reverse of file_to_binary_file: packs a '0'/'1' text file (such as output.txt or
+// output_huffman.txt) into bytes, the last byte being padded with 0 bits.
+// Returns 0 on success, -1 if a character other than '0' or '1' is found
+int binary_file_to_file(FILE *input_file, FILE *output_file)
+{
+    if (input_file == NULL || output_file == NULL)
+    {
+        return -1;
+    }
+    TRACE(TRACE_STEPS, "binary_file_to_file");
+
+    char *chars = malloc(8 * BITSTRING_BLOCK);
+    unsigned char *bytes = malloc(BITSTRING_BLOCK);
+    long long offset = 0;
+    size_t nb_chars, valid;
+    int status = 0;
+
+    while ((nb_chars = fread(chars, 1, 8 * BITSTRING_BLOCK, input_file)) > 0)
+    {
+        valid = ascii_to_bits(chars, nb_chars, bytes);
+        if (valid != nb_chars)
+        {
+            // A trailing line break is tolerated at the very end of the text
+            size_t end = valid;
+            while (end < nb_chars && (chars[end] == '\n' || chars[end] == '\r'))
+            {
+                end++;
+            }
+            if (end != nb_chars || fgetc(input_file) != EOF)
+            {
+                printf("Error: unexpected character %s at offset %lld.\n", display_char((unsigned char)chars[valid]),
+                       offset + (long long)valid);
+                status = -1;
+                break;
+            }
+            nb_chars = valid;
+            ascii_to_bits(chars, nb_chars, bytes);
+        }
+        fwrite(bytes, 1, (nb_chars + 7) / 8, output_file);
+        offset += (long long)nb_chars;
+    }
+    free(chars);
+    free(bytes);
+
+    TRACE(TRACE_STEPS, "packed %lld bits", offset);
+    return status;
+}
+
+Element *find_elem_in_dict(Element *dict, char *value, int letter_or_code)
+{
+    Element *curr_elem = dict;
+    if (curr_elem != NULL)
+    {
+        while (curr_elem != NULL)
+        {
+            if (letter_or_code && strcmp(curr_elem->node->code, value) == 0)
+            {
+                return curr_elem;
+            }
+            else if (!letter_or_code && curr_elem->letter == (unsigned char)value[0])
+            {
+                return curr_elem;
+            }
+            else
+            {
+                curr_elem = curr_elem->next;
+            }
+        }
+    }
+    else
+    {
+        return NULL;
+    }
+    return NULL;
+}
+
+void compress_file(FILE *input, FILE *output, HuffmanTree *huffman_tree)
+{
+    if (input != NULL)
+    {
+        TRACE(TRACE_STEPS, "compress_file");
+        int curr_char;
+        char curr_byte;
+        char *curr_code;
+        Element *curr_elem;
+        while ((curr_char = fgetc_ascii(input)) != EOF)
+        {
+            curr_byte = (char)curr_char;
+            curr_elem = find_elem_in_dict(huffman_tree->root_dict, &curr_byte, 0);
+            curr_code = curr_elem->node->code;
+            fwrite(curr_code, 1, strlen(curr_code), output);
+
+            TRACE(TRACE_BYTES, "current character: %lld (writing %lld bits)", curr_char, strlen(curr_code));
+        }
+        TRACE(TRACE_STEPS, "reached end of file");
+
+        fseeko(input, 0, SEEK_SET);
+        fseeko(output, 0, SEEK_SET);
+    }
+    else
+    {
+        printf("Error: could not read input file");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void compress_file_wrapper(FILE *input, FILE *output)
+{
+    Element *occurrences = get_occurrences_by_dichotomy(input);
+    HuffmanTree *huffman_root = huffman_tree_from_occurrences(occurrences);
+
+    compress_file(input, output, huffman_root);
+    huffman_tree_free(huffman_root);
+}
+
+// Bits written by a tree for the given counts
+static unsigned long long tree_cost(const HuffmanTree *huffman_tree, const long long *histogram)
+{
+    unsigned long long bits = 0;
+    for (Element *curr = huffman_tree->root_dict; curr != NULL; curr = curr->next)
+    {
+        bits += (unsigned long long)histogram[curr->letter] * strlen(curr->node->code);
+    }
+    return bits;
+}
+
+HuffmanTree *compress_file_sampled(FILE *input, FILE *output, double sample_percent, SampledCompression *report)
+{
+    memset(report, 0, sizeof(SampledCompression));
+    off_t start = ftello(input);
+    if (start < 0 || fseeko(input, 0, SEEK_END) != 0 || ftello(input) <= start)
+    {
+        printf("Error: the input is empty or cannot be sampled.\n");
+        return NULL;
+    }
+    long long size = (long long)(ftello(input) - start);
+
+    // Evenly spaced chunks, the first at the start and the last at the end of the input
+    long long nb_chunks = (long long)((double)size * sample_percent / 100.0 / SAMPLE_CHUNK_SIZE) + 1;
+    long long chunk_size = SAMPLE_CHUNK_SIZE;
+    if (nb_chunks * chunk_size >= size)
+    {
+        nb_chunks = 1;
+        chunk_size = size;
+    }
+    long long step = nb_chunks > 1 ? (size - chunk_size) / (nb_chunks - 1) : 0;
+
+    unsigned char *buffer = mem_alloc(SAMPLE_CHUNK_SIZE);
+    char *bits = mem_alloc(8 * SAMPLE_CHUNK_SIZE);
+    if (buffer == NULL || bits == NULL)
+    {
+        printf("Error: not enough memory to sample the input.\n");
+        mem_free(buffer);
+        mem_free(bits);
+        return NULL;
+    }
+    long long sampled[NB_SYMBOLS] = {0};
+    for (long long i = 0; i < nb_chunks; i++)
+    {
+        fseeko(input, start + (off_t)(i * step), SEEK_SET);
+        for (long long remaining = chunk_size; remaining > 0;)
+        {
+            size_t nb_bytes = fread(buffer, 1, remaining < SAMPLE_CHUNK_SIZE ? (size_t)remaining : SAMPLE_CHUNK_SIZE,
+                                    input);
+            if (nb_bytes == 0)
+            {
+                break;
+            }
+            histogram_add_buffer(sampled, buffer, nb_bytes);
+            report->sampled_bytes += (long long)nb_bytes;
+            remaining -= (long long)nb_bytes;
+        }
+    }
+
+    // The fallback: a letter missing from the sample is counted once, so it still gets a
+    // code, at least as long as the codes of the rarest letters of the sample
+    int missing[NB_SYMBOLS];
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        missing[c] = sampled[c] == 0;
+        sampled[c] = missing[c] ? 1 : sampled[c];
+    }
+    HuffmanTree *huffman_tree = huffman_tree_from_occurrences(occurrences_from_histogram(sampled));
+    const char *codes[NB_SYMBOLS];
+    size_t lengths[NB_SYMBOLS];
+    for (Element *curr = huffman_tree->root_dict; curr != NULL; curr = curr->next)
+    {
+        codes[curr->letter] = curr->node->code;
+        lengths[curr->letter] = strlen(curr->node->code);
+    }
+
+    // The single pass over the input, counting the exact histogram for the report
+    long long exact[NB_SYMBOLS] = {0};
+    size_t nb_bytes;
+    fseeko(input, start, SEEK_SET);
+    while ((nb_bytes = fread(buffer, 1, SAMPLE_CHUNK_SIZE, input)) > 0)
+    {
+        size_t pos = 0;
+        for (size_t i = 0; i < nb_bytes; i++)
+        {
+            size_t length = lengths[buffer[i]];
+            if (pos + length > 8 * SAMPLE_CHUNK_SIZE)
+            {
+                fwrite(bits, 1, pos, output);
+                pos = 0;
+            }
+            memcpy(bits + pos, codes[buffer[i]], length);
+            pos += length;
+            exact[buffer[i]]++;
+        }
+        fwrite(bits, 1, pos, output);
+        report->raw_size += (long long)nb_bytes;
+    }
+    mem_free(buffer);
+    mem_free(bits);
+    fseeko(input, start, SEEK_SET);
+    fseeko(output, 0, SEEK_SET);
+
+    report->bits = tree_cost(huffman_tree, exact);
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        report->nb_fallback_letters += exact[c] > 0 && missing[c];
+    }
+    HuffmanTree *exact_tree = huffman_tree_from_occurrences(occurrences_from_histogram(exact));
+    report->exact_bits = tree_cost(exact_tree, exact);
+    huffman_tree_free(exact_tree);
+    TRACE(TRACE_STEPS, "sampled %lld of %lld bytes: %lld bits instead of %lld", report->sampled_bytes,
+          report->raw_size, report->bits, report->exact_bits);
+    return huffman_tree;
+}
+
+// Loads the whole file in a NUL-terminated buffer; the file is left open and rewound
+char *load_full_file(FILE *file)
+{
+    char *buffer = 0;
+    off_t length;
+
+    if (file)
+    {
+        fseeko(file, 0, SEEK_END);
+        length = ftello(file);
+        fseeko(file, 0, SEEK_SET);
+        if (length >= 0 && (unsigned long long)length < (size_t)-1)
+        {
+            buffer = malloc((size_t)length + 1);
+        }
+        if (buffer)
+        {
+            size_t read = fread(buffer, 1, (size_t)length, file);
+            buffer[read] = '\0';
+        }
+        fseeko(file, 0, SEEK_SET);
+    }
+
+    if (buffer)
+    {
+        return buffer;
+    }
+    else
+    {
+        return NULL;
+    }
+}
+
+int dict_parse(const char *text, size_t length, DictCodes *dict)
+{
+    size_t delim_length = strlen(delim);
+    int line = 1;
+
+    memset(dict, 0, sizeof(DictCodes));
+    for (size_t pos = 0; pos < length; line++)
+    {
+        const char *start = text + pos;
+        const char *end = memchr(start, separator[0], length - pos);
+        size_t line_length = end != NULL ? (size_t)(end - start) : length - pos;
+        pos += line_length + 1;
+        if (line_length > 0 && start[line_length - 1] == '\r')
+        {
+            line_length--;
+        }
+        if (line_length == 0)
+        {
+            continue;
+        }
+
+        // The name has at least one character, so that the line of ':' is ":: <code>"
+        size_t split = 1;
+        while (split + delim_length <= line_length && memcmp(start + split, delim, delim_length) != 0)
+        {
+            split++;
+        }
+        if (split + delim_length > line_length)
+        {
+            return line;
+        }
+        const char *code = start + split + delim_length;
+        size_t code_length = line_length - split - delim_length;
+        int letter = letter_from_display_name(start, split);
+        if (letter < 0 || dict->lengths[letter] > 0 || code_length == 0 || code_length > DICT_MAX_CODE_LENGTH)
+        {
+            return line;
+        }
+        for (size_t i = 0; i < code_length; i++)
+        {
+            if (code[i] != '0' && code[i] != '1')
+            {
+                return line;
+            }
+        }
+        dict->codes[letter] = code;
+        dict->lengths[letter] = (unsigned char)code_length;
+        dict->nb_letters++;
+    }
+    return 0;
+}
+
+Element *decode_dict(FILE *input_dictionary)
+{
+    if (input_dictionary == NULL)
+    {
+        printf("Error: input dictionary is empty.\n");
+        return NULL;
+    }
+
+    char *file_buffer = load_full_file(input_dictionary);
+    DictCodes dict;
+    int line = file_buffer != NULL ? dict_parse(file_buffer, strlen(file_buffer), &dict) : 1;
+    Element *root_elem = NULL, *last_elem = NULL;
+
+    if (line == 0 && dict.nb_letters == 0)
+    {
+        printf("Error: the dictionary is empty.\n");
+    }
+    else if (line != 0)
+    {
+        printf("Error: the dictionary is wrongly formatted (line %d).\n", line);
+    }
+    else
+    {
+        for (int c = 0; c < DICT_NB_LETTERS; c++)
+        {
+            if (dict.lengths[c] > 0)
+            {
+                Element *curr_elem = new_element(c);
+                curr_elem->node->code = copy_code(dict.codes[c], dict.lengths[c]);
+                if (last_elem == NULL)
+                {
+                    root_elem = curr_elem;
+                }
+                else
+                {
+                    last_elem->next = curr_elem;
+                }
+                last_elem = curr_elem;
+                TRACE(TRACE_DETAIL, "got letter %lld with a code of %lld bits", c, dict.lengths[c]);
+            }
+        }
+    }
+    free(file_buffer);
+    return root_elem;
+}
+
+void uncompress_file(FILE *input_compressed, FILE *input_dictionary, FILE *output_uncompressed)
+{
+    TRACE(TRACE_STEPS, "uncompress_file");
+    Element *huffman_dict = decode_dict(input_dictionary);
+
+    size_t max_size = 0;
+    for (Element *curr = huffman_dict; curr != NULL; curr = curr->next)
+    {
+        if (strlen(curr->node->code) > max_size)
+        {
+            max_size = strlen(curr->node->code);
+        }
+    }
+    char *curr_code = malloc(sizeof(char) * (max_size + 1));
+    curr_code[0] = '\0';
+    int curr_char;
+    char curr_bit;
+
+    if (input_compressed != NULL)
+    {
+        Element *curr_elem;
+        do
+        {
+            curr_char = fgetc_ascii(input_compressed);
+            if (curr_char == EOF)
+            {
+                TRACE(TRACE_STEPS, "reached end of file");
+            }
+            else if (strlen(curr_code) == max_size)
+            {
+                // No code of the dictionary is that long (or the dictionary is empty)
+                printf("Error: the compressed file holds a code that is not in the dictionary.\n");
+                curr_char = EOF;
+            }
+            else
+            {
+                curr_bit = (char)curr_char;
+                strncat(curr_code, &curr_bit, 1);
+                curr_elem = find_elem_in_dict(huffman_dict, curr_code, 1);
+                if (curr_elem != NULL)
+                {
+                    TRACE(TRACE_BYTES, "found code of %lld bits (writing %lld)", strlen(curr_code), curr_elem->letter);
+                    fwrite(&(curr_elem->letter), 1, 1, output_uncompressed);
+                    curr_code[0] = '\0';
+                }
+            }
+        } while (curr_char != EOF);
+        fseeko(input_compressed, 0, SEEK_SET);
+    }
+    else
+    {
+        printf("Error: could not read input file");
+        exit(EXIT_FAILURE);
+    }
+    free(curr_code);
+    free_elements(huffman_dict);
+}
@@ -1,1245 +1,666 @@
 #include <stdlib.h>
 #include <stdio.h>
-#include <math.h>
 #include <string.h>
 
-typedef struct Node
-{
-    int letter;                //  Contained letter in (= -1 if no letter is contained)
-    int size;                  //  Weight of the node
-    struct Node *left, *right; //  Pointers to the nodes below this Node
-    char *code;
-    struct Element *element_ref;
-} Node;
-
-typedef struct Element
-{
-    int letter;           //  Contained letter
-    struct Element *next; //  Pointer to the next element
-    int occ;              //  Number of occurrences of the letter
-    Node *node;           //  Associated Node structure
-} Element;
-
-typedef struct HuffmanTree
-{
-    Node *root_node;
-    Element *root_dict;
-} HuffmanTree;
-
-char *NaN = "NaN";
-char *_NULL = "NULL";
-char *NEWLINE = "LF/NL";
-char *TAB = "TAB";
-char *SPACE = "SPACE";
-char *DEL = "DEL";
-char *ALT = "ALT";
-char *SPECIAL = "CHR";
-
-char fgetc_ascii(FILE *file)
-{
-    char chr = fgetc(file);
-    int curr_char = (int)chr;
-    if (curr_char < -1 || curr_char > 255)
-    {
-        curr_char = 0;
+#include "huffman.h"
+#include "container.h"
+#include "pipeline.h"
+#include "memstats.h"
+#include "estimate.h"
+#include "tablecache.h"
+#include "daemon.h"
+#include "tokens.h"
+#include "archive.h"
+#include "syncdecode.h"
+#include "tableset.h"
+#include "search.h"
+#include "trace.h"
+
+void print_usage(char *program)
+{
+    printf("Usage: %s                         compress input.txt with the default files\n", program);
+    printf("       %s tobits <input> <output>   expand bytes into a '0'/'1' text file\n", program);
+    printf("       %s frombits <input> <output> pack a '0'/'1' text file into bytes\n", program);
+    printf("       %s compress <input> <output> compress into a block container\n", program);
+    printf("       %s uncompress <bits> <dict> <output> decode a '0'/'1' text and its dictionary on -j threads\n", program);
+    printf("       %s decompress <input> <output> restore the content of a block container\n", program);
+    printf("       %s append <container> <input> add the content of input at the end of a container\n", program);
+    printf("       %s search <container> <pattern> offsets of a string in a container, not decompressed\n", program);
+    printf("       %s estimate <input>          compressed size, without compressing\n", program);
+    printf("       %s count <input> <histogram> count the letters of input into a histogram file\n", program);
+    printf("       %s merge <output> <histogram>... add up histogram files (from shards of the same data)\n", program);
+    printf("       %s dict <histogram> <dict>   write the Huffman dictionary of a histogram file\n", program);
+    printf("       %s train <tables> <name> <sample>... add a table trained on samples to a table set\n", program);
+    printf("       %s archive <archive> <file>... add files to an archive with shared tables (created if missing)\n", program);
+    printf("       %s extract <archive> <name> <output> extract one member of an archive\n", program);
+    printf("       %s list <archive>            list the members of an archive\n", program);
+    printf("       %s daemon <socket>           serve compress/decompress requests on a Unix socket\n", program);
+    printf("       %s client <socket> compress|decompress <input> <output> send a request to a daemon\n", program);
+    printf("       %s client <socket> stats     print the latency percentiles of a daemon\n", program);
+    printf("Options: -j N               number of coder (or daemon worker) threads, one per processor by default\n");
+    printf("         --max-memory SIZE  keep the codec buffers under SIZE bytes (K, M and G suffixes)\n");
+    printf("         --stats            print the peak memory use and the table cache use on stderr\n");
+    printf("         --sample           estimate from a sample of the input (approximate, for huge files);\n");
+    printf("                            without a command, build the code from a sample and read input.txt once\n");
+    printf("         --tokens NAME      compress whole tokens instead of bytes: words, fields or lines\n");
+    printf("         --transform LIST   transform the blocks before coding them, e.g. bwt,mtf,rle or delta4,shuffle4\n");
+    printf("         --kernel NAME      encode kernel: auto (default), scalar, avx2 or avx512\n");
+    printf("         --backend NAME     entropy coder of the blocks: huffman (default), tans, or auto for each block\n");
+    printf("         --tables FILE      let the blocks use the tables of a set made by train (needed to decompress)\n");
+}
+
+void print_memory_stats(void)
+{
+    MemoryStats stats;
+    memory_get_stats(&stats);
+    fprintf(stderr, "Peak memory: %lld bytes", stats.peak);
+    if (stats.limit > 0)
+    {
+        fprintf(stderr, " (limit %lld bytes, %lld allocations refused)", stats.limit, stats.failures);
+    }
+    fprintf(stderr, "\n");
+    for (int subsystem = 0; subsystem < MEM_NB_SUBSYSTEMS; subsystem++)
+    {
+        MemoryUsage usage;
+        memory_get_usage(subsystem, &usage);
+        fprintf(stderr, "  %-8s %lld allocations, %lld still allocated (%lld bytes)\n",
+                memory_subsystem_name(subsystem), usage.allocations, usage.live, usage.bytes);
+    }
+
+    TableCacheStats cache;
+    table_cache_get_stats(&cache);
+    fprintf(stderr, "Table cache: %lld hits, %lld misses, %d/%d tables\n", cache.hits, cache.misses, cache.nb_entries,
+            cache.capacity);
+}
+
+// Reads a histogram file written by the count or merge commands; returns 0, or -1
+int read_histogram_file(char *path, long long *histogram)
+{
+    unsigned char buffer[HISTOGRAM_MAX_SERIALIZED_SIZE + 1];
+    FILE *file = open_file(path, "rb");
+    size_t size = fread(buffer, 1, sizeof(buffer), file);
+    fclose(file);
+
+    if (size > HISTOGRAM_MAX_SERIALIZED_SIZE || histogram_deserialize(buffer, size, histogram) != size)
+    {
+        printf("Error: %s is not a histogram file.\n", path);
+        return -1;
     }
-    chr = (char)curr_char;
-    return chr;
+    return 0;
 }
 
-char *display_char(char chr)
+int write_histogram_file(char *path, const long long *histogram)
 {
-    int c = (int)chr;
-    char *new_chr = NULL;
+    unsigned char buffer[HISTOGRAM_MAX_SERIALIZED_SIZE];
+    size_t size = histogram_serialize(histogram, buffer);
+    FILE *file = open_file(path, "wb");
+    int status = fwrite(buffer, 1, size, file) == size ? 0 : -1;
 
-    switch (c)
+    if (fclose(file) != 0 || status != 0)
     {
-    case 0:
-        new_chr = _NULL;
-        break;
-
-    case 10:
-        new_chr = NEWLINE;
-        break;
-
-    case 9:
-        new_chr = TAB;
-        break;
-
-    case 32:
-        new_chr = SPACE;
-        break;
-
-    case 127:
-        new_chr = DEL;
-        break;
-
-    case 255:
-        new_chr = ALT;
-        break;
-
-    default:
-        if (c < 0 || c > 255)
-        {
-            new_chr = NaN;
-        }
-        else if (c < 32)
-        {
-            new_chr = malloc(strlen(SPECIAL) + 2);
-            sprintf(new_chr, "%s%02d", SPECIAL, c);
-        }
-        else
-        {
-            new_chr = malloc(2*sizeof(char));
-            new_chr[0] = (char)c;
-            new_chr[1] = '\0';
-        }
+        printf("Error: could not write %s.\n", path);
+        return -1;
     }
-
-    return new_chr;
+    return 0;
 }
 
-
-Element *get_element(Element *root, int index)
+// Reads a whole file in memory (allocated with malloc); returns NULL on error
+unsigned char *read_whole_file(char *path, size_t *length)
 {
-    if (index >= 0)
+    FILE *file = open_file(path, "rb");
+    unsigned char *data = NULL;
+
+    if (fseeko(file, 0, SEEK_END) == 0)
     {
-        Element *curr = root;
-        for (int i = 0; i < index; i++)
+        *length = (size_t)ftello(file);
+        fseeko(file, 0, SEEK_SET);
+        data = malloc(*length + 1);
+        if (data != NULL && fread(data, 1, *length, file) != *length)
         {
-            if (curr->next != NULL)
-            {
-                curr = curr->next;
-            }
-            else
-            {
-                exit(EXIT_FAILURE);
-            }
+            free(data);
+            data = NULL;
         }
-        return curr;
     }
-    else
+    fclose(file);
+    if (data == NULL)
     {
-        exit(EXIT_FAILURE);
+        printf("Error: could not read %s.\n", path);
     }
+    return data;
 }
 
-char get_char_from_display_char(char *display_chr)
+static void print_sampled_compression(const SampledCompression *report)
 {
-    if (strlen(display_chr) == 1)
-    {
-        return *display_chr;
-    }
-    else if (strlen(display_chr) == 0)
-    {
-        return -1;
-    }
-    else
-    {
-        if (strcmp(display_chr, NaN)  == 0)
-        {
-            return -1;
-        }
-        else if (strcmp(display_chr, _NULL) == 0)
-        {
-            return 0;
-        }
-        else if (strcmp(display_chr, NEWLINE) == 0)
-        {
-            return 10;
-        }
-        else if (strcmp(display_chr, TAB) == 0)
-        {
-            return 9;
-        }
-        else if (strcmp(display_chr, SPACE) == 0)
-        {
-            return 32;
-        }
-        else if (strcmp(display_chr, DEL) == 0)
-        {
-            return 127;
-        }
-        else if (strcmp(display_chr, ALT) == 0)
-        {
-            return 255;
-        }
-        else if (strlen(display_chr) == strlen(SPECIAL) + 2 && strncmp(SPECIAL, display_chr, strlen(SPECIAL)) == 0)
-        {
-            int chr;
-            sscanf(display_chr, "%s%02d", ((char*)0), &chr);
-            return ((char)chr);
-        }
-    }
+    double lost = report->exact_bits > 0 ? 100.0 * ((double)report->bits / (double)report->exact_bits - 1.0) : 0;
+    printf("Sampled %lld of %lld bytes (%.2f%%), read %lld bytes instead of %lld\n", report->sampled_bytes,
+           report->raw_size, report->raw_size > 0 ? 100.0 * (double)report->sampled_bytes / (double)report->raw_size : 0,
+           report->raw_size + report->sampled_bytes, 2 * report->raw_size);
+    printf("Letters missing from the sample: %d\n", report->nb_fallback_letters);
+    printf("Coded in %llu bits, %llu with the exact histogram (%+.3f%%)\n", report->bits, report->exact_bits, lost);
 }
 
-void print_node(Node *node)
+// Reads a table set file; returns 0, or -1 after printing an error
+static int read_table_set_file(char *path, TableSet *set)
 {
-    Node *left = node->left;
-    Node *right = node->right;
-
-    if (left != NULL)
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
     {
-        if (left->letter == -1)
-        {
-            printf("(%d) <- ", left->size);
-        }
-        else
-        {
-            printf("(%s, %d) <- ", display_char(left->letter), left->size);
-        }
-    }
-    else
-    {
-        printf("  NULL  <- ");
-    }
-
-    if (node->letter == -1)
-    {
-        printf("(%d)", node->size);
-    }
-    else
-    {
-        printf("(%s, %d)", display_char(node->letter), node->size);
-    }
-
-    if (right != NULL)
-    {
-        if (right->letter == -1)
-        {
-            printf(" -> (%d)", right->size);
-        }
-        else
-        {
-            printf(" -> (%s, %d)", display_char(right->letter), left->size);
-        }
-    }
-    else
-    {
-        printf(" ->  EOF");
+        printf("Error: could not read %s.\n", path);
+        return -1;
     }
+    int status = table_set_read(set, file);
+    fclose(file);
+    return status;
 }
 
-void print_element(Element *element, int display_code, int elem_or_node)
+// Prints the events traced by any command when it exits, in builds with tracing
+static void dump_trace(void)
 {
-    if (elem_or_node)
-    {
-        if (display_code)
-        {
-            printf("-> %s: %d (%s)\n", display_char(element->node->letter), element->node->size, element->node->code);
-        }
-        else
-        {
-            printf("-> %s: %d\n", display_char(element->node->letter), element->node->size);
-        }
-    }
-    else
-    {
-        if (display_code)
-        {
-            printf("-> %s: %d (%s)\n", display_char(element->letter), element->occ, element->node->code);
-        }
-        else
-        {
-            printf("-> %s: %d\n", display_char(element->letter), element->occ);
-        }
-    }
+    trace_dump(stderr);
 }
 
-void print_occurrences(Element *root, int display_code, int elem_or_node)
+int main(int argc, char **argv)
 {
-    if (root == NULL)
+    static TableSet table_set;
+    int sample = 0;
+    if (TRACE_ENABLED(TRACE_STEPS))
     {
-        printf("Error: The linked list of occurrences is empty.");
-        return;
+        atexit(dump_trace);
     }
-    printf("\n");
-    Element *curr = root;
-    do
+    if (argc > 1)
     {
-        print_element(curr, display_code, elem_or_node);
-        curr = curr->next;
-    } while (curr != NULL);
-
-    printf("-> EOF\n");
-}
-
-// C : Fonction qui renvoie une liste contenant chaque caractere present dans le texte,
-//     ainsi que le nombre d’occurrences de ce caractere.
-
-int idx_letter(Element *root, char letter)
-{
-    if (root != NULL)
-    {
-        Element *curr = root;
-        for (int i = 0; curr != NULL; i++)
+        // Options may come anywhere after the program name; they are removed from argv
+        int nb_coders = pipeline_default_coders();
+        int show_stats = 0;
+        Tokenizer tokenizer;
+        int tokens = 0;
+        int nb_args = 1;
+        for (int i = 1; i < argc; i++)
         {
-            if (curr->letter == letter)
+            if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
             {
-                return i;
+                nb_coders = atoi(argv[++i]);
             }
-            curr = curr->next;
-        }
-    }
-    return -1;
-}
-
-Node *new_node(int letter, int occ, Node *left, Node *right, Element *element_ref)
-{
-    Node *node = malloc(sizeof(Node));
-    node->letter = letter;
-    node->size = occ;
-    node->left = left;
-    node->right = right;
-    node->code = "";
-    node->element_ref = element_ref;
-}
-
-Element *new_element(int letter)
-{
-    Element *new = malloc(sizeof(Element));
-    new->next = NULL;
-    new->letter = letter;
-    new->occ = 1;
-    new->node = new_node(-1, -1, NULL, NULL, new);
-
-    return new;
-}
-
-// To pass an entire array to a function, only the name of the array is passed as an argument
-Element *get_occurrences(char *text)
-{
-    int text_length = strlen(text), idx_occ;
-    if (text_length > 0)
-    {
-        Element *root = new_element(text[0]);
-        Element *curr = root;
-        for (int i = 1; i <= text_length - 1; i++)
-        {
-            idx_occ = idx_letter(root, text[i]);
-            if (idx_occ == -1)
+            else if (strcmp(argv[i], "--max-memory") == 0 && i + 1 < argc)
             {
-                curr->next = new_element(text[i]);
-                curr = curr->next;
+                long long limit = memory_parse_size(argv[++i]);
+                if (limit <= 0)
+                {
+                    printf("Error: invalid memory size %s.\n", argv[i]);
+                    return EXIT_FAILURE;
+                }
+                memory_set_limit(limit);
             }
-            else
+            else if (strcmp(argv[i], "--stats") == 0)
             {
-                get_element(root, idx_occ)->occ++;
+                show_stats = 1;
             }
-        }
-        return root;
-    }
-    return NULL;
-}
-
-// D : Fonction qui renvoie un arbre de Huffman, à partir d’une liste d’occurrences
-
-char *insert_char_in_front(char c, char *curr_string)
-{
-    int new_len = strlen(curr_string) + 1;
-    char *new_string = malloc(new_len * sizeof(char));
-    new_string[0] = c;
-
-    for (int i = 1; i <= new_len; i++)
-    {
-        if (i == new_len) {
-            new_string[i] = '\0';
-        } else {
-            new_string[i] = curr_string[i - 1];
-        }
-    }
-
-    return new_string;
-}
-
-void swap(Element *a, Element *b)
-{
-    Element *temp = malloc(sizeof(Element));
-
-    temp->letter = a->letter;
-    temp->occ = a->occ;
-    temp->node = a->node;
-
-    a->letter = b->letter;
-    a->occ = b->occ;
-    a->node = b->node;
-    a->node->element_ref = a;
-
-    b->letter = temp->letter;
-    b->occ = temp->occ;
-    b->node = temp->node;
-    b->node->element_ref = b;
-}
-
-void new_compare(int *comparer_curr, int *comparer_to_insert, Element *curr, Element *to_insert, int node_or_elem,
-                 int size_or_letter)
-{
-    if (size_or_letter)
-    {
-        if (node_or_elem)
-        {
-            *comparer_curr = curr->letter;
-            *comparer_to_insert = to_insert->letter;
-        }
-        else
-        {
-            *comparer_curr = curr->node->letter;
-            *comparer_to_insert = to_insert->node->letter;
-        }
-    }
-    else
-    {
-        if (node_or_elem)
-        {
-            *comparer_curr = curr->occ;
-            *comparer_to_insert = to_insert->occ;
-        }
-        else
-        {
-            *comparer_curr = curr->node->size;
-            *comparer_to_insert = to_insert->node->size;
-        }
-    }
-}
-
-void insert_elem(Element *to_insert, Element *after, int insert_before)
-{
-    Element *temp = after->next;
-    after->next = to_insert;
-    to_insert->next = temp;
-    if (insert_before)
-    {
-        swap(after, to_insert);
-    }
-}
-
-Element *insert_elem_desc(Element *root, Element *to_insert, int node_or_elem, int size_or_letter, int verbose)
-{
-    if (verbose)
-    {
-        printf("\n*** insert_elem_desc (%s, %s) ***", (node_or_elem ? "elem" : "node"), (size_or_letter ? "letter" : "size"));
-    }
-
-    Element *curr = root;
-    int comparer_curr, comparer_to_insert;
-    new_compare(&comparer_curr, &comparer_to_insert, curr, to_insert, node_or_elem, size_or_letter);
-
-    if (comparer_to_insert > comparer_curr)
-    {
-        if (verbose)
-        {
-            if (node_or_elem)
+            else if (strcmp(argv[i], "--sample") == 0)
             {
-                printf("\nto_insert (%s, %d) greater than root (%s, %d): inserting and swapping", display_char(to_insert->letter),
-                       to_insert->occ, display_char(root->letter), root->occ);
+                sample = 1;
             }
-            else
+            else if (strcmp(argv[i], "--tokens") == 0 && i + 1 < argc)
             {
-                printf("\nto_insert [");
-                print_node(to_insert->node);
-                printf("] greater than root [");
-                print_node(root->node);
-                printf("]: inserting and swapping");
+                if (tokenizer_init(&tokenizer, argv[++i]) != 0)
+                {
+                    return EXIT_FAILURE;
+                }
+                tokens = 1;
             }
-        }
-        insert_elem(to_insert, root, 1);
-        if (verbose)
-        {
-            printf("\n************************\n");
-        }
-        return root;
-    }
-    else
-    {
-        while (comparer_curr > comparer_to_insert)
-        {
-            if (curr->next == NULL)
+            else if (strcmp(argv[i], "--transform") == 0 && i + 1 < argc)
             {
-                if (node_or_elem)
+                if (transform_chain_parse(argv[++i], &CONTAINER_TRANSFORMS) != 0)
                 {
-                    printf("\nreached the end of the occurrences: inserting at the end");
+                    printf("Error: invalid transforms %s (rle, mtf, bwt, deltaN, then shuffleN; N = 2, 4, 8).\n",
+                           argv[i]);
+                    return EXIT_FAILURE;
                 }
-                else
+            }
+            else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc)
+            {
+                if ((ENCODE_KERNEL = encode_kernel_parse(argv[++i])) < 0)
                 {
-                    printf("\nreached the end of the occurrences: inserting at the end");
+                    printf("Error: invalid encode kernel %s (auto, scalar, avx2 or avx512).\n", argv[i]);
+                    return EXIT_FAILURE;
                 }
-                curr->next = to_insert;
-                if (verbose)
+            }
+            else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc)
+            {
+                if ((CONTAINER_BACKEND = container_backend_parse(argv[++i])) < 0)
                 {
-                    printf("\n************************\n");
+                    printf("Error: invalid backend %s (huffman, tans or auto).\n", argv[i]);
+                    return EXIT_FAILURE;
                 }
-                return to_insert;
             }
-            else
+            else if (strcmp(argv[i], "--tables") == 0 && i + 1 < argc)
             {
-                if (verbose)
+                if (read_table_set_file(argv[++i], &table_set) != 0)
                 {
-                    if (node_or_elem)
-                    {
-                        printf("\nto_insert (%s, %d) smaller than curr (%s, %d): continuing", display_char(to_insert->letter),
-                               to_insert->occ, display_char(curr->letter), curr->occ);
-                    }
-                    else
-                    {
-                        printf("\nto_insert [");
-                        print_node(to_insert->node);
-                        printf("] smaller than [");
-                        print_node(curr->node);
-                        printf("]: continuing");
-                    }
+                    return EXIT_FAILURE;
                 }
-                curr = curr->next;
-                new_compare(&comparer_curr, &comparer_to_insert, curr, to_insert, node_or_elem, size_or_letter);
+                CONTAINER_TABLE_SET = &table_set;
+            }
+            else
+            {
+                argv[nb_args++] = argv[i];
             }
         }
-        if (verbose)
+        argc = nb_args;
+
+        if (argc == 4 && (strcmp(argv[1], "tobits") == 0 || strcmp(argv[1], "frombits") == 0))
         {
-            if (node_or_elem)
+            FILE *input = open_file(argv[2], "rb");
+            FILE *output = open_file(argv[3], "wb");
+            int status = 0;
+
+            if (strcmp(argv[1], "tobits") == 0)
             {
-                printf("\nto_insert (%s, %d) greater than or equal to curr (%s, %d): inserting", display_char(to_insert->letter), to_insert->occ,
-                       display_char(curr->letter), curr->occ);
+                file_to_binary_file(input, output);
             }
             else
             {
-                printf("\nto_insert [");
-                print_node(to_insert->node);
-                printf("] greater than or equal to curr [");
-                print_node(curr->node);
-                printf("]: inserting");
+                status = binary_file_to_file(input, output);
             }
-        }
-        insert_elem(to_insert, curr, 1);
-        if (verbose)
-        {
-            printf("\n************************\n");
-        }
-        return to_insert;
-    }
-}
-
-int SPACING = 10;
-// Displays a tree with the leaves first, going back to the root
-void print_tree_2D(Node *root, int space)
-{
-    if (root == NULL)
-        return;
-
-    space += SPACING;
-
-    // Process right children first
-    print_tree_2D(root->right, space);
-
-    // Display the current node
-    printf("\n");
-    for (int i = SPACING; i < space; i++)
-        printf(" ");
-
-    if (root->letter == -1)
-    {
-        printf("(%d)\n", root->size);
-    }
-    else
-    {
-        printf("(%s, %d)\n", display_char(root->letter), root->size);
-    }
-
-    // Process left children afterwards
-    print_tree_2D(root->left, space);
-}
-
-void print_tree_2D_wrapper(struct Node *root)
-{
-    print_tree_2D(root, 0);
-}
-
-// G : fonction qui compresse un fichier texte
-//     Le fichier d’entree ne sera pas modifie, un autre fichier, contenant le texte compresse sera cree
-
-int len(Element *root)
-{
-    Element *curr = root;
-    int i;
-    for (i = 1; curr->next != NULL; i++)
-    {
-        curr = curr->next;
-    }
-    return i;
-}
 
-// Add occurrences to a new tab (kept in descending order) by dichotomy
-Element *get_occurrences_by_dichotomy(FILE *input_file, int verbose)
-{
-    if (verbose)
-    {
-        printf("\n*** get_occurrences_by_dichotomy ***\n");
-    }
-
-    char curr_char = fgetc_ascii(input_file);
-
-    // Create and initialize the tab
-    Element *root;
-    if (curr_char == EOF)
-    {
-        printf("Error: file is empty.");
-        exit(EXIT_FAILURE);
-    }
-    else
-    {
-        root = new_element(curr_char);
-        if (verbose)
-        {
-            printf("Starting with character %s, adding with occurence: %d\n", display_char(curr_char), 1);
+            fclose(input);
+            fclose(output);
+            return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
         }
-        curr_char = fgetc_ascii(input_file);
-    }
-
-    int lower_bnd, upper_bnd, middle;
-    Element *curr;
 
-    int curr_len = 1;
-    while (curr_char != EOF)
-    {
-        lower_bnd = 0;
-        upper_bnd = curr_len - 1;
-        middle = (upper_bnd + lower_bnd) / 2;
-        curr = get_element(root, middle);
-        if (verbose)
-        {
-            printf("\nSearching for the next letter: %s (%d) (lower bound: %d, upper bound: %d)", display_char(curr_char), curr_char, lower_bnd, upper_bnd);
-        }
-        while (lower_bnd < upper_bnd)
+        if (argc == 4 && (strcmp(argv[1], "compress") == 0 || strcmp(argv[1], "decompress") == 0))
         {
-            if (verbose)
+            FILE *input = open_file(argv[2], "rb");
+            FILE *output = open_file(argv[3], "w+b");
+            int status;
+
+            // The threaded pipeline needs positioned I/O and room for its buffers, otherwise
+            // the sequential path does the work. Token containers have a single code
+            if (strcmp(argv[1], "compress") == 0 && tokens)
             {
-                printf("\nSearching... lower: %d, upper: %d, middle: %d", lower_bnd, upper_bnd, middle);
-                printf("\nCurrent element: ");
-                print_element(curr, 0, 0);
+                status = token_compress(input, output, &tokenizer);
             }
-
-            if (curr_char > curr->letter)
+            else if (strcmp(argv[1], "compress") == 0)
             {
-                upper_bnd = middle - 1;
+                status = pipeline_compress(input, output, CONTAINER_BLOCK_SIZE, nb_coders);
+                if (status == 1)
+                {
+                    status = container_compress(input, output, CONTAINER_BLOCK_SIZE);
+                }
             }
-            else if (curr_char < curr->letter)
+            else if (token_file_detect(input))
             {
-                lower_bnd = middle + 1;
+                status = token_decompress(input, output);
             }
             else
             {
-                lower_bnd = middle;
-                upper_bnd = middle; //End the while loop
+                status = pipeline_decompress(input, output, nb_coders);
+                if (status == 1)
+                {
+                    status = container_decompress(input, output);
+                }
             }
-            if (verbose)
+            if (show_stats)
             {
-                printf("\nNearest index hasn't yet been reached; current index (idx: %d, letter: %s)\n", middle,
-                       display_char(curr->letter));
-                printf("New boundaries: (%d, %d)\n", lower_bnd, upper_bnd);
+                print_memory_stats();
             }
-            middle = (upper_bnd + lower_bnd) / 2;
-            curr = get_element(root, middle);
+
+            fclose(input);
+            fclose(output);
+            return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
         }
 
-        if (verbose)
+        if (argc == 4 && strcmp(argv[1], "append") == 0)
         {
-            printf("\nNearest index reached: %d", middle);
-            printf("\nCurrent element: ");
-            print_element(curr, 0, 0);
+            FILE *container = open_file(argv[2], "r+b");
+            FILE *input = open_file(argv[3], "rb");
+            int status = container_append(container, input);
+            if (show_stats)
+            {
+                print_memory_stats();
+            }
+
+            fclose(container);
+            fclose(input);
+            return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
         }
-        if (curr->letter == curr_char)
+
+        if (argc == 3 && strcmp(argv[1], "estimate") == 0)
         {
-            if (verbose)
+            FILE *input = open_file(argv[2], "rb");
+            SizeEstimate estimate;
+            int status = sample ? estimate_compressed_size_sampled(input, CONTAINER_BLOCK_SIZE, ESTIMATE_SAMPLES, &estimate)
+                                : estimate_compressed_size(input, CONTAINER_BLOCK_SIZE, &estimate);
+            fclose(input);
+            if (status != 0)
             {
-                printf("Letter %s already exists, new occurence: %d\n", display_char(curr_char), curr->occ + 1);
+                return EXIT_FAILURE;
             }
-            curr->occ++;
+
+            printf("Input:          %llu bytes%s\n", estimate.raw_size, estimate.sampled ? " (estimated from a sample)" : "");
+            printf("Payload:        %llu bits (%llu bytes) with one code table\n", estimate.payload_bits,
+                   (estimate.payload_bits + 7) / 8);
+            printf("Code table:     %llu bytes\n", estimate.table_bytes);
+            printf("Entropy bound:  %.0f bits (%.0f bytes)\n", estimate.entropy_bits, estimate.entropy_bits / 8);
+            printf("Container:      %llu bytes, ratio %.4f\n", estimate.container_bytes, estimate.ratio);
+            return EXIT_SUCCESS;
         }
-        else
+
+        if (argc == 4 && strcmp(argv[1], "count") == 0)
         {
-            if (verbose)
+            long long histogram[NB_SYMBOLS];
+            FILE *input = open_file(argv[2], "rb");
+            histogram_from_file(input, histogram);
+            fclose(input);
+            return write_histogram_file(argv[3], histogram) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        if (argc >= 4 && strcmp(argv[1], "merge") == 0)
+        {
+            long long merged[NB_SYMBOLS] = {0};
+            long long histogram[NB_SYMBOLS];
+            for (int i = 3; i < argc; i++)
             {
-                printf("Letter %s isn't in the list, adding with occurence: %d\n", display_char(curr_char), 1);
+                if (read_histogram_file(argv[i], histogram) != 0)
+                {
+                    return EXIT_FAILURE;
+                }
+                if (histogram_merge(merged, histogram) != 0)
+                {
+                    printf("Error: the merged counts overflow.\n");
+                    return EXIT_FAILURE;
+                }
             }
+            return write_histogram_file(argv[2], merged) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
 
-            if (curr_char < curr->letter)
+        if (argc == 4 && strcmp(argv[1], "dict") == 0)
+        {
+            long long histogram[NB_SYMBOLS];
+            if (read_histogram_file(argv[2], histogram) != 0)
             {
-                insert_elem(new_element(curr_char), curr, 0);
+                return EXIT_FAILURE;
             }
-            else
+            Element *occurrences = occurrences_from_histogram(histogram);
+            if (occurrences == NULL)
             {
-                insert_elem(new_element(curr_char), curr, 1);
+                printf("Error: the histogram is empty.\n");
+                return EXIT_FAILURE;
             }
-            //insert_elem_desc(root, new_element(curr_char), 1, 1, 1);
-            curr_len++;
+            HuffmanTree *huffman_tree = huffman_tree_from_occurrences(occurrences);
+            FILE *dict = open_file(argv[3], "w");
+            write_huffman_dict(dict, huffman_tree->root_dict);
+            huffman_tree_free(huffman_tree);
+            fclose(dict);
+            return EXIT_SUCCESS;
         }
 
-        curr_char = fgetc_ascii(input_file);
-    }
-    fseek(input_file, 0, SEEK_SET);
-
-    if (verbose)
-    {
-        printf("\ngot occurrences:");
-        print_occurrences(root, 0, 0);
-        printf("\n***********************************\n");
-    }
-
-    return root;
-}
-
-// J : Fonction qui trie un tableau de noeuds en fonction des occurrences
-
-// C Implementation of the Quick Sorting Algorithm for Linked List
-void quick_sorting(Element *root, int first, int last)
-{
-    int pivot;
-    if (first < last)
-    {
-        pivot = first; //On definit le pivot au debut
-        int curr_pivot_occ = get_element(root, pivot)->occ;
-
-        int i = first, j = last;
-        while (i < j)
+        if (argc >= 5 && strcmp(argv[1], "train") == 0)
         {
-            // On cherche un element plus grand que le pivot a gauche
-            while ((get_element(root, i)->occ >= curr_pivot_occ) && (i < last))
+            // The set is created on the first table, and a table trained again is replaced
+            FILE *existing = fopen(argv[2], "rb");
+            table_set_init(&table_set);
+            if (existing != NULL)
             {
-                i++;
+                int status = table_set_read(&table_set, existing);
+                fclose(existing);
+                if (status != 0)
+                {
+                    return EXIT_FAILURE;
+                }
             }
-
-            // On cherche un element plus petit que le pivot a droite
-            while (get_element(root, j)->occ < curr_pivot_occ)
+            long long histogram[NB_SYMBOLS] = {0};
+            for (int i = 4; i < argc; i++)
             {
-                j--;
+                long long sample_histogram[NB_SYMBOLS];
+                FILE *input = open_file(argv[i], "rb");
+                histogram_from_file(input, sample_histogram);
+                fclose(input);
+                histogram_merge(histogram, sample_histogram);
             }
-
-            // Si les deux éléments existent, on les échange
-            if (i < j)
+            if (table_set_train(&table_set, argv[3], histogram) != 0)
             {
-                swap(get_element(root, i), get_element(root, j));
+                return EXIT_FAILURE;
             }
-        }
-
-        swap(get_element(root, pivot), get_element(root, j));
-        quick_sorting(root, first, j - 1); // On repete l'operation jusqu'a obtenir les deux sub-tables
-        quick_sorting(root, j + 1, last);
-    }
-}
-
-void quick_sorting_wrapper(Element *root)
-{
-    quick_sorting(root, 0, len(root) - 1);
-}
-
-void new_code(char zero_or_one, Node *node)
-{
-    node->code = insert_char_in_front(zero_or_one, node->code);
-}
-
-void propagate_new_code(char zero_or_one, Node *node)
-{
-    new_code(zero_or_one, node);
-    if (node->left != NULL)
-    {
-        propagate_new_code(zero_or_one, node->left);
-    }
-
-    if (node->right != NULL)
-    {
-        propagate_new_code(zero_or_one, node->right);
-    }
-}
-
-Element *copy_elems_shallow_nodes(Element *root)
-{
-    if (root == NULL)
-    {
-        return NULL;
-    }
-    else
-    {
-        Element *new_root = new_element(root->letter);
-        new_root->occ = root->occ;
-        new_root->node = root->node;
-        new_root->next = copy_elems_shallow_nodes(root->next);
-        return new_root;
-    }
-}
-
-HuffmanTree *huffman_tree_from_occurrences(Element *root)
-{
-    quick_sorting_wrapper(root);
-    Element *curr = root;
-    curr->node = new_node(curr->letter, curr->occ, NULL, NULL, curr);
-
-    while (curr->next != NULL)
-    {
-        curr = curr->next;
-        curr->node = new_node(curr->letter, curr->occ, NULL, NULL, curr);
-    }
-
-    Element *dict = copy_elems_shallow_nodes(root);
-
-    int curr_len = len(root);
-    while (curr_len > 1)
-    {
-        Element *first = get_element(root, curr_len - 1);
-        Element *second = get_element(root, curr_len - 2);
-
-        propagate_new_code('0', first->node);
-        propagate_new_code('1', second->node);
-
-        Element *sum_elem = malloc(sizeof(Element));
-        sum_elem->letter = -1;
-        sum_elem->occ = -1;
-        sum_elem->node = new_node(-1, first->node->size + second->node->size, first->node, second->node, sum_elem);
-        insert_elem_desc(root, sum_elem, 0, 0, 1);
-
-        get_element(root, curr_len - 2)->next = NULL;
-        first->next = NULL;
-        second->next = NULL;
-        curr_len = curr_len - 1;
-    }
-    HuffmanTree *huffman_tree = malloc(sizeof(HuffmanTree));
-    huffman_tree->root_dict = dict;
-    huffman_tree->root_node = root->node;
-
-    return huffman_tree;
-}
-
-char *delim = ": ";
-char *separator = "\n";
-
-void write_huffman_dict(FILE *dict_file, Element *dict)
-{
-    Element *curr_elem = dict;
-    char *buffer;
-    char *curr_char;
-    char *curr_code;
-    int length;
-
-    char *string_format = malloc(sizeof(char) * (4 + strlen(delim) + strlen(separator)));
-    sprintf(string_format, "%s%s%s%s", "%s", delim, "%s", separator);
-
-    if (dict_file != NULL && curr_elem != NULL)
-    {
-        while (curr_elem != NULL)
-        {
-
-            curr_char = display_char(curr_elem->letter);
-            curr_code = curr_elem->node->code;
-            length = strlen(curr_char) + strlen(delim) + strlen(curr_code) + strlen(separator);
-
-            buffer = malloc(length * sizeof(char));
-            sprintf(buffer, string_format, curr_char, curr_code);
-            fwrite(buffer, 1, length, dict_file);
-
-            curr_elem = curr_elem->next;
-        }
-        fseek(dict_file, 0, SEEK_SET);
-    }
-}
-
-FILE *open_file(char *file, char *mode)
-{
-    FILE *input_file = fopen(file, mode);
-    if (input_file == NULL)
-    {                                                  // Si fopen n'arrive pas a ouvrir le fichier
-        printf("Error: input file cannot be opened."); // Message d'erreur
-        exit(EXIT_FAILURE);                            // Arrêt du programme
-    }
-    return input_file;
-}
-
-int char_to_binary(int word)
-{
-    int res = 0, i = 1;
-    while (word > 0)
-    {
-        //printf("%d %d %d\n", word % 2 , i, word);
-        res = res + (i * (word % 2));
-        word = word / 2;
-        i = i * 10;
-    }
-    return res;
-}
-
-int nb_char_in_file(FILE *input_file, int verbose)
-{
-    int cpt = 0;
-    char curr_char;
-    if (verbose)
-    {
-        printf("\n*** nb_char_in_file ***\n");
-    }
-    if (input_file != NULL)
-    {
-        do
-        {
-            curr_char = fgetc(input_file);
-            if (curr_char == EOF)
+            FILE *file = open_file(argv[2], "wb");
+            int status = table_set_write(&table_set, file);
+            if (fclose(file) != 0 || status != 0)
             {
-                printf("Reached end of file.\n");
+                printf("Error: could not write %s.\n", argv[2]);
+                return EXIT_FAILURE;
             }
-            else
+            printf("Table set %08x:", (unsigned int)table_set.id);
+            for (unsigned int t = 0; t < table_set.nb_tables; t++)
             {
-                cpt++;
-                if (verbose)
-                {
-                    printf("%s (%d)\n", display_char(curr_char), cpt);
-                }
+                printf(" %s", table_set.names[t]);
             }
-        } while (curr_char != EOF);
-    }
-    fseek(input_file, 0, SEEK_SET);
-    if (verbose)
-    {
-        printf("Got %d chars.", cpt);
-        printf("\n***********************\n");
-    }
-    return cpt;
-}
-
-void file_to_binary_file(FILE *input_file, FILE *output_file, int verbose)
-{
-    if (input_file != NULL && output_file != NULL)
-    {
-        if (verbose)
-        {
-            printf("\n*** file_to_binary_file ***\n");
-            printf("In binary: ");
+            printf("\n");
+            return EXIT_SUCCESS;
         }
 
-        char chr;
-        int bin;
-        do
+        if (argc >= 4 && strcmp(argv[1], "archive") == 0)
         {
-            chr = fgetc_ascii(input_file);
-            bin = char_to_binary((int)chr);
-            if (verbose)
+            // Every input is checked first: read_whole_file stops the program on a missing file
+            for (int i = 3; i < argc; i++)
             {
-                printf("\n%s: %08d", display_char(chr), bin);
+                FILE *input = fopen(argv[i], "rb");
+                if (input == NULL)
+                {
+                    printf("Error: could not read %s.\n", argv[i]);
+                    return EXIT_FAILURE;
+                }
+                fclose(input);
             }
-            fprintf(output_file, "%08d", bin);
-        } while (chr != EOF);
-
-        fseek(input_file, 0, SEEK_SET);
-        fseek(output_file, 0, SEEK_SET);
-        if (verbose)
-        {
-            printf("\n***************************\n");
-        }
-    }
-}
 
-Element *find_elem_in_dict(Element *dict, char *value, int letter_or_code)
-{
-    Element *curr_elem = dict;
-    if (curr_elem != NULL)
-    {
-        while (curr_elem != NULL)
-        {
-            if (letter_or_code && strcmp(curr_elem->node->code, value) == 0)
+            Archive archive;
+            FILE *file = fopen(argv[2], "r+b");
+            int status = file != NULL ? archive_open(&archive, file) : -1;
+            if (file == NULL)
             {
-                return curr_elem;
+                file = open_file(argv[2], "w+b");
+                status = archive_create(&archive, file);
             }
-            else if (!letter_or_code && curr_elem->letter == value[0])
+            // The members added before an error stay in the archive
+            int opened = status == 0;
+            for (int i = 3; i < argc && status == 0; i++)
             {
-                return curr_elem;
+                size_t length;
+                unsigned char *data = read_whole_file(argv[i], &length);
+                status = data != NULL ? archive_add(&archive, argv[i], data, length) : -1;
+                free(data);
             }
-            else
+            if (opened && archive_finish(&archive) != 0)
             {
-                curr_elem = curr_elem->next;
+                status = -1;
             }
+            archive_free(&archive);
+            fclose(file);
+            return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
         }
-    }
-    else
-    {
-        return NULL;
-    }
-    return NULL;
-}
 
-void compress_file(FILE *input, FILE *output, HuffmanTree *huffman_tree, int verbose)
-{
-    if (input != NULL)
-    {
-        char curr_char;
-        char *curr_code;
-        Element *curr_elem;
-        do
+        if ((argc == 5 && strcmp(argv[1], "extract") == 0) || (argc == 3 && strcmp(argv[1], "list") == 0))
         {
-            curr_char = fgetc_ascii(input);
-            if (curr_char == EOF)
+            Archive archive;
+            FILE *file = open_file(argv[2], "rb");
+            if (archive_open(&archive, file) != 0)
             {
-                if (verbose)
+                fclose(file);
+                return EXIT_FAILURE;
+            }
+            int status = 0;
+            if (argc == 3)
+            {
+                for (unsigned int i = 0; i < archive.nb_members; i++)
                 {
-                    printf("Reached end of file.\n");
+                    const ArchiveMember *member = &archive.members[i];
+                    printf("%12llu %12llu  table %-4u %s\n", member->raw_size, (member->payload_bits + 7) / 8,
+                           member->table, member->name);
                 }
+                printf("%u members, %u shared tables\n", archive.nb_members, archive.nb_tables);
             }
             else
             {
-                curr_elem = find_elem_in_dict(huffman_tree->root_dict, &curr_char, 0);
-                curr_code = curr_elem->node->code;
-                fwrite(curr_code, 1, strlen(curr_code), output);
-
-                if (verbose)
+                long member = archive_find(&archive, argv[3]);
+                unsigned char *data = member >= 0 ? malloc(archive.members[member].raw_size + 1) : NULL;
+                long long length = data != NULL ? archive_extract(&archive, (unsigned int)member, data,
+                                                                  archive.members[member].raw_size)
+                                                : -1;
+                if (member < 0)
+                {
+                    printf("Error: the archive has no member %s.\n", argv[3]);
+                }
+                if (length >= 0)
+                {
+                    FILE *output = open_file(argv[4], "wb");
+                    status = fwrite(data, 1, (size_t)length, output) == (size_t)length ? 0 : -1;
+                    fclose(output);
+                }
+                else
                 {
-                    printf("Current character: %s (writing %s)\n", display_char(curr_char), curr_code);
+                    status = -1;
                 }
+                free(data);
             }
-        } while (curr_char != EOF);
-
-        fseek(input, 0, SEEK_SET);
-        fseek(output, 0, SEEK_SET);
-    }
-    else
-    {
-        printf("Error: could not read input file");
-        exit(EXIT_FAILURE);
-    }
-}
-
-void compress_file_wrapper(FILE *input, FILE *output)
-{
-    Element *occurrences = get_occurrences_by_dichotomy(input, 0);
-    HuffmanTree *huffman_root = huffman_tree_from_occurrences(occurrences);
-
-    compress_file(input, output, huffman_root, 0);
-}
-
-char *load_full_file(FILE *file)
-{
-    char *buffer = 0;
-    int length;
-
-    if (file)
-    {
-        fseek(file, 0, SEEK_END);
-        length = ftell(file);
-        fseek(file, 0, SEEK_SET);
-        buffer = malloc(length);
-        if (buffer)
-        {
-            fread(buffer, 1, length, file);
+            archive_free(&archive);
+            fclose(file);
+            return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
         }
-        fclose(file);
-    }
-
-    if (buffer)
-    {
-        return buffer;
-    }
-    else
-    {
-        return NULL;
-    }
-}
-
-int n_lines(char *buffer, char *line_separator)
-{
-    char first = line_separator[0];
-    int i, j, count = 0;
-
-    if (first == '\0')
-        return strlen(buffer) + 1;
 
-    for (i = 0; buffer[i] != '\0'; i++)
-    {
-        if (buffer[i] == first)
+        if (argc == 5 && strcmp(argv[1], "uncompress") == 0)
         {
-            for (j = 1; line_separator[j] != '\0' && buffer[i + j] == line_separator[j]; j++)
-                continue;
-            if (line_separator[j] == '\0')
-                count++;
-        }
-    }
-    return count;
-}
-
-char *strtokm(char *str, const char *delim)
-{
-    static char *tok;
-    static char *next;
-    char *m;
-
-    if (delim == NULL) return NULL;
-
-    tok = (str) ? str : next;
-    if (tok == NULL) return NULL;
-
-    m = strstr(tok, delim);
-
-    if (m) {
-        next = m + strlen(delim);
-        *m = '\0';
-    } else {
-        next = NULL;
-    }
-
-    return tok;
-}
-
-Element *decode_dict(FILE *input_dictionary, int verbose)
-{
-    Element *root_elem = NULL;
-    Element* curr_elem;
-    if (input_dictionary != NULL)
-    {
-        char *file_buffer = load_full_file(input_dictionary);
-        int number_of_lines = n_lines(file_buffer, separator);
-
-        char *lines[number_of_lines];
-
-        char *token = strtokm(file_buffer, separator);
-        for (int i = 0; token != NULL; i++)
-        {
-            lines[i] = token;
-            token = strtokm(NULL, separator);
+            FILE *input = open_file(argv[2], "rb");
+            FILE *dict = open_file(argv[3], "rb");
+            FILE *output = open_file(argv[4], "wb");
+            SyncDecodeReport report;
+            int status = uncompress_file_parallel(input, dict, output, nb_coders, &report);
+            fclose(input);
+            fclose(dict);
+            fclose(output);
+            if (status == 0)
+            {
+                printf("Decoded %llu letters in %d chunks, %d joined, %llu bits decoded twice\n", report.nb_letters,
+                       report.nb_chunks, report.nb_synchronized, report.redecoded_bits);
+            }
+            if (show_stats)
+            {
+                print_memory_stats();
+            }
+            return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
         }
 
-        char *curr_line = lines[0];
-        char *curr_char = strtokm(curr_line, delim);
-        char *curr_code = strtokm(NULL, delim);
-        int line = 1;
-
-        if (curr_line == NULL)
+        if (argc == 4 && strcmp(argv[1], "search") == 0)
         {
-            if (verbose)
+            FILE *container = open_file(argv[2], "rb");
+            unsigned long long *offsets;
+            SearchReport report;
+            long long nb_matches = container_search(container, (const unsigned char *)argv[3], strlen(argv[3]),
+                                                    nb_coders, &offsets, &report);
+            fclose(container);
+            for (long long i = 0; i < nb_matches; i++)
             {
-                printf("\nUnexpected input: dictionary input is empty.\n");
+                printf("%llu\n", offsets[i]);
             }
-            return NULL;
-        }
-        else if (curr_char == NULL || curr_code == NULL)
-        {
-            if (verbose)
+            if (nb_matches >= 0)
             {
-                printf("\nUnexpected input: dictionary input is wrongly formatted (line %d).\n", line);
+                printf("%lld matches in %u blocks: %u skipped, %u walked (%llu candidates), %u decoded\n", nb_matches,
+                       report.nb_blocks, report.nb_skipped, report.nb_walked, report.nb_candidates, report.nb_decoded);
             }
-            return NULL;
+            mem_free(offsets);
+            if (show_stats)
+            {
+                print_memory_stats();
+            }
+            return nb_matches >= 0 ? EXIT_SUCCESS : EXIT_FAILURE;
         }
-        else
-        {
-            int first_iter = 1;
 
-            root_elem = new_element(get_char_from_display_char(curr_char));
-            root_elem->node->code = curr_code;
-            curr_elem = root_elem;
-            do
+        if (argc == 3 && strcmp(argv[1], "daemon") == 0)
+        {
+            int status = daemon_serve(argv[2], nb_coders);
+            if (show_stats)
             {
-                if (curr_char == NULL || curr_code == NULL)
-                {
-                    if (verbose)
-                    {
-                        printf("\nUnexpected input: dictionary input is wrongly formatted (line %d).\n", line);
-                        return root_elem;
-                    }
-                }
-                else
-                {
-                    if (!first_iter)
-                    {
-                        curr_elem->next = new_element(get_char_from_display_char(curr_char));
-                        curr_elem->next->node->code = curr_code;
-                        curr_elem = curr_elem->next;
-                    }
-                    else
-                    {
-                        first_iter = 0;
-                    }
-
-                    if (verbose)
-                    {
-                        printf("Got character: %s with code %s\n", curr_char, curr_code);
-                    }
-                }
-                line++;
-                curr_line = lines[line - 1];
-                curr_char = strtokm(curr_line, delim);
-                curr_code = strtokm(NULL, delim);
-            } while (curr_line != NULL && curr_line[0] != 0);
+                print_memory_stats();
+            }
+            return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
         }
-        fseek(input_dictionary, 0, SEEK_SET);
-    }
-    else
-    {
-        printf("Error: input dictionary is empty.");
-        return NULL;
-    }
-
-    return root_elem;
-}
 
-void uncompress_file(FILE *input_compressed, FILE *input_dictionary, FILE *output_uncompressed, int verbose)
-{
-    Element *huffman_dict = decode_dict(input_dictionary, verbose);
-
-    int max_size = strlen(get_element(huffman_dict, len(huffman_dict)-1)->node->code);
-    char *curr_code = malloc(sizeof(char)*max_size);
-    curr_code[0] = '\0';
-    char curr_char;
-
-    if (input_compressed != NULL)
-    {
-        Element *curr_elem;
-        do
+        if ((argc == 4 && strcmp(argv[1], "client") == 0 && strcmp(argv[3], "stats") == 0) ||
+            (argc == 6 && strcmp(argv[1], "client") == 0 &&
+             (strcmp(argv[3], "compress") == 0 || strcmp(argv[3], "decompress") == 0)))
         {
-            curr_char = fgetc_ascii(input_compressed);
-            if (curr_char == EOF)
+            int operation = argc == 4 ? DAEMON_STATS : (strcmp(argv[3], "compress") == 0 ? DAEMON_COMPRESS : DAEMON_DECOMPRESS);
+            unsigned char *data = NULL, *reply;
+            size_t length = 0, reply_length;
+
+            if (argc == 6 && (data = read_whole_file(argv[4], &length)) == NULL)
             {
-                if (verbose)
-                {
-                    printf("Reached end of file.\n");
-                }
+                return EXIT_FAILURE;
             }
-            else
+            int status = daemon_request(argv[2], operation, data, length, &reply, &reply_length);
+            free(data);
+            if (status == 0 && argc == 6)
             {
-                strncat(curr_code, &curr_char, 1);
-                curr_elem = find_elem_in_dict(huffman_dict, curr_code, 1);
-                if (curr_elem != NULL)
+                FILE *output = open_file(argv[5], "wb");
+                if (fwrite(reply, 1, reply_length, output) != reply_length)
                 {
-                    if (verbose)
-                    {
-                        printf("Found code: %s (writing %s)\n", curr_code, display_char(curr_elem->letter));
-                    }
-                    fwrite(&(curr_elem->letter), 1, 1, output_uncompressed);
-                    curr_code[0] = '\0';
+                    status = -1;
                 }
+                fclose(output);
             }
-        } while (curr_char != EOF);
-        fseek(input_compressed, 0, SEEK_SET);
-    }
-    else
-    {
-        printf("Error: could not read input file");
-        exit(EXIT_FAILURE);
+            else if (reply != NULL)
+            {
+                printf("%s%s", (char *)reply, status == 0 ? "" : "\n");
+            }
+            free(reply);
+            return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        // Only options: the default files
+        if (argc > 1)
+        {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
     }
-}
 
-int main()
-{
-    FILE *input = open_file("input.txt", "r");
+    FILE *input = open_file("input.txt", "rb");
     FILE *output = open_file("output.txt", "w+");
 
     FILE *output_huffman = open_file("output_huffman.txt", "w+");
-    FILE *output_uncompressed = open_file("output_uncompressed.txt", "w+");
+    FILE *output_uncompressed = open_file("output_uncompressed.txt", "w+b");
     FILE *dict = open_file("dict.txt", "w+");
 
-    file_to_binary_file(input, output, 0);
+    file_to_binary_file(input, output);
 
-    //int nb_char_input = nb_char_in_file(input, 0);
-    //int nb_char_output = nb_char_in_file(output, 0);
+    //long long nb_char_input = nb_char_in_file(input);
+    //long long nb_char_output = nb_char_in_file(output);
 
-    Element *occurrences = get_occurrences_by_dichotomy(input, 0);
-    print_occurrences(occurrences, 0, 0);
-    HuffmanTree *huffman_root = huffman_tree_from_occurrences(occurrences);
+    HuffmanTree *huffman_root;
+    if (sample)
+    {
+        SampledCompression report;
+        huffman_root = compress_file_sampled(input, output_huffman, SAMPLE_DEFAULT_PERCENT, &report);
+        if (huffman_root == NULL)
+        {
+            return EXIT_FAILURE;
+        }
+        print_sampled_compression(&report);
+    }
+    else
+    {
+        Element *occurrences = get_occurrences_by_dichotomy(input);
+        print_occurrences(occurrences, 0, 0);
+        huffman_root = huffman_tree_from_occurrences(occurrences);
+    }
 
     print_tree_2D_wrapper(huffman_root->root_node);
     print_occurrences(huffman_root->root_dict, 1, 1);
     write_huffman_dict(dict, huffman_root->root_dict);
-    
-    compress_file(input, output_huffman, huffman_root, 0);
-    uncompress_file(output_huffman, dict, output_uncompressed, 0);
+
+    if (!sample)
+    {
+        compress_file(input, output_huffman, huffman_root);
+    }
+    uncompress_file(output_huffman, dict, output_uncompressed);
+    huffman_tree_free(huffman_root);
 
     fclose(input);
     fclose(output);
@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <stdalign.h>
+
+#include "memstats.h"
+
+// Every block starts with its size and its subsystem, padded to keep the user part aligned
+typedef struct MemoryHeader
+{
+    size_t size;
+    int subsystem;
+} MemoryHeader;
+
+#define MEM_HEADER_SIZE (sizeof(max_align_t) > sizeof(MemoryHeader) ? sizeof(max_align_t) : sizeof(MemoryHeader))
+
+static atomic_llong mem_current = 0;
+static atomic_llong mem_peak = 0;
+static atomic_llong mem_limit = 0;
+static atomic_llong mem_failures = 0;
+
+static atomic_llong mem_allocations[MEM_NB_SUBSYSTEMS];
+static atomic_llong mem_live[MEM_NB_SUBSYSTEMS];
+static atomic_llong mem_bytes[MEM_NB_SUBSYSTEMS];
+
+static void *default_alloc(void *context, size_t size)
+{
+    (void)context;
+    return malloc(size);
+}
+
+static void *default_realloc(void *context, void *ptr, size_t size)
+{
+    (void)context;
+    return realloc(ptr, size);
+}
+
+static void default_free(void *context, void *ptr)
+{
+    (void)context;
+    free(ptr);
+}
+
+static const MemoryAllocator default_allocator = {default_alloc, default_realloc, default_free, NULL};
+static MemoryAllocator allocator = {default_alloc, default_realloc, default_free, NULL};
+
+// Reserves size bytes against the limit before they are allocated
+static int mem_charge(size_t size)
+{
+    long long limit = atomic_load_explicit(&mem_limit, memory_order_relaxed);
+    long long current = atomic_fetch_add_explicit(&mem_current, (long long)size, memory_order_relaxed) + (long long)size;
+
+    if (limit > 0 && current > limit)
+    {
+        atomic_fetch_sub_explicit(&mem_current, (long long)size, memory_order_relaxed);
+        atomic_fetch_add_explicit(&mem_failures, 1, memory_order_relaxed);
+        return -1;
+    }
+
+    long long peak = atomic_load_explicit(&mem_peak, memory_order_relaxed);
+    while (current > peak &&
+           !atomic_compare_exchange_weak_explicit(&mem_peak, &peak, current, memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+    return 0;
+}
+
+static void mem_release(size_t size)
+{
+    atomic_fetch_sub_explicit(&mem_current, (long long)size, memory_order_relaxed);
+}
+
+// Counters of the subsystem: one more allocation of size bytes (or one less if negative)
+static void mem_account(int subsystem, long long size, int allocation)
+{
+    atomic_fetch_add_explicit(&mem_bytes[subsystem], size, memory_order_relaxed);
+    if (allocation > 0)
+    {
+        atomic_fetch_add_explicit(&mem_allocations[subsystem], 1, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&mem_live[subsystem], allocation, memory_order_relaxed);
+}
+
+void *mem_alloc_in(MemorySubsystem subsystem, size_t size)
+{
+    if (size > (size_t)-1 - MEM_HEADER_SIZE || mem_charge(size + MEM_HEADER_SIZE) != 0)
+    {
+        return NULL;
+    }
+    unsigned char *block = allocator.alloc(allocator.context, size + MEM_HEADER_SIZE);
+    if (block == NULL)
+    {
+        mem_release(size + MEM_HEADER_SIZE);
+        return NULL;
+    }
+    MemoryHeader header = {size, (int)subsystem};
+    memcpy(block, &header, sizeof(header));
+    mem_account(subsystem, (long long)(size + MEM_HEADER_SIZE), 1);
+    return block + MEM_HEADER_SIZE;
+}
+
+void *mem_alloc(size_t size)
+{
+    return mem_alloc_in(MEM_BUFFERS, size);
+}
+
+void *mem_calloc(size_t count, size_t size)
+{
+    return mem_calloc_in(MEM_BUFFERS, count, size);
+}
+
+void *mem_calloc_in(MemorySubsystem subsystem, size_t count, size_t size)
+{
+    if (size > 0 && count > ((size_t)-1 - MEM_HEADER_SIZE) / size)
+    {
+        return NULL;
+    }
+    void *ptr = mem_alloc_in(subsystem, count * size);
+    if (ptr != NULL)
+    {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+void *mem_realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL)
+    {
+        return mem_alloc(size);
+    }
+    unsigned char *block = (unsigned char *)ptr - MEM_HEADER_SIZE;
+    MemoryHeader header;
+    memcpy(&header, block, sizeof(header));
+
+    // Both blocks may exist while realloc copies, so both are charged until it returns
+    if (size > (size_t)-1 - MEM_HEADER_SIZE || mem_charge(size + MEM_HEADER_SIZE) != 0)
+    {
+        return NULL;
+    }
+    unsigned char *moved = allocator.realloc(allocator.context, block, size + MEM_HEADER_SIZE);
+    if (moved == NULL)
+    {
+        mem_release(size + MEM_HEADER_SIZE);
+        return NULL;
+    }
+    mem_release(header.size + MEM_HEADER_SIZE);
+    mem_account(header.subsystem, (long long)size - (long long)header.size, 0);
+    atomic_fetch_add_explicit(&mem_allocations[header.subsystem], 1, memory_order_relaxed);
+    header.size = size;
+    memcpy(moved, &header, sizeof(header));
+    return moved + MEM_HEADER_SIZE;
+}
+
+void mem_free(void *ptr)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+    unsigned char *block = (unsigned char *)ptr - MEM_HEADER_SIZE;
+    MemoryHeader header;
+    memcpy(&header, block, sizeof(header));
+    mem_release(header.size + MEM_HEADER_SIZE);
+    mem_account(header.subsystem, -(long long)(header.size + MEM_HEADER_SIZE), -1);
+    allocator.free(allocator.context, block);
+}
+
+void memory_set_allocator(const MemoryAllocator *hooks)
+{
+    allocator = hooks != NULL ? *hooks : default_allocator;
+}
+
+void memory_get_usage(MemorySubsystem subsystem, MemoryUsage *usage)
+{
+    usage->allocations = atomic_load(&mem_allocations[subsystem]);
+    usage->live = atomic_load(&mem_live[subsystem]);
+    usage->bytes = atomic_load(&mem_bytes[subsystem]);
+}
+
+const char *memory_subsystem_name(MemorySubsystem subsystem)
+{
+    static const char *names[MEM_NB_SUBSYSTEMS] = {"buffers", "trees", "tables", "tokens"};
+    return subsystem < MEM_NB_SUBSYSTEMS ? names[subsystem] : "unknown";
+}
+
+void memory_set_limit(long long limit)
+{
+    atomic_store(&mem_limit, limit > 0 ? limit : 0);
+}
+
+long long memory_limit(void)
+{
+    return atomic_load(&mem_limit);
+}
+
+long long memory_available(void)
+{
+    long long limit = atomic_load(&mem_limit);
+    if (limit == 0)
+    {
+        return -1;
+    }
+    long long available = limit - atomic_load(&mem_current);
+    return available > 0 ? available : 0;
+}
+
+void memory_get_stats(MemoryStats *stats)
+{
+    stats->current = atomic_load(&mem_current);
+    stats->peak = atomic_load(&mem_peak);
+    stats->limit = atomic_load(&mem_limit);
+    stats->failures = atomic_load(&mem_failures);
+}
+
+void memory_reset_peak(void)
+{
+    atomic_store(&mem_peak, atomic_load(&mem_current));
+}
+
+long long memory_parse_size(const char *text)
+{
+    char *end;
+    long long size = strtoll(text, &end, 10);
+
+    if (end == text || size < 0)
+    {
+        return -1;
+    }
+    int shift = 0;
+    switch (*end)
+    {
+    case 'k':
+    case 'K':
+        shift = 10;
+        end++;
+        break;
+    case 'm':
+    case 'M':
+        shift = 20;
+        end++;
+        break;
+    case 'g':
+    case 'G':
+        shift = 30;
+        end++;
+        break;
+    }
+    if (*end != '\0' || size > (0x7FFFFFFFFFFFFFFFLL >> shift))
+    {
+        return -1;
+    }
+    return size << shift;
+}
@@ -0,0 +1,747 @@
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <unistd.h>
+
+#include "pipeline.h"
+#include "container.h"
+#include "memstats.h"
+#include "async_io.h"
+#include "trace.h"
+
+int PIPELINE_URING = 1;
+
+// Under a memory limit, the compressor runs fewer coders before it uses blocks smaller than this
+#define PIPELINE_MIN_BLOCK_SIZE (1 << 16)
+
+typedef struct PipelineJob
+{
+    unsigned long long seq;
+    unsigned char *in;
+    size_t in_size;
+    unsigned char *coded;         //  Transformed block, with CONTAINER_TRANSFORMS
+    const unsigned char *symbols; //  Bytes to code: in or coded
+    unsigned char *out;
+    size_t out_start; //  The compressed block starts at out + out_start
+    size_t out_size;
+    CodeTable table;
+    int new_table;
+    unsigned int table_block;
+    long long histogram[NB_SYMBOLS];
+    BlockHeader header;
+    unsigned long long raw_offset;
+    size_t payload_start;
+} PipelineJob;
+
+// Bounded multi-producer multi-consumer queue of jobs (Vyukov's algorithm): each cell
+// holds a sequence number telling whether it is ready to be written or read. A counting
+// semaphore, posted on each push, lets the consumers sleep while the queue is empty: it
+// is taken with an atomic decrement while jobs are ready, and only an empty queue makes
+// a consumer wait in the kernel
+typedef struct JobCell
+{
+    atomic_size_t seq;
+    PipelineJob *job;
+} JobCell;
+
+typedef struct JobQueue
+{
+    JobCell *cells;
+    size_t mask;
+    atomic_size_t enqueue_pos;
+    atomic_size_t dequeue_pos;
+    sem_t nb_ready; //  Jobs pushed and not taken yet
+} JobQueue;
+
+typedef struct Pipeline
+{
+    int compress;
+    int input_fd, output_fd;
+    off_t input_offset;
+    unsigned int block_size;
+    ContainerInfo info;
+    int nb_coders;
+    int nb_jobs;
+    PipelineJob *jobs;
+    JobQueue free_jobs, coder_jobs, writer_jobs;
+    PipelineJob **pending; //  Jobs waiting in the writer for the previous ones, by sequence number
+    atomic_int failed;
+} Pipeline;
+
+static int queue_init(JobQueue *queue, size_t capacity)
+{
+    size_t size = 1;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+    queue->cells = mem_alloc(size * sizeof(JobCell));
+    if (queue->cells == NULL)
+    {
+        return -1;
+    }
+    if (sem_init(&queue->nb_ready, 0, 0) != 0)
+    {
+        mem_free(queue->cells);
+        queue->cells = NULL;
+        return -1;
+    }
+    for (size_t i = 0; i < size; i++)
+    {
+        atomic_init(&queue->cells[i].seq, i);
+    }
+    queue->mask = size - 1;
+    atomic_init(&queue->enqueue_pos, 0);
+    atomic_init(&queue->dequeue_pos, 0);
+    return 0;
+}
+
+static int queue_try_push(JobQueue *queue, PipelineJob *job)
+{
+    size_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+    for (;;)
+    {
+        JobCell *cell = &queue->cells[pos & queue->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        long long dif = (long long)seq - (long long)pos;
+        if (dif == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed))
+            {
+                cell->job = job;
+                atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+                return 1;
+            }
+        }
+        else if (dif < 0)
+        {
+            return 0; // Full
+        }
+        else
+        {
+            pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+static int queue_try_pop(JobQueue *queue, PipelineJob **job)
+{
+    size_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+    for (;;)
+    {
+        JobCell *cell = &queue->cells[pos & queue->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        long long dif = (long long)seq - (long long)(pos + 1);
+        if (dif == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&queue->dequeue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed))
+            {
+                *job = cell->job;
+                atomic_store_explicit(&cell->seq, pos + queue->mask + 1, memory_order_release);
+                return 1;
+            }
+        }
+        else if (dif < 0)
+        {
+            return 0; // Empty
+        }
+        else
+        {
+            pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+static void queue_destroy(JobQueue *queue)
+{
+    if (queue->cells != NULL)
+    {
+        sem_destroy(&queue->nb_ready);
+        mem_free(queue->cells);
+    }
+}
+
+// The queues hold every job of the pipeline and every end marker at once, so a push
+// never finds its queue full
+static void queue_push(JobQueue *queue, PipelineJob *job)
+{
+    while (!queue_try_push(queue, job))
+    {
+        sched_yield();
+    }
+    sem_post(&queue->nb_ready);
+}
+
+// Pops a job counted by the semaphore: it is in the queue, but the push of an earlier
+// cell can still be between its reservation and its store
+static PipelineJob *queue_take(JobQueue *queue)
+{
+    PipelineJob *job;
+    while (!queue_try_pop(queue, &job))
+    {
+        sched_yield();
+    }
+    return job;
+}
+
+// Waits for a job, asleep while the queue is empty
+static PipelineJob *queue_pop(JobQueue *queue)
+{
+    while (sem_wait(&queue->nb_ready) != 0)
+    {
+        // Interrupted by a signal
+    }
+    return queue_take(queue);
+}
+
+// Takes a job if one is ready; returns 0 otherwise, without waiting
+static int queue_try_take(JobQueue *queue, PipelineJob **job)
+{
+    if (sem_trywait(&queue->nb_ready) != 0)
+    {
+        return 0;
+    }
+    *job = queue_take(queue);
+    return 1;
+}
+
+// Completes a transfer that io_uring left short (or could not do) with pread/pwrite
+static int complete_read(int fd, unsigned char *buffer, size_t length, off_t offset, long long done, size_t *total)
+{
+    size_t pos = done > 0 ? (size_t)done : 0;
+    while (pos < length)
+    {
+        ssize_t nb_bytes = pread(fd, buffer + pos, length - pos, offset + (off_t)pos);
+        if (nb_bytes < 0)
+        {
+            return -1;
+        }
+        if (nb_bytes == 0)
+        {
+            break;
+        }
+        pos += (size_t)nb_bytes;
+    }
+    *total = pos;
+    return 0;
+}
+
+static int complete_write(int fd, const unsigned char *buffer, size_t length, off_t offset, long long done)
+{
+    size_t pos = done > 0 ? (size_t)done : 0;
+    while (pos < length)
+    {
+        ssize_t nb_bytes = pwrite(fd, buffer + pos, length - pos, offset + (off_t)pos);
+        if (nb_bytes <= 0)
+        {
+            return -1;
+        }
+        pos += (size_t)nb_bytes;
+    }
+    return 0;
+}
+
+// Length and offset of the next read of the reader, or 0 once everything was read
+static size_t next_read(Pipeline *pipeline, unsigned long long index, off_t *offset)
+{
+    if (pipeline->compress)
+    {
+        *offset = pipeline->input_offset + (off_t)(index * pipeline->block_size);
+        return pipeline->block_size;
+    }
+    if (index >= pipeline->info.nb_blocks)
+    {
+        return 0;
+    }
+    unsigned long long end = index + 1 < pipeline->info.nb_blocks ? pipeline->info.blocks[index + 1].offset
+                                                                  : pipeline->info.index_offset;
+    *offset = (off_t)pipeline->info.blocks[index].offset;
+    return (size_t)(end - pipeline->info.blocks[index].offset);
+}
+
+// Reads the blocks, always keeping the read of the next block in flight while the
+// current one is prepared: transforms, histogram and table choice when compressing,
+// header and table parsing when decompressing
+static void *reader_thread(void *arg)
+{
+    Pipeline *pipeline = arg;
+    AsyncIo io;
+    ContainerInfo plan;
+    CodeTable table;
+    unsigned long long index = 0;
+    unsigned int table_block = 0;
+    off_t offset;
+
+    async_io_init(&io, PIPELINE_URING);
+    memset(&plan, 0, sizeof(plan));
+    TRACE(TRACE_STEPS, "pipeline reader started (io_uring: %lld)", async_io_uses_uring(&io));
+
+    size_t length = next_read(pipeline, 0, &offset);
+    PipelineJob *next = NULL;
+    if (length > 0)
+    {
+        next = queue_pop(&pipeline->free_jobs);
+        async_io_read(&io, pipeline->input_fd, next->in, length, offset, 0);
+    }
+
+    while (next != NULL)
+    {
+        AsyncIoCompletion completion;
+        PipelineJob *job = next;
+        off_t job_offset = offset;
+        size_t job_length = length;
+        size_t nb_bytes = 0;
+
+        next = NULL;
+        if (!async_io_reap(&io, 1, &completion) ||
+            complete_read(pipeline->input_fd, job->in, job_length, job_offset, completion.result, &nb_bytes) != 0)
+        {
+            atomic_store(&pipeline->failed, 1);
+        }
+        if (atomic_load(&pipeline->failed) || nb_bytes == 0)
+        {
+            queue_push(&pipeline->free_jobs, job);
+            break;
+        }
+
+        // Start reading the next block before working on this one
+        length = next_read(pipeline, index + 1, &offset);
+        if (length > 0 && (pipeline->compress ? nb_bytes == job_length : 1))
+        {
+            next = queue_pop(&pipeline->free_jobs);
+            async_io_read(&io, pipeline->input_fd, next->in, length, offset, 0);
+        }
+
+        job->seq = index;
+        job->in_size = nb_bytes;
+        if (pipeline->compress)
+        {
+            memset(job->histogram, 0, sizeof(job->histogram));
+            job->symbols = container_transform_block(job->in, nb_bytes, job->coded, &job->header);
+            histogram_add_buffer(job->histogram, job->symbols, (size_t)job->header.coded_size);
+            job->new_table = container_choose_table(&plan, job->histogram, &table, &job->header.set_table);
+            job->new_table |= container_choose_backend(job->histogram, &table, job->new_table, &job->header);
+            if (job->new_table)
+            {
+                table_block = (unsigned int)index;
+            }
+            job->table = table;
+            job->table_block = table_block;
+            for (int c = 0; c < NB_SYMBOLS; c++)
+            {
+                plan.histogram[c] += job->histogram[c];
+            }
+            plan.nb_blocks++;
+        }
+        else
+        {
+            size_t header_size = container_parse_block_header(job->in, nb_bytes, &job->header, &table);
+            if (header_size == 0 || nb_bytes != job_length ||
+                job->header.raw_size != pipeline->info.blocks[index].raw_size ||
+                (index == 0 && !(job->header.flags & BLOCK_TABLE_FLAGS)) ||
+                (job->header.payload_bits + 7) / 8 > nb_bytes - header_size)
+            {
+                atomic_store(&pipeline->failed, 1);
+            }
+            job->table = table;
+            job->payload_start = header_size;
+            job->raw_offset = pipeline->info.blocks[index].raw_offset;
+        }
+        queue_push(&pipeline->coder_jobs, job);
+        index++;
+    }
+
+    async_io_destroy(&io);
+    for (int i = 0; i < pipeline->nb_coders; i++)
+    {
+        queue_push(&pipeline->coder_jobs, NULL);
+    }
+    return NULL;
+}
+
+static void *coder_thread(void *arg)
+{
+    Pipeline *pipeline = arg;
+    PipelineJob *job;
+
+    while ((job = queue_pop(&pipeline->coder_jobs)) != NULL)
+    {
+        if (atomic_load(&pipeline->failed))
+        {
+            // Nothing to code, the writer only recycles the job
+        }
+        else if (pipeline->compress)
+        {
+            unsigned char header[CONTAINER_MAX_BLOCK_HEADER_SIZE];
+            job->header.payload_bits = container_encode_block(job->symbols, &job->header, &job->table,
+                                                              job->out + CONTAINER_MAX_BLOCK_HEADER_SIZE);
+            size_t header_size = container_block_header(header, &job->header, job->new_table ? &job->table : NULL);
+            job->out_start = CONTAINER_MAX_BLOCK_HEADER_SIZE - header_size;
+            memcpy(job->out + job->out_start, header, header_size);
+            job->out_size = header_size + (size_t)((job->header.payload_bits + 7) / 8);
+        }
+        else
+        {
+            if (container_decode_block(job->in + job->payload_start, &job->header, &job->table, job->out) != 0)
+            {
+                atomic_store(&pipeline->failed, 1);
+            }
+            job->out_start = 0;
+            job->out_size = (size_t)job->header.raw_size;
+        }
+        queue_push(&pipeline->writer_jobs, job);
+    }
+    queue_push(&pipeline->writer_jobs, NULL);
+    return NULL;
+}
+
+// Returns the job of a finished write to the reader
+static void recycle_written(Pipeline *pipeline, AsyncIo *io, int wait, PipelineJob **in_flight)
+{
+    AsyncIoCompletion completion;
+    while (async_io_reap(io, wait, &completion))
+    {
+        PipelineJob *job = in_flight[completion.user_data];
+        off_t offset = pipeline->compress ? (off_t)pipeline->info.blocks[job->seq].offset : (off_t)job->raw_offset;
+        if (completion.result != (long long)job->out_size &&
+            complete_write(pipeline->output_fd, job->out + job->out_start, job->out_size, offset,
+                           completion.result) != 0)
+        {
+            atomic_store(&pipeline->failed, 1);
+        }
+        in_flight[completion.user_data] = NULL;
+        queue_push(&pipeline->free_jobs, job);
+        wait = 0;
+    }
+}
+
+// Writes the blocks: in order at the end of the container when compressing (the offset
+// of a block depends on the size of the previous ones), at their place in the original
+// data when decompressing
+static void *writer_thread(void *arg)
+{
+    Pipeline *pipeline = arg;
+    AsyncIo io;
+    PipelineJob **pending = pipeline->pending;
+    PipelineJob *in_flight[ASYNC_IO_DEPTH] = {NULL};
+    unsigned long long next_seq = 0;
+    int nb_ended = 0;
+
+    async_io_init(&io, PIPELINE_URING);
+    while (nb_ended < pipeline->nb_coders || pending[next_seq % (unsigned long long)pipeline->nb_jobs] != NULL)
+    {
+        PipelineJob *job;
+        if (!queue_try_take(&pipeline->writer_jobs, &job))
+        {
+            // Nothing to write yet: sleep until a write completes, which gives its job back
+            // to the reader, or else until a coder hands a block over
+            if (io.in_flight > 0)
+            {
+                recycle_written(pipeline, &io, 1, in_flight);
+                continue;
+            }
+            job = queue_pop(&pipeline->writer_jobs);
+        }
+        if (job == NULL)
+        {
+            nb_ended++;
+            continue;
+        }
+        pending[job->seq % (unsigned long long)pipeline->nb_jobs] = job;
+
+        while ((job = pending[next_seq % (unsigned long long)pipeline->nb_jobs]) != NULL)
+        {
+            pending[next_seq % (unsigned long long)pipeline->nb_jobs] = NULL;
+            next_seq++;
+            if (atomic_load(&pipeline->failed))
+            {
+                queue_push(&pipeline->free_jobs, job);
+                continue;
+            }
+
+            off_t offset = (off_t)job->raw_offset;
+            if (pipeline->compress)
+            {
+                offset = (off_t)pipeline->info.index_offset;
+                if (container_add_block(&pipeline->info, (unsigned long long)offset, job->header.raw_size,
+                                        job->table_block, job->histogram) != 0)
+                {
+                    atomic_store(&pipeline->failed, 1);
+                    queue_push(&pipeline->free_jobs, job);
+                    continue;
+                }
+                pipeline->info.index_offset += job->out_size;
+            }
+
+            int slot = 0;
+            while (io.in_flight == ASYNC_IO_DEPTH)
+            {
+                recycle_written(pipeline, &io, 1, in_flight);
+            }
+            while (in_flight[slot] != NULL)
+            {
+                slot++;
+            }
+            in_flight[slot] = job;
+            if (async_io_write(&io, pipeline->output_fd, job->out + job->out_start, job->out_size, offset,
+                               (unsigned long long)slot) != 0)
+            {
+                in_flight[slot] = NULL;
+                if (complete_write(pipeline->output_fd, job->out + job->out_start, job->out_size, offset, 0) != 0)
+                {
+                    atomic_store(&pipeline->failed, 1);
+                }
+                queue_push(&pipeline->free_jobs, job);
+            }
+        }
+    }
+    while (io.in_flight > 0)
+    {
+        recycle_written(pipeline, &io, 1, in_flight);
+    }
+
+    async_io_destroy(&io);
+    return NULL;
+}
+
+static int run_pipeline(Pipeline *pipeline, size_t in_capacity, size_t out_capacity)
+{
+    pipeline->nb_jobs = 2 * pipeline->nb_coders + 2;
+    pipeline->jobs = mem_calloc((size_t)pipeline->nb_jobs, sizeof(PipelineJob));
+    pipeline->pending = mem_calloc((size_t)pipeline->nb_jobs, sizeof(PipelineJob *));
+    atomic_init(&pipeline->failed, 0);
+
+    int status = pipeline->jobs == NULL || pipeline->pending == NULL ||
+                         queue_init(&pipeline->free_jobs, (size_t)pipeline->nb_jobs) != 0 ||
+                         queue_init(&pipeline->coder_jobs, (size_t)pipeline->nb_jobs + (size_t)pipeline->nb_coders) != 0 ||
+                         queue_init(&pipeline->writer_jobs, (size_t)pipeline->nb_jobs + (size_t)pipeline->nb_coders) != 0
+                     ? -1
+                     : 0;
+    for (int i = 0; i < pipeline->nb_jobs && status == 0; i++)
+    {
+        pipeline->jobs[i].in = mem_alloc(in_capacity);
+        pipeline->jobs[i].out = mem_alloc(out_capacity);
+        if (pipeline->compress && CONTAINER_TRANSFORMS.nb_stages > 0)
+        {
+            pipeline->jobs[i].coded = mem_alloc(CONTAINER_MAX_CODED_SIZE(in_capacity));
+            status = pipeline->jobs[i].coded == NULL ? -1 : 0;
+        }
+        if (status != 0 || pipeline->jobs[i].in == NULL || pipeline->jobs[i].out == NULL)
+        {
+            status = -1;
+        }
+        else
+        {
+            queue_push(&pipeline->free_jobs, &pipeline->jobs[i]);
+        }
+    }
+
+    pthread_t *coders = mem_alloc((size_t)pipeline->nb_coders * sizeof(pthread_t));
+    int *started = mem_calloc((size_t)pipeline->nb_coders, sizeof(int));
+    pthread_t reader, writer;
+    if (status == 0 && coders != NULL && started != NULL && pthread_create(&writer, NULL, writer_thread, pipeline) == 0)
+    {
+        // The writer counts an end marker for each coder: the ones that did not start
+        // leave theirs at once, and the pipeline runs with the others
+        int nb_started = 0;
+        for (int i = 0; i < pipeline->nb_coders; i++)
+        {
+            started[i] = pthread_create(&coders[i], NULL, coder_thread, pipeline) == 0;
+            nb_started += started[i];
+            if (!started[i])
+            {
+                queue_push(&pipeline->writer_jobs, NULL);
+            }
+        }
+        if (nb_started == 0)
+        {
+            atomic_store(&pipeline->failed, 1);
+        }
+        else if (pthread_create(&reader, NULL, reader_thread, pipeline) == 0)
+        {
+            pthread_join(reader, NULL);
+        }
+        else
+        {
+            reader_thread(pipeline);
+        }
+
+        for (int i = 0; i < pipeline->nb_coders; i++)
+        {
+            if (started[i])
+            {
+                pthread_join(coders[i], NULL);
+            }
+        }
+        pthread_join(writer, NULL);
+        status = atomic_load(&pipeline->failed) ? -1 : 0;
+        TRACE(TRACE_STEPS, "pipeline: %lld of %lld coders started", nb_started, pipeline->nb_coders);
+    }
+    else
+    {
+        status = -1;
+    }
+    mem_free(coders);
+    mem_free(started);
+
+    for (int i = 0; pipeline->jobs != NULL && i < pipeline->nb_jobs; i++)
+    {
+        mem_free(pipeline->jobs[i].in);
+        mem_free(pipeline->jobs[i].out);
+        mem_free(pipeline->jobs[i].coded);
+    }
+    mem_free(pipeline->jobs);
+    mem_free(pipeline->pending);
+    queue_destroy(&pipeline->free_jobs);
+    queue_destroy(&pipeline->coder_jobs);
+    queue_destroy(&pipeline->writer_jobs);
+    return status;
+}
+
+// Bytes allocated by a pipeline besides its block buffers
+static long long pipeline_overhead(int nb_coders)
+{
+    long long nb_jobs = 2 * nb_coders + 2;
+    return nb_jobs * (long long)(sizeof(PipelineJob) + sizeof(PipelineJob *) + 8 * sizeof(JobCell) + 64) + 4096;
+}
+
+static int seekable(FILE *file)
+{
+    return fflush(file) == 0 && lseek(fileno(file), 0, SEEK_CUR) >= 0;
+}
+
+int pipeline_compress(FILE *input, FILE *output, unsigned int block_size, int nb_coders)
+{
+    Pipeline pipeline;
+
+    if (!seekable(input) || !seekable(output))
+    {
+        return 1;
+    }
+    block_size = block_size > 0 ? block_size : CONTAINER_BLOCK_SIZE;
+    nb_coders = nb_coders > 0 ? nb_coders : 1;
+
+    // Under a memory limit, drop coders first, then halve the blocks
+    long long input_size = container_input_size(input);
+    unsigned int min_block_size = block_size < PIPELINE_MIN_BLOCK_SIZE ? block_size : PIPELINE_MIN_BLOCK_SIZE;
+    unsigned int fitted;
+    for (;; nb_coders--)
+    {
+        fitted = container_fit_block_size(block_size, (unsigned int)(2 * nb_coders + 2), pipeline_overhead(nb_coders),
+                                          input_size);
+        if (nb_coders == 1 || fitted >= min_block_size)
+        {
+            break;
+        }
+    }
+    if (fitted == 0)
+    {
+        return 1;
+    }
+
+    memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.compress = 1;
+    pipeline.input_fd = fileno(input);
+    pipeline.output_fd = fileno(output);
+    pipeline.input_offset = ftello(input);
+    pipeline.block_size = fitted;
+    pipeline.nb_coders = nb_coders;
+    pipeline.info.block_size = pipeline.block_size;
+    TRACE(TRACE_STEPS, "pipeline: %lld coders, blocks of %lld bytes", nb_coders, fitted);
+
+    if (container_write_header(output) != 0 || fflush(output) != 0)
+    {
+        printf("Error: could not write the compressed container.\n");
+        return -1;
+    }
+    pipeline.info.index_offset = (unsigned long long)ftello(output);
+
+    int status = run_pipeline(&pipeline, pipeline.block_size,
+                              CONTAINER_MAX_BLOCK_HEADER_SIZE +
+                                  CONTAINER_MAX_CODED_SIZE(pipeline.block_size) * (MAX_CODE_LENGTH / 8) + 8);
+    if (status == 0)
+    {
+        status = container_write_index_and_trailer(output, &pipeline.info);
+    }
+    if (status != 0)
+    {
+        printf("Error: could not write the compressed container.\n");
+    }
+    fseeko(input, 0, SEEK_END);
+    container_free_info(&pipeline.info);
+    return status;
+}
+
+// Whether the reader can read every block, with its header, into a job buffer of the given capacity:
+// the spans between the offsets of the index must increase and fit
+static int blocks_fit(const ContainerInfo *info, size_t capacity)
+{
+    for (unsigned int i = 0; i < info->nb_blocks; i++)
+    {
+        unsigned long long end = i + 1 < info->nb_blocks ? info->blocks[i + 1].offset : info->index_offset;
+        if (end <= info->blocks[i].offset || end - info->blocks[i].offset > capacity)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int pipeline_decompress(FILE *container, FILE *output, int nb_coders)
+{
+    Pipeline pipeline;
+
+    if (!seekable(container) || !seekable(output))
+    {
+        return 1;
+    }
+    memset(&pipeline, 0, sizeof(pipeline));
+    if (container_read_info(container, &pipeline.info) != 0)
+    {
+        return -1;
+    }
+    pipeline.compress = 0;
+    pipeline.input_fd = fileno(container);
+    pipeline.output_fd = fileno(output);
+    pipeline.nb_coders = nb_coders > 0 ? nb_coders : 1;
+
+    // The block size is set by the container, only the number of coders can change
+    long long available = memory_available();
+    while (available >= 0 && (2 * pipeline.nb_coders + 2) * CONTAINER_BLOCK_MEMORY(pipeline.info.block_size) +
+                                     pipeline_overhead(pipeline.nb_coders) >
+                                 available)
+    {
+        if (pipeline.nb_coders == 1)
+        {
+            container_free_info(&pipeline.info);
+            return 1;
+        }
+        pipeline.nb_coders--;
+    }
+
+    size_t in_capacity =
+        CONTAINER_MAX_BLOCK_HEADER_SIZE + CONTAINER_MAX_CODED_SIZE(pipeline.info.block_size) * (MAX_CODE_LENGTH / 8) + 8;
+    int status = blocks_fit(&pipeline.info, in_capacity)
+                     ? run_pipeline(&pipeline, in_capacity, pipeline.info.block_size)
+                     : -1;
+    if (status != 0)
+    {
+        printf("Error: the compressed container is damaged.\n");
+    }
+    fseeko(output, (off_t)pipeline.info.raw_size, SEEK_SET);
+    container_free_info(&pipeline.info);
+    return status;
+}
+
+int pipeline_default_coders(void)
+{
+    long nb_processors = sysconf(_SC_NPROCESSORS_ONLN);
+    return nb_processors > 0 ? (int)nb_processors : 1;
+}
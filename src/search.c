@@ -0,0 +1,622 @@
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SEARCH_MMAP 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "search.h"
+#include "bitio.h"
+#include "memstats.h"
+
+// Bits of the coded pattern compared at once: a window of 64 bits loaded at any byte
+// holds them at every one of the 8 bit offsets
+#define SEARCH_CHUNK_BITS 56
+
+#define BLOCK_SEARCHED 0
+#define BLOCK_SKIPPED 1
+#define BLOCK_WALKED 2
+#define BLOCK_DECODED 3
+
+typedef struct SearchQuery
+{
+    unsigned long long bit; //  Bit position in the payload
+    size_t k;               //  0 for a match inside the block, or the letters of the pattern ending it
+    long long letter;       //  After the walk: index of the letter whose code starts there, or -1
+} SearchQuery;
+
+typedef struct BlockResult
+{
+    unsigned long long *matches; //  Offsets of the matches inside the block, in increasing order
+    size_t nb_matches;
+    size_t capacity;
+    unsigned char head[SEARCH_MAX_PATTERN - 1]; //  First letters of the block
+    size_t head_size;
+    unsigned char ends_with[SEARCH_MAX_PATTERN]; //  ends_with[k]: the block ends with the first k letters
+    int kind;                                    //  BLOCK_*
+    unsigned long long nb_candidates;
+} BlockResult;
+
+typedef struct Search
+{
+    const unsigned char *container; //  The whole file, with the index and trailer after the payloads
+    const ContainerInfo *info;
+    const unsigned char *pattern;
+    size_t length;
+    BlockResult *results;
+    atomic_uint next_block;
+    atomic_int failed;
+} Search;
+
+typedef struct SearchWorker
+{
+    Search *search;
+    unsigned char *decoded; //  block_size bytes for the blocks that are decoded
+    SearchQuery *queries;
+    size_t nb_queries;
+    size_t capacity;
+} SearchWorker;
+
+// Whether the n bits of a from bit a_pos are the n bits of b from bit b_pos (8 bytes
+// past the last bit of each are read)
+static int bits_equal(const unsigned char *a, unsigned long long a_pos, const unsigned char *b,
+                      unsigned long long b_pos, unsigned long long n)
+{
+    while (n > 0)
+    {
+        int chunk = n < SEARCH_CHUNK_BITS ? (int)n : SEARCH_CHUNK_BITS;
+        unsigned long long x = (load_be64(a + (a_pos >> 3)) << (a_pos & 7)) >> (64 - chunk);
+        unsigned long long y = (load_be64(b + (b_pos >> 3)) << (b_pos & 7)) >> (64 - chunk);
+        if (x != y)
+        {
+            return 0;
+        }
+        a_pos += (unsigned long long)chunk;
+        b_pos += (unsigned long long)chunk;
+        n -= (unsigned long long)chunk;
+    }
+    return 1;
+}
+
+static int add_query(SearchWorker *worker, unsigned long long bit, size_t k)
+{
+    if (worker->nb_queries == worker->capacity)
+    {
+        size_t capacity = worker->capacity > 0 ? 2 * worker->capacity : 64;
+        SearchQuery *queries = mem_realloc(worker->queries, capacity * sizeof(SearchQuery));
+        if (queries == NULL)
+        {
+            return -1;
+        }
+        worker->queries = queries;
+        worker->capacity = capacity;
+    }
+    SearchQuery *query = &worker->queries[worker->nb_queries++];
+    query->bit = bit;
+    query->k = k;
+    query->letter = -1;
+    return 0;
+}
+
+static int add_match(BlockResult *result, unsigned long long offset)
+{
+    if (result->nb_matches == result->capacity)
+    {
+        size_t capacity = result->capacity > 0 ? 2 * result->capacity : 16;
+        unsigned long long *matches = mem_realloc(result->matches, capacity * sizeof(unsigned long long));
+        if (matches == NULL)
+        {
+            return -1;
+        }
+        result->matches = matches;
+        result->capacity = capacity;
+    }
+    result->matches[result->nb_matches++] = offset;
+    return 0;
+}
+
+static int compare_queries(const void *a, const void *b)
+{
+    unsigned long long x = ((const SearchQuery *)a)->bit;
+    unsigned long long y = ((const SearchQuery *)b)->bit;
+    return x < y ? -1 : x > y;
+}
+
+// Length of the code starting at bit pos, with its letter in *letter; 0 if no code starts there
+static inline int next_code(const CodeTable *table, const unsigned char *payload, unsigned long long pos,
+                            unsigned char *letter)
+{
+    unsigned long long peek = load_be64(payload + (pos >> 3)) << (pos & 7);
+    unsigned int entry = table->fast[peek >> (64 - DECODE_TABLE_BITS)];
+    if (entry >> 8)
+    {
+        *letter = (unsigned char)entry;
+        return (int)(entry >> 8);
+    }
+    for (int length = DECODE_TABLE_BITS + 1; length <= table->max_length; length++)
+    {
+        unsigned int code = (unsigned int)(peek >> (64 - length));
+        if (code - table->first_code[length] < (unsigned int)table->count[length])
+        {
+            *letter = table->symbols[table->first_index[length] + (int)(code - table->first_code[length])];
+            return length;
+        }
+    }
+    return 0;
+}
+
+// Steps over the codes from the first bit up to the last query (sorted by bit), setting
+// the letter of the queries where a code starts. Returns -1 if the bits are not codes
+static int walk_codes(const CodeTable *table, const unsigned char *payload, unsigned long long nb_bits,
+                      SearchQuery *queries, size_t nb_queries)
+{
+    unsigned long long pos = 0;
+    long long letter = 0;
+    size_t q = 0;
+    while (q < nb_queries)
+    {
+        if (queries[q].bit <= pos)
+        {
+            queries[q].letter = queries[q].bit == pos ? letter : -1;
+            q++;
+            continue;
+        }
+        unsigned char c;
+        int length = next_code(table, payload, pos, &c);
+        if (length == 0 || pos + (unsigned long long)length > nb_bits)
+        {
+            return -1;
+        }
+        pos += (unsigned long long)length;
+        letter++;
+    }
+    return 0;
+}
+
+// Searches a block decoded in memory; returns -1 if the memory for the matches is missing
+static int search_decoded(const Search *search, const unsigned char *data, size_t size, unsigned long long raw_offset,
+                           BlockResult *result)
+{
+    const unsigned char *pattern = search->pattern;
+    size_t length = search->length;
+    if (size >= length)
+    {
+        const unsigned char *end = data + size - length + 1;
+        for (const unsigned char *p = data; (p = memchr(p, pattern[0], (size_t)(end - p))) != NULL; p++)
+        {
+            if (memcmp(p, pattern, length) == 0 && add_match(result, raw_offset + (unsigned long long)(p - data)) != 0)
+            {
+                return -1;
+            }
+        }
+    }
+    for (size_t k = 1; k < length && k <= size; k++)
+    {
+        result->ends_with[k] = memcmp(data + size - k, pattern, k) == 0;
+    }
+    result->head_size = size < length - 1 ? size : length - 1;
+    memcpy(result->head, data, result->head_size);
+    return 0;
+}
+
+// Adds a query for every bit position up to last where the payload holds the m bits
+// of coded. A pattern of 16 bits or more has, at each of the 8 bit offsets of a
+// position, a whole byte in the next byte of the payload: a table of those 8 bytes
+// skips most positions with one lookup
+static int scan_payload(SearchWorker *worker, const unsigned char *payload, unsigned long long last,
+                        const unsigned char *coded, unsigned long long m)
+{
+    unsigned char offsets[256];
+    memset(offsets, m >= 16 ? 0 : 0xFF, sizeof(offsets));
+    for (int s = 0; s < 8 && m >= 16; s++)
+    {
+        offsets[(load_be64(coded) << (8 - s)) >> 56] |= (unsigned char)(1 << s);
+    }
+    int h = m < SEARCH_CHUNK_BITS ? (int)m : SEARCH_CHUNK_BITS;
+    unsigned long long head = load_be64(coded) >> (64 - h);
+    for (unsigned long long byte = 0; byte <= last >> 3; byte++)
+    {
+        unsigned int candidates = offsets[payload[byte + 1]];
+        if (candidates == 0)
+        {
+            continue;
+        }
+        unsigned long long window = load_be64(payload + byte);
+        for (int s = 0; candidates != 0; s++, candidates >>= 1)
+        {
+            if (!(candidates & 1) || (window << s) >> (64 - h) != head)
+            {
+                continue;
+            }
+            unsigned long long bit = 8 * byte + (unsigned long long)s;
+            if (bit <= last && bits_equal(payload, bit + (unsigned long long)h, coded, (unsigned long long)h,
+                                          m - (unsigned long long)h) &&
+                add_query(worker, bit, 0) != 0)
+            {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Searches a Huffman block in its payload; returns -1 if the block is damaged or the
+// memory is missing
+static int search_coded(SearchWorker *worker, const unsigned char *payload, const BlockHeader *header,
+                        const CodeTable *table, unsigned long long raw_offset, BlockResult *result)
+{
+    const Search *search = worker->search;
+    const unsigned char *pattern = search->pattern;
+    size_t length = search->length;
+    unsigned long long nb_bits = header->payload_bits;
+    size_t raw_size = (size_t)header->raw_size;
+
+    // The first letters, for the matches that end in this block
+    result->head_size = raw_size < length - 1 ? raw_size : length - 1;
+    unsigned long long pos = 0;
+    for (size_t i = 0; i < result->head_size; i++)
+    {
+        int code_length = next_code(table, payload, pos, &result->head[i]);
+        if (code_length == 0 || pos + (unsigned long long)code_length > nb_bits)
+        {
+            return -1;
+        }
+        pos += (unsigned long long)code_length;
+    }
+
+    // The pattern coded with the table of the block, as far as its letters have a code
+    unsigned char coded[SEARCH_MAX_PATTERN * MAX_CODE_LENGTH / 8 + 16] = {0};
+    unsigned long long prefix_bits[SEARCH_MAX_PATTERN + 1]; //  Bits of the first k letters
+    BitWriter writer;
+    bit_writer_init(&writer, coded);
+    size_t nb_coded = 0;
+    prefix_bits[0] = 0;
+    while (nb_coded < length && table->lengths[pattern[nb_coded]] > 0)
+    {
+        unsigned char c = pattern[nb_coded];
+        bit_writer_put(&writer, table->codes[c], table->lengths[c]);
+        prefix_bits[nb_coded + 1] = prefix_bits[nb_coded] + table->lengths[c];
+        nb_coded++;
+    }
+    bit_writer_flush(&writer);
+
+    worker->nb_queries = 0;
+    unsigned long long m = prefix_bits[length];
+    if (nb_coded < length)
+    {
+        result->kind = BLOCK_SKIPPED;
+    }
+    else if (raw_size >= length && nb_bits >= m)
+    {
+        if (scan_payload(worker, payload, nb_bits - m, coded, m) != 0)
+        {
+            return -1;
+        }
+        result->nb_candidates = worker->nb_queries;
+    }
+
+    // The ends of the pattern the block may end with, from the longest, so that the
+    // positions increase
+    size_t nb_candidates = worker->nb_queries;
+    for (size_t k = length - 1; k >= 1; k--)
+    {
+        if (k <= nb_coded && k <= raw_size && prefix_bits[k] <= nb_bits &&
+            bits_equal(payload, nb_bits - prefix_bits[k], coded, 0, prefix_bits[k]) &&
+            add_query(worker, nb_bits - prefix_bits[k], k) != 0)
+        {
+            return -1;
+        }
+    }
+    if (worker->nb_queries == 0)
+    {
+        return 0;
+    }
+    if (nb_candidates > 0 && worker->nb_queries > nb_candidates)
+    {
+        qsort(worker->queries, worker->nb_queries, sizeof(SearchQuery), compare_queries);
+    }
+    if (result->kind != BLOCK_SKIPPED)
+    {
+        result->kind = BLOCK_WALKED;
+    }
+    if (walk_codes(table, payload, nb_bits, worker->queries, worker->nb_queries) != 0)
+    {
+        return -1;
+    }
+    for (size_t q = 0; q < worker->nb_queries; q++)
+    {
+        const SearchQuery *query = &worker->queries[q];
+        if (query->letter < 0)
+        {
+            continue;
+        }
+        if (query->k > 0)
+        {
+            // Codes follow until the end, so they are exactly the k letters
+            if ((unsigned long long)query->letter + query->k != raw_size)
+            {
+                return -1;
+            }
+            result->ends_with[query->k] = 1;
+        }
+        else if ((unsigned long long)query->letter + length > raw_size ||
+                 add_match(result, raw_offset + (unsigned long long)query->letter) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Searches block i of the container; returns -1 if it is damaged
+static int search_block(SearchWorker *worker, unsigned int i)
+{
+    const Search *search = worker->search;
+    const ContainerInfo *info = search->info;
+    const BlockInfo *block = &info->blocks[i];
+    BlockResult *result = &search->results[i];
+    BlockHeader header;
+    CodeTable table;
+
+    if (block->table_block != i)
+    {
+        const BlockInfo *table_block = &info->blocks[block->table_block];
+        if (container_parse_block_header(search->container + table_block->offset,
+                                         (size_t)(info->index_offset - table_block->offset), &header, &table) == 0 ||
+            !(header.flags & BLOCK_TABLE_FLAGS))
+        {
+            return -1;
+        }
+    }
+    size_t available = (size_t)(info->index_offset - block->offset);
+    size_t header_size = container_parse_block_header(search->container + block->offset, available, &header, &table);
+    if (header_size == 0 || header.raw_size != block->raw_size ||
+        (block->table_block == i && !(header.flags & BLOCK_TABLE_FLAGS)) ||
+        (block->table_block != i && (header.flags & BLOCK_TABLE_FLAGS)) ||
+        (header.payload_bits + 7) / 8 > available - header_size)
+    {
+        return -1;
+    }
+    const unsigned char *payload = search->container + block->offset + header_size;
+
+    if (header.backend == CONTAINER_BACKEND_TANS || (header.flags & BLOCK_TRANSFORMED))
+    {
+        if (container_decode_block(payload, &header, &table, worker->decoded) != 0)
+        {
+            return -1;
+        }
+        result->kind = BLOCK_DECODED;
+        return search_decoded(search, worker->decoded, (size_t)block->raw_size, block->raw_offset, result);
+    }
+    if (table.nb_symbols == 0 && header.raw_size > 0)
+    {
+        return -1;
+    }
+    return search_coded(worker, payload, &header, &table, block->raw_offset, result);
+}
+
+static void *search_thread(void *arg)
+{
+    SearchWorker *worker = arg;
+    Search *search = worker->search;
+    for (;;)
+    {
+        unsigned int i = atomic_fetch_add(&search->next_block, 1);
+        if (i >= search->info->nb_blocks || atomic_load(&search->failed))
+        {
+            break;
+        }
+        if (search_block(worker, i) != 0)
+        {
+            atomic_store(&search->failed, 1);
+        }
+    }
+    return NULL;
+}
+
+// Appends the matches of the blocks in order, with the ones across their ends
+static long long stitch_matches(const Search *search, unsigned long long **offsets)
+{
+    const ContainerInfo *info = search->info;
+    size_t total = 0;
+    for (unsigned int i = 0; i < info->nb_blocks; i++)
+    {
+        total += search->results[i].nb_matches;
+    }
+
+    BlockResult all;
+    memset(&all, 0, sizeof(all));
+    if (total > 0 && (all.matches = mem_alloc(total * sizeof(unsigned long long))) == NULL)
+    {
+        return -1;
+    }
+    all.capacity = total;
+    for (unsigned int i = 0; i < info->nb_blocks; i++)
+    {
+        const BlockResult *result = &search->results[i];
+        if (result->nb_matches > 0)
+        {
+            if (all.nb_matches + result->nb_matches > all.capacity)
+            {
+                unsigned long long *matches =
+                    mem_realloc(all.matches, (all.nb_matches + result->nb_matches) * sizeof(unsigned long long));
+                if (matches == NULL)
+                {
+                    mem_free(all.matches);
+                    return -1;
+                }
+                all.matches = matches;
+                all.capacity = all.nb_matches + result->nb_matches;
+            }
+            memcpy(all.matches + all.nb_matches, result->matches, result->nb_matches * sizeof(unsigned long long));
+            all.nb_matches += result->nb_matches;
+        }
+
+        // The block ends with the first k letters: the others must start the next blocks
+        const BlockInfo *block = &info->blocks[i];
+        for (size_t k = search->length - 1; k >= 1; k--)
+        {
+            if (!result->ends_with[k])
+            {
+                continue;
+            }
+            size_t matched = k;
+            for (unsigned int next = i + 1; next < info->nb_blocks && matched < search->length; next++)
+            {
+                const BlockResult *following = &search->results[next];
+                size_t size = search->length - matched < following->head_size ? search->length - matched
+                                                                               : following->head_size;
+                if (memcmp(following->head, search->pattern + matched, size) != 0)
+                {
+                    break;
+                }
+                matched += size;
+            }
+            if (matched == search->length &&
+                add_match(&all, block->raw_offset + block->raw_size - (unsigned long long)k) != 0)
+            {
+                mem_free(all.matches);
+                return -1;
+            }
+        }
+    }
+    *offsets = all.matches;
+    return (long long)all.nb_matches;
+}
+
+long long container_search(FILE *container, const unsigned char *pattern, size_t length, int nb_threads,
+                           unsigned long long **offsets, SearchReport *report)
+{
+    ContainerInfo info;
+
+    *offsets = NULL;
+    memset(report, 0, sizeof(SearchReport));
+    if (length == 0 || length > SEARCH_MAX_PATTERN)
+    {
+        printf("Error: the pattern has 1 to %d bytes.\n", SEARCH_MAX_PATTERN);
+        return -1;
+    }
+    if (container_read_info(container, &info) != 0)
+    {
+        return -1;
+    }
+    size_t size = (size_t)(info.index_offset + (unsigned long long)info.nb_blocks * CONTAINER_INDEX_ENTRY_SIZE +
+                           CONTAINER_TRAILER_SIZE);
+
+    // The payloads are read in place, from the mapped file when it can be mapped
+    unsigned char *data = NULL;
+    int mapped = 0;
+#ifdef SEARCH_MMAP
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(container), 0);
+    if (map != MAP_FAILED)
+    {
+        data = map;
+        mapped = 1;
+    }
+#endif
+    if (data == NULL)
+    {
+        data = mem_alloc(size);
+        if (data == NULL || fseeko(container, 0, SEEK_SET) != 0 || fread(data, 1, size, container) != size)
+        {
+            printf("Error: cannot read the %zu bytes of the container.\n", size);
+            mem_free(data);
+            container_free_info(&info);
+            return -1;
+        }
+    }
+
+    unsigned int nb_workers = nb_threads > 1 ? (unsigned int)nb_threads : 1;
+    if (nb_workers > info.nb_blocks)
+    {
+        nb_workers = info.nb_blocks > 0 ? info.nb_blocks : 1;
+    }
+    Search search = {data, &info, pattern, length, NULL, 0, 0};
+    search.results = mem_calloc(info.nb_blocks + 1, sizeof(BlockResult));
+    SearchWorker *workers = mem_calloc(nb_workers, sizeof(SearchWorker));
+    pthread_t *threads = mem_calloc(nb_workers, sizeof(pthread_t));
+    int *started = mem_calloc(nb_workers, sizeof(int));
+    int status = search.results != NULL && workers != NULL && threads != NULL && started != NULL ? 0 : -1;
+    for (unsigned int w = 0; w < nb_workers && status == 0; w++)
+    {
+        workers[w].search = &search;
+        if ((workers[w].decoded = mem_alloc(info.block_size)) == NULL)
+        {
+            status = -1;
+        }
+    }
+    if (status != 0)
+    {
+        printf("Error: the memory limit is too low to search blocks of %u bytes.\n", info.block_size);
+    }
+
+    long long nb_matches = -1;
+    if (status == 0)
+    {
+        for (unsigned int w = 1; w < nb_workers; w++)
+        {
+            started[w] = pthread_create(&threads[w], NULL, search_thread, &workers[w]) == 0;
+        }
+        search_thread(&workers[0]);
+        for (unsigned int w = 1; w < nb_workers; w++)
+        {
+            if (started[w])
+            {
+                pthread_join(threads[w], NULL);
+            }
+        }
+        if (atomic_load(&search.failed))
+        {
+            printf("Error: the compressed container is damaged.\n");
+        }
+        else if ((nb_matches = stitch_matches(&search, offsets)) < 0)
+        {
+            printf("Error: not enough memory for the matches.\n");
+        }
+    }
+
+    if (nb_matches >= 0)
+    {
+        report->nb_blocks = info.nb_blocks;
+        for (unsigned int i = 0; i < info.nb_blocks; i++)
+        {
+            const BlockResult *result = &search.results[i];
+            report->nb_skipped += result->kind == BLOCK_SKIPPED;
+            report->nb_walked += result->kind == BLOCK_WALKED;
+            report->nb_decoded += result->kind == BLOCK_DECODED;
+            report->nb_candidates += result->nb_candidates;
+        }
+        report->nb_matches = (unsigned long long)nb_matches;
+    }
+    for (unsigned int i = 0; search.results != NULL && i < info.nb_blocks; i++)
+    {
+        mem_free(search.results[i].matches);
+    }
+    for (unsigned int w = 0; workers != NULL && w < nb_workers; w++)
+    {
+        mem_free(workers[w].decoded);
+        mem_free(workers[w].queries);
+    }
+    mem_free(search.results);
+    mem_free(workers);
+    mem_free(threads);
+    mem_free(started);
+#ifdef SEARCH_MMAP
+    if (mapped)
+    {
+        munmap(data, size);
+    }
+#endif
+    if (!mapped)
+    {
+        mem_free(data);
+    }
+    container_free_info(&info);
+    return nb_matches;
+}
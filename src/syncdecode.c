@@ -0,0 +1,339 @@
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "syncdecode.h"
+#include "memstats.h"
+
+size_t SYNC_DECODE_MIN_CHUNK_BITS = 1 << 20;
+
+#define SYNC_NO_CODE -1       //  The bits from there are no code, or the text ends inside one
+#define SYNC_BAD_CHARACTER -2 //  A character other than '0' and '1'
+
+typedef struct SyncDecoder
+{
+    const char *bits;
+    size_t nb_bits;
+    int (*next)[2]; //  Tree of the codes: next[node][bit] is the node below, -1 - letter for a
+                    //  leaf, or 0 when no code goes that way (the root is node 0)
+} SyncDecoder;
+
+typedef struct SyncChunk
+{
+    const SyncDecoder *decoder;
+    size_t start, end;      //  The chunk decodes the codes starting in [start, end)
+    size_t stop;            //  Where the code after its last letter starts
+    int guessed;            //  0 for the first chunk, whose start is a real code start
+    int status;             //  0, or SYNC_BAD_CHARACTER (SYNC_NO_CODE too for the first chunk)
+    unsigned char *letters; //  Capacity end - start: each code has at least one bit
+    size_t nb_letters;
+    size_t starts[SYNC_DECODE_WINDOW]; //  Where the code of each of the first letters starts
+} SyncChunk;
+
+static int build_code_tree(const DictCodes *dict, SyncDecoder *decoder)
+{
+    size_t capacity = 1;
+    for (int c = 0; c < DICT_NB_LETTERS; c++)
+    {
+        capacity += dict->lengths[c];
+    }
+    decoder->next = mem_calloc_in(MEM_TREES, capacity, sizeof(int[2]));
+    if (decoder->next == NULL)
+    {
+        printf("Error: not enough memory for the codes of the dictionary.\n");
+        return -1;
+    }
+
+    int nb_nodes = 1;
+    for (int c = 0; c < DICT_NB_LETTERS; c++)
+    {
+        int node = 0;
+        for (int i = 0; i < dict->lengths[c]; i++)
+        {
+            int *below = &decoder->next[node][dict->codes[c][i] - '0'];
+            if (i == dict->lengths[c] - 1 ? *below != 0 : *below < 0)
+            {
+                printf("Error: the codes of the dictionary are not a prefix code.\n");
+                return -1;
+            }
+            if (i == dict->lengths[c] - 1)
+            {
+                *below = -1 - c;
+            }
+            else
+            {
+                if (*below == 0)
+                {
+                    *below = nb_nodes++;
+                }
+                node = *below;
+            }
+        }
+    }
+    return 0;
+}
+
+// Decodes the letter whose code starts at *pos and moves *pos after it; returns the
+// letter, or SYNC_NO_CODE or SYNC_BAD_CHARACTER (*pos unchanged)
+static int decode_letter(const SyncDecoder *decoder, size_t *pos)
+{
+    int node = 0;
+    for (size_t p = *pos; p < decoder->nb_bits; p++)
+    {
+        unsigned int bit = (unsigned int)(unsigned char)decoder->bits[p] - '0';
+        if (bit > 1)
+        {
+            return SYNC_BAD_CHARACTER;
+        }
+        node = decoder->next[node][bit];
+        if (node < 0)
+        {
+            *pos = p + 1;
+            return -1 - node;
+        }
+        if (node == 0)
+        {
+            return SYNC_NO_CODE;
+        }
+    }
+    return SYNC_NO_CODE;
+}
+
+static void *chunk_thread(void *arg)
+{
+    SyncChunk *chunk = arg;
+    size_t pos = chunk->start;
+    chunk->nb_letters = 0;
+    while (pos < chunk->end)
+    {
+        size_t code_start = pos;
+        int letter = decode_letter(chunk->decoder, &pos);
+        if (letter >= 0)
+        {
+            if (chunk->nb_letters < SYNC_DECODE_WINDOW)
+            {
+                chunk->starts[chunk->nb_letters] = code_start;
+            }
+            chunk->letters[chunk->nb_letters++] = (unsigned char)letter;
+        }
+        else if (letter == SYNC_NO_CODE && chunk->guessed)
+        {
+            // No real code starts at any of the code starts found so far, since the real
+            // decoding would have failed here too: guess again from the next bit
+            chunk->nb_letters = 0;
+            pos = code_start + 1;
+        }
+        else
+        {
+            chunk->status = letter;
+            break;
+        }
+    }
+    chunk->stop = pos;
+    return NULL;
+}
+
+static void print_decode_error(int status)
+{
+    if (status == SYNC_BAD_CHARACTER)
+    {
+        printf("Error: the compressed text holds a character other than '0' and '1'.\n");
+    }
+    else
+    {
+        printf("Error: the compressed text holds a code that is not in the dictionary, or ends inside a code.\n");
+    }
+}
+
+// Continues the real decoding from *pos through the chunk, until it meets a code start of
+// the guessed decoding; writes the letters decoded on the way, then the guessed ones from there
+static int stitch_chunk(const SyncChunk *chunk, size_t *pos, unsigned char *redecoded, FILE *output,
+                        SyncDecodeReport *report)
+{
+    size_t window = chunk->nb_letters < SYNC_DECODE_WINDOW ? chunk->nb_letters : SYNC_DECODE_WINDOW;
+    size_t first = 0, nb_redecoded = 0, from = *pos;
+    int synchronized = 0;
+    while (*pos < chunk->end)
+    {
+        while (first < window && chunk->starts[first] < *pos)
+        {
+            first++;
+        }
+        if (first < window && chunk->starts[first] == *pos)
+        {
+            synchronized = 1;
+            break;
+        }
+        int letter = decode_letter(chunk->decoder, pos);
+        if (letter < 0)
+        {
+            print_decode_error(letter);
+            return -1;
+        }
+        redecoded[nb_redecoded++] = (unsigned char)letter;
+    }
+    report->redecoded_bits += *pos - from;
+    report->nb_letters += nb_redecoded;
+    if (fwrite(redecoded, 1, nb_redecoded, output) != nb_redecoded)
+    {
+        printf("Error: cannot write the decoded letters.\n");
+        return -1;
+    }
+    if (synchronized)
+    {
+        size_t nb_guessed = chunk->nb_letters - first;
+        report->nb_synchronized++;
+        report->nb_letters += nb_guessed;
+        *pos = chunk->stop;
+        if (fwrite(chunk->letters + first, 1, nb_guessed, output) != nb_guessed)
+        {
+            printf("Error: cannot write the decoded letters.\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int sync_decode(const char *bits, size_t nb_bits, const DictCodes *dict, FILE *output, int nb_threads,
+                SyncDecodeReport *report)
+{
+    memset(report, 0, sizeof(SyncDecodeReport));
+    SyncDecoder decoder = {bits, nb_bits, NULL};
+    if (build_code_tree(dict, &decoder) != 0)
+    {
+        mem_free(decoder.next);
+        return -1;
+    }
+
+    size_t min_chunk_bits = SYNC_DECODE_MIN_CHUNK_BITS > 0 ? SYNC_DECODE_MIN_CHUNK_BITS : 1;
+    size_t nb_chunks = nb_threads > 1 ? (size_t)nb_threads : 1;
+    if (nb_chunks > nb_bits / min_chunk_bits)
+    {
+        nb_chunks = nb_bits / min_chunk_bits > 0 ? nb_bits / min_chunk_bits : 1;
+    }
+    size_t chunk_bits = nb_bits / nb_chunks + 1;
+    SyncChunk *chunks = mem_calloc(nb_chunks, sizeof(SyncChunk));
+    unsigned char *letters = mem_alloc(nb_bits + 1);
+    unsigned char *redecoded = mem_alloc(chunk_bits);
+    pthread_t *threads = mem_calloc(nb_chunks, sizeof(pthread_t));
+    int *started = mem_calloc(nb_chunks, sizeof(int));
+    if (chunks == NULL || letters == NULL || redecoded == NULL || threads == NULL || started == NULL)
+    {
+        printf("Error: not enough memory to decode %zu bits.\n", nb_bits);
+        mem_free(chunks);
+        mem_free(letters);
+        mem_free(redecoded);
+        mem_free(threads);
+        mem_free(started);
+        mem_free(decoder.next);
+        return -1;
+    }
+
+    for (size_t k = 0; k < nb_chunks; k++)
+    {
+        SyncChunk *chunk = &chunks[k];
+        chunk->decoder = &decoder;
+        chunk->start = k * chunk_bits;
+        chunk->end = k + 1 < nb_chunks ? (k + 1) * chunk_bits : nb_bits;
+        chunk->guessed = k > 0;
+        chunk->letters = letters + chunk->start;
+    }
+    for (size_t k = 1; k < nb_chunks; k++)
+    {
+        started[k] = pthread_create(&threads[k], NULL, chunk_thread, &chunks[k]) == 0;
+    }
+    chunk_thread(&chunks[0]);
+    for (size_t k = 1; k < nb_chunks; k++)
+    {
+        if (started[k])
+        {
+            pthread_join(threads[k], NULL);
+        }
+        else
+        {
+            chunk_thread(&chunks[k]);
+        }
+    }
+
+    int status = 0;
+    for (size_t k = 0; k < nb_chunks && status == 0; k++)
+    {
+        if (chunks[k].status != 0)
+        {
+            print_decode_error(chunks[k].status);
+            status = -1;
+        }
+    }
+    report->nb_chunks = (int)nb_chunks;
+    if (status == 0)
+    {
+        report->nb_letters = chunks[0].nb_letters;
+        if (fwrite(chunks[0].letters, 1, chunks[0].nb_letters, output) != chunks[0].nb_letters)
+        {
+            printf("Error: cannot write the decoded letters.\n");
+            status = -1;
+        }
+    }
+    size_t pos = chunks[0].stop;
+    for (size_t k = 1; k < nb_chunks && status == 0; k++)
+    {
+        status = stitch_chunk(&chunks[k], &pos, redecoded, output, report);
+    }
+
+    mem_free(chunks);
+    mem_free(letters);
+    mem_free(redecoded);
+    mem_free(threads);
+    mem_free(started);
+    mem_free(decoder.next);
+    return status;
+}
+
+// The whole content of a file, in an accounted buffer; NULL after printing an error
+static char *read_text(FILE *file, size_t *length)
+{
+    off_t size;
+    if (file == NULL || fseeko(file, 0, SEEK_END) != 0 || (size = ftello(file)) < 0 || fseeko(file, 0, SEEK_SET) != 0)
+    {
+        printf("Error: cannot read the compressed text.\n");
+        return NULL;
+    }
+    char *text = mem_alloc((size_t)size + 1);
+    if (text == NULL)
+    {
+        printf("Error: not enough memory for %lld bytes of compressed text.\n", (long long)size);
+        return NULL;
+    }
+    *length = fread(text, 1, (size_t)size, file);
+    fseeko(file, 0, SEEK_SET);
+    return text;
+}
+
+int uncompress_file_parallel(FILE *input_compressed, FILE *input_dictionary, FILE *output_uncompressed,
+                             int nb_threads, SyncDecodeReport *report)
+{
+    memset(report, 0, sizeof(SyncDecodeReport));
+    if (input_dictionary == NULL)
+    {
+        printf("Error: cannot read the dictionary.\n");
+        return -1;
+    }
+    char *dict_text = load_full_file(input_dictionary);
+    DictCodes dict;
+    int line = dict_parse(dict_text, strlen(dict_text), &dict);
+    if (line != 0)
+    {
+        printf("Error: line %d of the dictionary is not \"<letter>: <code>\".\n", line);
+        free(dict_text);
+        return -1;
+    }
+
+    size_t nb_bits;
+    char *bits = read_text(input_compressed, &nb_bits);
+    int status = bits != NULL ? sync_decode(bits, nb_bits, &dict, output_uncompressed, nb_threads, report) : -1;
+    mem_free(bits);
+    free(dict_text);
+    return status;
+}
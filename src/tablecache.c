@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "tablecache.h"
+#include "memstats.h"
+
+typedef struct TableCacheEntry
+{
+    uint64_t hash;
+    atomic_ullong last_used;      //  Value of the clock at the last lookup, for the LRU eviction
+    struct TableCacheEntry *next; //  Next entry of the same bucket
+    CodeTable table;
+} TableCacheEntry;
+
+static pthread_rwlock_t cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+static TableCacheEntry **cache_entries = NULL;
+static int cache_nb_entries = 0;
+// The entries chained by the low bits of their hash: a power of two of buckets, at
+// least as many as entries, so that a lookup compares about one table
+static TableCacheEntry **cache_buckets = NULL;
+static uint64_t cache_bucket_mask = 0;
+static int cache_capacity = TABLE_CACHE_DEFAULT_CAPACITY;
+static atomic_ullong cache_clock = 0;
+static atomic_llong cache_hits = 0;
+static atomic_llong cache_misses = 0;
+
+uint64_t code_lengths_hash(const unsigned char *lengths)
+{
+    // FNV-1a, 64 bits
+    uint64_t hash = 14695981039346656037ULL;
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        hash = (hash ^ lengths[c]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// The entry of these lengths, or NULL; under the lock
+static TableCacheEntry *find_entry(uint64_t hash, const unsigned char *lengths)
+{
+    if (cache_buckets == NULL)
+    {
+        return NULL;
+    }
+    for (TableCacheEntry *entry = cache_buckets[hash & cache_bucket_mask]; entry != NULL; entry = entry->next)
+    {
+        if (entry->hash == hash && memcmp(entry->table.lengths, lengths, NB_SYMBOLS) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void unlink_entry(TableCacheEntry *entry)
+{
+    TableCacheEntry **link = &cache_buckets[entry->hash & cache_bucket_mask];
+    while (*link != entry)
+    {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+}
+
+int table_cache_lookup(uint64_t hash, const unsigned char *lengths, CodeTable *table)
+{
+    pthread_rwlock_rdlock(&cache_lock);
+    TableCacheEntry *entry = find_entry(hash, lengths);
+    int found = entry != NULL;
+    if (found)
+    {
+        memcpy(table, &entry->table, sizeof(CodeTable));
+        atomic_store_explicit(&entry->last_used, atomic_fetch_add_explicit(&cache_clock, 1, memory_order_relaxed),
+                              memory_order_relaxed);
+    }
+    pthread_rwlock_unlock(&cache_lock);
+
+    atomic_fetch_add_explicit(found ? &cache_hits : &cache_misses, 1, memory_order_relaxed);
+    return found;
+}
+
+void table_cache_insert(uint64_t hash, const CodeTable *table)
+{
+    pthread_rwlock_wrlock(&cache_lock);
+    if (cache_capacity == 0)
+    {
+        pthread_rwlock_unlock(&cache_lock);
+        return;
+    }
+
+    TableCacheEntry *entry = find_entry(hash, table->lengths);
+    if (entry != NULL)
+    {
+        // Inserted by another thread in the meantime
+        pthread_rwlock_unlock(&cache_lock);
+        return;
+    }
+
+    // A new entry while there is room, under the memory limit too; otherwise the least recently used one
+    long long available = memory_available();
+    if (cache_nb_entries < cache_capacity && (available < 0 || available > 8 * (long long)sizeof(TableCacheEntry)))
+    {
+        if (cache_entries == NULL)
+        {
+            uint64_t nb_buckets = 1;
+            while (nb_buckets < (uint64_t)cache_capacity)
+            {
+                nb_buckets *= 2;
+            }
+            cache_entries = mem_calloc_in(MEM_TABLES, (size_t)cache_capacity, sizeof(TableCacheEntry *));
+            cache_buckets = mem_calloc_in(MEM_TABLES, (size_t)nb_buckets, sizeof(TableCacheEntry *));
+            cache_bucket_mask = nb_buckets - 1;
+            if (cache_entries == NULL || cache_buckets == NULL)
+            {
+                mem_free(cache_entries);
+                mem_free(cache_buckets);
+                cache_entries = NULL;
+                cache_buckets = NULL;
+            }
+        }
+        entry = cache_entries != NULL ? mem_alloc_in(MEM_TABLES, sizeof(TableCacheEntry)) : NULL;
+        if (entry != NULL)
+        {
+            cache_entries[cache_nb_entries++] = entry;
+        }
+    }
+    if (entry == NULL)
+    {
+        for (int i = 0; i < cache_nb_entries; i++)
+        {
+            if (entry == NULL || atomic_load_explicit(&cache_entries[i]->last_used, memory_order_relaxed) <
+                                     atomic_load_explicit(&entry->last_used, memory_order_relaxed))
+            {
+                entry = cache_entries[i];
+            }
+        }
+        if (entry != NULL)
+        {
+            unlink_entry(entry);
+        }
+    }
+
+    if (entry != NULL)
+    {
+        entry->hash = hash;
+        entry->next = cache_buckets[hash & cache_bucket_mask];
+        cache_buckets[hash & cache_bucket_mask] = entry;
+        memcpy(&entry->table, table, sizeof(CodeTable));
+        atomic_store_explicit(&entry->last_used, atomic_fetch_add_explicit(&cache_clock, 1, memory_order_relaxed),
+                              memory_order_relaxed);
+    }
+    pthread_rwlock_unlock(&cache_lock);
+}
+
+void table_cache_clear(void)
+{
+    pthread_rwlock_wrlock(&cache_lock);
+    for (int i = 0; i < cache_nb_entries; i++)
+    {
+        mem_free(cache_entries[i]);
+    }
+    mem_free(cache_entries);
+    mem_free(cache_buckets);
+    cache_entries = NULL;
+    cache_buckets = NULL;
+    cache_nb_entries = 0;
+    pthread_rwlock_unlock(&cache_lock);
+}
+
+void table_cache_set_capacity(int capacity)
+{
+    table_cache_clear();
+    pthread_rwlock_wrlock(&cache_lock);
+    cache_capacity = capacity < 0 ? 0 : (capacity > TABLE_CACHE_MAX_CAPACITY ? TABLE_CACHE_MAX_CAPACITY : capacity);
+    pthread_rwlock_unlock(&cache_lock);
+}
+
+void table_cache_get_stats(TableCacheStats *stats)
+{
+    pthread_rwlock_rdlock(&cache_lock);
+    stats->nb_entries = cache_nb_entries;
+    stats->capacity = cache_capacity;
+    pthread_rwlock_unlock(&cache_lock);
+    stats->hits = atomic_load(&cache_hits);
+    stats->misses = atomic_load(&cache_misses);
+}
@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "tableset.h"
+#include "byteio.h"
+
+// FNV-1a of the serialized tables, folded to 32 bits
+static void update_id(TableSet *set)
+{
+    unsigned char serialized[2 + 2 * NB_SYMBOLS];
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned int t = 0; t < set->nb_tables; t++)
+    {
+        size_t size = code_table_serialize(&set->tables[t], serialized);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash = (hash ^ serialized[i]) * 1099511628211ULL;
+        }
+    }
+    set->id = (uint32_t)(hash ^ (hash >> 32));
+}
+
+void table_set_init(TableSet *set)
+{
+    set->nb_tables = 0;
+    update_id(set);
+}
+
+int table_set_train(TableSet *set, const char *name, const long long *histogram)
+{
+    size_t name_length = strlen(name);
+    if (name_length == 0 || name_length > TABLE_SET_MAX_NAME_LENGTH)
+    {
+        printf("Error: a table name has 1 to %d characters.\n", TABLE_SET_MAX_NAME_LENGTH);
+        return -1;
+    }
+    int table = table_set_find(set, name);
+    if (table < 0 && set->nb_tables == TABLE_SET_MAX_TABLES)
+    {
+        printf("Error: a table set holds at most %d tables.\n", TABLE_SET_MAX_TABLES);
+        return -1;
+    }
+
+    long long total = 0;
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        total += histogram[c];
+    }
+    if (total == 0)
+    {
+        printf("Error: no sample to train the table %s on.\n", name);
+        return -1;
+    }
+    // The letters never sampled would get the longest codes and push the table off the
+    // fast encode path: the counts are flattened until every code fits in it
+    CodeTable trained;
+    for (int shift = 0; shift < 63; shift++)
+    {
+        long long counts[NB_SYMBOLS];
+        for (int c = 0; c < NB_SYMBOLS; c++)
+        {
+            counts[c] = (histogram[c] >> shift) + 1;
+        }
+        if (code_table_from_histogram(counts, &trained) != 0)
+        {
+            printf("Error: cannot train the table %s.\n", name);
+            return -1;
+        }
+        if (trained.max_length <= TABLE_SET_MAX_CODE_LENGTH)
+        {
+            break;
+        }
+    }
+    if (table < 0)
+    {
+        table = (int)set->nb_tables++;
+        memcpy(set->names[table], name, name_length + 1);
+    }
+    set->tables[table] = trained;
+    update_id(set);
+    return 0;
+}
+
+int table_set_find(const TableSet *set, const char *name)
+{
+    for (unsigned int t = 0; t < set->nb_tables; t++)
+    {
+        if (strcmp(set->names[t], name) == 0)
+        {
+            return (int)t;
+        }
+    }
+    return -1;
+}
+
+int table_set_best(const TableSet *set, const long long *histogram, long long *cost)
+{
+    int best = -1;
+    for (unsigned int t = 0; t < set->nb_tables; t++)
+    {
+        long long table_cost = code_table_cost(&set->tables[t], histogram);
+        if (table_cost >= 0 && (best < 0 || table_cost < *cost))
+        {
+            best = (int)t;
+            *cost = table_cost;
+        }
+    }
+    return best;
+}
+
+int table_set_write(const TableSet *set, FILE *file)
+{
+    unsigned char buffer[1 + TABLE_SET_MAX_NAME_LENGTH + 2 + 2 * NB_SYMBOLS];
+    memcpy(buffer, TABLE_SET_MAGIC, 4);
+    buffer[4] = TABLE_SET_VERSION;
+    buffer[5] = (unsigned char)set->nb_tables;
+    if (fwrite(buffer, 1, 6, file) != 6)
+    {
+        printf("Error: cannot write the table set.\n");
+        return -1;
+    }
+    for (unsigned int t = 0; t < set->nb_tables; t++)
+    {
+        size_t name_length = strlen(set->names[t]);
+        buffer[0] = (unsigned char)name_length;
+        memcpy(buffer + 1, set->names[t], name_length);
+        size_t size = 1 + name_length + code_table_serialize(&set->tables[t], buffer + 1 + name_length);
+        if (fwrite(buffer, 1, size, file) != size)
+        {
+            printf("Error: cannot write the table set.\n");
+            return -1;
+        }
+    }
+    return fflush(file) == 0 ? 0 : -1;
+}
+
+int table_set_read(TableSet *set, FILE *file)
+{
+    unsigned char buffer[2 + 2 * NB_SYMBOLS];
+    table_set_init(set);
+    if (fread(buffer, 1, 6, file) != 6 || memcmp(buffer, TABLE_SET_MAGIC, 4) != 0 || buffer[4] != TABLE_SET_VERSION ||
+        buffer[5] > TABLE_SET_MAX_TABLES)
+    {
+        printf("Error: not a table set of version %d.\n", TABLE_SET_VERSION);
+        return -1;
+    }
+    unsigned int nb_tables = buffer[5];
+    for (unsigned int t = 0; t < nb_tables; t++)
+    {
+        int name_length = fgetc(file);
+        if (name_length <= 0 || fread(set->names[t], 1, (size_t)name_length, file) != (size_t)name_length ||
+            fread(buffer, 1, 2, file) != 2)
+        {
+            printf("Error: the table set is damaged.\n");
+            return -1;
+        }
+        set->names[t][name_length] = '\0';
+        size_t nb_symbols = get_u16(buffer);
+        if (nb_symbols > NB_SYMBOLS || fread(buffer + 2, 1, 2 * nb_symbols, file) != 2 * nb_symbols ||
+            code_table_deserialize(buffer, 2 + 2 * nb_symbols, &set->tables[t]) == 0)
+        {
+            printf("Error: the table set is damaged.\n");
+            return -1;
+        }
+        set->nb_tables = t + 1;
+    }
+    update_id(set);
+    return 0;
+}
@@ -0,0 +1,343 @@
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "tans.h"
+#include "byteio.h"
+
+// Decoding of a state: its letter, and the next state is new_state plus the next nb_bits bits
+typedef struct TansDecodeEntry
+{
+    unsigned short new_state;
+    unsigned char symbol;
+    unsigned char nb_bits;
+} TansDecodeEntry;
+
+// Coding of a letter from a state x in [size, 2 * size): it writes the low
+// (x + delta_nb_bits) >> 16 bits of x, and the rest of x leads to the next state
+typedef struct TansSymbolTransform
+{
+    int delta_find_state;
+    unsigned int delta_nb_bits;
+} TansSymbolTransform;
+
+static unsigned int highest_bit(unsigned int value)
+{
+    unsigned int bit = 0;
+    while (value >>= 1)
+    {
+        bit++;
+    }
+    return bit;
+}
+
+int tans_normalize(const long long *histogram, unsigned int table_log, TansFrequencies *frequencies)
+{
+    long long total = 0;
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        total += histogram[c];
+    }
+    if (total == 0)
+    {
+        return -1;
+    }
+
+    long long size = 1LL << table_log, sum = 0;
+    int largest = -1;
+    frequencies->table_log = table_log;
+    frequencies->nb_symbols = 0;
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        frequencies->counts[c] = 0;
+        if (histogram[c] > 0)
+        {
+            long long count = (long long)((double)histogram[c] * (double)size / (double)total + 0.5);
+            frequencies->counts[c] = (unsigned short)(count > 0 ? count : 1);
+            sum += frequencies->counts[c];
+            frequencies->nb_symbols++;
+            if (largest < 0 || histogram[c] > histogram[largest])
+            {
+                largest = c;
+            }
+        }
+    }
+    // What the rounding and the letters raised to 1 left over goes to the most frequent
+    // letter; what they took is given back by the largest counts, a little at a time
+    if (sum < size)
+    {
+        frequencies->counts[largest] = (unsigned short)(frequencies->counts[largest] + size - sum);
+    }
+    while (sum > size)
+    {
+        int richest = largest;
+        for (int c = 0; c < NB_SYMBOLS; c++)
+        {
+            richest = frequencies->counts[c] > frequencies->counts[richest] ? c : richest;
+        }
+        long long take = frequencies->counts[richest] / 8 + 1;
+        take = take < sum - size ? take : sum - size;
+        frequencies->counts[richest] = (unsigned short)(frequencies->counts[richest] - take);
+        sum -= take;
+    }
+    return 0;
+}
+
+long long tans_cost(const TansFrequencies *frequencies, const long long *histogram)
+{
+    double bits = 0;
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        if (histogram[c] > 0)
+        {
+            if (frequencies->counts[c] == 0)
+            {
+                return -1;
+            }
+            bits += (double)histogram[c] * ((double)frequencies->table_log - log2((double)frequencies->counts[c]));
+        }
+    }
+    return (long long)ceil(bits) + 2 * frequencies->table_log;
+}
+
+size_t tans_serialized_size(const TansFrequencies *frequencies)
+{
+    return 3 + 3 * (size_t)frequencies->nb_symbols;
+}
+
+size_t tans_serialize(const TansFrequencies *frequencies, unsigned char *out)
+{
+    size_t size = 3;
+    out[0] = (unsigned char)frequencies->table_log;
+    put_u16(out + 1, (uint16_t)frequencies->nb_symbols);
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        if (frequencies->counts[c] > 0)
+        {
+            out[size] = (unsigned char)c;
+            put_u16(out + size + 1, frequencies->counts[c]);
+            size += 3;
+        }
+    }
+    return size;
+}
+
+size_t tans_deserialize(const unsigned char *in, size_t size, TansFrequencies *frequencies)
+{
+    if (size < 3 || in[0] < TANS_MIN_TABLE_LOG || in[0] > TANS_MAX_TABLE_LOG)
+    {
+        return 0;
+    }
+    size_t nb_symbols = get_u16(in + 1);
+    if (nb_symbols == 0 || nb_symbols > NB_SYMBOLS || size < 3 + 3 * nb_symbols)
+    {
+        return 0;
+    }
+    frequencies->table_log = in[0];
+    frequencies->nb_symbols = (int)nb_symbols;
+    memset(frequencies->counts, 0, sizeof(frequencies->counts));
+    long long sum = 0;
+    for (size_t i = 0; i < nb_symbols; i++)
+    {
+        const unsigned char *entry = in + 3 + 3 * i;
+        // Letters in increasing order, each with a count
+        if ((i > 0 && entry[0] <= entry[-3]) || get_u16(entry + 1) == 0)
+        {
+            return 0;
+        }
+        frequencies->counts[entry[0]] = get_u16(entry + 1);
+        sum += frequencies->counts[entry[0]];
+    }
+    return sum == 1LL << frequencies->table_log ? 3 + 3 * nb_symbols : 0;
+}
+
+// Letter of each state: the occurrences of each letter are scattered over the states by
+// an odd step, so that each one has states across the whole range
+static void spread_symbols(const TansFrequencies *frequencies, unsigned char *spread)
+{
+    unsigned int size = 1u << frequencies->table_log, mask = size - 1;
+    unsigned int step = (size >> 1) + (size >> 3) + 3, pos = 0;
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        for (unsigned int i = 0; i < frequencies->counts[c]; i++)
+        {
+            spread[pos] = (unsigned char)c;
+            pos = (pos + step) & mask;
+        }
+    }
+}
+
+// Bits of the payload are written low bits first, 4 letters per store (4 * 12 + 7 bits
+// fit in the accumulator)
+typedef struct TansWriter
+{
+    unsigned char *out;
+    size_t pos;
+    uint64_t acc;
+    unsigned int nb_bits;
+} TansWriter;
+
+static inline void tans_put(TansWriter *writer, uint64_t value, unsigned int length)
+{
+    writer->acc |= value << writer->nb_bits;
+    writer->nb_bits += length;
+}
+
+static inline void tans_flush(TansWriter *writer)
+{
+    put_u64(writer->out + writer->pos, writer->acc);
+    writer->pos += writer->nb_bits >> 3;
+    writer->acc >>= writer->nb_bits & ~7u;
+    writer->nb_bits &= 7;
+}
+
+// Codes a letter from *state, which moves to the next state
+static inline void tans_put_letter(TansWriter *writer, unsigned int *state, const TansSymbolTransform *transform,
+                                   const unsigned short *state_table)
+{
+    unsigned int nb_bits = (*state + transform->delta_nb_bits) >> 16;
+    tans_put(writer, *state & ((1u << nb_bits) - 1), nb_bits);
+    *state = state_table[(int)(*state >> nb_bits) + transform->delta_find_state];
+}
+
+unsigned long long tans_encode(const unsigned char *data, size_t length, const TansFrequencies *frequencies,
+                               unsigned char *out)
+{
+    unsigned int size = 1u << frequencies->table_log;
+    unsigned char spread[1 << TANS_MAX_TABLE_LOG];
+    unsigned short state_table[1 << TANS_MAX_TABLE_LOG];
+    TansSymbolTransform transforms[NB_SYMBOLS];
+    unsigned int cumul[NB_SYMBOLS], total = 0;
+
+    spread_symbols(frequencies, spread);
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        unsigned int count = frequencies->counts[c];
+        cumul[c] = total;
+        if (count == 1)
+        {
+            transforms[c].delta_nb_bits = (frequencies->table_log << 16) - size;
+            transforms[c].delta_find_state = (int)total - 1;
+        }
+        else if (count > 1)
+        {
+            unsigned int max_bits_out = frequencies->table_log - highest_bit(count - 1);
+            transforms[c].delta_nb_bits = (max_bits_out << 16) - (count << max_bits_out);
+            transforms[c].delta_find_state = (int)total - (int)count;
+        }
+        total += count;
+    }
+    // The states of each letter, in the order of the spread, after the ones of the letters before
+    for (unsigned int u = 0; u < size; u++)
+    {
+        state_table[cumul[spread[u]]++] = (unsigned short)(size + u);
+    }
+
+    // Letters at even and odd positions go through two states, whose chains of table
+    // lookups run side by side
+    TansWriter writer = {out, 0, 0, 0};
+    unsigned int even = size, odd = size;
+    size_t i = length;
+    if (i % 2 == 1)
+    {
+        tans_put_letter(&writer, &even, &transforms[data[--i]], state_table);
+    }
+    while (i > 0)
+    {
+        tans_put_letter(&writer, &odd, &transforms[data[i - 1]], state_table);
+        tans_put_letter(&writer, &even, &transforms[data[i - 2]], state_table);
+        i -= 2;
+        if (i > 0)
+        {
+            tans_put_letter(&writer, &odd, &transforms[data[i - 1]], state_table);
+            tans_put_letter(&writer, &even, &transforms[data[i - 2]], state_table);
+            i -= 2;
+        }
+        tans_flush(&writer);
+    }
+    tans_put(&writer, odd - size, frequencies->table_log);
+    tans_put(&writer, even - size, frequencies->table_log);
+    tans_flush(&writer);
+    return (unsigned long long)writer.pos * 8 + writer.nb_bits;
+}
+
+// The 64 bits from the given byte, with zeros past the end of the payload
+static inline uint64_t load_bits(const unsigned char *in, size_t nb_bytes, size_t byte)
+{
+    if (byte + 8 <= nb_bytes)
+    {
+        return get_u64(in + byte);
+    }
+    uint64_t value = 0;
+    for (size_t i = nb_bytes; i > byte; i--)
+    {
+        value = (value << 8) | in[i - 1];
+    }
+    return value;
+}
+
+// Decodes the letter of *state, and moves it to the next state with the bits below *pos,
+// which window holds from bit window_pos; returns 0, or -1 if these bits are missing
+static inline int tans_get_letter(const TansDecodeEntry *table, unsigned int *state, uint64_t window,
+                                  unsigned long long window_pos, unsigned long long *pos, unsigned char *out)
+{
+    const TansDecodeEntry *entry = &table[*state];
+    *out = entry->symbol;
+    if (*pos < window_pos + entry->nb_bits)
+    {
+        return -1;
+    }
+    *pos -= entry->nb_bits;
+    *state = entry->new_state + ((unsigned int)(window >> (*pos - window_pos)) & ((1u << entry->nb_bits) - 1));
+    return 0;
+}
+
+int tans_decode(const unsigned char *in, unsigned long long nb_bits, const TansFrequencies *frequencies,
+                unsigned char *out, size_t length)
+{
+    unsigned int size = 1u << frequencies->table_log;
+    unsigned char spread[1 << TANS_MAX_TABLE_LOG];
+    TansDecodeEntry table[1 << TANS_MAX_TABLE_LOG];
+    unsigned int next[NB_SYMBOLS];
+
+    spread_symbols(frequencies, spread);
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        next[c] = frequencies->counts[c];
+    }
+    for (unsigned int u = 0; u < size; u++)
+    {
+        unsigned int x = next[spread[u]]++;
+        unsigned int nb = frequencies->table_log - highest_bit(x);
+        table[u].symbol = spread[u];
+        table[u].nb_bits = (unsigned char)nb;
+        table[u].new_state = (unsigned short)((x << nb) - size);
+    }
+
+    // The payload is read from its end: window holds the 64 bits from bit window_pos, and
+    // pos - window_pos >= 48 after a reload, enough for 4 letters
+    size_t nb_bytes = (size_t)((nb_bits + 7) / 8);
+    unsigned long long pos = nb_bits;
+    if (pos < 2 * frequencies->table_log)
+    {
+        return -1;
+    }
+    pos -= frequencies->table_log;
+    unsigned int even = (unsigned int)(load_bits(in, nb_bytes, (size_t)(pos >> 3)) >> (pos & 7)) & (size - 1);
+    pos -= frequencies->table_log;
+    unsigned int odd = (unsigned int)(load_bits(in, nb_bytes, (size_t)(pos >> 3)) >> (pos & 7)) & (size - 1);
+    for (size_t i = 0; i < length; i += 4)
+    {
+        unsigned long long window_pos = pos >= 56 ? (pos - 56) & ~7ULL : 0;
+        uint64_t window = load_bits(in, nb_bytes, (size_t)(window_pos >> 3));
+        if (tans_get_letter(table, &even, window, window_pos, &pos, out + i) != 0 ||
+            (i + 1 < length && tans_get_letter(table, &odd, window, window_pos, &pos, out + i + 1) != 0) ||
+            (i + 2 < length && tans_get_letter(table, &even, window, window_pos, &pos, out + i + 2) != 0) ||
+            (i + 3 < length && tans_get_letter(table, &odd, window, window_pos, &pos, out + i + 3) != 0))
+        {
+            return -1;
+        }
+    }
+    // The encoder started from state 0, with every bit read back
+    return pos == 0 && even == 0 && odd == 0 ? 0 : -1;
+}
@@ -0,0 +1,729 @@
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "tokens.h"
+#include "container.h"
+#include "memstats.h"
+#include "bitio.h"
+#include "byteio.h"
+
+#define TOKEN_TABLE_INITIAL_CAPACITY 1024
+#define TOKEN_OUTPUT_BUFFER_SIZE (1 << 16)
+
+int tokenizer_init(Tokenizer *tokenizer, const char *name)
+{
+    tokenizer->max_length = TOKEN_MAX_LENGTH;
+    if (strcmp(name, "words") == 0)
+    {
+        for (int c = 0; c < 256; c++)
+        {
+            tokenizer->classes[c] = (unsigned char)(isalnum(c) || c == '_' || c >= 0x80 ? 1 : 0);
+        }
+        tokenizer_set_class(tokenizer, " \t", 2);
+    }
+    else if (strcmp(name, "fields") == 0)
+    {
+        memset(tokenizer->classes, 1, sizeof(tokenizer->classes));
+        tokenizer_set_class(tokenizer, " \t\n\r\v\f", 2);
+    }
+    else if (strcmp(name, "lines") == 0)
+    {
+        memset(tokenizer->classes, 1, sizeof(tokenizer->classes));
+        tokenizer_set_class(tokenizer, "\n", TOKEN_CLASS_END);
+    }
+    else
+    {
+        printf("Error: unknown tokenizer %s (words, fields or lines).\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+void tokenizer_set_class(Tokenizer *tokenizer, const char *bytes, unsigned char class)
+{
+    for (; *bytes != '\0'; bytes++)
+    {
+        tokenizer->classes[(unsigned char)*bytes] = class;
+    }
+}
+
+size_t tokenizer_next(const Tokenizer *tokenizer, const unsigned char *data, size_t length)
+{
+    size_t max_length = tokenizer->max_length > 0 && tokenizer->max_length < length ? tokenizer->max_length : length;
+    if (max_length == 0)
+    {
+        return 0;
+    }
+
+    unsigned char class = tokenizer->classes[data[0]];
+    size_t end = 1;
+    if (class == 0 || class == TOKEN_CLASS_END)
+    {
+        return end;
+    }
+    while (end < max_length && tokenizer->classes[data[end]] == class)
+    {
+        end++;
+    }
+    if (end < max_length && tokenizer->classes[data[end]] == TOKEN_CLASS_END)
+    {
+        end++;
+    }
+    return end;
+}
+
+// FNV-1a, folded to 32 bits
+static uint32_t token_hash(const unsigned char *token, size_t length)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ token[i]) * 0x100000001b3ULL;
+    }
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+int token_table_init(TokenTable *table)
+{
+    memset(table, 0, sizeof(TokenTable));
+    table->tokens = mem_alloc_in(MEM_TOKENS, TOKEN_TABLE_INITIAL_CAPACITY * sizeof(*table->tokens));
+    table->lengths = mem_alloc_in(MEM_TOKENS, TOKEN_TABLE_INITIAL_CAPACITY * sizeof(*table->lengths));
+    table->hashes = mem_alloc_in(MEM_TOKENS, TOKEN_TABLE_INITIAL_CAPACITY * sizeof(*table->hashes));
+    table->counts = mem_alloc_in(MEM_TOKENS, TOKEN_TABLE_INITIAL_CAPACITY * sizeof(*table->counts));
+    table->slots = mem_calloc_in(MEM_TOKENS, 2 * TOKEN_TABLE_INITIAL_CAPACITY, sizeof(*table->slots));
+    table->capacity = TOKEN_TABLE_INITIAL_CAPACITY;
+    table->nb_slots = 2 * TOKEN_TABLE_INITIAL_CAPACITY;
+
+    if (table->tokens == NULL || table->lengths == NULL || table->hashes == NULL || table->counts == NULL ||
+        table->slots == NULL)
+    {
+        token_table_free(table);
+        return -1;
+    }
+    return 0;
+}
+
+void token_table_free(TokenTable *table)
+{
+    mem_free((void *)table->tokens);
+    mem_free(table->lengths);
+    mem_free(table->hashes);
+    mem_free(table->counts);
+    mem_free(table->slots);
+    memset(table, 0, sizeof(TokenTable));
+}
+
+// Index of the slot of the token, or of the free slot where it would go
+static size_t find_slot(const TokenTable *table, const unsigned char *token, size_t length, uint32_t hash)
+{
+    size_t mask = table->nb_slots - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask)
+    {
+        uint32_t entry = table->slots[slot];
+        if (entry == 0)
+        {
+            return slot;
+        }
+        uint32_t id = entry - 1;
+        if (table->hashes[id] == hash && table->lengths[id] == length && memcmp(table->tokens[id], token, length) == 0)
+        {
+            return slot;
+        }
+    }
+}
+
+// Doubles the token arrays and the slots, keeping the load factor under 1/2
+static int grow_token_table(TokenTable *table)
+{
+    size_t capacity = 2 * table->capacity;
+    void *tokens = mem_realloc((void *)table->tokens, capacity * sizeof(*table->tokens));
+    if (tokens == NULL)
+    {
+        return -1;
+    }
+    table->tokens = tokens;
+    void *lengths = mem_realloc(table->lengths, capacity * sizeof(*table->lengths));
+    if (lengths == NULL)
+    {
+        return -1;
+    }
+    table->lengths = lengths;
+    void *hashes = mem_realloc(table->hashes, capacity * sizeof(*table->hashes));
+    if (hashes == NULL)
+    {
+        return -1;
+    }
+    table->hashes = hashes;
+    void *counts = mem_realloc(table->counts, capacity * sizeof(*table->counts));
+    if (counts == NULL)
+    {
+        return -1;
+    }
+    table->counts = counts;
+
+    uint32_t *slots = mem_calloc_in(MEM_TOKENS, 2 * capacity, sizeof(*slots));
+    if (slots == NULL)
+    {
+        return -1;
+    }
+    mem_free(table->slots);
+    table->slots = slots;
+    table->nb_slots = 2 * capacity;
+    table->capacity = capacity;
+
+    size_t mask = table->nb_slots - 1;
+    for (size_t id = 0; id < table->nb_tokens; id++)
+    {
+        size_t slot = table->hashes[id] & mask;
+        while (table->slots[slot] != 0)
+        {
+            slot = (slot + 1) & mask;
+        }
+        table->slots[slot] = (uint32_t)id + 1;
+    }
+    return 0;
+}
+
+long token_table_add(TokenTable *table, const unsigned char *token, size_t length)
+{
+    uint32_t hash = token_hash(token, length);
+    size_t slot = find_slot(table, token, length, hash);
+    if (table->slots[slot] != 0)
+    {
+        uint32_t id = table->slots[slot] - 1;
+        table->counts[id]++;
+        return (long)id;
+    }
+
+    if (table->nb_tokens == table->capacity)
+    {
+        if (table->nb_tokens >= UINT32_MAX / 4 || grow_token_table(table) != 0)
+        {
+            return -1;
+        }
+        slot = find_slot(table, token, length, hash);
+    }
+    size_t id = table->nb_tokens++;
+    table->tokens[id] = token;
+    table->lengths[id] = (uint32_t)length;
+    table->hashes[id] = hash;
+    table->counts[id] = 1;
+    table->slots[slot] = (uint32_t)id + 1;
+    return (long)id;
+}
+
+long token_table_find(const TokenTable *table, const unsigned char *token, size_t length)
+{
+    if (table->nb_slots == 0)
+    {
+        return -1;
+    }
+    size_t slot = find_slot(table, token, length, token_hash(token, length));
+    return table->slots[slot] == 0 ? -1 : (long)table->slots[slot] - 1;
+}
+
+typedef struct WeightedToken
+{
+    uint64_t weight;
+    uint32_t token;
+} WeightedToken;
+
+static int compare_weighted_tokens(const void *a, const void *b)
+{
+    const WeightedToken *x = a, *y = b;
+    if (x->weight != y->weight)
+    {
+        return x->weight < y->weight ? -1 : 1;
+    }
+    return x->token < y->token ? -1 : (x->token > y->token ? 1 : 0);
+}
+
+// Moffat and Katajainen, "In-place calculation of minimum-redundancy codes": weight holds
+// n >= 2 increasing weights and receives the code length of each, in the same order (so
+// decreasing). The internal nodes are built in the slots of the leaves already merged,
+// exactly as the two-queue method of huffman_code_lengths
+static void code_lengths_in_place(uint64_t *weight, size_t n)
+{
+    size_t leaf = 0, root = 0;
+
+    // Merges: weight[next] becomes an internal node, then the index of its parent
+    for (size_t next = 0; next < n - 1; next++)
+    {
+        for (int k = 0; k < 2; k++)
+        {
+            uint64_t lightest;
+            if (leaf >= n || (root < next && weight[root] < weight[leaf]))
+            {
+                lightest = weight[root];
+                weight[root++] = next;
+            }
+            else
+            {
+                lightest = weight[leaf++];
+            }
+            weight[next] = k == 0 ? lightest : weight[next] + lightest;
+        }
+    }
+
+    // Depths of the internal nodes, from the root down
+    weight[n - 2] = 0;
+    for (size_t next = n - 2; next-- > 0;)
+    {
+        weight[next] = weight[weight[next]] + 1;
+    }
+
+    // Depths of the leaves: the free slots at each depth that are not internal nodes
+    long long internal = (long long)n - 2;
+    size_t next = n, available = 1;
+    for (uint64_t depth = 0; available > 0; depth++)
+    {
+        size_t used = 0;
+        while (internal >= 0 && weight[internal] == depth)
+        {
+            used++;
+            internal--;
+        }
+        while (available > used)
+        {
+            weight[--next] = depth;
+            available--;
+        }
+        available = 2 * used;
+    }
+}
+
+long token_code_lengths(const uint64_t *counts, size_t nb_symbols, unsigned char *lengths, int max_length)
+{
+    size_t nb_coded = 0;
+
+    memset(lengths, 0, nb_symbols);
+    for (size_t i = 0; i < nb_symbols; i++)
+    {
+        nb_coded += counts[i] > 0;
+    }
+    if (max_length > TOKEN_MAX_CODE_LENGTH || max_length < 1 || nb_coded > (1ULL << max_length))
+    {
+        return -1;
+    }
+    if (nb_coded <= 1)
+    {
+        // A single token still needs a one-bit code
+        for (size_t i = 0; i < nb_symbols; i++)
+        {
+            lengths[i] = counts[i] > 0;
+        }
+        return (long)nb_coded;
+    }
+
+    WeightedToken *sorted = mem_alloc_in(MEM_TOKENS, nb_coded * sizeof(WeightedToken));
+    uint64_t *weight = mem_alloc_in(MEM_TOKENS, nb_coded * sizeof(uint64_t));
+    if (sorted == NULL || weight == NULL)
+    {
+        mem_free(sorted);
+        mem_free(weight);
+        return -1;
+    }
+    for (size_t i = 0, j = 0; i < nb_symbols; i++)
+    {
+        if (counts[i] > 0)
+        {
+            sorted[j].weight = counts[i];
+            sorted[j].token = (uint32_t)i;
+            j++;
+        }
+    }
+    qsort(sorted, nb_coded, sizeof(WeightedToken), compare_weighted_tokens);
+    for (size_t j = 0; j < nb_coded; j++)
+    {
+        weight[j] = sorted[j].weight;
+    }
+    code_lengths_in_place(weight, nb_coded);
+
+    // Codes over max_length are cut to max_length, then the longest codes that can still
+    // grow are made one bit longer until the lengths form a prefix code again. Only the
+    // number of codes of each length matters: the lengths are handed back out by
+    // decreasing length to the tokens by increasing count
+    uint64_t count[TOKEN_MAX_CODE_LENGTH + 1] = {0};
+    uint64_t kraft = 0, capacity = 1ULL << max_length;
+    for (size_t j = 0; j < nb_coded; j++)
+    {
+        int length = weight[j] > (uint64_t)max_length ? max_length : (int)weight[j];
+        count[length]++;
+        kraft += capacity >> length;
+    }
+    while (kraft > capacity)
+    {
+        int length = max_length - 1;
+        while (count[length] == 0)
+        {
+            length--;
+        }
+        count[length]--;
+        count[length + 1]++;
+        kraft -= capacity >> (length + 1);
+    }
+    size_t j = 0;
+    for (int length = max_length; length >= 1; length--)
+    {
+        for (uint64_t k = 0; k < count[length]; k++)
+        {
+            lengths[sorted[j++].token] = (unsigned char)length;
+        }
+    }
+
+    mem_free(sorted);
+    mem_free(weight);
+    return (long)nb_coded;
+}
+
+// The whole file in memory, followed by 8 zero bytes so that the decoder can always peek
+// 64 bits; returns NULL on error
+static unsigned char *read_all(FILE *input, size_t *length)
+{
+    // One more byte than the size of a regular file, to see the end of file without growing
+    long long size = container_input_size(input);
+    size_t capacity = size >= 0 ? (size_t)size + 1 : TOKEN_OUTPUT_BUFFER_SIZE;
+    unsigned char *data = mem_alloc(capacity + 8);
+    size_t nb_bytes;
+
+    *length = 0;
+    while (data != NULL && (nb_bytes = fread(data + *length, 1, capacity - *length, input)) > 0)
+    {
+        *length += nb_bytes;
+        if (*length == capacity)
+        {
+            unsigned char *larger = mem_realloc(data, 2 * capacity + 8);
+            if (larger == NULL)
+            {
+                mem_free(data);
+                return NULL;
+            }
+            data = larger;
+            capacity *= 2;
+        }
+    }
+    if (data == NULL || ferror(input))
+    {
+        mem_free(data);
+        return NULL;
+    }
+    memset(data + *length, 0, 8);
+    return data;
+}
+
+int token_compress(FILE *input, FILE *output, const Tokenizer *tokenizer)
+{
+    TokenTable table;
+    size_t length, nb_coded = 0, capacity = TOKEN_TABLE_INITIAL_CAPACITY;
+    unsigned char *data = read_all(input, &length);
+    uint32_t *coded = mem_alloc(capacity * sizeof(uint32_t));
+    unsigned char *lengths = NULL, *dict = NULL, *payload = NULL;
+    uint32_t *codes = NULL;
+    int status = -1;
+
+    if (data == NULL || coded == NULL || token_table_init(&table) != 0)
+    {
+        printf("Error: not enough memory to hold the input and its tokens.\n");
+        mem_free(data);
+        mem_free(coded);
+        return -1;
+    }
+
+    // One pass numbers the tokens and keeps the numbers of the whole input
+    for (size_t pos = 0; pos < length;)
+    {
+        size_t token_length = tokenizer_next(tokenizer, data + pos, length - pos);
+        long id = token_table_add(&table, data + pos, token_length);
+        if (id >= 0 && nb_coded == capacity)
+        {
+            uint32_t *larger = mem_realloc(coded, 2 * capacity * sizeof(uint32_t));
+            if (larger == NULL)
+            {
+                id = -1;
+            }
+            else
+            {
+                coded = larger;
+                capacity *= 2;
+            }
+        }
+        if (id < 0)
+        {
+            printf("Error: not enough memory for the tokens of the input.\n");
+            goto cleanup;
+        }
+        coded[nb_coded++] = (uint32_t)id;
+        pos += token_length;
+    }
+
+    size_t nb_symbols = table.nb_tokens;
+    lengths = mem_alloc_in(MEM_TOKENS, nb_symbols + 1);
+    codes = mem_alloc_in(MEM_TOKENS, (nb_symbols + 1) * sizeof(uint32_t));
+    if (lengths == NULL || codes == NULL ||
+        token_code_lengths(table.counts, nb_symbols, lengths, TOKEN_MAX_CODE_LENGTH) < 0)
+    {
+        printf("Error: not enough memory for the code of %zu tokens.\n", nb_symbols);
+        goto cleanup;
+    }
+
+    // Canonical codes, in the order of (code length, token number)
+    uint64_t count[TOKEN_MAX_CODE_LENGTH + 2] = {0};
+    uint32_t next_code[TOKEN_MAX_CODE_LENGTH + 1];
+    unsigned long long nb_bits = 0;
+    size_t dict_size = 0;
+    int max_length = 0;
+    for (size_t id = 0; id < nb_symbols; id++)
+    {
+        count[lengths[id]]++;
+        nb_bits += table.counts[id] * lengths[id];
+        dict_size += VARINT_MAX_SIZE + table.lengths[id];
+        max_length = lengths[id] > max_length ? lengths[id] : max_length;
+    }
+    uint32_t code = 0;
+    for (int bits = 1; bits <= TOKEN_MAX_CODE_LENGTH; bits++)
+    {
+        code = (code + (uint32_t)count[bits - 1]) << 1;
+        next_code[bits] = code;
+    }
+    for (size_t id = 0; id < nb_symbols; id++)
+    {
+        codes[id] = next_code[lengths[id]]++;
+    }
+
+    dict = mem_alloc_in(MEM_TOKENS, 6 + (TOKEN_MAX_CODE_LENGTH + 3) * VARINT_MAX_SIZE + dict_size);
+    payload = mem_alloc((size_t)(nb_bits / 8) + 8);
+    if (dict == NULL || payload == NULL)
+    {
+        printf("Error: not enough memory for the compressed tokens.\n");
+        goto cleanup;
+    }
+
+    size_t pos = 0;
+    memcpy(dict, TOKEN_MAGIC, 4);
+    dict[4] = TOKEN_VERSION;
+    dict[5] = (unsigned char)max_length;
+    pos = 6;
+    pos += put_varint(dict + pos, nb_symbols);
+    for (int bits = 1; bits <= max_length; bits++)
+    {
+        pos += put_varint(dict + pos, count[bits]);
+    }
+    for (int bits = 1; bits <= max_length; bits++)
+    {
+        for (size_t id = 0; id < nb_symbols; id++)
+        {
+            if (lengths[id] == bits)
+            {
+                pos += put_varint(dict + pos, table.lengths[id]);
+                memcpy(dict + pos, table.tokens[id], table.lengths[id]);
+                pos += table.lengths[id];
+            }
+        }
+    }
+    pos += put_varint(dict + pos, nb_coded);
+    pos += put_varint(dict + pos, nb_bits);
+
+    BitWriter writer;
+    bit_writer_init(&writer, payload);
+    for (size_t i = 0; i < nb_coded; i++)
+    {
+        bit_writer_put(&writer, codes[coded[i]], lengths[coded[i]]);
+    }
+    size_t payload_size = bit_writer_flush(&writer);
+
+    if (fwrite(dict, 1, pos, output) != pos || fwrite(payload, 1, payload_size, output) != payload_size ||
+        fflush(output) != 0)
+    {
+        printf("Error: could not write the compressed tokens.\n");
+        goto cleanup;
+    }
+    status = 0;
+
+cleanup:
+    token_table_free(&table);
+    mem_free(data);
+    mem_free(coded);
+    mem_free(lengths);
+    mem_free(codes);
+    mem_free(dict);
+    mem_free(payload);
+    return status;
+}
+
+// Appends a token to the output buffer, which is written out when full
+static int put_token(FILE *output, unsigned char *buffer, size_t *used, const unsigned char *token, size_t length)
+{
+    if (*used + length > TOKEN_OUTPUT_BUFFER_SIZE)
+    {
+        if (fwrite(buffer, 1, *used, output) != *used)
+        {
+            return -1;
+        }
+        *used = 0;
+        if (length > TOKEN_OUTPUT_BUFFER_SIZE)
+        {
+            return fwrite(token, 1, length, output) == length ? 0 : -1;
+        }
+    }
+    memcpy(buffer + *used, token, length);
+    *used += length;
+    return 0;
+}
+
+int token_decompress(FILE *input, FILE *output)
+{
+    size_t size, pos = 6, nb_symbols = 0, used = 0;
+    uint64_t value, nb_coded = 0, nb_bits = 0;
+    unsigned char *data = read_all(input, &size);
+    const unsigned char **tokens = NULL;
+    uint32_t *token_lengths = NULL;
+    uint32_t *fast = mem_calloc_in(MEM_TOKENS, 1 << TOKEN_DECODE_BITS, sizeof(uint32_t));
+    unsigned char *buffer = mem_alloc(TOKEN_OUTPUT_BUFFER_SIZE);
+    uint32_t first_code[TOKEN_MAX_CODE_LENGTH + 1] = {0};
+    size_t first_index[TOKEN_MAX_CODE_LENGTH + 1] = {0};
+    uint64_t count[TOKEN_MAX_CODE_LENGTH + 1] = {0};
+    int max_length = 0, status = -1;
+
+    if (data == NULL || fast == NULL || buffer == NULL)
+    {
+        printf("Error: not enough memory to hold the compressed tokens.\n");
+        goto cleanup;
+    }
+    if (size < 6 || memcmp(data, TOKEN_MAGIC, 4) != 0 || data[4] != TOKEN_VERSION ||
+        data[5] > TOKEN_MAX_CODE_LENGTH)
+    {
+        printf("Error: not a token container.\n");
+        goto cleanup;
+    }
+    max_length = data[5];
+
+    // Code lengths: the counts must add up to the number of tokens and form a prefix code
+    size_t read = get_varint(data + pos, size - pos, &value);
+    nb_symbols = (size_t)value;
+    pos += read;
+    int valid = read > 0 && value <= size;
+    uint64_t total = 0, kraft = 0;
+    for (int bits = 1; valid && bits <= max_length; bits++)
+    {
+        read = get_varint(data + pos, size - pos, &count[bits]);
+        pos += read;
+        valid = read > 0 && count[bits] <= nb_symbols && count[bits] <= (1ULL << bits);
+        total += count[bits];
+        kraft += count[bits] << (TOKEN_MAX_CODE_LENGTH - bits);
+    }
+    valid = valid && total == nb_symbols && kraft <= (1ULL << TOKEN_MAX_CODE_LENGTH);
+    if (valid)
+    {
+        tokens = mem_alloc_in(MEM_TOKENS, (nb_symbols + 1) * sizeof(*tokens));
+        token_lengths = mem_alloc_in(MEM_TOKENS, (nb_symbols + 1) * sizeof(uint32_t));
+        if (tokens == NULL || token_lengths == NULL)
+        {
+            printf("Error: not enough memory for %zu tokens.\n", nb_symbols);
+            goto cleanup;
+        }
+    }
+    for (size_t rank = 0; valid && rank < nb_symbols; rank++)
+    {
+        read = get_varint(data + pos, size - pos, &value);
+        pos += read;
+        valid = read > 0 && value > 0 && value <= size - pos;
+        tokens[rank] = data + pos;
+        token_lengths[rank] = (uint32_t)value;
+        pos += valid ? (size_t)value : 0;
+    }
+    if (valid)
+    {
+        read = get_varint(data + pos, size - pos, &nb_coded);
+        pos += read;
+        valid = read > 0;
+        read = valid ? get_varint(data + pos, size - pos, &nb_bits) : 0;
+        pos += read;
+        valid = read > 0 && (nb_bits + 7) / 8 == size - pos && (nb_coded == 0 || nb_symbols > 0);
+    }
+    if (!valid)
+    {
+        printf("Error: the token container is damaged.\n");
+        goto cleanup;
+    }
+
+    // Canonical decoding: whole tokens straight from the fast table for the codes of at
+    // most TOKEN_DECODE_BITS bits, whose ranks are below 1 << TOKEN_DECODE_BITS
+    uint32_t code = 0;
+    size_t index = 0;
+    for (int bits = 1; bits <= max_length; bits++)
+    {
+        code = (code + (uint32_t)count[bits - 1]) << 1;
+        first_code[bits] = code;
+        first_index[bits] = index;
+        for (uint64_t k = 0; k < count[bits] && bits <= TOKEN_DECODE_BITS; k++)
+        {
+            uint32_t first = (code + (uint32_t)k) << (TOKEN_DECODE_BITS - bits);
+            for (uint32_t i = first; i < first + (1u << (TOKEN_DECODE_BITS - bits)); i++)
+            {
+                fast[i] = (uint32_t)((index + k) << 6) | (uint32_t)bits;
+            }
+        }
+        index += (size_t)count[bits];
+    }
+
+    const unsigned char *payload = data + pos;
+    unsigned long long bit_pos = 0;
+    for (uint64_t t = 0; t < nb_coded; t++)
+    {
+        unsigned long long peek = load_be64(payload + (bit_pos >> 3)) << (bit_pos & 7);
+        uint32_t entry = fast[peek >> (64 - TOKEN_DECODE_BITS)];
+        size_t rank = entry >> 6;
+        int bits = (int)(entry & 63);
+
+        for (int length = TOKEN_DECODE_BITS + 1; bits == 0 && length <= max_length; length++)
+        {
+            uint32_t long_code = (uint32_t)(peek >> (64 - length));
+            if (long_code - first_code[length] < count[length])
+            {
+                rank = first_index[length] + (long_code - first_code[length]);
+                bits = length;
+            }
+        }
+        bit_pos += (unsigned long long)bits;
+        if (bits == 0 || bit_pos > nb_bits)
+        {
+            printf("Error: the token container is damaged.\n");
+            goto cleanup;
+        }
+        if (put_token(output, buffer, &used, tokens[rank], token_lengths[rank]) != 0)
+        {
+            printf("Error: could not write the decompressed tokens.\n");
+            goto cleanup;
+        }
+    }
+    if (bit_pos != nb_bits)
+    {
+        printf("Error: the token container is damaged.\n");
+        goto cleanup;
+    }
+    if (fwrite(buffer, 1, used, output) != used || fflush(output) != 0)
+    {
+        printf("Error: could not write the decompressed tokens.\n");
+        goto cleanup;
+    }
+    status = 0;
+
+cleanup:
+    mem_free(data);
+    mem_free((void *)tokens);
+    mem_free(token_lengths);
+    mem_free(fast);
+    mem_free(buffer);
+    return status;
+}
+
+int token_file_detect(FILE *input)
+{
+    unsigned char magic[4];
+    int found = fread(magic, 1, 4, input) == 4 && memcmp(magic, TOKEN_MAGIC, 4) == 0;
+    rewind(input);
+    return found;
+}
@@ -0,0 +1,72 @@
+#include <stdatomic.h>
+
+#include "trace.h"
+
+typedef struct TraceEvent
+{
+    atomic_ullong seq;  //  Index + 1 of the event stored in the slot (0 while empty or being written)
+    const char *format; //  Static format string of the event
+    long long args[4];
+} TraceEvent;
+
+static TraceEvent trace_ring[TRACE_RING_SIZE];
+static atomic_ullong trace_head = 0;
+
+void trace_record(const char *format, long long a, long long b, long long c, long long d)
+{
+    unsigned long long idx = atomic_fetch_add_explicit(&trace_head, 1, memory_order_relaxed);
+    TraceEvent *event = &trace_ring[idx & (TRACE_RING_SIZE - 1)];
+
+    // Mark the slot as being written, so that a concurrent dump skips it
+    atomic_store_explicit(&event->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    event->format = format;
+    event->args[0] = a;
+    event->args[1] = b;
+    event->args[2] = c;
+    event->args[3] = d;
+    atomic_store_explicit(&event->seq, idx + 1, memory_order_release);
+}
+
+void trace_dump(FILE *output)
+{
+    unsigned long long head = atomic_load_explicit(&trace_head, memory_order_acquire);
+    unsigned long long first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+    if (first > 0)
+    {
+        fprintf(output, "[trace] %llu older events were overwritten\n", first);
+    }
+    for (unsigned long long idx = first; idx < head; idx++)
+    {
+        TraceEvent *event = &trace_ring[idx & (TRACE_RING_SIZE - 1)];
+        if (atomic_load_explicit(&event->seq, memory_order_acquire) != idx + 1)
+        {
+            continue;
+        }
+        TraceEvent copy;
+        copy.format = event->format;
+        for (int i = 0; i < 4; i++)
+        {
+            copy.args[i] = event->args[i];
+        }
+        // The slot was reused while it was copied: the event is lost
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&event->seq, memory_order_relaxed) != idx + 1)
+        {
+            continue;
+        }
+        fprintf(output, "[trace %llu] ", idx);
+        fprintf(output, copy.format, copy.args[0], copy.args[1], copy.args[2], copy.args[3]);
+        fprintf(output, "\n");
+    }
+}
+
+void trace_clear(void)
+{
+    for (int i = 0; i < TRACE_RING_SIZE; i++)
+    {
+        atomic_store_explicit(&trace_ring[i].seq, 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&trace_head, 0, memory_order_release);
+}
@@ -0,0 +1,842 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "transform.h"
+#include "memstats.h"
+#include "byteio.h"
+
+// The shuffles transpose whole vectors where the baseline instruction set has them
+#if defined(__SSE2__)
+#define TRANSFORM_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#define RLE_MIN_RUN 4
+#define RLE_MAX_RUN (RLE_MIN_RUN + 255)
+
+int transform_chain_parse(const char *text, TransformChain *chain)
+{
+    chain->nb_stages = 0;
+    if (strcmp(text, "none") == 0)
+    {
+        return 0;
+    }
+    for (;;)
+    {
+        size_t length = strcspn(text, ",");
+        int stage = 0;
+        for (int candidate = TRANSFORM_RLE; candidate <= TRANSFORM_SHUFFLE8; candidate++)
+        {
+            const char *name = transform_stage_name(candidate);
+            if (strlen(name) == length && strncmp(text, name, length) == 0)
+            {
+                stage = candidate;
+            }
+        }
+        if (stage == 0 || chain->nb_stages == TRANSFORM_MAX_STAGES)
+        {
+            return -1;
+        }
+        chain->stages[chain->nb_stages++] = (unsigned char)stage;
+        if (text[length] == '\0')
+        {
+            break;
+        }
+        text += length + 1;
+    }
+    return transform_chain_valid(chain) ? 0 : -1;
+}
+
+int transform_chain_valid(const TransformChain *chain)
+{
+    if (chain->nb_stages > TRANSFORM_MAX_STAGES)
+    {
+        return 0;
+    }
+    for (int i = 0; i < chain->nb_stages; i++)
+    {
+        if (chain->stages[i] < TRANSFORM_RLE || chain->stages[i] > TRANSFORM_SHUFFLE8 ||
+            (chain->stages[i] >= TRANSFORM_SHUFFLE2 && i + 1 < chain->nb_stages))
+        {
+            return 0;
+        }
+        for (int j = 0; j < i; j++)
+        {
+            if (chain->stages[j] == chain->stages[i])
+            {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+const char *transform_stage_name(int stage)
+{
+    switch (stage)
+    {
+    case TRANSFORM_RLE:
+        return "rle";
+    case TRANSFORM_MTF:
+        return "mtf";
+    case TRANSFORM_BWT:
+        return "bwt";
+    case TRANSFORM_DELTA2:
+        return "delta2";
+    case TRANSFORM_DELTA4:
+        return "delta4";
+    case TRANSFORM_DELTA8:
+        return "delta8";
+    case TRANSFORM_SHUFFLE2:
+        return "shuffle2";
+    case TRANSFORM_SHUFFLE4:
+        return "shuffle4";
+    case TRANSFORM_SHUFFLE8:
+        return "shuffle8";
+    default:
+        return "?";
+    }
+}
+
+// Element width of the delta and shuffle stages
+static unsigned int stage_width(int stage)
+{
+    switch (stage)
+    {
+    case TRANSFORM_DELTA2:
+    case TRANSFORM_SHUFFLE2:
+        return 2;
+    case TRANSFORM_DELTA4:
+    case TRANSFORM_SHUFFLE4:
+        return 4;
+    case TRANSFORM_DELTA8:
+    case TRANSFORM_SHUFFLE8:
+        return 8;
+    default:
+        return 1;
+    }
+}
+
+unsigned int transform_planes(const TransformChain *chain)
+{
+    int last = chain->nb_stages > 0 ? chain->stages[chain->nb_stages - 1] : 0;
+    return last >= TRANSFORM_SHUFFLE2 ? stage_width(last) : 1;
+}
+
+size_t rle_encode(const unsigned char *data, size_t length, unsigned char *out)
+{
+    size_t pos = 0;
+    size_t i = 0;
+    while (i < length)
+    {
+        unsigned char c = data[i];
+        size_t run = 1;
+        while (i + run < length && data[i + run] == c && run < RLE_MAX_RUN)
+        {
+            run++;
+        }
+        if (run >= RLE_MIN_RUN)
+        {
+            memset(out + pos, c, RLE_MIN_RUN);
+            out[pos + RLE_MIN_RUN] = (unsigned char)(run - RLE_MIN_RUN);
+            pos += RLE_MIN_RUN + 1;
+        }
+        else
+        {
+            memset(out + pos, c, run);
+            pos += run;
+        }
+        i += run;
+    }
+    return pos;
+}
+
+long long rle_decode(const unsigned char *data, size_t length, unsigned char *out, size_t capacity)
+{
+    size_t pos = 0;
+    size_t i = 0;
+    int previous = -1;
+    int run = 0;
+    while (i < length)
+    {
+        unsigned char c = data[i++];
+        if (pos == capacity)
+        {
+            return -1;
+        }
+        out[pos++] = c;
+        run = c == previous ? run + 1 : 1;
+        previous = c;
+        if (run == RLE_MIN_RUN)
+        {
+            // A run of RLE_MIN_RUN bytes is always followed by its count
+            if (i == length || data[i] > capacity - pos)
+            {
+                return -1;
+            }
+            memset(out + pos, c, data[i]);
+            pos += data[i++];
+            previous = -1;
+        }
+    }
+    return (long long)pos;
+}
+
+void mtf_encode(const unsigned char *data, size_t length, unsigned char *out)
+{
+    unsigned char list[256];
+    for (int c = 0; c < 256; c++)
+    {
+        list[c] = (unsigned char)c;
+    }
+    for (size_t i = 0; i < length; i++)
+    {
+        unsigned char c = data[i];
+        size_t rank = (size_t)((unsigned char *)memchr(list, c, sizeof(list)) - list);
+        memmove(list + 1, list, rank);
+        list[0] = c;
+        out[i] = (unsigned char)rank;
+    }
+}
+
+void mtf_decode(const unsigned char *data, size_t length, unsigned char *out)
+{
+    unsigned char list[256];
+    for (int c = 0; c < 256; c++)
+    {
+        list[c] = (unsigned char)c;
+    }
+    for (size_t i = 0; i < length; i++)
+    {
+        int rank = data[i];
+        unsigned char c = list[rank];
+        memmove(list + 1, list, (size_t)rank);
+        list[0] = c;
+        out[i] = c;
+    }
+}
+
+// SA-IS (Nong, Zhang and Chan): the suffixes are typed S (smaller than the next one) or
+// L (larger); sorting the LMS substrings (from an S suffix right after an L one to the
+// next) by induction, naming them and sorting the reduced string recursively gives
+// the order of the LMS suffixes, from which a last induction orders all of them.
+// s ends with a unique 0 and its letters are below k
+#define IS_LMS(types, i) ((i) > 0 && (types)[i] && !(types)[(i)-1])
+
+static void get_buckets(const int32_t *s, int32_t n, int32_t k, int32_t *buckets, int end)
+{
+    int32_t sum = 0;
+    memset(buckets, 0, (size_t)k * sizeof(int32_t));
+    for (int32_t i = 0; i < n; i++)
+    {
+        buckets[s[i]]++;
+    }
+    for (int32_t c = 0; c < k; c++)
+    {
+        sum += buckets[c];
+        buckets[c] = end ? sum : sum - buckets[c];
+    }
+}
+
+static void induce(const int32_t *s, int32_t *sa, const unsigned char *types, int32_t n, int32_t k, int32_t *buckets)
+{
+    get_buckets(s, n, k, buckets, 0);
+    for (int32_t i = 0; i < n; i++)
+    {
+        int32_t j = sa[i] - 1;
+        if (j >= 0 && !types[j])
+        {
+            sa[buckets[s[j]]++] = j;
+        }
+    }
+    get_buckets(s, n, k, buckets, 1);
+    for (int32_t i = n - 1; i >= 0; i--)
+    {
+        int32_t j = sa[i] - 1;
+        if (j >= 0 && types[j])
+        {
+            sa[--buckets[s[j]]] = j;
+        }
+    }
+}
+
+static int sais(const int32_t *s, int32_t *sa, int32_t n, int32_t k)
+{
+    unsigned char *types = mem_alloc((size_t)n);
+    int32_t *buckets = mem_alloc((size_t)k * sizeof(int32_t));
+    if (types == NULL || buckets == NULL)
+    {
+        mem_free(types);
+        mem_free(buckets);
+        return -1;
+    }
+
+    types[n - 1] = 1;
+    for (int32_t i = n - 2; i >= 0; i--)
+    {
+        types[i] = s[i] < s[i + 1] || (s[i] == s[i + 1] && types[i + 1]);
+    }
+
+    // Sort the LMS substrings
+    get_buckets(s, n, k, buckets, 1);
+    for (int32_t i = 0; i < n; i++)
+    {
+        sa[i] = -1;
+    }
+    for (int32_t i = 1; i < n; i++)
+    {
+        if (IS_LMS(types, i))
+        {
+            sa[--buckets[s[i]]] = i;
+        }
+    }
+    induce(s, sa, types, n, k, buckets);
+
+    // Name them in order, equal substrings getting the same name; the names go to the
+    // upper half of sa (two LMS positions are at least 2 apart), then to its end
+    int32_t nb_lms = 0;
+    for (int32_t i = 0; i < n; i++)
+    {
+        if (IS_LMS(types, sa[i]))
+        {
+            sa[nb_lms++] = sa[i];
+        }
+    }
+    for (int32_t i = nb_lms; i < n; i++)
+    {
+        sa[i] = -1;
+    }
+    int32_t name = 0;
+    int32_t previous = -1;
+    for (int32_t i = 0; i < nb_lms; i++)
+    {
+        int32_t pos = sa[i];
+        int differ = previous < 0;
+        for (int32_t d = 0; !differ; d++)
+        {
+            if (s[pos + d] != s[previous + d] || types[pos + d] != types[previous + d])
+            {
+                differ = 1;
+            }
+            else if (d > 0 && (IS_LMS(types, pos + d) || IS_LMS(types, previous + d)))
+            {
+                break;
+            }
+        }
+        if (differ)
+        {
+            name++;
+            previous = pos;
+        }
+        sa[nb_lms + pos / 2] = name - 1;
+    }
+    for (int32_t i = n - 1, j = n - 1; i >= nb_lms; i--)
+    {
+        if (sa[i] >= 0)
+        {
+            sa[j--] = sa[i];
+        }
+    }
+
+    // Order the LMS suffixes: recursively unless every name is unique
+    int32_t *reduced = sa + n - nb_lms;
+    int status = 0;
+    if (name < nb_lms)
+    {
+        status = sais(reduced, sa, nb_lms, name);
+    }
+    else
+    {
+        for (int32_t i = 0; i < nb_lms; i++)
+        {
+            sa[reduced[i]] = i;
+        }
+    }
+
+    // Put the sorted LMS suffixes at the end of their buckets and induce the others
+    if (status == 0)
+    {
+        for (int32_t i = 1, j = 0; i < n; i++)
+        {
+            if (IS_LMS(types, i))
+            {
+                reduced[j++] = i;
+            }
+        }
+        for (int32_t i = 0; i < nb_lms; i++)
+        {
+            sa[i] = reduced[sa[i]];
+        }
+        for (int32_t i = nb_lms; i < n; i++)
+        {
+            sa[i] = -1;
+        }
+        get_buckets(s, n, k, buckets, 1);
+        for (int32_t i = nb_lms - 1; i >= 0; i--)
+        {
+            int32_t j = sa[i];
+            sa[i] = -1;
+            sa[--buckets[s[j]]] = j;
+        }
+        induce(s, sa, types, n, k, buckets);
+    }
+
+    mem_free(types);
+    mem_free(buckets);
+    return status;
+}
+
+// Suffix array of data followed by a sentinel smaller than every byte: length + 1
+// entries, the first one being length (the sentinel alone)
+static int32_t *sentinel_suffix_array(const unsigned char *data, size_t length)
+{
+    if (length >= INT32_MAX - 1)
+    {
+        return NULL;
+    }
+    int32_t n = (int32_t)length + 1;
+    int32_t *s = mem_alloc((size_t)n * sizeof(int32_t));
+    int32_t *sa = mem_alloc((size_t)n * sizeof(int32_t));
+    if (s == NULL || sa == NULL)
+    {
+        mem_free(s);
+        mem_free(sa);
+        return NULL;
+    }
+    for (size_t i = 0; i < length; i++)
+    {
+        s[i] = data[i] + 1;
+    }
+    s[length] = 0;
+    int status = sais(s, sa, n, 257);
+    mem_free(s);
+    if (status != 0)
+    {
+        mem_free(sa);
+        return NULL;
+    }
+    return sa;
+}
+
+int suffix_array(const unsigned char *data, size_t length, int32_t *sa)
+{
+    int32_t *full = sentinel_suffix_array(data, length);
+    if (full == NULL)
+    {
+        return -1;
+    }
+    memcpy(sa, full + 1, length * sizeof(int32_t));
+    mem_free(full);
+    return 0;
+}
+
+// The rotations of data + sentinel are sorted; the row starting with the sentinel is
+// the first one, the row ending with it (the primary index) is left out of the output
+int bwt_encode(const unsigned char *data, size_t length, unsigned char *out)
+{
+    int32_t *sa = sentinel_suffix_array(data, length);
+    if (sa == NULL)
+    {
+        return -1;
+    }
+    size_t pos = 4;
+    uint32_t primary = 0;
+    for (size_t i = 0; i <= length; i++)
+    {
+        if (sa[i] == 0)
+        {
+            primary = (uint32_t)i;
+        }
+        else
+        {
+            out[pos++] = data[sa[i] - 1];
+        }
+    }
+    put_u32(out, primary);
+    mem_free(sa);
+    return 0;
+}
+
+int bwt_decode(const unsigned char *data, size_t length, unsigned char *out)
+{
+    if (length < 4 || length - 4 >= INT32_MAX - 1)
+    {
+        return -1;
+    }
+    size_t n = length - 4;
+    const unsigned char *last = data + 4;
+    uint32_t primary = get_u32(data);
+    if (primary > n || (primary == 0 && n > 0))
+    {
+        return -1;
+    }
+    uint32_t *lf = mem_alloc((n + 1) * sizeof(uint32_t));
+    if (lf == NULL)
+    {
+        return -1;
+    }
+
+    // Row i of the last column maps to the row starting with the same letter occurrence;
+    // the sentinel sorts first, so the counts of the letters start at 1
+    size_t first[256] = {0};
+    for (size_t i = 0; i < n; i++)
+    {
+        first[last[i]]++;
+    }
+    size_t sum = 1;
+    for (int c = 0; c < 256; c++)
+    {
+        size_t count = first[c];
+        first[c] = sum;
+        sum += count;
+    }
+    for (size_t i = 0, j = 0; i <= n; i++)
+    {
+        lf[i] = i == primary ? 0 : (uint32_t)first[last[j++]]++;
+    }
+
+    // From the row starting with the sentinel, the last column gives data backwards
+    int status = 0;
+    size_t row = 0;
+    for (size_t k = n; k > 0; k--)
+    {
+        if (row == primary)
+        {
+            status = -1;
+            break;
+        }
+        out[k - 1] = last[row < primary ? row : row - 1];
+        row = lf[row];
+    }
+    mem_free(lf);
+    return status;
+}
+
+// Called with a constant width, so that each width gets its own loop
+static inline uint64_t get_element(const unsigned char *in, unsigned int width)
+{
+    return width == 2 ? get_u16(in) : width == 4 ? get_u32(in) : get_u64(in);
+}
+
+static inline void put_element(unsigned char *out, uint64_t value, unsigned int width)
+{
+    if (width == 2)
+    {
+        put_u16(out, (uint16_t)value);
+    }
+    else if (width == 4)
+    {
+        put_u32(out, (uint32_t)value);
+    }
+    else
+    {
+        put_u64(out, value);
+    }
+}
+
+static inline void delta_width(const unsigned char *data, size_t length, unsigned int width, unsigned char *out,
+                               int decode)
+{
+    size_t n = length / width;
+    uint64_t previous = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        uint64_t value = get_element(data + i * width, width);
+        put_element(out + i * width, decode ? value + previous : value - previous, width);
+        previous = decode ? value + previous : value;
+    }
+    memcpy(out + n * width, data + n * width, length - n * width);
+}
+
+void delta_encode(const unsigned char *data, size_t length, unsigned int width, unsigned char *out)
+{
+    switch (width)
+    {
+    case 2:
+        delta_width(data, length, 2, out, 0);
+        break;
+    case 4:
+        delta_width(data, length, 4, out, 0);
+        break;
+    default:
+        delta_width(data, length, 8, out, 0);
+        break;
+    }
+}
+
+void delta_decode(const unsigned char *data, size_t length, unsigned int width, unsigned char *out)
+{
+    switch (width)
+    {
+    case 2:
+        delta_width(data, length, 2, out, 1);
+        break;
+    case 4:
+        delta_width(data, length, 4, out, 1);
+        break;
+    default:
+        delta_width(data, length, 8, out, 1);
+        break;
+    }
+}
+
+#ifdef TRANSFORM_SSE2
+// v holds 16 elements of width bytes, 16 bytes per vector; each round packs the even
+// bytes of every pair of vectors into the first half and the odd ones into the second,
+// so that after log2(width) rounds v[k] holds byte k of the 16 elements
+static inline void transpose_to_planes(__m128i *v, unsigned int width)
+{
+    const __m128i low = _mm_set1_epi16(0x00FF);
+    for (unsigned int round = 1; round < width; round *= 2)
+    {
+        __m128i split[TRANSFORM_MAX_PLANES];
+        for (unsigned int i = 0; i < width / 2; i++)
+        {
+            split[i] = _mm_packus_epi16(_mm_and_si128(v[2 * i], low), _mm_and_si128(v[2 * i + 1], low));
+            split[width / 2 + i] = _mm_packus_epi16(_mm_srli_epi16(v[2 * i], 8), _mm_srli_epi16(v[2 * i + 1], 8));
+        }
+        for (unsigned int i = 0; i < width; i++)
+        {
+            v[i] = split[i];
+        }
+    }
+}
+
+// The inverse: each round interleaves the bytes of the two halves
+static inline void transpose_from_planes(__m128i *v, unsigned int width)
+{
+    for (unsigned int round = 1; round < width; round *= 2)
+    {
+        __m128i merged[TRANSFORM_MAX_PLANES];
+        for (unsigned int i = 0; i < width / 2; i++)
+        {
+            merged[2 * i] = _mm_unpacklo_epi8(v[i], v[width / 2 + i]);
+            merged[2 * i + 1] = _mm_unpackhi_epi8(v[i], v[width / 2 + i]);
+        }
+        for (unsigned int i = 0; i < width; i++)
+        {
+            v[i] = merged[i];
+        }
+    }
+}
+#endif
+
+static inline void shuffle_width(const unsigned char *data, size_t length, unsigned int width, unsigned char *out,
+                                 int decode)
+{
+    size_t n = length / width;
+    size_t i = 0;
+#ifdef TRANSFORM_SSE2
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v[TRANSFORM_MAX_PLANES];
+        for (unsigned int k = 0; k < width; k++)
+        {
+            v[k] = _mm_loadu_si128((const __m128i *)(decode ? data + k * n + i : data + i * width + 16 * k));
+        }
+        if (decode)
+        {
+            transpose_from_planes(v, width);
+        }
+        else
+        {
+            transpose_to_planes(v, width);
+        }
+        for (unsigned int k = 0; k < width; k++)
+        {
+            _mm_storeu_si128((__m128i *)(decode ? out + i * width + 16 * k : out + k * n + i), v[k]);
+        }
+    }
+#endif
+    for (; i < n; i++)
+    {
+        for (unsigned int k = 0; k < width; k++)
+        {
+            if (decode)
+            {
+                out[i * width + k] = data[k * n + i];
+            }
+            else
+            {
+                out[k * n + i] = data[i * width + k];
+            }
+        }
+    }
+    memcpy(out + n * width, data + n * width, length - n * width);
+}
+
+void shuffle_encode(const unsigned char *data, size_t length, unsigned int width, unsigned char *out)
+{
+    switch (width)
+    {
+    case 2:
+        shuffle_width(data, length, 2, out, 0);
+        break;
+    case 4:
+        shuffle_width(data, length, 4, out, 0);
+        break;
+    default:
+        shuffle_width(data, length, 8, out, 0);
+        break;
+    }
+}
+
+void shuffle_decode(const unsigned char *data, size_t length, unsigned int width, unsigned char *out)
+{
+    switch (width)
+    {
+    case 2:
+        shuffle_width(data, length, 2, out, 1);
+        break;
+    case 4:
+        shuffle_width(data, length, 4, out, 1);
+        break;
+    default:
+        shuffle_width(data, length, 8, out, 1);
+        break;
+    }
+}
+
+// One stage, from in to out; out holds capacity bytes (checked by the inverse stages only)
+static long long stage_forward(int stage, const unsigned char *in, size_t length, unsigned char *out)
+{
+    switch (stage)
+    {
+    case TRANSFORM_RLE:
+        return (long long)rle_encode(in, length, out);
+    case TRANSFORM_MTF:
+        mtf_encode(in, length, out);
+        return (long long)length;
+    case TRANSFORM_BWT:
+        return bwt_encode(in, length, out) == 0 ? (long long)length + 4 : -1;
+    case TRANSFORM_DELTA2:
+    case TRANSFORM_DELTA4:
+    case TRANSFORM_DELTA8:
+        delta_encode(in, length, stage_width(stage), out);
+        return (long long)length;
+    case TRANSFORM_SHUFFLE2:
+    case TRANSFORM_SHUFFLE4:
+    case TRANSFORM_SHUFFLE8:
+        shuffle_encode(in, length, stage_width(stage), out);
+        return (long long)length;
+    default:
+        return -1;
+    }
+}
+
+static long long stage_inverse(int stage, const unsigned char *in, size_t length, unsigned char *out,
+                               size_t capacity)
+{
+    switch (stage)
+    {
+    case TRANSFORM_RLE:
+        return rle_decode(in, length, out, capacity);
+    case TRANSFORM_MTF:
+        if (length > capacity)
+        {
+            return -1;
+        }
+        mtf_decode(in, length, out);
+        return (long long)length;
+    case TRANSFORM_BWT:
+        return length >= 4 && length - 4 <= capacity && bwt_decode(in, length, out) == 0 ? (long long)length - 4 : -1;
+    case TRANSFORM_DELTA2:
+    case TRANSFORM_DELTA4:
+    case TRANSFORM_DELTA8:
+        if (length > capacity)
+        {
+            return -1;
+        }
+        delta_decode(in, length, stage_width(stage), out);
+        return (long long)length;
+    case TRANSFORM_SHUFFLE2:
+    case TRANSFORM_SHUFFLE4:
+    case TRANSFORM_SHUFFLE8:
+        if (length > capacity)
+        {
+            return -1;
+        }
+        shuffle_decode(in, length, stage_width(stage), out);
+        return (long long)length;
+    default:
+        return -1;
+    }
+}
+
+long long transform_forward(const TransformChain *chain, const unsigned char *data, size_t length, unsigned char *out,
+                            size_t capacity)
+{
+    // Every stage but the last writes into one of two buffers in turn
+    unsigned char *buffers[2] = {NULL, NULL};
+    for (int i = 0; i < 2 && i < chain->nb_stages; i++)
+    {
+        buffers[i] = mem_alloc(TRANSFORM_BOUND(length));
+        if (buffers[i] == NULL)
+        {
+            mem_free(buffers[0]);
+            return -1;
+        }
+    }
+
+    const unsigned char *in = data;
+    long long size = (long long)length;
+    for (int i = 0; i < chain->nb_stages && size >= 0; i++)
+    {
+        size = stage_forward(chain->stages[i], in, (size_t)size, buffers[i % 2]);
+        in = buffers[i % 2];
+    }
+    if (size > (long long)capacity)
+    {
+        size = -1;
+    }
+    if (size >= 0)
+    {
+        memcpy(out, in, (size_t)size);
+    }
+    mem_free(buffers[0]);
+    mem_free(buffers[1]);
+    return size;
+}
+
+int transform_inverse(const TransformChain *chain, const unsigned char *data, size_t length, unsigned char *out,
+                      size_t raw_size)
+{
+    if (!transform_chain_valid(chain) || length > raw_size + TRANSFORM_MAX_GROWTH)
+    {
+        return -1;
+    }
+    if (chain->nb_stages == 0)
+    {
+        if (length != raw_size)
+        {
+            return -1;
+        }
+        memcpy(out, data, length);
+        return 0;
+    }
+
+    // The first stage to undo is the last one applied; the final one writes into out
+    size_t capacity = raw_size + TRANSFORM_MAX_GROWTH;
+    unsigned char *buffers[2] = {NULL, NULL};
+    for (int i = 0; i < 2 && chain->nb_stages > 1; i++)
+    {
+        buffers[i] = mem_alloc(capacity);
+        if (buffers[i] == NULL)
+        {
+            mem_free(buffers[0]);
+            return -1;
+        }
+    }
+
+    const unsigned char *in = data;
+    long long size = (long long)length;
+    for (int i = chain->nb_stages - 1; i >= 0 && size >= 0; i--)
+    {
+        unsigned char *target = i == 0 ? out : buffers[i % 2];
+        size = stage_inverse(chain->stages[i], in, (size_t)size, target, i == 0 ? raw_size : capacity);
+        in = target;
+    }
+    mem_free(buffers[0]);
+    mem_free(buffers[1]);
+    return size == (long long)raw_size ? 0 : -1;
+}
@@ -0,0 +1,82 @@
+// The code compiled in by gentable must code exactly like the library.
+//
+// Usage: test_gentable <sample>   (the file sample_table.h was generated from)
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "codetable.h"
+#include "sample_table.h"
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        printf("Usage: test_gentable <sample>\n");
+        return EXIT_FAILURE;
+    }
+    FILE *input = fopen(argv[1], "rb");
+    if (input == NULL)
+    {
+        printf("Error: cannot open %s.\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    fseek(input, 0, SEEK_END);
+    size_t length = (size_t)ftell(input);
+    fseek(input, 0, SEEK_SET);
+    unsigned char *data = malloc(length);
+    if (fread(data, 1, length, input) != length)
+    {
+        printf("Error: cannot read %s.\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    fclose(input);
+
+    long long histogram[NB_SYMBOLS] = {0};
+    CodeTable table;
+    histogram_add_buffer(histogram, data, length);
+    code_table_from_histogram(histogram, &table);
+
+    size_t capacity = length * (MAX_CODE_LENGTH / 8) + 8;
+    unsigned char *expected = calloc(capacity, 1);
+    unsigned char *encoded = calloc(capacity, 1);
+    unsigned char *decoded = malloc(length);
+    int failures = 0;
+
+    if (memcmp(table.lengths, sample_lengths, NB_SYMBOLS) != 0 || SAMPLE_MAX_CODE_LENGTH != table.max_length)
+    {
+        printf("FAIL generated code lengths differ from the library\n");
+        failures++;
+    }
+
+    unsigned long long expected_bits = encode_buffer(data, length, &table, expected);
+    size_t nb_bits = sample_encode(data, length, encoded);
+    if (nb_bits != expected_bits || memcmp(encoded, expected, (nb_bits + 7) / 8) != 0)
+    {
+        printf("FAIL generated encoder: %zu bits instead of %llu\n", nb_bits, expected_bits);
+        failures++;
+    }
+    if (sample_decode(encoded, nb_bits, decoded, length) != 0 || memcmp(decoded, data, length) != 0)
+    {
+        printf("FAIL generated decoder\n");
+        failures++;
+    }
+    if (length > 0 && sample_decode(encoded, nb_bits - 1, decoded, length) == 0)
+    {
+        printf("FAIL generated decoder accepted a truncated payload\n");
+        failures++;
+    }
+
+    free(data);
+    free(expected);
+    free(encoded);
+    free(decoded);
+    if (failures > 0)
+    {
+        return EXIT_FAILURE;
+    }
+    printf("Generated tables match the library (%d letters, codes of up to %d bits)\n", SAMPLE_NB_SYMBOLS,
+           SAMPLE_MAX_CODE_LENGTH);
+    return EXIT_SUCCESS;
+}
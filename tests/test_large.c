@@ -0,0 +1,361 @@
+// Large inputs, streamed:
+//  - 4gib: a sparse file of a little more than 4 GiB, mostly zeros with marks around the
+//    2 GiB and 4 GiB boundaries, is counted, turned into a tree and round-tripped through
+//    a container, streamed so that neither side holds it in memory. The decompressed
+//    bytes are compared with the input as they are written (about 90 s)
+//  - rss: a few hundred MB are round-tripped under a memory limit in a child process,
+//    whose peak resident size must stay near the limit: it also sees the allocations
+//    and mappings that the memory accounting does not
+//
+// Usage: test_large [4gib | rss]   (both by default)
+//
+// Slow: ctest runs them with the label "large", so that "ctest -LE large" skips them.
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "huffman.h"
+#include "codetable.h"
+#include "container.h"
+#include "pipeline.h"
+#include "memstats.h"
+
+#define LARGE_SIZE ((4ULL << 30) + 12345)
+#define CHUNK_SIZE (1 << 20)
+
+#define RSS_INPUT_SIZE (256 << 20)
+#define RSS_LIMIT (32LL << 20)
+// Resident bytes the limit does not cover: the code, the C library, the thread stacks,
+// the comparison buffers
+#define RSS_SLACK (8LL << 20)
+
+// Checks the bytes written by the decompressor against the input, at the same offsets
+typedef struct CompareStream
+{
+    int input_fd;
+    unsigned long long offset;
+    unsigned long long nb_differences;
+    unsigned char *expected;
+} CompareStream;
+
+static ssize_t compare_write(void *cookie, const char *buffer, size_t size)
+{
+    CompareStream *stream = cookie;
+    for (size_t done = 0; done < size;)
+    {
+        size_t length = size - done < CHUNK_SIZE ? size - done : CHUNK_SIZE;
+        if (pread(stream->input_fd, stream->expected, length, (off_t)stream->offset) != (ssize_t)length ||
+            memcmp(stream->expected, buffer + done, length) != 0)
+        {
+            stream->nb_differences++;
+        }
+        stream->offset += length;
+        done += length;
+    }
+    return (ssize_t)size;
+}
+
+// Zeros with marks on both sides of 2^31 and 2^32, text across 2^32 and at the end
+static FILE *make_input(void)
+{
+    static const unsigned long long marks[] = {0, (1ULL << 31) - 1, 1ULL << 31, (1ULL << 32) - 1, 1ULL << 32,
+                                               (1ULL << 32) + 1, LARGE_SIZE - 1};
+    FILE *input = tmpfile();
+    if (input == NULL || ftruncate(fileno(input), (off_t)LARGE_SIZE) != 0)
+    {
+        printf("Error: cannot create a sparse file of %llu bytes.\n", LARGE_SIZE);
+        return NULL;
+    }
+    for (size_t i = 0; i < sizeof(marks) / sizeof(marks[0]); i++)
+    {
+        unsigned char mark = (unsigned char)(0xF0 + i);
+        fseeko(input, (off_t)marks[i], SEEK_SET);
+        fwrite(&mark, 1, 1, input);
+    }
+    static const char text[] = "a text across the 4 GiB boundary, and at the end of the file. ";
+    fseeko(input, (off_t)(1ULL << 32) - 5000, SEEK_SET);
+    for (int i = 0; i < 160; i++)
+    {
+        fwrite(text, 1, sizeof(text) - 1, input);
+    }
+    fseeko(input, (off_t)LARGE_SIZE - 1000, SEEK_SET);
+    fwrite(text, 1, sizeof(text) - 1, input);
+    if (fflush(input) != 0)
+    {
+        printf("Error: cannot write the sparse file.\n");
+        fclose(input);
+        return NULL;
+    }
+    fseeko(input, 0, SEEK_SET);
+    return input;
+}
+
+// The histogram counts more than 2^32 zeros, and the tree gives them a one-bit code
+static int check_counts(FILE *input)
+{
+    long long histogram[NB_SYMBOLS] = {0};
+    unsigned char *buffer = malloc(CHUNK_SIZE);
+    size_t nb_bytes;
+    while ((nb_bytes = fread(buffer, 1, CHUNK_SIZE, input)) > 0)
+    {
+        histogram_add_buffer(histogram, buffer, nb_bytes);
+    }
+    free(buffer);
+    fseeko(input, 0, SEEK_SET);
+
+    unsigned long long total = 0;
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        total += (unsigned long long)histogram[c];
+    }
+    if (total != LARGE_SIZE || histogram[0] <= (1LL << 32))
+    {
+        printf("FAIL %llu bytes counted, %lld zeros\n", total, histogram[0]);
+        return 1;
+    }
+    long long nb_chars = nb_char_in_file(input);
+    if (nb_chars != (long long)LARGE_SIZE)
+    {
+        printf("FAIL nb_char_in_file: %lld bytes instead of %llu\n", nb_chars, LARGE_SIZE);
+        return 1;
+    }
+
+    int status = 0;
+    HuffmanTree *tree = huffman_tree_from_occurrences(occurrences_from_histogram(histogram));
+    int nb_letters = 0;
+    for (Element *curr = tree->root_dict; curr != NULL; curr = curr->next)
+    {
+        nb_letters++;
+        if (curr->letter == 0 && strlen(curr->node->code) != 1)
+        {
+            printf("FAIL code of %zu bits for the zeros\n", strlen(curr->node->code));
+            status = 1;
+        }
+    }
+    int nb_present = 0;
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        nb_present += histogram[c] > 0;
+    }
+    if (nb_letters != nb_present)
+    {
+        printf("FAIL %d codes for %d letters\n", nb_letters, nb_present);
+        status = 1;
+    }
+    huffman_tree_free(tree);
+    return status;
+}
+
+static int check_container_round_trip(FILE *input)
+{
+    FILE *container = tmpfile();
+    int status = pipeline_compress(input, container, CONTAINER_BLOCK_SIZE, pipeline_default_coders());
+    if (status == 1)
+    {
+        fseeko(input, 0, SEEK_SET);
+        status = container_compress(input, container, CONTAINER_BLOCK_SIZE);
+    }
+    ContainerInfo info;
+    if (status != 0 || container_read_info(container, &info) != 0)
+    {
+        printf("FAIL container of %llu bytes not written\n", LARGE_SIZE);
+        fclose(container);
+        return 1;
+    }
+    unsigned long long last_offset = info.blocks[info.nb_blocks - 1].raw_offset;
+    if (info.raw_size != LARGE_SIZE || last_offset < (1ULL << 32))
+    {
+        printf("FAIL container index: %llu bytes, last block at %llu\n", info.raw_size, last_offset);
+        status = 1;
+    }
+    container_free_info(&info);
+
+    CompareStream stream = {fileno(input), 0, 0, malloc(CHUNK_SIZE)};
+    cookie_io_functions_t functions = {NULL, compare_write, NULL, NULL};
+    FILE *output = fopencookie(&stream, "w", functions);
+    fseeko(container, 0, SEEK_SET);
+    if (container_decompress(container, output) != 0 || fflush(output) != 0)
+    {
+        printf("FAIL container of %llu bytes not decompressed\n", LARGE_SIZE);
+        status = 1;
+    }
+    fclose(output);
+    if (stream.offset != LARGE_SIZE || stream.nb_differences > 0)
+    {
+        printf("FAIL %llu bytes restored, %llu chunks differ\n", stream.offset, stream.nb_differences);
+        status = 1;
+    }
+    free(stream.expected);
+    fclose(container);
+    return status;
+}
+
+// Text-like bytes: a skewed distribution over 32 letters
+static FILE *make_text_input(void)
+{
+    FILE *input = tmpfile();
+    unsigned char *buffer = malloc(CHUNK_SIZE);
+    unsigned long long state = 0x9E3779B97F4A7C15ULL;
+    for (int chunk = 0; input != NULL && chunk < RSS_INPUT_SIZE / CHUNK_SIZE; chunk++)
+    {
+        for (size_t i = 0; i < CHUNK_SIZE; i++)
+        {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            unsigned int r = (unsigned int)(state >> 33);
+            buffer[i] = (unsigned char)('a' + (r % 32) * ((r >> 8) % 32) / 32);
+        }
+        if (fwrite(buffer, 1, CHUNK_SIZE, input) != CHUNK_SIZE)
+        {
+            fclose(input);
+            input = NULL;
+        }
+    }
+    free(buffer);
+    if (input == NULL || fflush(input) != 0)
+    {
+        printf("Error: cannot write an input of %d bytes.\n", RSS_INPUT_SIZE);
+        return NULL;
+    }
+    return input;
+}
+
+static int same_content(FILE *first, FILE *second)
+{
+    unsigned char *a = malloc(CHUNK_SIZE), *b = malloc(CHUNK_SIZE);
+    int same = fseeko(first, 0, SEEK_SET) == 0 && fseeko(second, 0, SEEK_SET) == 0;
+    size_t nb_bytes;
+    while (same && (nb_bytes = fread(a, 1, CHUNK_SIZE, first)) > 0)
+    {
+        same = fread(b, 1, nb_bytes, second) == nb_bytes && memcmp(a, b, nb_bytes) == 0;
+    }
+    same = same && fread(b, 1, 1, second) == 0;
+    free(a);
+    free(b);
+    return same;
+}
+
+// Round trip in a child process under the limit (none if 0), with the pipeline or
+// sequentially; returns 0 and the peak resident size of the child, or -1
+static int limited_round_trip(FILE *input, long long limit, int use_pipeline, int work, long long *peak_rss)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int status = 0;
+        if (work)
+        {
+            memory_set_limit(limit);
+            FILE *container = tmpfile();
+            FILE *output = tmpfile();
+            fseeko(input, 0, SEEK_SET);
+            status = use_pipeline ? pipeline_compress(input, container, CONTAINER_BLOCK_SIZE, 4) : 1;
+            if (status == 1)
+            {
+                fseeko(input, 0, SEEK_SET);
+                status = container_compress(input, container, CONTAINER_BLOCK_SIZE);
+            }
+            fseeko(container, 0, SEEK_SET);
+            int result = status == 0 && use_pipeline ? pipeline_decompress(container, output, 4) : 1;
+            if (status == 0 && result == 1)
+            {
+                fseeko(container, 0, SEEK_SET);
+                result = container_decompress(container, output);
+            }
+            status = status == 0 && result == 0 && same_content(input, output) ? 0 : 1;
+        }
+        _exit(status);
+    }
+
+    struct rusage usage;
+    int status;
+    if (pid < 0 || wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        return -1;
+    }
+    *peak_rss = (long long)usage.ru_maxrss * 1024;
+    return 0;
+}
+
+// The peak resident size of a round trip under a limit, above the one of a child that does
+// nothing, stays within the limit and a few MB
+static int check_resident_size(void)
+{
+    FILE *input = make_text_input();
+    if (input == NULL)
+    {
+        return 1;
+    }
+    long long idle_rss;
+    if (limited_round_trip(input, 0, 0, 0, &idle_rss) != 0)
+    {
+        printf("FAIL rss: no child process\n");
+        fclose(input);
+        return 1;
+    }
+
+    int status = 0;
+    for (int use_pipeline = 0; use_pipeline < 2; use_pipeline++)
+    {
+        long long peak_rss;
+        if (limited_round_trip(input, RSS_LIMIT, use_pipeline, 1, &peak_rss) != 0)
+        {
+            printf("FAIL rss (pipeline %d): round trip of %d bytes under %lld bytes\n", use_pipeline, RSS_INPUT_SIZE,
+                   RSS_LIMIT);
+            status = 1;
+            continue;
+        }
+        printf("rss (pipeline %d): peak of %.1f MB over %.1f MB idle, limit %.1f MB\n", use_pipeline,
+               (double)peak_rss / (1 << 20), (double)idle_rss / (1 << 20), (double)RSS_LIMIT / (1 << 20));
+        if (peak_rss - idle_rss > RSS_LIMIT + RSS_SLACK)
+        {
+            printf("FAIL rss (pipeline %d): %lld resident bytes for a limit of %lld\n", use_pipeline,
+                   peak_rss - idle_rss, RSS_LIMIT);
+            status = 1;
+        }
+    }
+    fclose(input);
+    return status;
+}
+
+static int check_larger_than_4gib(void)
+{
+    FILE *input = make_input();
+    if (input == NULL)
+    {
+        return 1;
+    }
+    int failures = check_counts(input);
+    failures += check_container_round_trip(input);
+    fclose(input);
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    const char *check = argc > 1 ? argv[1] : "";
+    int failures = 0;
+    if (strcmp(check, "rss") != 0)
+    {
+        failures += check_larger_than_4gib();
+    }
+    if (strcmp(check, "4gib") != 0)
+    {
+        failures += check_resident_size();
+    }
+
+    if (failures > 0)
+    {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("Large inputs passed\n");
+    return EXIT_SUCCESS;
+}
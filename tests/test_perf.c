@@ -0,0 +1,720 @@
+// Throughput gate: compresses and uncompresses a fixed corpus and fails when a
+// throughput drops by more than the given percentage from the baseline stored in a JSON
+// file. The gated throughputs, each the best of several runs timed on the wall clock, are
+// the text format and the container (encode and decode), the transform stages, the encode
+// kernels, the Huffman and tANS backends, the container with a full table set, the search
+// in a container and the byte-plane shuffles. A throughput missing from the baseline (an
+// encode kernel the reference machine did not run) is printed but not checked. While a
+// throughput is below the tolerance, the benchmarks run again, up to MAX_ROUNDS times, so
+// that a machine busy for a moment does not fail the gate but a slower codec does.
+//
+// Usage: test_perf <baseline.json> <tolerance_percent> [--update]
+//        --update rewrites the baseline with the measured throughputs
+//
+// ctest runs it only when configured with -DPERF_GATE=ON, on the machine that recorded
+// the baseline.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "huffman.h"
+#include "transform.h"
+#include "codetable.h"
+#include "container.h"
+#include "tableset.h"
+#include "tans.h"
+#include "search.h"
+#include "memstats.h"
+#include "byteio.h"
+
+#define CORPUS_SIZE (256 * 1024)
+#define RUNS 5
+// The benchmarks run several times, some time apart, and each throughput is the best of
+// all its runs: a machine busy for a moment slows down one round, not all of them
+#define ROUNDS 3
+#define MAX_ROUNDS 10
+#define MAX_METRICS 64
+#define MAX_METRIC_NAME 48
+
+// Throughputs measured by this run, gated against the baseline under "<name>_mbps"
+typedef struct Metric
+{
+    char name[MAX_METRIC_NAME];
+    double mbps;
+} Metric;
+
+static Metric metrics[MAX_METRICS];
+static int nb_metrics = 0;
+
+// Keeps the best throughput of each name
+static void record(const char *name, double mbps)
+{
+    char sanitized[MAX_METRIC_NAME];
+    size_t i;
+    for (i = 0; name[i] != '\0' && i + 1 < MAX_METRIC_NAME; i++)
+    {
+        // Names are identifiers in the JSON file: "bwt,mtf,rle" becomes "bwt_mtf_rle"
+        sanitized[i] = name[i] == ',' ? '_' : name[i];
+    }
+    sanitized[i] = '\0';
+    for (int m = 0; m < nb_metrics; m++)
+    {
+        if (strcmp(metrics[m].name, sanitized) == 0)
+        {
+            metrics[m].mbps = mbps > metrics[m].mbps ? mbps : metrics[m].mbps;
+            return;
+        }
+    }
+    if (nb_metrics < MAX_METRICS)
+    {
+        memcpy(metrics[nb_metrics].name, sanitized, i + 1);
+        metrics[nb_metrics].mbps = mbps;
+        nb_metrics++;
+    }
+}
+
+// Text-like corpus: a skewed distribution over 64 letters, always the same
+static void make_corpus(unsigned char *corpus, size_t length)
+{
+    unsigned long long state = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < length; i++)
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        unsigned int r = (unsigned int)(state >> 33);
+        unsigned int rank = (r % 64) * ((r >> 8) % 64) / 64;
+        corpus[i] = (unsigned char)(' ' + rank);
+    }
+}
+
+// Wall-clock time: a throughput that waits on memory or on other threads must show it
+static double seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+// Best forward and inverse throughputs of a transform chain over the corpus
+static int bench_transforms(const char *name, const unsigned char *corpus, size_t length)
+{
+    TransformChain chain;
+    unsigned char *transformed = malloc(TRANSFORM_BOUND(length));
+    unsigned char *restored = malloc(length);
+    double best_forward = 0, best_inverse = 0;
+    long long size = -1;
+    int status = transform_chain_parse(name, &chain);
+
+    for (int run = 0; run < RUNS && status == 0; run++)
+    {
+        double start = seconds();
+        size = transform_forward(&chain, corpus, length, transformed, TRANSFORM_BOUND(length));
+        double forward_time = seconds() - start;
+        start = seconds();
+        if (size < 0 || transform_inverse(&chain, transformed, (size_t)size, restored, length) != 0 ||
+            memcmp(restored, corpus, length) != 0)
+        {
+            status = -1;
+            break;
+        }
+        double inverse_time = seconds() - start;
+
+        double forward_mbps = length / 1e6 / (forward_time > 1e-9 ? forward_time : 1e-9);
+        double inverse_mbps = length / 1e6 / (inverse_time > 1e-9 ? inverse_time : 1e-9);
+        best_forward = forward_mbps > best_forward ? forward_mbps : best_forward;
+        best_inverse = inverse_mbps > best_inverse ? inverse_mbps : best_inverse;
+    }
+    if (status == 0)
+    {
+        printf("transform %-12s forward: %.3f MB/s, inverse: %.3f MB/s, %lld bytes\n", name, best_forward,
+               best_inverse, size);
+        char metric[MAX_METRIC_NAME];
+        snprintf(metric, sizeof(metric), "transform_%s_forward", name);
+        record(metric, best_forward);
+        snprintf(metric, sizeof(metric), "transform_%s_inverse", name);
+        record(metric, best_inverse);
+    }
+    else
+    {
+        printf("FAIL: transform %s does not invert\n", name);
+    }
+    free(transformed);
+    free(restored);
+    return status;
+}
+
+// Best throughput of each encode kernel the processor runs, coding the corpus in memory
+static int bench_encode_kernels(const unsigned char *corpus, size_t length)
+{
+    enum { PASSES = 20 };
+    long long histogram[NB_SYMBOLS] = {0};
+    CodeTable table;
+    histogram_add_buffer(histogram, corpus, length);
+    if (code_table_from_histogram(histogram, &table) != 0)
+    {
+        return -1;
+    }
+    unsigned char *reference = malloc(MAX_CODE_LENGTH * length / 8 + 8);
+    unsigned char *encoded = malloc(MAX_CODE_LENGTH * length / 8 + 8);
+    int saved_kernel = ENCODE_KERNEL;
+    int status = 0;
+
+    ENCODE_KERNEL = ENCODE_KERNEL_SCALAR;
+    unsigned long long reference_bits = encode_buffer(corpus, length, &table, reference);
+    for (int kernel = ENCODE_KERNEL_SCALAR; kernel <= ENCODE_KERNEL_AVX512 && status == 0; kernel++)
+    {
+        if (encode_kernel_resolve(kernel) != kernel)
+        {
+            continue;
+        }
+        ENCODE_KERNEL = kernel;
+        double best = 0;
+        for (int run = 0; run < RUNS; run++)
+        {
+            unsigned long long bits = 0;
+            double start = seconds();
+            for (int pass = 0; pass < PASSES; pass++)
+            {
+                bits = encode_buffer(corpus, length, &table, encoded);
+            }
+            double elapsed = seconds() - start;
+            if (bits != reference_bits || memcmp(encoded, reference, (size_t)((bits + 7) / 8)) != 0)
+            {
+                printf("FAIL: encode kernel %s does not write the scalar bits\n", encode_kernel_name(kernel));
+                status = -1;
+                break;
+            }
+            double mbps = PASSES * (double)length / 1e6 / (elapsed > 1e-9 ? elapsed : 1e-9);
+            best = mbps > best ? mbps : best;
+        }
+        if (status == 0)
+        {
+            printf("encode kernel %-8s %.3f MB/s\n", encode_kernel_name(kernel), best);
+            char metric[MAX_METRIC_NAME];
+            snprintf(metric, sizeof(metric), "encode_kernel_%s", encode_kernel_name(kernel));
+            record(metric, best);
+        }
+    }
+    ENCODE_KERNEL = saved_kernel;
+    free(reference);
+    free(encoded);
+    return status;
+}
+
+// Throughput and size of the Huffman and tANS backends on a corpus, coded in memory
+static int bench_backends(const char *name, const unsigned char *corpus, size_t length)
+{
+    long long histogram[NB_SYMBOLS] = {0};
+    CodeTable table;
+    TansFrequencies frequencies;
+    histogram_add_buffer(histogram, corpus, length);
+    if (code_table_from_histogram(histogram, &table) != 0 ||
+        tans_normalize(histogram, TANS_TABLE_LOG, &frequencies) != 0)
+    {
+        return -1;
+    }
+    unsigned char *encoded = malloc(MAX_CODE_LENGTH * length / 8 + 16);
+    unsigned char *decoded = malloc(length);
+    int status = 0;
+
+    for (int backend = 0; backend < 2 && status == 0; backend++)
+    {
+        double best_encode = 0, best_decode = 0;
+        unsigned long long bits = 0;
+        for (int run = 0; run < RUNS; run++)
+        {
+            double start = seconds();
+            bits = backend == 0 ? encode_buffer(corpus, length, &table, encoded)
+                                : tans_encode(corpus, length, &frequencies, encoded);
+            double encode_time = seconds() - start;
+            start = seconds();
+            int decode_status = backend == 0 ? decode_buffer(encoded, bits, &table, decoded, length)
+                                             : tans_decode(encoded, bits, &frequencies, decoded, length);
+            double decode_time = seconds() - start;
+            if (decode_status != 0 || memcmp(decoded, corpus, length) != 0)
+            {
+                printf("FAIL: the %s backend does not decode the %s corpus\n", backend == 0 ? "Huffman" : "tANS", name);
+                status = -1;
+                break;
+            }
+            double encode_mbps = length / 1e6 / (encode_time > 1e-9 ? encode_time : 1e-9);
+            double decode_mbps = length / 1e6 / (decode_time > 1e-9 ? decode_time : 1e-9);
+            best_encode = encode_mbps > best_encode ? encode_mbps : best_encode;
+            best_decode = decode_mbps > best_decode ? decode_mbps : best_decode;
+        }
+        if (status == 0)
+        {
+            printf("backend %-8s %-7s encode: %.3f MB/s, decode: %.3f MB/s, %.3f bits per byte\n",
+                   backend == 0 ? "huffman" : "tans", name, best_encode, best_decode, (double)bits / (double)length);
+            char metric[MAX_METRIC_NAME];
+            snprintf(metric, sizeof(metric), "%s_%s_encode", backend == 0 ? "huffman" : "tans", name);
+            record(metric, best_encode);
+            snprintf(metric, sizeof(metric), "%s_%s_decode", backend == 0 ? "huffman" : "tans", name);
+            record(metric, best_decode);
+        }
+    }
+    free(encoded);
+    free(decoded);
+    return status;
+}
+
+// Container throughput without and with a full table set, whose tables every block
+// weighs against its own
+static int bench_table_set(const unsigned char *corpus, size_t length)
+{
+    enum { BLOCK_SIZE = 16 * 1024 };
+    static TableSet set;
+    table_set_init(&set);
+    for (int t = 0; t < TABLE_SET_MAX_TABLES; t++)
+    {
+        // Histograms of the corpus seen through other letters
+        long long histogram[NB_SYMBOLS] = {0};
+        char name[16];
+        for (size_t i = 0; i < length; i += 7)
+        {
+            histogram[(corpus[i] + 3 * t) & 0xFF]++;
+        }
+        sprintf(name, "shift%d", t);
+        table_set_train(&set, name, histogram);
+    }
+
+    size_t capacity = container_compress_bound(length, BLOCK_SIZE);
+    unsigned char *out = malloc(capacity);
+    double best[2] = {0, 0};
+    long long size[2] = {-1, -1};
+    for (int with_set = 0; with_set < 2; with_set++)
+    {
+        CONTAINER_TABLE_SET = with_set ? &set : NULL;
+        for (int run = 0; run < RUNS; run++)
+        {
+            double start = seconds();
+            size[with_set] = container_compress_buffer(corpus, length, BLOCK_SIZE, out, capacity);
+            double elapsed = seconds() - start;
+            double mbps = length / 1e6 / (elapsed > 1e-9 ? elapsed : 1e-9);
+            best[with_set] = mbps > best[with_set] ? mbps : best[with_set];
+        }
+    }
+    CONTAINER_TABLE_SET = NULL;
+    free(out);
+    if (size[0] < 0 || size[1] < 0)
+    {
+        printf("FAIL: container compression with a table set\n");
+        return -1;
+    }
+    printf("container %.3f MB/s, with %d set tables %.3f MB/s (%+.1f%%), %lld and %lld bytes\n", best[0],
+           TABLE_SET_MAX_TABLES, best[1], 100.0 * (best[1] / best[0] - 1.0), size[0], size[1]);
+    record("container_table_set_encode", best[1]);
+    return 0;
+}
+
+// The text of the baseline file, or NULL
+static char *read_baseline(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+    char *buffer = load_full_file(file);
+    fclose(file);
+    return buffer;
+}
+
+// The baseline value of a metric; returns 0, or -1 if the baseline does not have it
+static int baseline_value(const char *baseline, const char *name, double *mbps)
+{
+    char key[MAX_METRIC_NAME + 8];
+    int length = snprintf(key, sizeof(key), "\"%s_mbps\"", name);
+    const char *found = length > 0 && (size_t)length < sizeof(key) ? strstr(baseline, key) : NULL;
+    if (found == NULL || strchr(found, ':') == NULL)
+    {
+        return -1;
+    }
+    *mbps = strtod(strchr(found, ':') + 1, NULL);
+    return 0;
+}
+
+static int write_baseline(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        return -1;
+    }
+    fprintf(file, "{\n  \"corpus_bytes\": %d", CORPUS_SIZE);
+    for (int m = 0; m < nb_metrics; m++)
+    {
+        fprintf(file, ",\n  \"%s_mbps\": %.3f", metrics[m].name, metrics[m].mbps);
+    }
+    fprintf(file, "\n}\n");
+    fclose(file);
+    return 0;
+}
+
+// Container compression and decompression of the corpus in memory, in blocks of 16 KB
+static int bench_container(const unsigned char *corpus, size_t length)
+{
+    enum { BLOCK_SIZE = 16 * 1024 };
+    size_t capacity = container_compress_bound(length, BLOCK_SIZE);
+    unsigned char *compressed = malloc(capacity);
+    unsigned char *decoded = malloc(length);
+    double best_encode = 0, best_decode = 0;
+    long long size = -1;
+    int status = 0;
+    for (int run = 0; run < RUNS; run++)
+    {
+        double start = seconds();
+        size = container_compress_buffer(corpus, length, BLOCK_SIZE, compressed, capacity);
+        double encode_time = seconds() - start;
+        start = seconds();
+        if (size < 0 || container_decompress_buffer(compressed, (size_t)size, decoded, length) != (long long)length ||
+            memcmp(decoded, corpus, length) != 0)
+        {
+            printf("FAIL: the container does not round-trip the corpus\n");
+            status = -1;
+            break;
+        }
+        double decode_time = seconds() - start;
+        double encode_mbps = length / 1e6 / (encode_time > 1e-9 ? encode_time : 1e-9);
+        double decode_mbps = length / 1e6 / (decode_time > 1e-9 ? decode_time : 1e-9);
+        best_encode = encode_mbps > best_encode ? encode_mbps : best_encode;
+        best_decode = decode_mbps > best_decode ? decode_mbps : best_decode;
+    }
+    if (status == 0)
+    {
+        printf("container encode: %.3f MB/s, decode: %.3f MB/s, %lld bytes\n", best_encode, best_decode, size);
+        record("container_encode", best_encode);
+        record("container_decode", best_decode);
+    }
+    free(compressed);
+    free(decoded);
+    return status;
+}
+
+// Search in the container against decompressing it and searching the bytes, for a
+// pattern taken from the corpus, and one with a letter the corpus does not have
+static int bench_search(const unsigned char *corpus, size_t length)
+{
+    enum { BLOCK_SIZE = 16 * 1024, PASSES = 10 };
+    size_t capacity = container_compress_bound(length, BLOCK_SIZE);
+    unsigned char *compressed = malloc(capacity);
+    unsigned char *decoded = malloc(length);
+    long long size = container_compress_buffer(corpus, length, BLOCK_SIZE, compressed, capacity);
+    FILE *container = tmpfile();
+    if (size < 0 || fwrite(compressed, 1, (size_t)size, container) != (size_t)size || fflush(container) != 0)
+    {
+        printf("FAIL: container for the search\n");
+        free(compressed);
+        free(decoded);
+        fclose(container);
+        return -1;
+    }
+
+    char sample[7] = {0};
+    memcpy(sample, corpus + length / 2, 6);
+    const char *patterns[] = {sample, "z{"};
+    const char *metric_names[] = {"search_match", "search_absent"};
+    int status = 0;
+    for (size_t p = 0; p < 2 && status == 0; p++)
+    {
+        const unsigned char *pattern = (const unsigned char *)patterns[p];
+        size_t pattern_length = strlen(patterns[p]);
+        double best_search = 0, best_decode = 0;
+        long long nb_found = -1;
+        size_t nb_expected = 0;
+        SearchReport report;
+        for (int run = 0; run < RUNS; run++)
+        {
+            // Several passes: a search that skips most blocks takes a few microseconds
+            double start = seconds();
+            for (int pass = 0; pass < PASSES; pass++)
+            {
+                unsigned long long *offsets;
+                nb_found = container_search(container, pattern, pattern_length, 1, &offsets, &report);
+                mem_free(offsets);
+            }
+            double search_time = (seconds() - start) / PASSES;
+
+            start = seconds();
+            nb_expected = 0;
+            if (container_decompress_buffer(compressed, (size_t)size, decoded, length) != (long long)length)
+            {
+                nb_found = -1;
+            }
+            for (size_t i = 0; i + pattern_length <= length; i++)
+            {
+                nb_expected += decoded[i] == pattern[0] && memcmp(decoded + i, pattern, pattern_length) == 0;
+            }
+            double decode_time = seconds() - start;
+            double search_mbps = length / 1e6 / (search_time > 1e-9 ? search_time : 1e-9);
+            double decode_mbps = length / 1e6 / (decode_time > 1e-9 ? decode_time : 1e-9);
+            best_search = search_mbps > best_search ? search_mbps : best_search;
+            best_decode = decode_mbps > best_decode ? decode_mbps : best_decode;
+        }
+        if (nb_found != (long long)nb_expected)
+        {
+            printf("FAIL: %lld matches of \"%s\" found in the container, %zu expected\n", nb_found, patterns[p],
+                   nb_expected);
+            status = -1;
+            break;
+        }
+        printf("search \"%s\": %.3f MB/s, decompress and search: %.3f MB/s, %lld matches, %u of %u blocks skipped, "
+               "%llu candidates\n",
+               patterns[p], best_search, best_decode, nb_found, report.nb_skipped, report.nb_blocks,
+               report.nb_candidates);
+        record(metric_names[p], best_search);
+    }
+    free(compressed);
+    free(decoded);
+    fclose(container);
+    return status;
+}
+
+// Shuffle throughput against memcpy, and the container size of counter records without
+// transforms, with their byte planes, and with their deltas in planes
+static int bench_planes(size_t length)
+{
+    enum { REPEATS = 20, BLOCK_SIZE = 64 * 1024 };
+    unsigned char *records = malloc(length);
+    unsigned char *shuffled = malloc(length);
+    unsigned char *restored = malloc(length);
+    unsigned long long state = 0x9E3779B97F4A7C15ULL, counter = 1u << 30;
+    for (size_t i = 0; i + 4 <= length; i += 4)
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        counter += 900 + (state >> 33) % 200;
+        put_u32(records + i, (uint32_t)counter);
+    }
+
+    double best[3] = {0, 0, 0};
+    int status = 0;
+    for (unsigned int width = 4; width <= 8 && status == 0; width *= 2)
+    {
+        memset(best, 0, sizeof(best));
+        for (int run = 0; run < RUNS; run++)
+        {
+            double times[3];
+            double start = seconds();
+            for (int r = 0; r < REPEATS; r++)
+            {
+                memcpy(shuffled, records, length);
+            }
+            times[0] = seconds() - start;
+            start = seconds();
+            for (int r = 0; r < REPEATS; r++)
+            {
+                shuffle_encode(records, length, width, shuffled);
+            }
+            times[1] = seconds() - start;
+            start = seconds();
+            for (int r = 0; r < REPEATS; r++)
+            {
+                shuffle_decode(shuffled, length, width, restored);
+            }
+            times[2] = seconds() - start;
+            for (int t = 0; t < 3; t++)
+            {
+                double mbps = REPEATS * (double)length / 1e6 / (times[t] > 1e-9 ? times[t] : 1e-9);
+                best[t] = mbps > best[t] ? mbps : best[t];
+            }
+        }
+        if (memcmp(restored, records, length) != 0)
+        {
+            printf("FAIL: shuffle%u does not invert\n", width);
+            status = -1;
+        }
+        printf("shuffle%u forward: %.3f MB/s, inverse: %.3f MB/s, memcpy: %.3f MB/s\n", width, best[1], best[2],
+               best[0]);
+        char metric[MAX_METRIC_NAME];
+        snprintf(metric, sizeof(metric), "shuffle%u_forward", width);
+        record(metric, best[1]);
+        snprintf(metric, sizeof(metric), "shuffle%u_inverse", width);
+        record(metric, best[2]);
+    }
+
+    const char *chains[] = {"none", "shuffle4", "delta4,shuffle4"};
+    long long sizes[3] = {-1, -1, -1};
+    size_t capacity = container_compress_bound(length, BLOCK_SIZE);
+    unsigned char *out = malloc(capacity);
+    for (int c = 0; c < 3; c++)
+    {
+        transform_chain_parse(chains[c], &CONTAINER_TRANSFORMS);
+        sizes[c] = container_compress_buffer(records, length, BLOCK_SIZE, out, capacity);
+    }
+    transform_chain_parse("none", &CONTAINER_TRANSFORMS);
+    if (sizes[0] < 0 || sizes[1] < 0 || sizes[2] < 0)
+    {
+        printf("FAIL: container of the counter records\n");
+        status = -1;
+    }
+    printf("counter records: %zu bytes, container %lld, with shuffle4 %lld, with delta4,shuffle4 %lld\n", length,
+           sizes[0], sizes[1], sizes[2]);
+    free(out);
+    free(records);
+    free(shuffled);
+    free(restored);
+    return status;
+}
+
+// The '0'/'1' text format, from the histogram to the decoded file
+static int bench_text(const unsigned char *corpus, size_t length)
+{
+    double best_encode = 0, best_decode = 0;
+    for (int run = 0; run < RUNS; run++)
+    {
+        FILE *input = tmpfile();
+        FILE *compressed = tmpfile();
+        FILE *dict = tmpfile();
+        FILE *output = tmpfile();
+        fwrite(corpus, 1, length, input);
+        fseek(input, 0, SEEK_SET);
+
+        double start = seconds();
+        Element *occurrences = get_occurrences_by_dichotomy(input);
+        HuffmanTree *huffman_tree = huffman_tree_from_occurrences(occurrences);
+        write_huffman_dict(dict, huffman_tree->root_dict);
+        compress_file(input, compressed, huffman_tree);
+        fflush(compressed);
+        double encode_time = seconds() - start;
+
+        start = seconds();
+        uncompress_file(compressed, dict, output);
+        fflush(output);
+        double decode_time = seconds() - start;
+        huffman_tree_free(huffman_tree);
+
+        double encode_mbps = length / 1e6 / (encode_time > 1e-9 ? encode_time : 1e-9);
+        double decode_mbps = length / 1e6 / (decode_time > 1e-9 ? decode_time : 1e-9);
+        best_encode = encode_mbps > best_encode ? encode_mbps : best_encode;
+        best_decode = decode_mbps > best_decode ? decode_mbps : best_decode;
+
+        fclose(input);
+        fclose(compressed);
+        fclose(dict);
+        fclose(output);
+    }
+    printf("text encode: %.3f MB/s, decode: %.3f MB/s\n", best_encode, best_decode);
+    record("text_encode", best_encode);
+    record("text_decode", best_decode);
+    return 0;
+}
+
+// Every benchmark once; returns -1 if one of them does not round-trip
+static int run_benches(const unsigned char *corpus, size_t length)
+{
+    const char *chains[] = {"rle", "mtf", "bwt", "bwt,mtf,rle"};
+    int status = bench_text(corpus, length);
+    status |= bench_container(corpus, length);
+    for (size_t i = 0; i < sizeof(chains) / sizeof(chains[0]); i++)
+    {
+        status |= bench_transforms(chains[i], corpus, length);
+    }
+    status |= bench_encode_kernels(corpus, length);
+    status |= bench_table_set(corpus, length);
+    status |= bench_backends("text", corpus, length);
+    status |= bench_search(corpus, length);
+    status |= bench_planes(length);
+    // Mostly one letter: Huffman spends a whole bit on it
+    unsigned char *skewed = malloc(length);
+    for (size_t i = 0; i < length; i++)
+    {
+        skewed[i] = corpus[i] < ' ' + 48 ? 0 : corpus[i] - ' ';
+    }
+    status |= bench_backends("skewed", skewed, length);
+    free(skewed);
+    return status;
+}
+
+// Number of throughputs more than the tolerance below their baseline; with verbose set,
+// prints every throughput against its baseline
+static int count_regressions(const char *baseline, double tolerance, int verbose)
+{
+    int nb_regressions = 0;
+    for (int m = 0; m < nb_metrics; m++)
+    {
+        double reference;
+        if (baseline_value(baseline, metrics[m].name, &reference) != 0)
+        {
+            if (verbose)
+            {
+                printf("  %-32s %12.3f MB/s, not in the baseline\n", metrics[m].name, metrics[m].mbps);
+            }
+            continue;
+        }
+        int regressed = metrics[m].mbps < reference * (1.0 - tolerance);
+        nb_regressions += regressed;
+        if (verbose)
+        {
+            printf("  %-32s %12.3f MB/s, baseline %12.3f MB/s (%+.1f%%)\n", metrics[m].name, metrics[m].mbps,
+                   reference, 100.0 * (metrics[m].mbps / reference - 1.0));
+        }
+        if (verbose && regressed)
+        {
+            printf("FAIL: %s throughput regressed by %.1f%%\n", metrics[m].name,
+                   100.0 * (1.0 - metrics[m].mbps / reference));
+        }
+    }
+    return nb_regressions;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        printf("Usage: %s <baseline.json> <tolerance_percent> [--update]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    double tolerance = strtod(argv[2], NULL) / 100.0;
+    int update = argc > 3 && strcmp(argv[3], "--update") == 0;
+    char *baseline = NULL;
+    if (!update && (baseline = read_baseline(argv[1])) == NULL)
+    {
+        printf("Error: cannot read the baseline %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    unsigned char *corpus = malloc(CORPUS_SIZE);
+    make_corpus(corpus, CORPUS_SIZE);
+
+    // A throughput below the tolerance gets more rounds before it fails: a regression of
+    // the code slows down every one of them
+    int benches_status = 0;
+    for (int round = 0; benches_status == 0 && round < MAX_ROUNDS; round++)
+    {
+        if (round >= ROUNDS)
+        {
+            if (update || count_regressions(baseline, tolerance, 0) == 0)
+            {
+                break;
+            }
+            // Away from a moment the machine was busy
+            sleep(1);
+        }
+        printf("round %d\n", round + 1);
+        benches_status = run_benches(corpus, CORPUS_SIZE);
+    }
+    free(corpus);
+    if (benches_status != 0)
+    {
+        free(baseline);
+        return EXIT_FAILURE;
+    }
+
+    if (update)
+    {
+        if (write_baseline(argv[1]) != 0)
+        {
+            printf("Error: cannot write %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+        printf("Baseline %s updated with %d throughputs\n", argv[1], nb_metrics);
+        return EXIT_SUCCESS;
+    }
+
+    printf("baseline %s (tolerance %.0f%%):\n", argv[1], tolerance * 100);
+    int status = count_regressions(baseline, tolerance, 1) > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    free(baseline);
+    return status;
+}
@@ -0,0 +1,1776 @@
+// Round-trip (compress -> uncompress -> byte compare) and differential tests.
+//
+// Usage: test_roundtrip [seed] [iterations]
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "huffman.h"
+#include "bitstring.h"
+#include "container.h"
+#include "pipeline.h"
+#include "memstats.h"
+#include "estimate.h"
+#include "tablecache.h"
+#include "daemon.h"
+#include "tokens.h"
+#include "transform.h"
+#include "archive.h"
+#include "codetable.h"
+#include "bitio.h"
+#include "syncdecode.h"
+#include "tableset.h"
+#include "tans.h"
+#include "search.h"
+#include "byteio.h"
+
+static unsigned long long rng_state;
+
+static unsigned long long next_random(void)
+{
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+static FILE *file_from_bytes(const unsigned char *data, size_t length)
+{
+    FILE *file = tmpfile();
+    if (file == NULL)
+    {
+        printf("Error: cannot create a temporary file.\n");
+        exit(EXIT_FAILURE);
+    }
+    fwrite(data, 1, length, file);
+    fseek(file, 0, SEEK_SET);
+    return file;
+}
+
+static long long file_size(FILE *file)
+{
+    fseek(file, 0, SEEK_END);
+    long long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    return size;
+}
+
+// Cost in bits of an optimal prefix code for the histogram, computed independently
+// of the codec by repeatedly merging the two lightest weights
+static long long reference_cost(const unsigned char *data, size_t length)
+{
+    long long weights[256];
+    int n = 0;
+    long long hist[256] = {0};
+    for (size_t i = 0; i < length; i++)
+    {
+        hist[data[i]]++;
+    }
+    for (int c = 0; c < 256; c++)
+    {
+        if (hist[c] > 0)
+        {
+            weights[n++] = hist[c];
+        }
+    }
+    if (n == 1)
+    {
+        return weights[0]; // One bit per letter, as written by the codec
+    }
+
+    long long cost = 0;
+    while (n > 1)
+    {
+        int a = 0, b = 1;
+        if (weights[b] < weights[a])
+        {
+            a = 1;
+            b = 0;
+        }
+        for (int i = 2; i < n; i++)
+        {
+            if (weights[i] < weights[a])
+            {
+                b = a;
+                a = i;
+            }
+            else if (weights[i] < weights[b])
+            {
+                b = i;
+            }
+        }
+        long long merged = weights[a] + weights[b];
+        cost += merged;
+        weights[a] = merged;
+        weights[b] = weights[--n];
+    }
+    return cost;
+}
+
+// Compresses and uncompresses the data, checks the output is identical and that
+// the number of bits written matches the reference optimal cost
+static int check_roundtrip(const unsigned char *data, size_t length, const char *name)
+{
+    FILE *input = file_from_bytes(data, length);
+    FILE *compressed = tmpfile();
+    FILE *dict = tmpfile();
+    FILE *output = tmpfile();
+
+    Element *occurrences = get_occurrences_by_dichotomy(input);
+    HuffmanTree *huffman_tree = huffman_tree_from_occurrences(occurrences);
+    write_huffman_dict(dict, huffman_tree->root_dict);
+    compress_file(input, compressed, huffman_tree);
+    uncompress_file(compressed, dict, output);
+    huffman_tree_free(huffman_tree);
+
+    int status = 0;
+    long long nb_bits = file_size(compressed);
+    long long expected_bits = reference_cost(data, length);
+    if (nb_bits != expected_bits)
+    {
+        printf("FAIL %s: %lld bits written, optimal code needs %lld\n", name, nb_bits, expected_bits);
+        status = 1;
+    }
+
+    long long output_length = file_size(output);
+    unsigned char *decoded = malloc(length + 1);
+    size_t read = fread(decoded, 1, length + 1, output);
+    if (output_length != (long long)length || read != length || memcmp(decoded, data, length) != 0)
+    {
+        printf("FAIL %s: decoded %lld bytes that differ from the %zu input bytes\n", name, output_length, length);
+        status = 1;
+    }
+
+    free(decoded);
+    fclose(input);
+    fclose(compressed);
+    fclose(dict);
+    fclose(output);
+    return status;
+}
+
+// The one-read encoder restores the data, letters missing from its sample included, and
+// reports the bits it wrote against the optimal code of the exact histogram
+static int check_sampled(const unsigned char *data, size_t length, int expect_fallback, const char *name)
+{
+    FILE *input = file_from_bytes(data, length);
+    FILE *compressed = tmpfile();
+    FILE *dict = tmpfile();
+    FILE *output = tmpfile();
+    SampledCompression report;
+    int status = 0;
+
+    HuffmanTree *huffman_tree = compress_file_sampled(input, compressed, SAMPLE_DEFAULT_PERCENT, &report);
+    if (huffman_tree == NULL)
+    {
+        printf("FAIL %s: sampled compression error\n", name);
+        fclose(input);
+        fclose(compressed);
+        fclose(dict);
+        fclose(output);
+        return 1;
+    }
+    write_huffman_dict(dict, huffman_tree->root_dict);
+    huffman_tree_free(huffman_tree);
+    uncompress_file(compressed, dict, output);
+
+    if (file_size(compressed) != (long long)report.bits || report.raw_size != (long long)length ||
+        report.exact_bits != (unsigned long long)reference_cost(data, length) || report.bits < report.exact_bits ||
+        (expect_fallback ? report.nb_fallback_letters == 0 || report.sampled_bytes >= (long long)length / 2
+                         : report.nb_fallback_letters != 0))
+    {
+        printf("FAIL %s: sampled compression report (%lld sampled, %d missing, %llu bits, %llu exact)\n", name,
+               report.sampled_bytes, report.nb_fallback_letters, report.bits, report.exact_bits);
+        status = 1;
+    }
+    unsigned char *decoded = malloc(length + 1);
+    fseek(output, 0, SEEK_SET);
+    size_t read = fread(decoded, 1, length + 1, output);
+    if (read != length || memcmp(decoded, data, length) != 0)
+    {
+        printf("FAIL %s: sampled compression decoded %zu bytes that differ\n", name, read);
+        status = 1;
+    }
+
+    free(decoded);
+    fclose(input);
+    fclose(compressed);
+    fclose(dict);
+    fclose(output);
+    return status;
+}
+
+// Stores the data in a container in two parts (a compression then an append, with
+// small blocks so that the tables are reused or replaced) and restores it
+static int check_container(const unsigned char *data, size_t length, size_t split, const char *name)
+{
+    FILE *first = file_from_bytes(data, split);
+    FILE *second = file_from_bytes(data + split, length - split);
+    FILE *container = tmpfile();
+    FILE *output = tmpfile();
+    int status = 0;
+
+    if (container_compress(first, container, 512) != 0 || container_append(container, second) != 0 ||
+        container_decompress(container, output) != 0)
+    {
+        printf("FAIL %s: container error\n", name);
+        status = 1;
+    }
+    else
+    {
+        unsigned char *decoded = malloc(length + 1);
+        fseek(output, 0, SEEK_SET);
+        size_t read = fread(decoded, 1, length + 1, output);
+        if (read != length || memcmp(decoded, data, length) != 0)
+        {
+            printf("FAIL %s: container restored %zu bytes that differ from the %zu input bytes\n", name, read, length);
+            status = 1;
+        }
+
+        // Decoding into caller buffers, from the file and from memory
+        long long container_size = file_size(container);
+        unsigned char *packed = malloc((size_t)container_size);
+        fseek(container, 0, SEEK_SET);
+        read = fread(packed, 1, (size_t)container_size, container);
+        memset(decoded, 0, length + 1);
+        if (container_decompress_into(container, decoded, length) != (long long)length ||
+            memcmp(decoded, data, length) != 0)
+        {
+            printf("FAIL %s: container_decompress_into\n", name);
+            status = 1;
+        }
+        memset(decoded, 0, length + 1);
+        if (container_decompress_buffer(packed, read, decoded, length) != (long long)length ||
+            memcmp(decoded, data, length) != 0)
+        {
+            printf("FAIL %s: container_decompress_buffer\n", name);
+            status = 1;
+        }
+        free(packed);
+        free(decoded);
+    }
+
+    fclose(first);
+    fclose(second);
+    fclose(container);
+    fclose(output);
+    return status;
+}
+
+static unsigned char *file_bytes(FILE *file, long long *size)
+{
+    *size = file_size(file);
+    unsigned char *bytes = malloc((size_t)*size + 1);
+    if (fread(bytes, 1, (size_t)*size, file) != (size_t)*size)
+    {
+        *size = -1;
+    }
+    return bytes;
+}
+
+// The threaded pipeline must write exactly the container of the sequential encoder
+static int check_pipeline(const unsigned char *data, size_t length, int nb_coders, const char *name)
+{
+    FILE *input = file_from_bytes(data, length);
+    FILE *expected = tmpfile();
+    FILE *container = tmpfile();
+    FILE *output = tmpfile();
+    int status = 0;
+
+    SizeEstimate estimate;
+    if (estimate_compressed_size(input, 512, &estimate) != 0)
+    {
+        printf("FAIL %s: estimate error\n", name);
+        status = 1;
+    }
+    fseek(input, 0, SEEK_SET);
+    if (container_compress(input, expected, 512) != 0)
+    {
+        printf("FAIL %s: container error\n", name);
+        status = 1;
+    }
+    fseek(input, 0, SEEK_SET);
+    if (pipeline_compress(input, container, 512, nb_coders) != 0 ||
+        pipeline_decompress(container, output, nb_coders) != 0)
+    {
+        printf("FAIL %s: pipeline error\n", name);
+        status = 1;
+    }
+    if (status == 0)
+    {
+        long long expected_size, container_size, output_size;
+        unsigned char *expected_bytes = file_bytes(expected, &expected_size);
+        unsigned char *container_bytes = file_bytes(container, &container_size);
+        unsigned char *output_bytes = file_bytes(output, &output_size);
+        // The payloads of tANS blocks are only estimated
+        int exact = CONTAINER_BACKEND == CONTAINER_BACKEND_HUFFMAN;
+        if ((exact && estimate.container_bytes != (unsigned long long)expected_size) || estimate.raw_size != length)
+        {
+            printf("FAIL %s: estimated %llu bytes, the container has %lld\n", name, estimate.container_bytes,
+                   expected_size);
+            status = 1;
+        }
+        if (container_size != expected_size || memcmp(container_bytes, expected_bytes, (size_t)expected_size) != 0)
+        {
+            printf("FAIL %s: pipeline container differs from the sequential one\n", name);
+            status = 1;
+        }
+        if (output_size != (long long)length || memcmp(output_bytes, data, length) != 0)
+        {
+            printf("FAIL %s: pipeline restored %lld bytes instead of %zu\n", name, output_size, length);
+            status = 1;
+        }
+        free(expected_bytes);
+        free(container_bytes);
+        free(output_bytes);
+    }
+
+    fclose(input);
+    fclose(expected);
+    fclose(container);
+    fclose(output);
+    return status;
+}
+
+// Under a memory limit the encoders must pick blocks small enough to never be refused
+// an allocation, and the peak reported by the stats must stay under the limit
+static int check_memory_limit(long long limit, size_t length)
+{
+    unsigned char *data = malloc(length);
+    int status = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        data[i] = (unsigned char)('a' + (next_random() % 16) * (next_random() % 16) / 16);
+    }
+
+    // The limit is set like at the start of a process, before anything is cached
+    table_cache_clear();
+    memory_set_limit(limit);
+    memory_reset_peak();
+    for (int use_pipeline = 0; use_pipeline < 2; use_pipeline++)
+    {
+        FILE *input = file_from_bytes(data, length);
+        FILE *container = tmpfile();
+        FILE *output = tmpfile();
+        int result = use_pipeline ? pipeline_compress(input, container, CONTAINER_BLOCK_SIZE, 4)
+                                  : container_compress(input, container, CONTAINER_BLOCK_SIZE);
+        if (result == 0)
+        {
+            result = use_pipeline ? pipeline_decompress(container, output, 4) : container_decompress(container, output);
+        }
+
+        long long output_size;
+        unsigned char *output_bytes = result == 0 ? file_bytes(output, &output_size) : NULL;
+        MemoryStats stats;
+        memory_get_stats(&stats);
+        if (result != 0 || output_size != (long long)length || memcmp(output_bytes, data, length) != 0 ||
+            stats.peak > limit || stats.failures > 0)
+        {
+            printf("FAIL memory limit %lld (pipeline %d): status %d, peak %lld, %lld refused\n", limit, use_pipeline,
+                   result, stats.peak, stats.failures);
+            status = 1;
+        }
+        free(output_bytes);
+        fclose(input);
+        fclose(container);
+        fclose(output);
+    }
+    memory_set_limit(0);
+
+    free(data);
+    return status;
+}
+
+// Histograms of two shards, serialized, read back and merged, must give the histogram
+// (and the code table) of the whole text
+static int check_histogram(const unsigned char *data, size_t length, size_t split)
+{
+    long long whole[NB_SYMBOLS] = {0}, first[NB_SYMBOLS] = {0}, second[NB_SYMBOLS] = {0}, merged[NB_SYMBOLS] = {0};
+    long long restored[NB_SYMBOLS];
+    unsigned char buffer[HISTOGRAM_MAX_SERIALIZED_SIZE];
+    int status = 0;
+
+    histogram_add_buffer(whole, data, length);
+    histogram_add_buffer(first, data, split);
+    histogram_add_buffer(second, data + split, length - split);
+
+    size_t size = histogram_serialize(second, buffer);
+    if (size != histogram_serialized_size(second) || histogram_deserialize(buffer, size, restored) != size ||
+        memcmp(restored, second, sizeof(restored)) != 0 || histogram_deserialize(buffer, size - 1, restored) != 0)
+    {
+        printf("FAIL histogram serialization (%zu bytes)\n", size);
+        status = 1;
+    }
+    // Second shard first: the order of the merges does not matter
+    if (histogram_merge(merged, second) != 0 || histogram_merge(merged, first) != 0 ||
+        memcmp(merged, whole, sizeof(whole)) != 0)
+    {
+        printf("FAIL histogram merge\n");
+        status = 1;
+    }
+
+    CodeTable merged_table, whole_table;
+    if (length > 0 && (code_table_from_histogram(merged, &merged_table) != 0 ||
+                       code_table_from_histogram(whole, &whole_table) != 0 ||
+                       memcmp(merged_table.lengths, whole_table.lengths, NB_SYMBOLS) != 0))
+    {
+        printf("FAIL code table of the merged histogram\n");
+        status = 1;
+    }
+    return status;
+}
+
+// A table served by the cache must be the table built from scratch
+static int check_table_cache(const unsigned char *data, size_t length)
+{
+    long long histogram[NB_SYMBOLS] = {0};
+    CodeTable built, cached;
+    TableCacheStats before, after;
+
+    histogram_add_buffer(histogram, data, length);
+    table_cache_set_capacity(0);
+    code_table_from_histogram(histogram, &built);
+    table_cache_set_capacity(TABLE_CACHE_DEFAULT_CAPACITY);
+    code_table_from_histogram(histogram, &cached);
+    table_cache_get_stats(&before);
+    code_table_from_histogram(histogram, &cached);
+    table_cache_get_stats(&after);
+
+    if (after.hits != before.hits + 1 || memcmp(&built, &cached, sizeof(CodeTable)) != 0)
+    {
+        printf("FAIL table cache: %lld hits, tables %s\n", after.hits - before.hits,
+               memcmp(&built, &cached, sizeof(CodeTable)) != 0 ? "differ" : "equal");
+        return 1;
+    }
+
+    // A small cache keeps the most recent tables found through their buckets, and evicts the others
+    enum { SMALL_CAPACITY = 5, NB_TABLES = 12 };
+    unsigned char first_lengths[NB_SYMBOLS];
+    table_cache_set_capacity(SMALL_CAPACITY);
+    for (int k = 0; k < NB_TABLES; k++)
+    {
+        long long skewed[NB_SYMBOLS];
+        for (int c = 0; c < NB_SYMBOLS; c++)
+        {
+            skewed[c] = c == k ? 1000 : 1;
+        }
+        code_table_from_histogram(skewed, &built);
+        if (table_cache_lookup(code_lengths_hash(built.lengths), built.lengths, &cached) != 1 ||
+            memcmp(&built, &cached, sizeof(CodeTable)) != 0)
+        {
+            printf("FAIL table cache: table %d not found after its insertion\n", k);
+            table_cache_set_capacity(TABLE_CACHE_DEFAULT_CAPACITY);
+            return 1;
+        }
+        if (k == 0)
+        {
+            memcpy(first_lengths, built.lengths, NB_SYMBOLS);
+        }
+    }
+    table_cache_get_stats(&after);
+    int first_found = table_cache_lookup(code_lengths_hash(first_lengths), first_lengths, &cached);
+    table_cache_set_capacity(TABLE_CACHE_DEFAULT_CAPACITY);
+    if (after.nb_entries != SMALL_CAPACITY || first_found)
+    {
+        printf("FAIL table cache: %d entries for a capacity of %d\n", after.nb_entries, SMALL_CAPACITY);
+        return 1;
+    }
+    return 0;
+}
+
+static void *daemon_thread(void *socket_path)
+{
+    daemon_serve(socket_path, 2);
+    return NULL;
+}
+
+// A client connection that sends the given bytes, then nothing
+static int stalled_client(const char *socket_path, const unsigned char *bytes, size_t length)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+                    send(fd, bytes, length, MSG_NOSIGNAL) != (ssize_t)length))
+    {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// Compress and decompress requests through a daemon running in a thread. Clients that
+// stall in a request or between requests must neither keep the two workers from the
+// others nor the daemon from stopping
+static int check_daemon(const unsigned char *data, size_t length)
+{
+    char socket_path[64];
+    pthread_t thread;
+    unsigned char *compressed = NULL, *restored = NULL;
+    size_t compressed_length, restored_length;
+    int status = 0;
+
+    sprintf(socket_path, "/tmp/test_roundtrip_%d.sock", (int)getpid());
+    pthread_create(&thread, NULL, daemon_thread, socket_path);
+    for (int attempt = 0; attempt < 100 && access(socket_path, F_OK) != 0; attempt++)
+    {
+        usleep(10000);
+    }
+
+    if (daemon_request(socket_path, DAEMON_COMPRESS, data, length, &compressed, &compressed_length) != 0 ||
+        daemon_request(socket_path, DAEMON_DECOMPRESS, compressed, compressed_length, &restored, &restored_length) != 0 ||
+        restored_length != length || memcmp(restored, data, length) != 0)
+    {
+        printf("FAIL daemon round trip of %zu bytes\n", length);
+        status = 1;
+    }
+    free(restored);
+    if (daemon_request(socket_path, DAEMON_DECOMPRESS, data, length, &restored, &restored_length) != 1)
+    {
+        printf("FAIL daemon accepted a damaged container\n");
+        status = 1;
+    }
+    free(restored);
+
+    const unsigned char partial_header[3] = {DAEMON_COMPRESS, 100, 0};
+    int idle = stalled_client(socket_path, NULL, 0);
+    int stalled = stalled_client(socket_path, partial_header, sizeof(partial_header));
+    usleep(100000);
+    int served = daemon_request(socket_path, DAEMON_DECOMPRESS, compressed, compressed_length, &restored,
+                                &restored_length) == 0 && restored_length == length;
+    if (idle < 0 || stalled < 0 || !served)
+    {
+        printf("FAIL daemon busy with stalled clients\n");
+        status = 1;
+    }
+    free(restored);
+    free(compressed);
+    close(idle);
+    close(stalled);
+
+    // Stopping while a client is in the middle of a request
+    stalled = stalled_client(socket_path, partial_header, sizeof(partial_header));
+    usleep(100000);
+    daemon_stop();
+    pthread_join(thread, NULL);
+    close(stalled);
+    return status;
+}
+
+static int check_bitstring(const unsigned char *data, size_t length)
+{
+    char *chars = malloc(8 * length + 1);
+    unsigned char *packed = malloc(length + 1);
+    int status = 0;
+
+    bits_to_ascii(data, length, chars);
+    for (size_t i = 0; i < 8 * length; i++)
+    {
+        char expected = (data[i / 8] & (0x80 >> (i % 8))) ? '1' : '0';
+        if (chars[i] != expected)
+        {
+            printf("FAIL bits_to_ascii: character %zu of %zu\n", i, 8 * length);
+            status = 1;
+            break;
+        }
+    }
+    if (ascii_to_bits(chars, 8 * length, packed) != 8 * length || memcmp(packed, data, length) != 0)
+    {
+        printf("FAIL ascii_to_bits: %zu bytes not restored\n", length);
+        status = 1;
+    }
+    if (length > 0)
+    {
+        size_t bad = (size_t)(next_random() % (8 * length));
+        chars[bad] = '2';
+        if (ascii_to_bits(chars, 8 * length, packed) != bad)
+        {
+            printf("FAIL ascii_to_bits: invalid character at %zu not reported\n", bad);
+            status = 1;
+        }
+    }
+
+    free(chars);
+    free(packed);
+    return status;
+}
+
+// Token mode: compress -> decompress with the given tokenizer, and the byte histogram of
+// the data coded as 256 tokens, which must cost exactly as much as the byte code table
+static int check_tokens(const unsigned char *data, size_t length, const char *tokenizer_name)
+{
+    Tokenizer tokenizer;
+    FILE *input = file_from_bytes(data, length);
+    FILE *compressed = tmpfile();
+    FILE *output = tmpfile();
+    int status = 0;
+
+    tokenizer_init(&tokenizer, tokenizer_name);
+    int compressed_status = token_compress(input, compressed, &tokenizer);
+    rewind(compressed);
+    if (compressed_status != 0 || !token_file_detect(compressed) ||
+        token_decompress(compressed, output) != 0)
+    {
+        printf("FAIL tokens %s: %zu bytes not compressed\n", tokenizer_name, length);
+        status = 1;
+    }
+    else
+    {
+        long long size;
+        unsigned char *restored = file_bytes(output, &size);
+        if (size != (long long)length || memcmp(restored, data, length) != 0)
+        {
+            printf("FAIL tokens %s: %zu bytes restored as %lld different bytes\n", tokenizer_name, length, size);
+            status = 1;
+        }
+        free(restored);
+    }
+    fclose(input);
+    fclose(compressed);
+    fclose(output);
+
+    long long histogram[NB_SYMBOLS] = {0};
+    uint64_t counts[NB_SYMBOLS];
+    unsigned char lengths[NB_SYMBOLS];
+    CodeTable table;
+    histogram_add_buffer(histogram, data, length);
+    long long cost = 0;
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        counts[c] = (uint64_t)histogram[c];
+    }
+    token_code_lengths(counts, NB_SYMBOLS, lengths, MAX_CODE_LENGTH);
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        cost += histogram[c] * lengths[c];
+    }
+    if (length > 0 && (code_table_from_histogram(histogram, &table) != 0 || code_table_cost(&table, histogram) != cost))
+    {
+        printf("FAIL token code lengths: %lld bits instead of %lld\n", cost, code_table_cost(&table, histogram));
+        status = 1;
+    }
+    return status;
+}
+
+// Alphabets far beyond 256 symbols: a text of Zipf-like words, and Fibonacci counts whose
+// optimal code lengths go past the limit
+static int check_token_alphabet(size_t nb_words, size_t nb_distinct)
+{
+    unsigned char *text = malloc(nb_words * 12);
+    size_t length = 0;
+    int status = 0;
+
+    for (size_t i = 0; i < nb_words; i++)
+    {
+        unsigned long long rank = next_random() % nb_distinct;
+        rank = rank * (next_random() % nb_distinct) / nb_distinct;
+        length += (size_t)sprintf((char *)text + length, "w%llx%s", rank, i % 16 == 15 ? ".\n" : " ");
+    }
+    status |= check_tokens(text, length, "words");
+    status |= check_tokens(text, length, "fields");
+    status |= check_tokens(text, length, "lines");
+
+    TokenTable table;
+    token_table_init(&table);
+    for (size_t pos = 0; pos < length; pos += 3)
+    {
+        token_table_add(&table, text + pos, 3);
+    }
+    for (size_t pos = 0; pos < length; pos += 3)
+    {
+        long id = token_table_find(&table, text + pos, 3);
+        if (id < 0 || table.lengths[id] != 3 || memcmp(table.tokens[id], text + pos, 3) != 0)
+        {
+            printf("FAIL token table: token at %zu not found\n", pos);
+            status = 1;
+            break;
+        }
+    }
+    if (token_table_find(&table, (const unsigned char *)"w", 1) >= 0)
+    {
+        printf("FAIL token table: unknown token found\n");
+        status = 1;
+    }
+    token_table_free(&table);
+    free(text);
+
+    uint64_t counts[60];
+    unsigned char lengths[60];
+    unsigned long long kraft = 0;
+    int longest = 0;
+    counts[0] = counts[1] = 1;
+    for (int i = 2; i < 60; i++)
+    {
+        counts[i] = counts[i - 1] + counts[i - 2];
+    }
+    if (token_code_lengths(counts, 60, lengths, 16) != 60)
+    {
+        printf("FAIL token code lengths of 60 symbols\n");
+        return 1;
+    }
+    for (int i = 0; i < 60; i++)
+    {
+        kraft += 1ULL << (16 - lengths[i]);
+        longest = lengths[i] > longest ? lengths[i] : longest;
+    }
+    if (longest > 16 || kraft > (1ULL << 16))
+    {
+        printf("FAIL token code lengths limited to 16 bits: longest %d, Kraft sum %llu\n", longest, kraft);
+        status = 1;
+    }
+    return status;
+}
+
+typedef struct AllocatorCounters
+{
+    long long allocations;
+    long long frees;
+} AllocatorCounters;
+
+static void *counting_alloc(void *context, size_t size)
+{
+    ((AllocatorCounters *)context)->allocations++;
+    return malloc(size);
+}
+
+static void *counting_realloc(void *context, void *ptr, size_t size)
+{
+    (void)context;
+    return realloc(ptr, size);
+}
+
+static void counting_free(void *context, void *ptr)
+{
+    ((AllocatorCounters *)context)->frees++;
+    free(ptr);
+}
+
+// Many compressions in a row, as in a long-running service, through a plugged allocator:
+// afterwards every subsystem must be back to the memory it used before
+static int check_teardown(int nb_runs)
+{
+    AllocatorCounters counters = {0, 0};
+    MemoryAllocator allocator = {counting_alloc, counting_realloc, counting_free, &counters};
+    MemoryUsage before[MEM_NB_SUBSYSTEMS], after;
+    MemoryStats stats_before, stats_after;
+    unsigned char data[128], restored[128];
+    char text[24];
+    int status = 0;
+
+    size_t capacity = container_compress_bound(sizeof(data), 256);
+    unsigned char *container = malloc(capacity);
+
+    table_cache_clear();
+    memory_get_stats(&stats_before);
+    for (int subsystem = 0; subsystem < MEM_NB_SUBSYSTEMS; subsystem++)
+    {
+        memory_get_usage(subsystem, &before[subsystem]);
+    }
+    memory_set_allocator(&allocator);
+
+    for (int run = 0; run < nb_runs && status == 0; run++)
+    {
+        for (size_t i = 0; i < sizeof(text) - 1; i++)
+        {
+            text[i] = (char)('a' + next_random() % (1 + run % 26));
+        }
+        text[sizeof(text) - 1] = '\0';
+        HuffmanTree *huffman_tree = huffman_tree_from_occurrences(get_occurrences(text));
+        huffman_tree_free(huffman_tree);
+
+        size_t length = (size_t)(next_random() % sizeof(data));
+        for (size_t i = 0; i < length; i++)
+        {
+            data[i] = (unsigned char)(next_random() % (2 + run % 200));
+        }
+        long long size = container_compress_buffer(data, length, 256, container, capacity);
+        if (size < 0 || container_decompress_buffer(container, (size_t)size, restored, sizeof(restored)) != (long long)length ||
+            memcmp(restored, data, length) != 0)
+        {
+            printf("FAIL teardown: compression %d\n", run);
+            status = 1;
+        }
+        if (run % 1000 == 0)
+        {
+            status |= check_tokens(data, length, "words");
+        }
+    }
+
+    free(container);
+    table_cache_clear();
+    memory_set_allocator(NULL);
+    memory_get_stats(&stats_after);
+    if (stats_after.current != stats_before.current || counters.allocations != counters.frees)
+    {
+        printf("FAIL teardown: %lld bytes left allocated, %lld blocks not freed\n",
+               stats_after.current - stats_before.current, counters.allocations - counters.frees);
+        status = 1;
+    }
+    for (int subsystem = 0; subsystem < MEM_NB_SUBSYSTEMS; subsystem++)
+    {
+        memory_get_usage(subsystem, &after);
+        if (after.live != before[subsystem].live || after.bytes != before[subsystem].bytes)
+        {
+            printf("FAIL teardown: %lld blocks (%lld bytes) of %s left allocated\n", after.live - before[subsystem].live,
+                   after.bytes - before[subsystem].bytes, memory_subsystem_name(subsystem));
+            status = 1;
+        }
+    }
+    memory_get_usage(MEM_TREES, &after);
+    if (after.allocations - before[MEM_TREES].allocations < nb_runs)
+    {
+        printf("FAIL teardown: the Huffman trees are not accounted\n");
+        status = 1;
+    }
+    return status;
+}
+
+typedef struct DictParseJob
+{
+    const char *text;
+    size_t length;
+    const DictCodes *expected;
+    int failures;
+} DictParseJob;
+
+static void *dict_parse_thread(void *arg)
+{
+    DictParseJob *job = arg;
+    for (int run = 0; run < 200; run++)
+    {
+        DictCodes dict;
+        if (dict_parse(job->text, job->length, &dict) != 0 ||
+            memcmp(dict.lengths, job->expected->lengths, sizeof(dict.lengths)) != 0 ||
+            memcmp(dict.codes, job->expected->codes, sizeof(dict.codes)) != 0)
+        {
+            job->failures++;
+        }
+    }
+    return NULL;
+}
+
+// The dictionary written for the data parses back to the codes of the tree, also from
+// several threads at once; malformed lines are reported with their number
+static int check_dict_parse(const unsigned char *data, size_t length)
+{
+    FILE *input = file_from_bytes(data, length);
+    FILE *dict_file = tmpfile();
+    HuffmanTree *huffman_tree = huffman_tree_from_occurrences(get_occurrences_by_dichotomy(input));
+    write_huffman_dict(dict_file, huffman_tree->root_dict);
+    char *text = load_full_file(dict_file);
+    size_t text_length = strlen(text);
+    DictCodes dict;
+    int status = 0;
+
+    if (dict_parse(text, text_length, &dict) != 0)
+    {
+        printf("FAIL dictionary of %zu bytes not parsed\n", length);
+        status = 1;
+    }
+    for (Element *curr = huffman_tree->root_dict; status == 0 && curr != NULL; curr = curr->next)
+    {
+        size_t code_length = strlen(curr->node->code);
+        if (dict.lengths[curr->letter] != code_length || memcmp(dict.codes[curr->letter], curr->node->code, code_length) != 0)
+        {
+            printf("FAIL dictionary: wrong code for letter %d\n", curr->letter);
+            status = 1;
+        }
+    }
+    huffman_tree_free(huffman_tree);
+    fclose(input);
+    fclose(dict_file);
+
+    pthread_t threads[4];
+    DictParseJob jobs[4];
+    for (int i = 0; i < 4; i++)
+    {
+        jobs[i] = (DictParseJob){text, text_length, &dict, 0};
+        pthread_create(&threads[i], NULL, dict_parse_thread, &jobs[i]);
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        pthread_join(threads[i], NULL);
+        if (jobs[i].failures > 0)
+        {
+            printf("FAIL dictionary parsed by thread %d: %d wrong results\n", i, jobs[i].failures);
+            status = 1;
+        }
+    }
+    free(text);
+
+    const struct
+    {
+        const char *text;
+        int line;
+    } cases[] = {{":: 0\nSPACE: 10\r\nCHR07: 11\n\n", 0}, {"a: 01\nb 10\n", 2}, {"a: 01\na: 10\n", 2},
+                 {"a: 0x\n", 1},                       {"CHR99: 1\n", 1},   {"LF/NL: 0\nNaN: 1\n", 2},
+                 {"b: \n", 1}};
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        if (dict_parse(cases[i].text, strlen(cases[i].text), &dict) != cases[i].line)
+        {
+            printf("FAIL dictionary case %zu: line %d expected\n", i, cases[i].line);
+            status = 1;
+        }
+    }
+    if (dict_parse(cases[0].text, strlen(cases[0].text), &dict) != 0 || dict.nb_letters != 3 || dict.lengths[':'] != 1 ||
+        dict.lengths[' '] != 2 || dict.lengths[7] != 2)
+    {
+        printf("FAIL dictionary with ':', SPACE and CHR07\n");
+        status = 1;
+    }
+    return status;
+}
+
+// Each transform chain inverts exactly, the suffix array is sorted, and the containers
+// written with transforms decode through every path, pipeline included
+static int check_transforms(const unsigned char *data, size_t length, const char *name)
+{
+    int status = 0;
+    int32_t *sa = malloc((length + 1) * sizeof(int32_t));
+    if (suffix_array(data, length, sa) != 0)
+    {
+        printf("FAIL %s: suffix array error\n", name);
+        status = 1;
+    }
+    for (size_t i = 1; status == 0 && i < length; i++)
+    {
+        size_t a = (size_t)sa[i - 1], b = (size_t)sa[i];
+        size_t common = length - a < length - b ? length - a : length - b;
+        int order = memcmp(data + a, data + b, common);
+        if (order > 0 || (order == 0 && a < b))
+        {
+            printf("FAIL %s: suffixes %zu and %zu out of order\n", name, a, b);
+            status = 1;
+        }
+    }
+    free(sa);
+
+    const char *chains[] = {"rle", "mtf", "bwt", "bwt,mtf,rle", "rle,bwt,mtf", "mtf,rle", "delta4,shuffle4", "shuffle8",
+                            "rle,delta2,shuffle2", "delta8"};
+    unsigned char *transformed = malloc(TRANSFORM_BOUND(length));
+    unsigned char *restored = malloc(length + 1);
+    for (size_t i = 0; i < sizeof(chains) / sizeof(chains[0]); i++)
+    {
+        TransformChain chain;
+        long long size = -1;
+        if (transform_chain_parse(chains[i], &chain) != 0 ||
+            (size = transform_forward(&chain, data, length, transformed, TRANSFORM_BOUND(length))) < 0 ||
+            transform_inverse(&chain, transformed, (size_t)size, restored, length) != 0 ||
+            memcmp(restored, data, length) != 0)
+        {
+            printf("FAIL %s: transforms %s do not invert (%lld bytes)\n", name, chains[i], size);
+            status = 1;
+        }
+    }
+
+    // Damaged inputs: a primary index past the end, a run without its count
+    unsigned char bad[5] = {0, 0, 0, 9, 'a'};
+    unsigned char run[4] = {'a', 'a', 'a', 'a'};
+    TransformChain repeated;
+    if (bwt_decode(bad, sizeof(bad), restored) == 0 || rle_decode(run, sizeof(run), transformed, 16) >= 0 ||
+        transform_chain_parse("mtf,mtf", &repeated) == 0 || transform_chain_parse("lzw", &repeated) == 0 ||
+        transform_chain_parse("shuffle4,mtf", &repeated) == 0)
+    {
+        printf("FAIL %s: damaged transform input accepted\n", name);
+        status = 1;
+    }
+    free(transformed);
+    free(restored);
+
+    transform_chain_parse("bwt,mtf,rle", &CONTAINER_TRANSFORMS);
+    status |= check_container(data, length, length / 3, name);
+    status |= check_pipeline(data, length, 2, name);
+    transform_chain_parse("none", &CONTAINER_TRANSFORMS);
+    return status;
+}
+
+// Members of related content share a few tables, survive an append, and each one is
+// extracted alone by name
+static int check_archive(const unsigned char *data, size_t length)
+{
+    enum { NB_MEMBERS = 40 };
+    FILE *file = tmpfile();
+    Archive archive;
+    char name[32];
+    size_t offsets[NB_MEMBERS], lengths[NB_MEMBERS];
+    int status = 0;
+
+    for (int i = 0; i < NB_MEMBERS; i++)
+    {
+        offsets[i] = (size_t)(next_random() % (length + 1));
+        lengths[i] = i == 7 ? 0 : (size_t)(next_random() % (length - offsets[i] + 1));
+    }
+    if (archive_create(&archive, file) != 0)
+    {
+        status = 1;
+    }
+    for (int i = 0; i < NB_MEMBERS / 2 && status == 0; i++)
+    {
+        sprintf(name, "member/%d", i);
+        status = archive_add(&archive, name, data + offsets[i], lengths[i]) != 0;
+    }
+    if (status == 0 && (archive_add(&archive, "member/3", data, length) == 0 || archive_finish(&archive) != 0))
+    {
+        status = 1;
+    }
+    archive_free(&archive);
+
+    // Append to the archive opened again, then read everything back
+    if (status == 0 && archive_open(&archive, file) != 0)
+    {
+        status = 1;
+    }
+    for (int i = NB_MEMBERS / 2; i < NB_MEMBERS && status == 0; i++)
+    {
+        sprintf(name, "member/%d", i);
+        status = archive_add(&archive, name, data + offsets[i], lengths[i]) != 0;
+    }
+    if (status == 0 && archive_finish(&archive) != 0)
+    {
+        status = 1;
+    }
+    archive_free(&archive);
+    if (status == 0 && archive_open(&archive, file) != 0)
+    {
+        status = 1;
+    }
+
+    unsigned char *decoded = malloc(length + 1);
+    for (int i = NB_MEMBERS - 1; i >= 0 && status == 0; i--)
+    {
+        sprintf(name, "member/%d", i);
+        long member = archive_find(&archive, name);
+        if (member < 0 || archive_extract(&archive, (unsigned int)member, decoded, length) != (long long)lengths[i] ||
+            memcmp(decoded, data + offsets[i], lengths[i]) != 0)
+        {
+            printf("FAIL archive member %d of %zu bytes\n", i, lengths[i]);
+            status = 1;
+        }
+    }
+    if (status == 0 && (archive.nb_members != NB_MEMBERS || archive.nb_tables >= NB_MEMBERS / 2 ||
+                        archive_find(&archive, "member/40") >= 0))
+    {
+        printf("FAIL archive of %u members with %u tables\n", archive.nb_members, archive.nb_tables);
+        status = 1;
+    }
+    else if (status != 0)
+    {
+        printf("FAIL archive of %zu bytes\n", length);
+    }
+    free(decoded);
+    archive_free(&archive);
+    fclose(file);
+    return status;
+}
+
+// Every encode kernel the processor runs writes the bits of a plain bit-by-bit encode,
+// for every start and length around the vector widths
+static int check_encode_kernels(const unsigned char *data, size_t length, const long long *histogram,
+                                const char *name)
+{
+    CodeTable table;
+    if (code_table_from_histogram(histogram, &table) != 0)
+    {
+        return 0;
+    }
+    size_t capacity = MAX_CODE_LENGTH * length / 8 + 8;
+    unsigned char *expected = malloc(capacity);
+    unsigned char *encoded = malloc(capacity);
+    int saved_kernel = ENCODE_KERNEL;
+    int status = 0;
+
+    for (size_t start = 0; start < 3 && start < length && status == 0; start++)
+    {
+        size_t nb_letters = length - start - (start == 2 ? (length - start) % 17 : 0);
+        BitWriter writer;
+        bit_writer_init(&writer, expected);
+        for (size_t i = 0; i < nb_letters; i++)
+        {
+            bit_writer_put(&writer, table.codes[data[start + i]], table.lengths[data[start + i]]);
+        }
+        unsigned long long expected_bits = 8ULL * writer.pos + (unsigned long long)writer.nb_bits;
+        size_t expected_size = bit_writer_flush(&writer);
+
+        for (int kernel = ENCODE_KERNEL_SCALAR; kernel <= ENCODE_KERNEL_AVX512 && status == 0; kernel++)
+        {
+            ENCODE_KERNEL = kernel;
+            unsigned long long bits = encode_buffer(data + start, nb_letters, &table, encoded);
+            if (bits != expected_bits || memcmp(encoded, expected, expected_size) != 0)
+            {
+                printf("FAIL %s: encode kernel %s (%zu letters from %zu, codes up to %d bits)\n", name,
+                       encode_kernel_name(encode_kernel_resolve(kernel)), nb_letters, start, table.max_length);
+                status = 1;
+            }
+        }
+    }
+    ENCODE_KERNEL = saved_kernel;
+    free(expected);
+    free(encoded);
+    return status;
+}
+
+static int check_encode_kernels_text(const unsigned char *data, size_t length, const char *name)
+{
+    long long histogram[NB_SYMBOLS] = {0};
+    histogram_add_buffer(histogram, data, length);
+    return check_encode_kernels(data, length, histogram, name);
+}
+
+// Codes longer than 16 bits, and up to MAX_CODE_LENGTH: Fibonacci counts over 33 letters
+static int check_encode_kernels_long_codes(void)
+{
+    long long histogram[NB_SYMBOLS] = {0};
+    long long a = 1, b = 1;
+    for (int c = 0; c < MAX_CODE_LENGTH + 1; c++)
+    {
+        histogram[c] = a;
+        long long next = a + b;
+        a = b;
+        b = next;
+    }
+    size_t length = 5000;
+    unsigned char *text = malloc(length);
+    for (size_t i = 0; i < length; i++)
+    {
+        // Mostly the rare letters, so that the long codes are written
+        text[i] = (unsigned char)(next_random() % 4 == 0 ? MAX_CODE_LENGTH - next_random() % 4
+                                                         : next_random() % (MAX_CODE_LENGTH + 1));
+    }
+    int status = check_encode_kernels(text, length, histogram, "long codes");
+    free(text);
+    return status;
+}
+
+// The text of compress_file decoded in tiny chunks on several threads gives the input back,
+// whether the guessed decodings synchronize or not, and damaged texts are rejected
+static int check_sync_decode(const unsigned char *data, size_t length, const char *name)
+{
+    FILE *input = file_from_bytes(data, length);
+    FILE *compressed = tmpfile();
+    FILE *dict = tmpfile();
+    Element *occurrences = get_occurrences_by_dichotomy(input);
+    HuffmanTree *huffman_tree = huffman_tree_from_occurrences(occurrences);
+    write_huffman_dict(dict, huffman_tree->root_dict);
+    compress_file(input, compressed, huffman_tree);
+    huffman_tree_free(huffman_tree);
+
+    size_t saved_min_chunk_bits = SYNC_DECODE_MIN_CHUNK_BITS;
+    unsigned char *decoded = malloc(length + 1);
+    int status = 0;
+    const int nb_threads[] = {1, 3, 8};
+    for (size_t t = 0; t < sizeof(nb_threads) / sizeof(nb_threads[0]) && status == 0; t++)
+    {
+        FILE *output = tmpfile();
+        SyncDecodeReport report;
+        SYNC_DECODE_MIN_CHUNK_BITS = t == 2 ? 1 : 64;
+        if (uncompress_file_parallel(compressed, dict, output, nb_threads[t], &report) != 0 ||
+            file_size(output) != (long long)length || fread(decoded, 1, length + 1, output) != length ||
+            memcmp(decoded, data, length) != 0 || report.nb_letters != length)
+        {
+            printf("FAIL %s: parallel decoding on %d threads (%d chunks)\n", name, nb_threads[t], report.nb_chunks);
+            status = 1;
+        }
+        fclose(output);
+    }
+
+    // A character other than '0' and '1' in the middle of the text
+    long long nb_bits = file_size(compressed);
+    if (status == 0 && nb_bits > 0)
+    {
+        FILE *output = tmpfile();
+        SyncDecodeReport report;
+        fseek(compressed, nb_bits / 2, SEEK_SET);
+        fputc('2', compressed);
+        if (uncompress_file_parallel(compressed, dict, output, 4, &report) == 0)
+        {
+            printf("FAIL %s: parallel decoding of a damaged text\n", name);
+            status = 1;
+        }
+        fclose(output);
+    }
+    SYNC_DECODE_MIN_CHUNK_BITS = saved_min_chunk_bits;
+    free(decoded);
+    fclose(input);
+    fclose(compressed);
+    fclose(dict);
+    return status;
+}
+
+// tANS round trips at every table size, cost estimates close to the bits written, damaged
+// payloads and frequencies refused, then containers coded with tANS only and with the
+// cheaper backend of each block
+static int check_tans(const unsigned char *data, size_t length, const char *name)
+{
+    long long histogram[NB_SYMBOLS] = {0};
+    histogram_add_buffer(histogram, data, length);
+    unsigned char *encoded = malloc(TANS_MAX_TABLE_LOG * length / 8 + 16);
+    unsigned char *decoded = malloc(length + 1);
+    unsigned char serialized[TANS_MAX_SERIALIZED_SIZE];
+    int status = 0;
+
+    for (unsigned int table_log = TANS_MIN_TABLE_LOG; table_log <= TANS_MAX_TABLE_LOG && status == 0; table_log++)
+    {
+        TansFrequencies frequencies, reread;
+        if (tans_normalize(histogram, table_log, &frequencies) != 0)
+        {
+            printf("FAIL %s: tANS frequencies of %zu letters\n", name, length);
+            status = 1;
+            break;
+        }
+        unsigned long long bits = tans_encode(data, length, &frequencies, encoded);
+        long long cost = tans_cost(&frequencies, histogram);
+        size_t size = tans_serialize(&frequencies, serialized);
+        if (size != tans_serialized_size(&frequencies) || tans_deserialize(serialized, size, &reread) != size ||
+            memcmp(reread.counts, frequencies.counts, sizeof(frequencies.counts)) != 0 ||
+            tans_decode(encoded, bits, &reread, decoded, length) != 0 || memcmp(decoded, data, length) != 0)
+        {
+            printf("FAIL %s: tANS round trip with a table of 2^%u states\n", name, table_log);
+            status = 1;
+        }
+        else if (llabs((long long)bits - cost) > (long long)length / 50 + 2 * (long long)table_log)
+        {
+            printf("FAIL %s: tANS wrote %llu bits, %lld estimated\n", name, bits, cost);
+            status = 1;
+        }
+        // Fewer bits than the final state, and a sum of counts off by one
+        serialized[4]++;
+        if (tans_decode(encoded, table_log - 1, &frequencies, decoded, length) == 0 ||
+            tans_deserialize(serialized, size, &reread) != 0)
+        {
+            printf("FAIL %s: damaged tANS payload or frequencies accepted\n", name);
+            status = 1;
+        }
+    }
+    free(encoded);
+    free(decoded);
+
+    for (int backend = CONTAINER_BACKEND_TANS; backend <= CONTAINER_BACKEND_AUTO; backend++)
+    {
+        CONTAINER_BACKEND = backend;
+        status |= check_container(data, length, length / 3, name);
+        status |= check_pipeline(data, length, 2, name);
+    }
+    CONTAINER_BACKEND = CONTAINER_BACKEND_HUFFMAN;
+    return status;
+}
+
+// Blocks of two kinds of data pick the matching table of a trained set and only name
+// it; the container then decodes with that set loaded, and with no other
+static int check_table_set(void)
+{
+    enum { KIND_SIZE = 512, NB_KINDS = 16 };
+    static const char *const keys[] = {"\"id\": ", "\"name\": \"", "\"tags\": [", "\"ok\": true, "};
+    unsigned char mixed[2 * NB_KINDS * KIND_SIZE];
+    long long histograms[2][NB_SYMBOLS] = {{0}};
+    size_t length = 0;
+    for (int k = 0; k < 2 * NB_KINDS; k++)
+    {
+        unsigned char *block = mixed + length;
+        for (size_t i = 0; i < KIND_SIZE; i++)
+        {
+            // JSON-like text, or small binary values
+            const char *key = keys[next_random() % 4];
+            if (k % 2 == 0)
+            {
+                unsigned char letter = (unsigned char)key[i % strlen(key)];
+                block[i] = (unsigned char)(next_random() % 4 == 0 ? letter : 'a' + next_random() % 26);
+            }
+            else
+            {
+                block[i] = (unsigned char)(next_random() % 8 * (next_random() % 8));
+            }
+        }
+        histogram_add_buffer(histograms[k % 2], block, KIND_SIZE);
+        length += KIND_SIZE;
+    }
+
+    TableSet set, other, reread;
+    table_set_init(&set);
+    table_set_init(&other);
+    int status = 0;
+    if (table_set_train(&set, "json", histograms[0]) != 0 || table_set_train(&set, "binary", histograms[1]) != 0 ||
+        table_set_train(&other, "binary", histograms[1]) != 0 || table_set_train(&other, "json", histograms[0]) != 0 ||
+        table_set_train(&set, "", histograms[0]) == 0 || set.nb_tables != 2 || set.id == other.id)
+    {
+        printf("FAIL table set: training\n");
+        status = 1;
+    }
+    FILE *file = tmpfile();
+    if (table_set_write(&set, file) != 0 || fseek(file, 0, SEEK_SET) != 0 || table_set_read(&reread, file) != 0 ||
+        reread.id != set.id || reread.nb_tables != 2 || strcmp(reread.names[1], "binary") != 0)
+    {
+        printf("FAIL table set: write and read\n");
+        status = 1;
+    }
+    fclose(file);
+
+    size_t capacity = container_compress_bound(length, KIND_SIZE);
+    unsigned char *plain = malloc(capacity);
+    unsigned char *with_set = malloc(capacity);
+    unsigned char *decoded = malloc(length);
+    long long plain_size = container_compress_buffer(mixed, length, KIND_SIZE, plain, capacity);
+    CONTAINER_TABLE_SET = &set;
+    long long set_size = container_compress_buffer(mixed, length, KIND_SIZE, with_set, capacity);
+    status |= check_container(mixed, length, length / 3, "table set");
+    status |= check_pipeline(mixed, length, 2, "table set");
+    if (set_size < 0 || plain_size < 0 || set_size >= plain_size ||
+        !(with_set[CONTAINER_HEADER_SIZE] & BLOCK_SET_TABLE) ||
+        container_decompress_buffer(with_set, (size_t)set_size, decoded, length) != (long long)length ||
+        memcmp(decoded, mixed, length) != 0)
+    {
+        printf("FAIL table set: %lld bytes with the set, %lld without\n", set_size, plain_size);
+        status = 1;
+    }
+    CONTAINER_TABLE_SET = &other;
+    if (set_size > 0 && container_decompress_buffer(with_set, (size_t)set_size, decoded, length) >= 0)
+    {
+        printf("FAIL table set: decoded with another set\n");
+        status = 1;
+    }
+    CONTAINER_TABLE_SET = NULL;
+    if (set_size > 0 && container_decompress_buffer(with_set, (size_t)set_size, decoded, length) >= 0)
+    {
+        printf("FAIL table set: decoded without the set\n");
+        status = 1;
+    }
+    free(plain);
+    free(with_set);
+    free(decoded);
+    return status;
+}
+
+// Offsets found in the container against a naive search of the data, for patterns
+// taken from the data (across the ends of the blocks too) and with a missing letter
+static int check_search(const unsigned char *data, size_t length, unsigned int block_size, int backend,
+                        const char *transforms, const char *name)
+{
+    CONTAINER_BACKEND = backend;
+    transform_chain_parse(transforms, &CONTAINER_TRANSFORMS);
+    size_t capacity = container_compress_bound(length, block_size);
+    unsigned char *compressed = malloc(capacity);
+    long long size = container_compress_buffer(data, length, block_size, compressed, capacity);
+    CONTAINER_BACKEND = CONTAINER_BACKEND_HUFFMAN;
+    transform_chain_parse("", &CONTAINER_TRANSFORMS);
+    if (size < 0)
+    {
+        printf("FAIL %s: cannot compress for the search\n", name);
+        free(compressed);
+        return 1;
+    }
+    FILE *container = file_from_bytes(compressed, (size_t)size);
+    free(compressed);
+
+    unsigned long long *expected = malloc((length + 1) * sizeof(unsigned long long));
+    unsigned char pattern[SEARCH_MAX_PATTERN];
+    int status = 0;
+    for (int p = 0; p < 8 && status == 0; p++)
+    {
+        size_t max_length = length < SEARCH_MAX_PATTERN ? length : SEARCH_MAX_PATTERN;
+        size_t pattern_length = 1 + (size_t)(next_random() % (p < 4 ? (max_length < 8 ? max_length : 8) : max_length));
+        size_t start = (size_t)(next_random() % (length - pattern_length + 1));
+        memcpy(pattern, data + start, pattern_length);
+        if (p == 7)
+        {
+            // A letter the data may not have
+            pattern[next_random() % pattern_length] = (unsigned char)next_random();
+        }
+        size_t nb_expected = 0;
+        for (size_t i = 0; i + pattern_length <= length; i++)
+        {
+            if (memcmp(data + i, pattern, pattern_length) == 0)
+            {
+                expected[nb_expected++] = i;
+            }
+        }
+
+        unsigned long long *offsets;
+        SearchReport report;
+        long long nb_matches = container_search(container, pattern, pattern_length, 1 + p % 3, &offsets, &report);
+        if (nb_matches != (long long)nb_expected ||
+            (nb_expected > 0 && memcmp(offsets, expected, nb_expected * sizeof(unsigned long long)) != 0) ||
+            report.nb_matches != nb_expected || report.nb_blocks != (length + block_size - 1) / block_size)
+        {
+            printf("FAIL %s: %lld matches of a pattern of %zu bytes found, %zu expected\n", name, nb_matches,
+                   pattern_length, nb_expected);
+            status = 1;
+        }
+        mem_free(offsets);
+    }
+    free(expected);
+    fclose(container);
+    return status;
+}
+
+// Records of 4-byte counters and 8-byte floats: the shuffles match a plain transpose at
+// every length, and the container codes the planes of "delta4,shuffle4" with their own
+// tables in fewer bytes than the raw records
+static int check_planes(void)
+{
+    enum { NB_RECORDS = 3000 };
+    unsigned char records[8 * NB_RECORDS + 7];
+    unsigned char shuffled[sizeof(records)], restored[sizeof(records)];
+    unsigned long long counter = 1000000;
+    for (size_t i = 0; i < NB_RECORDS; i++)
+    {
+        counter += 90 + next_random() % 20;
+        put_u32(records + 4 * i, (uint32_t)counter);
+    }
+    for (size_t i = 4 * NB_RECORDS; i < sizeof(records); i++)
+    {
+        records[i] = (unsigned char)next_random();
+    }
+
+    int status = 0;
+    const size_t lengths[] = {0, 1, 7, 63, 64, 65, 200, 1031, sizeof(records)};
+    for (unsigned int width = 2; width <= 8; width *= 2)
+    {
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++)
+        {
+            size_t length = lengths[l], n = length / width;
+            shuffle_encode(records, length, width, shuffled);
+            int transposed = 1;
+            for (size_t i = 0; i < n * width; i++)
+            {
+                transposed &= shuffled[i % width * n + i / width] == records[i];
+            }
+            shuffle_decode(shuffled, length, width, restored);
+            if (!transposed || memcmp(shuffled + n * width, records + n * width, length - n * width) != 0 ||
+                memcmp(restored, records, length) != 0)
+            {
+                printf("FAIL planes: shuffle of %zu bytes by %u\n", length, width);
+                status = 1;
+            }
+            delta_encode(records, length, width, shuffled);
+            delta_decode(shuffled, length, width, restored);
+            if (memcmp(restored, records, length) != 0)
+            {
+                printf("FAIL planes: delta of %zu bytes by %u\n", length, width);
+                status = 1;
+            }
+        }
+    }
+
+    size_t length = 4 * NB_RECORDS;
+    size_t capacity = container_compress_bound(length, 4096);
+    unsigned char *plain = malloc(capacity);
+    unsigned char *with_planes = malloc(capacity);
+    unsigned char *decoded = malloc(length);
+    long long plain_size = container_compress_buffer(records, length, 4096, plain, capacity);
+    transform_chain_parse("delta4,shuffle4", &CONTAINER_TRANSFORMS);
+    long long planes_size = container_compress_buffer(records, length, 4096, with_planes, capacity);
+    status |= check_container(records, sizeof(records), sizeof(records) / 3, "planes");
+    status |= check_pipeline(records, sizeof(records), 2, "planes");
+    status |= check_search(records, sizeof(records), 512, CONTAINER_BACKEND_AUTO, "delta8,shuffle8", "planes");
+    transform_chain_parse("none", &CONTAINER_TRANSFORMS);
+    if (planes_size < 0 || plain_size < 0 || 2 * planes_size >= plain_size ||
+        !(with_planes[CONTAINER_HEADER_SIZE] & BLOCK_PLANES) ||
+        container_decompress_buffer(with_planes, (size_t)planes_size, decoded, length) != (long long)length ||
+        memcmp(decoded, records, length) != 0)
+    {
+        printf("FAIL planes: %lld bytes with the planes, %lld without\n", planes_size, plain_size);
+        status = 1;
+    }
+    // One bit more in the first plane
+    if (planes_size > 0)
+    {
+        size_t bits_offset = CONTAINER_HEADER_SIZE + CONTAINER_BLOCK_HEADER_SIZE + 1 + 2 + 8;
+        with_planes[bits_offset]++;
+        if (container_decompress_buffer(with_planes, (size_t)planes_size, decoded, length) >= 0)
+        {
+            printf("FAIL planes: damaged plane accepted\n");
+            status = 1;
+        }
+    }
+    free(plain);
+    free(with_planes);
+    free(decoded);
+    return status;
+}
+
+// The codes of a tree: every letter of the histogram has one, and none is a prefix of another
+static int check_prefix_code(const HuffmanTree *tree, const long long *histogram, const char *name)
+{
+    const char *codes[NB_SYMBOLS] = {NULL};
+    for (Element *curr = tree->root_dict; curr != NULL; curr = curr->next)
+    {
+        codes[curr->letter] = curr->node->code;
+    }
+    for (int a = 0; a < NB_SYMBOLS; a++)
+    {
+        if (histogram[a] > 0 && (codes[a] == NULL || codes[a][0] == '\0'))
+        {
+            printf("FAIL %s: letter %d has no code\n", name, a);
+            return 1;
+        }
+        for (int b = 0; b < NB_SYMBOLS && codes[a] != NULL; b++)
+        {
+            if (b != a && codes[b] != NULL && strncmp(codes[a], codes[b], strlen(codes[a])) == 0)
+            {
+                printf("FAIL %s: the code of %d is a prefix of the code of %d\n", name, a, b);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Counts past 2^32, as in inputs larger than 4 GiB, keep their weight in the tree, and
+// counts whose sum would overflow the weights of the inner nodes are scaled down into a
+// valid prefix code that still has a code for the rarest letters
+static int check_large_counts(void)
+{
+    int status = 0;
+    long long histogram[NB_SYMBOLS] = {0};
+
+    // Truncated to 32 bits, the count of 'x' would be 0 and its code the longest
+    histogram['x'] = 3LL << 32;
+    histogram['y'] = 1000;
+    histogram['z'] = 1000;
+    histogram['w'] = 1;
+    HuffmanTree *tree = huffman_tree_from_occurrences(occurrences_from_histogram(histogram));
+    status |= check_prefix_code(tree, histogram, "counts past 2^32");
+    for (Element *curr = tree->root_dict; curr != NULL; curr = curr->next)
+    {
+        if (curr->letter == 'x' && strlen(curr->node->code) != 1)
+        {
+            printf("FAIL counts past 2^32: code of %zu bits for the most frequent letter\n", strlen(curr->node->code));
+            status = 1;
+        }
+    }
+    huffman_tree_free(tree);
+
+    // Every letter with a count near 2^62 except a few rare ones
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        histogram[c] = c % 64 == 0 ? 1 + c : (1LL << 62) - (long long)c * 977;
+    }
+    tree = huffman_tree_from_occurrences(occurrences_from_histogram(histogram));
+    status |= check_prefix_code(tree, histogram, "counts near 2^62");
+    huffman_tree_free(tree);
+
+    // Geometric counts from 2^62 down: codes of every length up to 62 bits
+    memset(histogram, 0, sizeof(histogram));
+    for (int c = 0; c < 63; c++)
+    {
+        histogram[c] = 1LL << (62 - c);
+    }
+    tree = huffman_tree_from_occurrences(occurrences_from_histogram(histogram));
+    status |= check_prefix_code(tree, histogram, "geometric counts");
+    huffman_tree_free(tree);
+    return status;
+}
+
+// Rejects the container whatever the path reading it: from the file, into a buffer, from memory
+static int check_rejected(const unsigned char *packed, size_t size, size_t raw_size, const char *name)
+{
+    FILE *container = file_from_bytes(packed, size);
+    FILE *output = tmpfile();
+    unsigned char *decoded = malloc(raw_size + 1);
+    int status = 0;
+
+    if (container_decompress(container, output) == 0 || container_decompress_into(container, decoded, raw_size) >= 0 ||
+        container_decompress_buffer(packed, size, decoded, raw_size) >= 0)
+    {
+        printf("FAIL damaged index accepted: %s\n", name);
+        status = 1;
+    }
+    free(decoded);
+    fclose(container);
+    fclose(output);
+    return status;
+}
+
+// Index entries and trailers whose offsets wrap, or that go backwards
+static int check_damaged_index(const unsigned char *data, size_t length)
+{
+    FILE *input = file_from_bytes(data, length);
+    FILE *container = tmpfile();
+    int status = 0;
+
+    if (container_compress(input, container, 512) != 0)
+    {
+        printf("FAIL damaged index: container error\n");
+        fclose(input);
+        fclose(container);
+        return 1;
+    }
+    long long size;
+    unsigned char *packed = file_bytes(container, &size);
+    unsigned char *damaged = malloc((size_t)size);
+    unsigned char *trailer = damaged + size - CONTAINER_TRAILER_SIZE;
+    unsigned long long index_offset = get_u64(packed + size - CONTAINER_TRAILER_SIZE + 8 * NB_SYMBOLS + 8);
+    unsigned char *index = damaged + index_offset;
+
+    memcpy(damaged, packed, (size_t)size);
+    put_u64(index + 8, (unsigned long long)-16);
+    status |= check_rejected(damaged, (size_t)size, length, "raw offset before the buffer");
+
+    memcpy(damaged, packed, (size_t)size);
+    put_u64(index + CONTAINER_INDEX_ENTRY_SIZE, get_u64(index));
+    status |= check_rejected(damaged, (size_t)size, length, "block offsets not increasing");
+
+    memcpy(damaged, packed, (size_t)size);
+    put_u64(index, 0);
+    status |= check_rejected(damaged, (size_t)size, length, "block inside the header");
+
+    // index_offset + nb_blocks * entry size wraps to the start of the trailer
+    memcpy(damaged, packed, (size_t)size);
+    unsigned int nb_blocks = 0xFFFFFFFFU;
+    unsigned long long index_bytes = (unsigned long long)nb_blocks * CONTAINER_INDEX_ENTRY_SIZE;
+    put_u64(trailer + 8 * NB_SYMBOLS + 8, (unsigned long long)size - CONTAINER_TRAILER_SIZE - index_bytes);
+    put_u32(trailer + 8 * NB_SYMBOLS + 16, nb_blocks);
+    status |= check_rejected(damaged, (size_t)size, length, "index offset that wraps");
+
+    // Padding before the index makes the last block longer than the reader's buffers
+    size_t padding = 1 << 20;
+    unsigned char *padded = calloc((size_t)size + padding, 1);
+    memcpy(padded, packed, (size_t)index_offset);
+    memcpy(padded + index_offset + padding, packed + index_offset, (size_t)size - index_offset);
+    put_u64(padded + (size_t)size + padding - CONTAINER_TRAILER_SIZE + 8 * NB_SYMBOLS + 8, index_offset + padding);
+    FILE *padded_container = file_from_bytes(padded, (size_t)size + padding);
+    FILE *output = tmpfile();
+    if (pipeline_decompress(padded_container, output, 2) != -1)
+    {
+        printf("FAIL damaged index accepted: block longer than the pipeline buffers\n");
+        status = 1;
+    }
+    fclose(padded_container);
+    fclose(output);
+    free(padded);
+
+    free(damaged);
+    free(packed);
+    fclose(input);
+    fclose(container);
+    return status;
+}
+
+int main(int argc, char **argv)
+{
+    rng_state = argc > 1 ? strtoull(argv[1], NULL, 10) : 20201214;
+    int iterations = argc > 2 ? atoi(argv[2]) : 200;
+    if (rng_state == 0)
+    {
+        rng_state = 1;
+    }
+    int failures = 0;
+    char name[64];
+    unsigned char data[8192];
+
+    // Every single-letter text, in particular 0x00 and 0xFF
+    for (int c = 0; c < 256; c++)
+    {
+        memset(data, c, 3);
+        sprintf(name, "single letter %d", c);
+        failures += check_roundtrip(data, 1, name);
+        failures += check_roundtrip(data, 3, name);
+        failures += check_container(data, 3, 1, name);
+    }
+
+    // 0xFF next to the other letters, and the full alphabet
+    const unsigned char ff_cases[][4] = {{0xFF, 0x00}, {0x00, 0xFF}, {0xFF, 0xFE}, {'a', 0xFF}, {0xFF, 0xFF, 0xFF, 'b'}};
+    for (size_t i = 0; i < sizeof(ff_cases) / sizeof(ff_cases[0]); i++)
+    {
+        sprintf(name, "0xFF case %zu", i);
+        failures += check_roundtrip(ff_cases[i], i < 4 ? 2 : 4, name);
+    }
+    for (int c = 0; c < 256; c++)
+    {
+        data[c] = (unsigned char)(255 - c);
+    }
+    failures += check_roundtrip(data, 256, "full alphabet");
+    failures += check_pipeline(data, 0, 2, "empty pipeline");
+    failures += check_memory_limit(256 << 10, 3 << 20);
+    failures += check_daemon(data, 256);
+    failures += check_tokens(data, 0, "words");
+    failures += check_token_alphabet(200000, 100000);
+    memset(data, 'a', sizeof(data));
+    failures += check_transforms(data, sizeof(data), "long run");
+    failures += check_encode_kernels_long_codes();
+    failures += check_table_set();
+    failures += check_tans(data, 1, "single letter");
+    failures += check_tans(data, sizeof(data), "long run");
+    failures += check_search(data, sizeof(data), 64, CONTAINER_BACKEND_HUFFMAN, "", "long run");
+    failures += check_planes();
+    failures += check_large_counts();
+    failures += check_damaged_index(data, sizeof(data));
+
+    // All 256 letters equally often: codes of 8 bits, with which guessed decodings
+    // starting off a byte boundary never synchronize
+    for (size_t i = 0; i < 4096; i++)
+    {
+        data[i] = (unsigned char)i;
+    }
+    failures += check_sync_decode(data, 4096, "fixed-length codes");
+
+    // Letters from 'A' to 'Z' first, then lowercase letters the first chunks do not sample
+    size_t large_length = 160000;
+    unsigned char *large = malloc(large_length);
+    for (size_t i = 0; i < large_length; i++)
+    {
+        large[i] = (unsigned char)((i < large_length / 2 ? 'A' : 'a') + next_random() % 26);
+    }
+    failures += check_sampled(large, large_length, 1, "sampled large text");
+    free(large);
+
+    // Random texts with random alphabet sizes and skews
+    for (int it = 0; it < iterations; it++)
+    {
+        size_t length = 1 + (size_t)(next_random() % sizeof(data));
+        int alphabet = 1 + (int)(next_random() % 256);
+        int skew = (int)(next_random() % 4);
+        int base = (int)(next_random() % 256);
+        for (size_t i = 0; i < length; i++)
+        {
+            unsigned long long r = next_random() % (unsigned long long)alphabet;
+            for (int s = 0; s < skew; s++)
+            {
+                r = r * (next_random() % (unsigned long long)alphabet) / (unsigned long long)alphabet;
+            }
+            data[i] = (unsigned char)((base + (int)r) & 0xFF);
+        }
+        sprintf(name, "random text %d", it);
+        failures += check_roundtrip(data, length, name);
+        failures += check_container(data, length, (size_t)(next_random() % (length + 1)), name);
+        failures += check_bitstring(data, length % 300);
+        failures += check_histogram(data, length, (size_t)(next_random() % (length + 1)));
+        failures += check_table_cache(data, length);
+        failures += check_encode_kernels_text(data, length, name);
+        failures += check_tokens(data, length, it % 2 == 0 ? "words" : "fields");
+        if (it % 50 == 0)
+        {
+            failures += check_dict_parse(data, length);
+            failures += check_sampled(data, length, 0, name);
+            failures += check_archive(data, length);
+            failures += check_sync_decode(data, length, name);
+            failures += check_tans(data, length, name);
+        }
+        if (it % 10 == 0)
+        {
+            PIPELINE_URING = it % 20 == 0;
+            failures += check_pipeline(data, length, 1 + it % 3, name);
+            failures += check_transforms(data, length, name);
+            const char *search_transforms = it % 30 == 0 ? "mtf" : it % 30 == 10 ? "delta4,shuffle4" : "";
+            failures += check_search(data, length, it % 20 == 0 ? 64 : 512, it / 10 % 3, search_transforms, name);
+        }
+    }
+
+    failures += check_teardown(100000);
+
+    if (failures > 0)
+    {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All round trips passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,265 @@
+// Generates a C/C++ header with a code table compiled in: static const encode and
+// decode tables, and encode/decode functions specialized on them, for data whose
+// distribution is known in advance. The payloads are the ones of encode_buffer /
+// decode_buffer with the same code lengths.
+//
+// Usage: gentable [--histogram|--dict|--sample] <input> <output.h> [name]
+//   --histogram  a histogram file written by 'main count' or 'main merge' (default)
+//   --dict       a dictionary written by write_huffman_dict (only the code lengths are kept)
+//   --sample     any file, counted as a sample of the data
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "huffman.h"
+#include "codetable.h"
+
+static int load_table(const char *mode, char *path, CodeTable *table)
+{
+    long long histogram[NB_SYMBOLS];
+    FILE *input = open_file(path, "rb");
+    int status = -1;
+
+    if (strcmp(mode, "--sample") == 0)
+    {
+        histogram_from_file(input, histogram);
+        status = code_table_from_histogram(histogram, table);
+    }
+    else if (strcmp(mode, "--histogram") == 0)
+    {
+        unsigned char buffer[HISTOGRAM_MAX_SERIALIZED_SIZE + 1];
+        size_t size = fread(buffer, 1, sizeof(buffer), input);
+        if (size <= HISTOGRAM_MAX_SERIALIZED_SIZE && histogram_deserialize(buffer, size, histogram) == size)
+        {
+            status = code_table_from_histogram(histogram, table);
+        }
+    }
+    else if (strcmp(mode, "--dict") == 0)
+    {
+        unsigned char lengths[NB_SYMBOLS] = {0};
+        char *text = load_full_file(input);
+        DictCodes dict;
+        if (text != NULL && dict_parse(text, strlen(text), &dict) == 0)
+        {
+            memcpy(lengths, dict.lengths, NB_SYMBOLS);
+        }
+        free(text);
+        status = code_table_from_lengths(lengths, table);
+    }
+
+    fclose(input);
+    if (status != 0)
+    {
+        printf("Error: no code table can be built from %s.\n", path);
+    }
+    return status;
+}
+
+static void write_array(FILE *out, const char *type, const char *name, const char *prefix, int size,
+                        const unsigned long long *values)
+{
+    fprintf(out, "static const %s %s_%s[%d] = {", type, prefix, name, size);
+    for (int i = 0; i < size; i++)
+    {
+        fprintf(out, "%s%llu%s", i % 16 == 0 ? "\n    " : "", values[i], i + 1 < size ? ", " : "");
+    }
+    fprintf(out, "};\n\n");
+}
+
+static void write_header(FILE *out, const CodeTable *table, const char *prefix)
+{
+    unsigned long long values[1 << 16];
+    char upper[64];
+    int decode_bits = table->max_length <= 12 ? table->max_length : DECODE_TABLE_BITS;
+
+    for (size_t i = 0; i <= strlen(prefix); i++)
+    {
+        upper[i] = (char)toupper((unsigned char)prefix[i]);
+    }
+
+    fprintf(out, "// Generated by gentable: do not edit.\n");
+    fprintf(out, "// Canonical Huffman code of %d letters, codes of at most %d bits.\n\n", table->nb_symbols,
+            table->max_length);
+    fprintf(out, "#ifndef %s_TABLE_H\n#define %s_TABLE_H\n\n#include <stddef.h>\n#include <stdint.h>\n\n", upper, upper);
+    fprintf(out, "#define %s_NB_SYMBOLS %d\n", upper, table->nb_symbols);
+    fprintf(out, "#define %s_MAX_CODE_LENGTH %d\n", upper, table->max_length);
+    fprintf(out, "#define %s_DECODE_BITS %d\n\n", upper, decode_bits);
+
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        values[c] = table->codes[c];
+    }
+    write_array(out, "uint32_t", "codes", prefix, NB_SYMBOLS, values);
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        values[c] = table->lengths[c];
+    }
+    write_array(out, "uint8_t", "lengths", prefix, NB_SYMBOLS, values);
+
+    // Letter | (length << 8) of the code starting with each decode_bits-bit value, 0 for longer codes
+    for (unsigned int i = 0; i < (1u << decode_bits); i++)
+    {
+        values[i] = 0;
+    }
+    for (int c = 0; c < NB_SYMBOLS; c++)
+    {
+        int length = table->lengths[c];
+        if (length > 0 && length <= decode_bits)
+        {
+            unsigned int first = table->codes[c] << (decode_bits - length);
+            for (unsigned int i = first; i < first + (1u << (decode_bits - length)); i++)
+            {
+                values[i] = (unsigned long long)(c | (length << 8));
+            }
+        }
+    }
+    write_array(out, "uint16_t", "decode_table", prefix, 1 << decode_bits, values);
+
+    if (table->max_length > decode_bits)
+    {
+        for (int length = 0; length <= table->max_length; length++)
+        {
+            values[length] = table->first_code[length];
+        }
+        write_array(out, "uint32_t", "first_code", prefix, table->max_length + 1, values);
+        for (int length = 0; length <= table->max_length; length++)
+        {
+            values[length] = (unsigned long long)table->first_index[length];
+        }
+        write_array(out, "uint16_t", "first_index", prefix, table->max_length + 1, values);
+        for (int length = 0; length <= table->max_length; length++)
+        {
+            values[length] = (unsigned long long)table->count[length];
+        }
+        write_array(out, "uint16_t", "count", prefix, table->max_length + 1, values);
+        for (int i = 0; i < table->nb_symbols; i++)
+        {
+            values[i] = table->symbols[i];
+        }
+        write_array(out, "uint8_t", "symbols", prefix, table->nb_symbols, values);
+    }
+
+    fprintf(out,
+            "// Codes length bytes (all of them letters of the code) into out, which needs\n"
+            "// %s_MAX_CODE_LENGTH * length / 8 + 1 bytes; returns the number of bits\n"
+            "static inline size_t %s_encode(const unsigned char *data, size_t length, unsigned char *out)\n"
+            "{\n"
+            "    uint64_t acc = 0;\n"
+            "    int nb_bits = 0;\n"
+            "    size_t pos = 0, total = 0;\n"
+            "    for (size_t i = 0; i < length; i++)\n"
+            "    {\n"
+            "        int code_length = %s_lengths[data[i]];\n"
+            "        acc = (acc << code_length) | %s_codes[data[i]];\n"
+            "        nb_bits += code_length;\n"
+            "        total += (size_t)code_length;\n"
+            "        while (nb_bits >= 8)\n"
+            "        {\n"
+            "            nb_bits -= 8;\n"
+            "            out[pos++] = (unsigned char)(acc >> nb_bits);\n"
+            "        }\n"
+            "    }\n"
+            "    if (nb_bits > 0)\n"
+            "    {\n"
+            "        out[pos] = (unsigned char)(acc << (8 - nb_bits));\n"
+            "    }\n"
+            "    return total;\n"
+            "}\n\n",
+            upper, prefix, prefix, prefix);
+
+    fprintf(out,
+            "// Decodes raw_size letters from nb_bits bits; returns 0, or -1 if the bits are not\n"
+            "// valid codes or do not hold exactly raw_size letters\n"
+            "static inline int %s_decode(const unsigned char *in, size_t nb_bits, unsigned char *out, size_t raw_size)\n"
+            "{\n"
+            "    size_t in_size = (nb_bits + 7) / 8, pos = 0, consumed = 0;\n"
+            "    uint64_t window = 0;\n"
+            "    int available = 0;\n"
+            "    for (size_t i = 0; i < raw_size; i++)\n"
+            "    {\n"
+            "        while (available <= 56)\n"
+            "        {\n"
+            "            window |= (uint64_t)(pos < in_size ? in[pos] : 0) << (56 - available);\n"
+            "            pos++;\n"
+            "            available += 8;\n"
+            "        }\n"
+            "        unsigned int entry = %s_decode_table[window >> (64 - %s_DECODE_BITS)];\n"
+            "        int code_length = (int)(entry >> 8);\n"
+            "        out[i] = (unsigned char)entry;\n",
+            prefix, prefix, upper);
+    if (table->max_length > decode_bits)
+    {
+        fprintf(out,
+                "        if (entry == 0)\n"
+                "        {\n"
+                "            // Longer code: canonical decoding, one more bit at a time\n"
+                "            code_length = 0;\n"
+                "            for (int length = %s_DECODE_BITS + 1; length <= %s_MAX_CODE_LENGTH; length++)\n"
+                "            {\n"
+                "                uint32_t code = (uint32_t)(window >> (64 - length));\n"
+                "                if (code - %s_first_code[length] < (uint32_t)%s_count[length])\n"
+                "                {\n"
+                "                    out[i] = %s_symbols[%s_first_index[length] + (int)(code - %s_first_code[length])];\n"
+                "                    code_length = length;\n"
+                "                    break;\n"
+                "                }\n"
+                "            }\n"
+                "        }\n",
+                upper, upper, prefix, prefix, prefix, prefix, prefix);
+    }
+    fprintf(out,
+            "        if (code_length == 0 || consumed + (size_t)code_length > nb_bits)\n"
+            "        {\n"
+            "            return -1;\n"
+            "        }\n"
+            "        consumed += (size_t)code_length;\n"
+            "        window <<= code_length;\n"
+            "        available -= code_length;\n"
+            "    }\n"
+            "    return consumed == nb_bits ? 0 : -1;\n"
+            "}\n\n"
+            "#endif\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *mode = "--histogram";
+    if (argc > 1 && strncmp(argv[1], "--", 2) == 0)
+    {
+        mode = argv[1];
+        argv++;
+        argc--;
+    }
+    if (argc < 3 || argc > 4)
+    {
+        printf("Usage: gentable [--histogram|--dict|--sample] <input> <output.h> [name]\n");
+        return EXIT_FAILURE;
+    }
+
+    const char *prefix = argc == 4 ? argv[3] : "huffman";
+    size_t prefix_length = strlen(prefix);
+    for (size_t i = 0; i < prefix_length; i++)
+    {
+        if (!(isalnum((unsigned char)prefix[i]) || prefix[i] == '_') || prefix_length >= 48 || isdigit((unsigned char)prefix[0]))
+        {
+            printf("Error: %s is not a valid C identifier.\n", prefix);
+            return EXIT_FAILURE;
+        }
+    }
+
+    CodeTable table;
+    if (load_table(mode, argv[1], &table) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    FILE *out = open_file(argv[2], "w");
+    write_header(out, &table, prefix);
+    if (fclose(out) != 0)
+    {
+        printf("Error: could not write %s.\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}